@@ -30,7 +30,50 @@ awk '
 ' > bench_http.dat
 
 plot benchmarks/bench_http "time (s)" "requests/s (Hz)" "bench_http.dat" ""
-sed "s/#TIMES#/$times/g" benchmarks/bench_http.txt
+
+#
+# Second part: sendsms requests/s against smsbox for a growing number
+# of sendsms-threads, with as many concurrent clients as we have CPUs.
+#
+
+clients=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4`
+[ $clients -lt 4 ] && clients=4
+sendsms_times=`expr $times / 10 / $clients + 1`
+url="http://127.0.0.1:13013/cgi-bin/sendsms?from=123&to=234&text=bench&username=tester&password=foobar"
+
+rm -f bench_http_sendsms.dat
+for threads in 1 2 4 8 16
+do
+    rm -f bench_sendsms_*.log
+    sed "s/#THREADS#/$threads/" benchmarks/bench_sendsms.conf > bench_sendsms.conf
+
+    gw/bearerbox -v 4 bench_sendsms.conf > /dev/null 2>&1 &
+    sleep 2
+    test/fakesmsc -H 127.0.0.1 -r 20000 -i 0 -m 0 '123 234 text nop' \
+        > bench_sendsms_smsc.log 2>&1 &
+    sleep 1
+    gw/smsbox -v 4 bench_sendsms.conf > /dev/null 2>&1 &
+    sleep 2
+
+    start=`date +%s.%N`
+    test/test_http -q -v 2 -t $clients -r $sendsms_times "$url"
+    end=`date +%s.%N`
+    echo "$threads $start $end" |
+    awk -v n=`expr $clients \* $sendsms_times` \
+        '{ printf "%d %.0f\n", $1, n / ($3 - $2) }' >> bench_http_sendsms.dat
+
+    test/test_http -q -v 2 "http://127.0.0.1:13000/cgi-bin/shutdown?password=bar"
+    wait
+
+    check_for_errors bench_sendsms_*.log
+done
+
+plot benchmarks/bench_http_sendsms "sendsms-threads" "requests/s (Hz)" \
+    "bench_http_sendsms.dat" ""
+sed "s/#TIMES#/$times/g" benchmarks/bench_http.txt |
+sed "s/#CLIENTS#/$clients/g" | sed "s/#SENDSMS_TIMES#/$sendsms_times/g"
 
 rm -f bench_http.log
 rm -f bench_http.dat
+rm -f bench_http_sendsms.dat
+rm -f bench_sendsms.conf bench_sendsms_*.log
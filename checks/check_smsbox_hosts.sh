@@ -0,0 +1,105 @@
+#!/bin/sh
+#
+# Use `test/test_http_server' and `test/fakesmsc' to check that a hung
+# HTTP server doesn't hold up smsbox requests towards other servers
+# (max-pending-requests-per-host). The hung server is a stopped
+# test_http_server: connections are accepted by the kernel, but never
+# answered.
+
+set -e
+#set -x
+
+host=127.0.0.1
+loglevel=0
+hung_port=8050
+ok_port=8051
+hung_times=10
+ok_times=5
+conf=check_smsbox_hosts.conf
+
+cat > $conf <<EOF
+group = core
+admin-port = 13000
+smsbox-port = 13001
+admin-password = bar
+box-deny-ip = "*.*.*.*"
+box-allow-ip = "127.0.0.1"
+
+group = smsc
+smsc = fake
+smsc-id = FAKE
+port = 20000
+connect-allow-ip = 127.0.0.1
+
+group = smsbox
+bearerbox-host = 127.0.0.1
+max-pending-requests = 4
+max-pending-requests-per-host = 2
+
+group = sms-service
+keyword = hung
+get-url = "http://$host:$hung_port/hung"
+
+group = sms-service
+keyword = ok
+get-url = "http://$host:$ok_port/ok"
+EOF
+
+test/test_http_server -p $hung_port -v $loglevel > check_smsbox_hosts_hung.log 2>&1 &
+hungpid=$!
+test/test_http_server -p $ok_port -v $loglevel > check_smsbox_hosts_ok.log 2>&1 &
+okpid=$!
+sleep 1
+kill -STOP $hungpid
+
+gw/bearerbox -v $loglevel $conf > check_smsbox_hosts_bb.log 2>&1 &
+bbpid=$!
+sleep 2
+
+# more requests for the hung server than max-pending-requests allows
+test/fakesmsc -H $host -r 20000 -i 0 -m $hung_times '123 234 text hung' \
+    > check_smsbox_hosts_smsc_hung.log 2>&1 &
+smscpid=$!
+sleep 1
+
+gw/smsbox -v $loglevel $conf > check_smsbox_hosts_sms.log 2>&1 &
+sleep 3
+
+kill $smscpid 2>/dev/null || true
+sleep 2
+test/fakesmsc -H $host -r 20000 -i 0 -m $ok_times '123 234 text ok' \
+    > check_smsbox_hosts_smsc.log 2>&1 &
+smscpid=$!
+
+# the healthy server has to answer all of its requests
+ret=1
+i=0
+while [ $i -lt 15 ]
+do
+    sleep 1
+    if grep "Got message $ok_times" check_smsbox_hosts_smsc.log >/dev/null
+    then
+        ret=0
+        break
+    fi
+    i=`expr $i + 1`
+done
+
+# let the requests towards the hung server fail before shutting down
+kill -9 $hungpid
+sleep 2
+kill $smscpid 2>/dev/null || true
+kill -INT $bbpid
+test/test_http -r 1 http://$host:$ok_port/quit > /dev/null 2>&1
+wait
+
+if [ $ret -ne 0 ] || grep 'PANIC:' check_smsbox_hosts*.log >/dev/null
+then
+	echo check_smsbox_hosts.sh failed 1>&2
+	echo See check_smsbox_hosts*.log for info 1>&2
+	exit 1
+fi
+
+rm -f check_smsbox_hosts*.log $conf
+
+exit 0
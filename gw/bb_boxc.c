@@ -82,6 +82,9 @@
 
 #define SMSBOX_MAX_PENDING 100
 
+/* max messages the sender writes to a box at once */
+#define BOXC_SEND_BATCH 64
+
 /* passed from bearerbox core */
 
 extern volatile sig_atomic_t bb_status;
@@ -131,6 +134,25 @@ static Counter *boxid;
 static long sms_dequeue_thread;
 
 
+/*
+ * Messages sent to an smsbox and not acked yet, hashed by their binary
+ * id. Entries are bounded by smsbox-max-pending, so the table never
+ * needs to grow.
+ */
+typedef struct boxc_sent_entry {
+    uuid_t id;
+    Msg *msg;
+    struct boxc_sent_entry *next;
+} BoxcSentEntry;
+
+typedef struct {
+    BoxcSentEntry **buckets;
+    unsigned long mask;
+    long count;
+    Mutex *lock;
+} BoxcSent;
+
+
 typedef struct _boxc {
     Connection	*conn;
     int               is_wap;
@@ -141,19 +163,21 @@ typedef struct _boxc {
     List            *incoming;
     List            *retry;   	/* If sending fails */
     List            *outgoing;
-    Dict           *sent;
+    BoxcSent    *sent;
     Semaphore *pending;
     volatile sig_atomic_t alive;
     Octstr        *boxc_id; /* identifies the connected smsbox instance */
     /* used to mark connection usable or still waiting for ident. msg */
     volatile int routable;
+    /* Msg format the box reads, see cmd_msg_v2 */
+    volatile int msg_format;
 } Boxc;
 
 
 /* forward declaration */
 static void sms_to_smsboxes(void *arg);
 static int send_msg(Boxc *boxconn, Msg *pmsg);
-static void boxc_sent_push(Boxc*, Msg*);
+static int boxc_sent_push(Boxc*, Msg*);
 static void boxc_sent_pop(Boxc*, Msg*, Msg**);
 static void boxc_gwlist_destroy(List *list);
 
@@ -430,6 +454,18 @@ static void boxc_receiver(void *arg)
                 /* wakeup the dequeue thread */
                 gwthread_wakeup(sms_dequeue_thread);
             }
+            /* box reads the compact Msg format, agree on it */
+            else if (msg_type(msg) == admin && msg->admin.command == cmd_msg_v2) {
+                Msg *reply;
+
+                conn->msg_format = MSG_FORMAT_V2;
+                reply = msg_create(admin);
+                reply->admin.command = cmd_msg_v2;
+                send_msg(conn, reply);
+                msg_destroy(reply);
+                debug("bb.boxc", 0, "boxc_receiver: using Msg format v2 for <%s>",
+                      octstr_get_cstr(conn->client_ip));
+            }
             else
                 warning(0, "boxc_receiver: unknown msg received from <%s>, "
                            "ignored", octstr_get_cstr(conn->client_ip));
@@ -447,7 +483,7 @@ static int send_msg(Boxc *boxconn, Msg *pmsg)
 {
     Octstr *pack;
 
-    pack = msg_pack(pmsg);
+    pack = msg_pack_format(pmsg, boxconn->msg_format);
 
     if (pack == NULL)
         return -1;
@@ -471,19 +507,130 @@ static int send_msg(Boxc *boxconn, Msg *pmsg)
 }
 
 
-static void boxc_sent_push(Boxc *conn, Msg *m)
+static BoxcSent *boxc_sent_create(long max_pending)
 {
-    Octstr *os;
-    char id[UUID_STR_LEN + 1];
+    BoxcSent *sent;
+    unsigned long size;
+
+    for (size = 64; size < (unsigned long) max_pending * 2; size <<= 1)
+        ;
+    sent = gw_malloc(sizeof(*sent));
+    sent->buckets = gw_malloc(size * sizeof(sent->buckets[0]));
+    memset(sent->buckets, 0, size * sizeof(sent->buckets[0]));
+    sent->mask = size - 1;
+    sent->count = 0;
+    sent->lock = mutex_create();
+
+    return sent;
+}
 
-    if (conn->is_wap || !conn->sent || !m || msg_type(m) != sms)
+static void boxc_sent_destroy(BoxcSent *sent)
+{
+    if (sent == NULL)
         return;
 
-    uuid_unparse(m->sms.id, id);
-    os = octstr_create(id);
-    dict_put(conn->sent, os, msg_duplicate(m));
+    gw_assert(sent->count == 0);
+    mutex_destroy(sent->lock);
+    gw_free(sent->buckets);
+    gw_free(sent);
+}
+
+static unsigned long boxc_sent_hash(const uuid_t id)
+{
+    unsigned long h = 2166136261UL;
+    int i;
+
+    for (i = 0; i < sizeof(uuid_t); i++)
+        h = (h ^ id[i]) * 16777619UL;
+
+    return h;
+}
+
+static long boxc_sent_count(BoxcSent *sent)
+{
+    long ret;
+
+    mutex_lock(sent->lock);
+    ret = sent->count;
+    mutex_unlock(sent->lock);
+
+    return ret;
+}
+
+/* remove and return the message with given id, NULL if not there */
+static Msg *boxc_sent_remove(BoxcSent *sent, const uuid_t id)
+{
+    BoxcSentEntry **pos, *entry;
+    Msg *msg = NULL;
+
+    mutex_lock(sent->lock);
+    for (pos = &sent->buckets[boxc_sent_hash(id) & sent->mask]; *pos != NULL; pos = &(*pos)->next) {
+        if (uuid_compare((*pos)->id, id) == 0) {
+            entry = *pos;
+            *pos = entry->next;
+            sent->count--;
+            msg = entry->msg;
+            gw_free(entry);
+            break;
+        }
+    }
+    mutex_unlock(sent->lock);
+
+    return msg;
+}
+
+/* remove all messages, returns them as a List */
+static List *boxc_sent_extract_all(BoxcSent *sent)
+{
+    BoxcSentEntry *entry;
+    List *ret;
+    unsigned long i;
+
+    ret = gwlist_create();
+    mutex_lock(sent->lock);
+    for (i = 0; i <= sent->mask; i++) {
+        while ((entry = sent->buckets[i]) != NULL) {
+            sent->buckets[i] = entry->next;
+            gwlist_append(ret, entry->msg);
+            gw_free(entry);
+        }
+    }
+    sent->count = 0;
+    mutex_unlock(sent->lock);
+
+    return ret;
+}
+
+static int boxc_sent_tracked(Boxc *conn, Msg *m)
+{
+    return !conn->is_wap && conn->sent && m && msg_type(m) == sms;
+}
+
+/*
+ * Put msg into sent queue, waiting for a free slot if needed. The
+ * queue takes over msg. Return 0 if msg is not tracked at all.
+ */
+static int boxc_sent_push(Boxc *conn, Msg *m)
+{
+    BoxcSentEntry *entry;
+    unsigned long bucket;
+
+    if (!boxc_sent_tracked(conn, m))
+        return 0;
+
+    entry = gw_malloc(sizeof(*entry));
+    uuid_copy(entry->id, m->sms.id);
+    entry->msg = m;
+    bucket = boxc_sent_hash(entry->id) & conn->sent->mask;
+
+    mutex_lock(conn->sent->lock);
+    entry->next = conn->sent->buckets[bucket];
+    conn->sent->buckets[bucket] = entry;
+    conn->sent->count++;
+    mutex_unlock(conn->sent->lock);
+
     semaphore_down(conn->pending);
-    octstr_destroy(os);
+    return 1;
 }
 
 
@@ -493,8 +640,6 @@ static void boxc_sent_push(Boxc *conn, Msg *m)
  */
 static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
 {
-    Octstr *os;
-    char id[UUID_STR_LEN + 1];
     Msg *msg;
 
     if (conn->is_wap || !conn->sent || !m || (msg_type(m) != ack && msg_type(m) != sms))
@@ -503,10 +648,7 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
     if (orig != NULL)
         *orig = NULL;
 
-    uuid_unparse((msg_type(m) == sms ? m->sms.id : m->ack.id), id);
-    os = octstr_create(id);
-    msg = dict_remove(conn->sent, os);
-    octstr_destroy(os);
+    msg = boxc_sent_remove(conn->sent, (msg_type(m) == sms ? m->sms.id : m->ack.id));
     if (!msg) {
         error(0, "BOXC: Got ack for nonexistend message!");
         msg_dump(m, 0);
@@ -520,14 +662,65 @@ static void boxc_sent_pop(Boxc *conn, Msg *m, Msg **orig)
 }
 
 
+/*
+ * Write the frames collected in batch to the box with one write. Messages
+ * that are not tracked in the sent queue are held in untracked until then.
+ * If the write fails, the messages of the batch still in the sent queue
+ * and the untracked ones are retried.
+ */
+static int boxc_send_batch(Boxc *conn, Octstr *batch, uuid_t *ids, long *ids_len,
+                           List *untracked)
+{
+    Msg *msg;
+    long i;
+    int ret = 0;
+
+    if (octstr_len(batch) > 0 && (!conn->alive || conn_write(conn->conn, batch) == -1)) {
+        error(0, "Couldn't write Msg to box <%s>, disconnecting",
+              octstr_get_cstr(conn->client_ip));
+        for (i = 0; i < *ids_len; i++) {
+            if ((msg = boxc_sent_remove(conn->sent, ids[i])) != NULL) {
+                semaphore_up(conn->pending);
+                gwlist_produce(conn->retry, msg);
+            }
+        }
+        while ((msg = gwlist_extract_first(untracked)) != NULL)
+            gwlist_produce(conn->retry, msg);
+        ret = -1;
+    } else if (octstr_len(batch) > 0) {
+        debug("bb.boxc", 0, "boxc_sender: sent %ld bytes to <%s>",
+              octstr_len(batch), octstr_get_cstr(conn->client_ip));
+    }
+    while ((msg = gwlist_extract_first(untracked)) != NULL)
+        msg_destroy(msg);
+
+    octstr_truncate(batch, 0);
+    *ids_len = 0;
+    return ret;
+}
+
+
+/*
+ * Takes whatever is queued for the box, up to BOXC_SEND_BATCH messages,
+ * and writes it at once. Tracked messages go into the sent queue before
+ * they are written, so their acks always find them.
+ */
 static void boxc_sender(void *arg)
 {
     Msg *msg;
     Boxc *conn = arg;
+    Octstr *batch, *pack;
+    List *untracked;
+    unsigned char len[4];
+    uuid_t ids[BOXC_SEND_BATCH];
+    long n, ids_len = 0;
+    int failed = 0;
 
     gwlist_add_producer(flow_threads);
+    batch = octstr_create("");
+    untracked = gwlist_create();
 
-    while (bb_status != BB_DEAD && conn->alive) {
+    while (bb_status != BB_DEAD && conn->alive && !failed) {
 
         /*
          * Make sure there's no data left in the outgoing connection before
@@ -545,25 +738,43 @@ static void boxc_sender(void *arg)
             msg_destroy(msg);
             break;
         }
-        if (msg_type(msg) == heartbeat) {
-            debug("bb.boxc", 0, "boxc_sender: catch an heartbeat - we are alive");
-            msg_destroy(msg);
-            continue;
-        }
-        boxc_sent_push(conn, msg);
-        if (!conn->alive || send_msg(conn, msg) == -1) {
-            /* we got message here */
-            boxc_sent_pop(conn, msg, NULL);
-            gwlist_produce(conn->retry, msg);
-            break;
+
+        for (n = 0; msg != NULL;
+             msg = (++n < BOXC_SEND_BATCH ? gwlist_extract_first(conn->incoming) : NULL)) {
+            if (msg_type(msg) == heartbeat) {
+                debug("bb.boxc", 0, "boxc_sender: catch an heartbeat - we are alive");
+                msg_destroy(msg);
+                continue;
+            }
+            /* don't wait for acks while holding unwritten messages */
+            if (boxc_sent_tracked(conn, msg) && semaphore_getvalue(conn->pending) <= 0 &&
+                boxc_send_batch(conn, batch, ids, &ids_len, untracked) == -1) {
+                gwlist_produce(conn->retry, msg);
+                failed = 1;
+                break;
+            }
+
+            pack = msg_pack_format(msg, conn->msg_format);
+            encode_network_long(len, octstr_len(pack));
+            octstr_append_data(batch, (char *) len, 4);
+            octstr_append(batch, pack);
+            octstr_destroy(pack);
+
+            if (boxc_sent_tracked(conn, msg))
+                uuid_copy(ids[ids_len++], msg->sms.id);
+            if (!boxc_sent_push(conn, msg))
+                gwlist_append(untracked, msg);
         }
-        msg_destroy(msg);
-        debug("bb.boxc", 0, "boxc_sender: sent message to <%s>",
-               octstr_get_cstr(conn->client_ip));
+
+        if (!failed && boxc_send_batch(conn, batch, ids, &ids_len, untracked) == -1)
+            failed = 1;
     }
     /* the client closes the connection, after that die in receiver */
     /* conn->alive = 0; */
 
+    octstr_destroy(batch);
+    gwlist_destroy(untracked, msg_destroy_item);
+
     /* set conn to unroutable */
     conn->routable = 0;
 
@@ -588,7 +799,9 @@ static Boxc *boxc_create(int fd, Octstr *ip, int ssl)
     boxc->alive = 1;
     boxc->connect_time = time(NULL);
     boxc->boxc_id = NULL;
+    boxc->sent = NULL;
     boxc->routable = 0;
+    boxc->msg_format = MSG_FORMAT_V1;
     return boxc;
 }
 
@@ -657,8 +870,7 @@ static void run_smsbox(void *arg)
     Boxc *newconn;
     long sender;
     Msg *msg;
-    List *keys;
-    Octstr *key;
+    List *msgs;
 
     gwlist_add_producer(flow_threads);
     newconn = arg;
@@ -666,7 +878,7 @@ static void run_smsbox(void *arg)
     gwlist_add_producer(newconn->incoming);
     newconn->retry = incoming_sms;
     newconn->outgoing = outgoing_sms;
-    newconn->sent = dict_create(smsbox_max_pending, NULL);
+    newconn->sent = boxc_sent_create(smsbox_max_pending);
     newconn->pending = semaphore_create(smsbox_max_pending);
 
     sender = gwthread_create(boxc_sender, newconn);
@@ -712,20 +924,16 @@ static void run_smsbox(void *arg)
         gwlist_remove_producer(newconn->incoming);
 
     /* check if we are still waiting for ack's and semaphore locked */
-    if (dict_key_count(newconn->sent) >= smsbox_max_pending)
+    if (boxc_sent_count(newconn->sent) >= smsbox_max_pending)
         semaphore_up(newconn->pending); /* allow sender to go down */
 
     gwthread_join(sender);
 
     /* put not acked msgs into incoming queue */
-    keys = dict_keys(newconn->sent);
-    while((key = gwlist_extract_first(keys)) != NULL) {
-        msg = dict_remove(newconn->sent, key);
+    msgs = boxc_sent_extract_all(newconn->sent);
+    while((msg = gwlist_extract_first(msgs)) != NULL)
         gwlist_produce(incoming_sms, msg);
-        octstr_destroy(key);
-    }
-    gw_assert(gwlist_len(keys) == 0);
-    gwlist_destroy(keys, octstr_destroy_item);
+    gwlist_destroy(msgs, NULL);
 
     /* clear our send queue */
     while((msg = gwlist_extract_first(newconn->incoming)) != NULL) {
@@ -735,8 +943,7 @@ static void run_smsbox(void *arg)
 cleanup:
     gw_assert(gwlist_len(newconn->incoming) == 0);
     gwlist_destroy(newconn->incoming, NULL);
-    gw_assert(dict_key_count(newconn->sent) == 0);
-    dict_destroy(newconn->sent);
+    boxc_sent_destroy(newconn->sent);
     semaphore_destroy(newconn->pending);
     boxc_destroy(newconn);
 
@@ -1423,7 +1630,7 @@ Octstr *boxc_status(int status_type)
                     "\t\t<ssl>%s</ssl>\n\t</box>",
                     (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : ""),
 		            octstr_get_cstr(bi->client_ip),
-		            gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+		            gwlist_len(bi->incoming) + boxc_sent_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "yes" : "no"
@@ -1434,7 +1641,7 @@ Octstr *boxc_status(int status_type)
             else
                 octstr_format_append(tmp, "%ssmsbox:%s, IP %s (%ld queued), (on-line %ldd %ldh %ldm %lds) %s %s",
                     ws, (bi->boxc_id ? octstr_get_cstr(bi->boxc_id) : "(none)"),
-                    octstr_get_cstr(bi->client_ip), gwlist_len(bi->incoming) + dict_key_count(bi->sent),
+                    octstr_get_cstr(bi->client_ip), gwlist_len(bi->incoming) + boxc_sent_count(bi->sent),
 		            t/3600/24, t/3600%24, t/60%60, t%60,
 #ifdef HAVE_LIBSSL
                     conn_get_ssl(bi->conn) != NULL ? "using SSL" : "",
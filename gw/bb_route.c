@@ -0,0 +1,407 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * bb_route.c - precompiled routing table for outgoing SMS
+ *
+ * See bb_route.h for the idea. The rules evaluated here mirror those of
+ * smscconn_usable() exactly, only on bitmaps of all connections at once.
+ */
+
+#include "gwlib/gwlib.h"
+#include "msg.h"
+#include "smscconn.h"
+#include "smscconn_p.h"
+#include "bb_route.h"
+
+#define BITS_PER_WORD (sizeof(unsigned long) * 8)
+#define WORD_OF(i) ((i) / BITS_PER_WORD)
+#define BIT_OF(i) (1UL << ((i) % BITS_PER_WORD))
+
+/* kinds of rules, used as index into the bitmaps of trie nodes and ids */
+enum {
+    ROUTE_ALLOWED = 0,
+    ROUTE_DENIED = 1,
+    ROUTE_PREFERRED = 2,
+    ROUTE_KINDS = 3
+};
+
+/* digits '0'-'9' and '+' */
+#define ROUTE_TRIE_FANOUT 11
+
+typedef struct RouteNode RouteNode;
+
+struct RouteNode {
+    RouteNode *child[ROUTE_TRIE_FANOUT];
+    unsigned long *bits[ROUTE_KINDS];
+};
+
+typedef struct {
+    unsigned long *bits[ROUTE_KINDS];
+} RouteIds;
+
+struct RouteTable {
+    long num;
+    long words;
+    SMSCConn **conns;
+    RouteNode *root;
+    Dict *ids;
+    /* connections having allowed-smsc-id, allowed-prefix, denied-prefix */
+    unsigned long *has_allowed_id;
+    unsigned long *has_allowed_prefix;
+    unsigned long *has_denied_prefix;
+    /* connections to be evaluated via smscconn_usable() */
+    unsigned long *eval;
+};
+
+
+static unsigned long *bitmap_create(RouteTable *table)
+{
+    unsigned long *bits;
+
+    bits = gw_malloc(sizeof(bits[0]) * table->words);
+    memset(bits, 0, sizeof(bits[0]) * table->words);
+
+    return bits;
+}
+
+static void bitmap_set(RouteTable *table, unsigned long **bits, long i)
+{
+    if (*bits == NULL)
+        *bits = bitmap_create(table);
+    (*bits)[WORD_OF(i)] |= BIT_OF(i);
+}
+
+static void bitmap_or(RouteTable *table, unsigned long *dst, unsigned long *src)
+{
+    long w;
+
+    if (src == NULL)
+        return;
+    for (w = 0; w < table->words; w++)
+        dst[w] |= src[w];
+}
+
+static int route_char_index(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c == '+')
+        return 10;
+    return -1;
+}
+
+static RouteNode *route_node_create(void)
+{
+    RouteNode *node;
+
+    node = gw_malloc(sizeof(*node));
+    memset(node, 0, sizeof(*node));
+
+    return node;
+}
+
+static void route_node_destroy(RouteNode *node)
+{
+    int i;
+
+    if (node == NULL)
+        return;
+    for (i = 0; i < ROUTE_TRIE_FANOUT; i++)
+        route_node_destroy(node->child[i]);
+    for (i = 0; i < ROUTE_KINDS; i++)
+        gw_free(node->bits[i]);
+    gw_free(node);
+}
+
+static void route_ids_destroy(void *p)
+{
+    RouteIds *ids = p;
+    int i;
+
+    for (i = 0; i < ROUTE_KINDS; i++)
+        gw_free(ids->bits[i]);
+    gw_free(ids);
+}
+
+/*
+ * Add the ';' separated prefixes to the trie. Return -1 if a prefix
+ * can't be represented in the trie, 0 otherwise.
+ */
+static int route_add_prefixes(RouteTable *table, Octstr *prefixes, int kind, long i)
+{
+    RouteNode *node;
+    long pos, len;
+    int c, idx;
+
+    len = octstr_len(prefixes);
+
+    /* does_prefix_match() matches every number if the list starts with ';' */
+    if (len > 0 && octstr_get_char(prefixes, 0) == ';')
+        bitmap_set(table, &table->root->bits[kind], i);
+
+    node = NULL;
+    for (pos = 0; pos <= len; pos++) {
+        c = (pos < len ? octstr_get_char(prefixes, pos) : ';');
+        if (c == ';') {
+            if (node != NULL && node != table->root)
+                bitmap_set(table, &node->bits[kind], i);
+            node = NULL;
+            continue;
+        }
+        if (node == NULL)
+            node = table->root;
+        if ((idx = route_char_index(c)) == -1)
+            return -1;
+        if (node->child[idx] == NULL)
+            node->child[idx] = route_node_create();
+        node = node->child[idx];
+    }
+
+    return 0;
+}
+
+static void route_add_ids(RouteTable *table, List *list, int kind, long i)
+{
+    RouteIds *ids;
+    Octstr *id;
+    long j;
+
+    for (j = 0; j < gwlist_len(list); j++) {
+        id = gwlist_get(list, j);
+        if ((ids = dict_get(table->ids, id)) == NULL) {
+            ids = gw_malloc(sizeof(*ids));
+            memset(ids, 0, sizeof(*ids));
+            dict_put(table->ids, id, ids);
+        }
+        bitmap_set(table, &ids->bits[kind], i);
+    }
+}
+
+RouteTable *route_table_create(List *conns)
+{
+    RouteTable *table;
+    SMSCConn *conn;
+    long i;
+    int eval;
+
+    table = gw_malloc(sizeof(*table));
+    table->num = gwlist_len(conns);
+    table->words = (table->num + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    if (table->words == 0)
+        table->words = 1;
+    table->conns = gw_malloc(sizeof(table->conns[0]) * (table->num > 0 ? table->num : 1));
+    table->root = route_node_create();
+    table->ids = dict_create(table->num * 4 + 16, route_ids_destroy);
+    table->has_allowed_id = bitmap_create(table);
+    table->has_allowed_prefix = bitmap_create(table);
+    table->has_denied_prefix = bitmap_create(table);
+    table->eval = bitmap_create(table);
+
+    for (i = 0; i < table->num; i++) {
+        conn = gwlist_get(conns, i);
+        table->conns[i] = conn;
+
+        eval = (conn->allowed_smsc_id_regex != NULL || conn->denied_smsc_id_regex != NULL ||
+                conn->allowed_prefix_regex != NULL || conn->denied_prefix_regex != NULL ||
+                conn->preferred_prefix_regex != NULL);
+
+        if (conn->allowed_smsc_id != NULL) {
+            table->has_allowed_id[WORD_OF(i)] |= BIT_OF(i);
+            route_add_ids(table, conn->allowed_smsc_id, ROUTE_ALLOWED, i);
+        }
+        if (conn->denied_smsc_id != NULL)
+            route_add_ids(table, conn->denied_smsc_id, ROUTE_DENIED, i);
+        if (conn->preferred_smsc_id != NULL)
+            route_add_ids(table, conn->preferred_smsc_id, ROUTE_PREFERRED, i);
+
+        if (conn->allowed_prefix != NULL) {
+            table->has_allowed_prefix[WORD_OF(i)] |= BIT_OF(i);
+            if (route_add_prefixes(table, conn->allowed_prefix, ROUTE_ALLOWED, i) == -1)
+                eval = 1;
+        }
+        if (conn->denied_prefix != NULL) {
+            table->has_denied_prefix[WORD_OF(i)] |= BIT_OF(i);
+            if (route_add_prefixes(table, conn->denied_prefix, ROUTE_DENIED, i) == -1)
+                eval = 1;
+        }
+        if (conn->preferred_prefix != NULL &&
+            route_add_prefixes(table, conn->preferred_prefix, ROUTE_PREFERRED, i) == -1)
+            eval = 1;
+
+        if (eval)
+            table->eval[WORD_OF(i)] |= BIT_OF(i);
+    }
+
+    debug("bb.sms", 0, "Routing table created for %ld SMSC connections.", table->num);
+
+    return table;
+}
+
+void route_table_destroy(RouteTable *table)
+{
+    if (table == NULL)
+        return;
+
+    route_node_destroy(table->root);
+    dict_destroy(table->ids);
+    gw_free(table->has_allowed_id);
+    gw_free(table->has_allowed_prefix);
+    gw_free(table->has_denied_prefix);
+    gw_free(table->eval);
+    gw_free(table->conns);
+    gw_free(table);
+}
+
+long route_table_size(RouteTable *table)
+{
+    return (table != NULL ? table->num : 0);
+}
+
+long route_table_find(RouteTable *table, Msg *msg, long start,
+                      SMSCConn **conns, int *usable)
+{
+    unsigned long *scratch, *ids[ROUTE_KINDS], *prefix[ROUTE_KINDS], *ok, *pref;
+    unsigned long reject, a, d;
+    RouteIds *id_bits;
+    RouteNode *node;
+    SMSCConn *conn;
+    long i, j, w, pos, len, found, skip;
+    int k, idx, ret;
+
+    gw_assert(msg != NULL && msg_type(msg) == sms);
+
+    if (table == NULL || table->num == 0)
+        return 0;
+
+    scratch = gw_malloc(sizeof(scratch[0]) * table->words * (2 * ROUTE_KINDS + 2));
+    memset(scratch, 0, sizeof(scratch[0]) * table->words * (2 * ROUTE_KINDS + 2));
+    for (k = 0; k < ROUTE_KINDS; k++) {
+        ids[k] = scratch + table->words * k;
+        prefix[k] = scratch + table->words * (ROUTE_KINDS + k);
+    }
+    ok = scratch + table->words * 2 * ROUTE_KINDS;
+    pref = ok + table->words;
+
+    /* connections referring to the smsc-id of the message */
+    if (msg->sms.smsc_id != NULL && (id_bits = dict_get(table->ids, msg->sms.smsc_id)) != NULL) {
+        for (k = 0; k < ROUTE_KINDS; k++)
+            bitmap_or(table, ids[k], id_bits->bits[k]);
+    }
+
+    /* connections having a prefix of the receiver */
+    if (msg->sms.receiver != NULL) {
+        node = table->root;
+        len = octstr_len(msg->sms.receiver);
+        for (pos = 0; node != NULL; pos++) {
+            for (k = 0; k < ROUTE_KINDS; k++)
+                bitmap_or(table, prefix[k], node->bits[k]);
+            if (pos >= len || (idx = route_char_index(octstr_get_char(msg->sms.receiver, pos))) == -1)
+                break;
+            node = node->child[idx];
+        }
+    }
+
+    /* same rules as in smscconn_usable() */
+    for (w = 0; w < table->words; w++) {
+        a = table->has_allowed_prefix[w];
+        d = table->has_denied_prefix[w];
+
+        /* denied-smsc-id only counts if there is no allowed-smsc-id */
+        reject = (table->has_allowed_id[w] & ~ids[ROUTE_ALLOWED][w]) |
+                 (ids[ROUTE_DENIED][w] & ~table->has_allowed_id[w]);
+        reject |= a & ~d & ~prefix[ROUTE_ALLOWED][w];
+        reject |= d & ~a & prefix[ROUTE_DENIED][w];
+        reject |= a & d & ~prefix[ROUTE_ALLOWED][w] & prefix[ROUTE_DENIED][w];
+
+        ok[w] = ~reject | table->eval[w];
+        pref[w] = ids[ROUTE_PREFERRED][w] | prefix[ROUTE_PREFERRED][w];
+    }
+
+    found = 0;
+    start = (start < 0 ? 0 : start % table->num);
+    for (j = 0; j < table->num; j++) {
+        i = (start + j) % table->num;
+        if (ok[WORD_OF(i)] == 0) {
+            /* skip to the next word, or the wrap around */
+            skip = BITS_PER_WORD - i % BITS_PER_WORD;
+            j += (skip < table->num - i ? skip : table->num - i) - 1;
+            continue;
+        }
+        if ((ok[WORD_OF(i)] & BIT_OF(i)) == 0)
+            continue;
+
+        conn = table->conns[i];
+        if (table->eval[WORD_OF(i)] & BIT_OF(i)) {
+            ret = smscconn_usable(conn, msg);
+        } else if (conn->status == SMSCCONN_DEAD || conn->why_killed != SMSCCONN_ALIVE) {
+            ret = -1;
+        } else {
+            ret = ((pref[WORD_OF(i)] & BIT_OF(i)) ? 1 : 0);
+        }
+        if (ret == -1)
+            continue;
+
+        conns[found] = conn;
+        usable[found] = ret;
+        found++;
+    }
+
+    gw_free(scratch);
+
+    return found;
+}
@@ -0,0 +1,108 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * bb_route.h - precompiled routing table for outgoing SMS
+ *
+ * The routing rules of all SMSCConns (allowed/denied/preferred smsc-ids
+ * and prefixes) are compiled into one table: a trie over the receiver
+ * digits and a hash of smsc-ids, both mapping to bitmaps of connections.
+ * Finding the candidate connections for a message is then bound by the
+ * length of the receiver number, not by connections times rules.
+ *
+ * Connections using regular expression rules, or prefixes with other
+ * characters than digits and '+', are evaluated via smscconn_usable().
+ *
+ * The table is not dynamic; it has to be recreated whenever the list
+ * of connections changes.
+ */
+
+#ifndef BB_ROUTE_H
+#define BB_ROUTE_H
+
+#include "msg.h"
+#include "smscconn.h"
+
+typedef struct RouteTable RouteTable;
+
+/*
+ * Compile the rules of all SMSCConns in `conns' into a new table.
+ * The caller must keep the list unchanged while the table is in use.
+ */
+RouteTable *route_table_create(List *conns);
+
+/*
+ * Destroy the table. The connections are not touched.
+ */
+void route_table_destroy(RouteTable *table);
+
+/*
+ * Return the number of connections in the table.
+ */
+long route_table_size(RouteTable *table);
+
+/*
+ * Find connections that may be used to send `msg', beginning the search
+ * at connection index `start' and wrapping around. Fill `conns' and
+ * `usable' with the connections and their smscconn_usable() value (0 for
+ * usable, 1 for preferred). Both arrays must hold route_table_size()
+ * items. Return the number of connections found.
+ */
+long route_table_find(RouteTable *table, Msg *msg, long start,
+                      SMSCConn **conns, int *usable);
+
+#endif
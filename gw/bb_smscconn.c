@@ -88,6 +88,8 @@
 #include "smscconn.h"
 #include "dlr.h"
 #include "load.h"
+#include "bb_route.h"
+#include "token_bucket.h"
 
 #include "bb_smscconn_cb.h"    /* callback functions for connections */
 #include "smscconn_p.h"        /* to access counters */
@@ -127,6 +129,8 @@ extern Octstr *cfg_filename;
 static volatile sig_atomic_t smsc_running;
 static List *smsc_list;
 static RWLock smsc_list_lock;
+/* compiled routing rules of smsc_list, guarded by smsc_list_lock */
+static RouteTable *route_table;
 static List *smsc_groups;
 static Octstr *unified_prefix;
 
@@ -139,12 +143,31 @@ static Numhash *white_list;
 static regex_t *white_list_regex;
 static regex_t *black_list_regex;
 
-static long router_thread = -1;
+/*
+ * Outgoing messages are spread over a number of router queues, each
+ * served by its own router thread. Messages for a given smsc-id (or
+ * receiver, if no smsc-id is set) always hash to the same queue, so
+ * a blocked link or a burst of resends only delays its own queue.
+ * The global outgoing_sms list stays the entry point for the boxes
+ * and the store; the dispatcher thread moves it into the router queues.
+ */
+static long dispatch_thread = -1;
+static long router_queue_count;
+static List **router_queues;
+static long *router_threads;
 
 /* message resend */
 static long sms_resend_frequency;
 static long sms_resend_retry;
 
+/*
+ * Messages waiting for their resend time, ordered by due time. The
+ * scheduler thread sleeps until the earliest one is due and releases
+ * all due messages into the router queues.
+ */
+static gw_prioqueue_t *resend_queue;
+static long resend_thread = -1;
+
 /*
  * Counter for catenated SMS messages. The counter that can be put into
  * the catenated SMS message's UDH headers is actually the lowest 8 bits.
@@ -155,6 +178,8 @@ Counter *split_msg_counter;
 static int handle_concatenated_mo;
 /* How long to wait for message parts */
 static long concatenated_mo_timeout;
+/* seconds between checks for timed out concatenated MO parts */
+#define CONCAT_CHECK_INTERVAL 1
 /* Flag for return value of check_concat */
 enum {concat_error = -1, concat_complete = 0, concat_pending = 1, concat_none};
 
@@ -181,10 +206,92 @@ void bb_smscconn_ready(SMSCConn *conn)
 }
 
 
+static void router_wakeup(void)
+{
+    long i;
+
+    for (i = 0; i < router_queue_count; i++) {
+        if (router_threads[i] >= 0)
+            gwthread_wakeup(router_threads[i]);
+    }
+}
+
+
+/*
+ * Put message into the router queue responsible for it. Until the
+ * router queues exist (or after they are gone) the global queue is used.
+ */
+static void router_queue_produce(Msg *msg)
+{
+    Octstr *key;
+    long i;
+
+    if (router_queues == NULL) {
+        gwlist_produce(outgoing_sms, msg);
+        return;
+    }
+
+    key = (msg->sms.smsc_id != NULL ? msg->sms.smsc_id : msg->sms.receiver);
+    i = (key != NULL ? octstr_hash_key(key) % router_queue_count : 0);
+    gwlist_produce(router_queues[i], msg);
+}
+
+
+static time_t sms_resend_due(const Msg *msg)
+{
+    return msg->sms.resend_time + sms_resend_frequency;
+}
+
+
+/* earlier due time means higher priority */
+static int sms_resend_cmp(const void *a, const void *b)
+{
+    time_t due_a = sms_resend_due(a), due_b = sms_resend_due(b);
+
+    if (due_a < due_b)
+        return 1;
+    if (due_a > due_b)
+        return -1;
+    return 0;
+}
+
+
+/*
+ * Queue message for routing. Messages which are not yet to be resent
+ * are held in the resend queue until they are due.
+ */
+static void sms_queue_produce(Msg *msg)
+{
+    if (resend_queue != NULL && msg->sms.resend_try > 0 &&
+        time(NULL) < sms_resend_due(msg) &&
+        bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        debug("bb.sms", 0, "delaying SMS not-yet-to-be resent");
+        gw_prioqueue_insert(resend_queue, msg);
+        /* wake the scheduler if we are the first one due now */
+        if (gw_prioqueue_get(resend_queue) == msg && resend_thread >= 0)
+            gwthread_wakeup(resend_thread);
+        return;
+    }
+    router_queue_produce(msg);
+}
+
+
+long smsc2_outgoing_queue(void)
+{
+    long i, len;
+
+    len = gwlist_len(outgoing_sms) + gw_prioqueue_len(resend_queue);
+    if (router_queues != NULL) {
+        for (i = 0; i < router_queue_count; i++)
+            len += gwlist_len(router_queues[i]);
+    }
+    return len;
+}
+
+
 void bb_smscconn_connected(SMSCConn *conn)
 {
-    if (router_thread >= 0)
-	gwthread_wakeup(router_thread);
+    router_wakeup();
 }
 
 
@@ -228,7 +335,7 @@ static void handle_split(SMSCConn *conn, Msg *msg, long reason)
             msg->sms.resend_try = (msg->sms.resend_try > 0 ? msg->sms.resend_try + 1 : 1);
             time(&msg->sms.resend_time);
         }
-        gwlist_produce(outgoing_sms, msg);
+        sms_queue_produce(msg);
         return;
     case SMSCCONN_FAILED_DISCARDED:
     case SMSCCONN_FAILED_REJECTED:
@@ -346,11 +453,11 @@ void bb_smscconn_send_failed(SMSCConn *conn, Msg *sms, int reason, Octstr *reply
            sms->sms.resend_try = (sms->sms.resend_try > 0 ? sms->sms.resend_try + 1 : 1);
            time(&sms->sms.resend_time);
        }
-       gwlist_produce(outgoing_sms, sms);
+       sms_queue_produce(sms);
        break;
        
     case SMSCCONN_FAILED_SHUTDOWN:
-        gwlist_produce(outgoing_sms, sms);
+        sms_queue_produce(sms);
         break;
 
     default:
@@ -583,21 +690,22 @@ int bb_reload_smsc_groups()
 
 
 
-/* function to route outgoing SMS'es from delay-list
+/* function to route outgoing SMS'es from one of the router queues
  * use some nice magics to route them to proper SMSC
  */
 static void sms_router(void *arg)
 {
     Msg *msg, *startmsg, *newmsg;
     long ret;
-    time_t concat_mo_check;
+    List *queue;
+
+    queue = router_queues[(long) arg];
 
     gwlist_add_producer(flow_threads);
     gwthread_wakeup(MAIN_THREAD_ID);
 
     startmsg = newmsg = NULL;
     ret = SMSCCONN_SUCCESS;
-    concat_mo_check = time(NULL);
 
     while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
 
@@ -605,19 +713,14 @@ static void sms_router(void *arg)
             if (ret == SMSCCONN_QUEUED || ret == SMSCCONN_FAILED_QFULL) {
                 /* sleep: sms_resend_frequency / 2 , so we reduce amount of msgs to send */
                 double sleep_time = (sms_resend_frequency / 2 > 1 ? sms_resend_frequency / 2 : sms_resend_frequency);
-                debug("bb.sms", 0, "sms_router: time to sleep %.2f secs.", sleep_time);
+                debug("bb.sms", 0, "sms_router[%ld]: time to sleep %.2f secs.", (long) arg, sleep_time);
                 gwthread_sleep(sleep_time);
-                debug("bb.sms", 0, "sms_router: gwlist_len = %ld", gwlist_len(outgoing_sms));
+                debug("bb.sms", 0, "sms_router[%ld]: gwlist_len = %ld", (long) arg, gwlist_len(queue));
             }
-            startmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
+            startmsg = msg = gwlist_timed_consume(queue, concatenated_mo_timeout);
             newmsg = NULL;
         } else {
-            newmsg = msg = gwlist_timed_consume(outgoing_sms, concatenated_mo_timeout);
-        }
-
-        if (difftime(time(NULL), concat_mo_check) > concatenated_mo_timeout) {
-            concat_mo_check = time(NULL);
-            clear_old_concat_parts();
+            newmsg = msg = gwlist_timed_consume(queue, concatenated_mo_timeout);
         }
 
         /* shutdown or timeout */
@@ -626,17 +729,8 @@ static void sms_router(void *arg)
             continue;
         }
 
-        debug("bb.sms", 0, "sms_router: handling message (%p vs %p)",
-                  msg, startmsg);
-
-        /* handle delayed msgs */
-        if (msg->sms.resend_try > 0 && difftime(time(NULL), msg->sms.resend_time) < sms_resend_frequency &&
-            bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
-            debug("bb.sms", 0, "re-queing SMS not-yet-to-be resent");
-            gwlist_produce(outgoing_sms, msg);
-            ret = SMSCCONN_QUEUED;
-            continue;
-        }
+        debug("bb.sms", 0, "sms_router[%ld]: handling message (%p vs %p)",
+                  (long) arg, msg, startmsg);
 
         ret = smsc2_rout(msg, 1);
         switch(ret) {
@@ -653,7 +747,7 @@ static void sms_router(void *arg)
             break;
         case SMSCCONN_FAILED_QFULL:
             debug("bb.sms", 0, "Routing failed, re-queuing.");
-            gwlist_produce(outgoing_sms, msg);
+            gwlist_produce(queue, msg);
             break;
         case SMSCCONN_FAILED_EXPIRED:
             debug("bb.sms", 0, "Routing failed, expired.");
@@ -668,6 +762,84 @@ static void sms_router(void *arg)
 }
 
 
+/* function to release delayed resends into the router queues
+ * as soon as they are due
+ */
+static void sms_resend_scheduler(void *arg)
+{
+    Msg *msg;
+    List *due;
+    time_t now;
+    double delay;
+
+    gwlist_add_producer(flow_threads);
+    gwthread_wakeup(MAIN_THREAD_ID);
+
+    due = gwlist_create();
+
+    while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        /* we are the only consumer, so the head stays ours until removed */
+        now = time(NULL);
+        while ((msg = gw_prioqueue_get(resend_queue)) != NULL &&
+               sms_resend_due(msg) <= now)
+            gwlist_append(due, gw_prioqueue_remove(resend_queue));
+
+        if (gwlist_len(due) > 0)
+            debug("bb.sms", 0, "sms_resend_scheduler: releasing %ld messages",
+                  gwlist_len(due));
+        while ((msg = gwlist_extract_first(due)) != NULL)
+            router_queue_produce(msg);
+
+        if ((msg = gw_prioqueue_get(resend_queue)) != NULL)
+            delay = difftime(sms_resend_due(msg), now);
+        else
+            delay = sms_resend_frequency;
+        gwthread_sleep(delay);
+    }
+
+    gwlist_destroy(due, NULL);
+    gwlist_remove_producer(flow_threads);
+}
+
+
+/* function to move outgoing SMS'es from the global queue into
+ * the router queues, and to expire old concatenated MO parts
+ */
+static void sms_dispatcher(void *arg)
+{
+    Msg *msg;
+    long i;
+    time_t concat_mo_check;
+
+    gwlist_add_producer(flow_threads);
+    gwthread_wakeup(MAIN_THREAD_ID);
+
+    concat_mo_check = time(NULL);
+
+    while(bb_status != BB_SHUTDOWN && bb_status != BB_DEAD) {
+        msg = gwlist_timed_consume(outgoing_sms, CONCAT_CHECK_INTERVAL);
+
+        /* expiring only looks at due messages, so do it often */
+        if (difftime(time(NULL), concat_mo_check) >= CONCAT_CHECK_INTERVAL) {
+            concat_mo_check = time(NULL);
+            clear_old_concat_parts();
+        }
+
+        /* shutdown or timeout */
+        if (msg == NULL)
+            continue;
+
+        sms_queue_produce(msg);
+    }
+
+    /* continue avalanche */
+    for (i = 0; i < router_queue_count; i++)
+        gwlist_remove_producer(router_queues[i]);
+
+    gwlist_remove_producer(flow_threads);
+}
+
+
 
 
 /*-------------------------------------------------------------
@@ -686,6 +858,9 @@ int smsc2_start(Cfg *cfg)
 
     /* create split sms counter */
     split_msg_counter = counter_create();
+
+    /* buckets for throughput limits shared by smsc-id */
+    token_bucket_init();
     
     /* create smsc list and rwlock for it */
     smsc_list = gwlist_create();
@@ -734,6 +909,22 @@ int smsc2_start(Cfg *cfg)
     else
         info(0, "SMS resend retry set to %ld.", sms_resend_retry);
 
+    if (cfg_get_integer(&router_queue_count, grp,
+            octstr_imm("sms-router-threads")) == -1 || router_queue_count <= 0) {
+        router_queue_count = 1;
+    }
+    info(0, "Using %ld SMS router thread(s).", router_queue_count);
+
+    router_threads = gw_malloc(sizeof(router_threads[0]) * router_queue_count);
+    for (i = 0; i < router_queue_count; i++)
+        router_threads[i] = -1;
+    router_queues = gw_malloc(sizeof(router_queues[0]) * router_queue_count);
+    for (i = 0; i < router_queue_count; i++) {
+        router_queues[i] = gwlist_create();
+        gwlist_add_producer(router_queues[i]);
+    }
+    resend_queue = gw_prioqueue_create(sms_resend_cmp);
+
     if (cfg_get_bool(&handle_concatenated_mo, grp, octstr_imm("sms-combine-concatenated-mo")) == -1)
         handle_concatenated_mo = 1; /* default is TRUE. */
 
@@ -757,15 +948,32 @@ int smsc2_start(Cfg *cfg)
         gwlist_append(smsc_list, conn);
     }
     gwlist_remove_producer(smsc_list);
+    route_table = route_table_create(smsc_list);
     
-    if ((router_thread = gwthread_create(sms_router, NULL)) == -1)
-	panic(0, "Failed to start a new thread for SMS routing");
+    for (i = 0; i < router_queue_count; i++) {
+        if ((router_threads[i] = gwthread_create(sms_router, (void *) (long) i)) == -1)
+            panic(0, "Failed to start a new thread for SMS routing");
+    }
+    if ((resend_thread = gwthread_create(sms_resend_scheduler, NULL)) == -1)
+	panic(0, "Failed to start a new thread for SMS resend scheduling");
+    if ((dispatch_thread = gwthread_create(sms_dispatcher, NULL)) == -1)
+	panic(0, "Failed to start a new thread for SMS dispatching");
     
     gwlist_add_producer(incoming_sms);
     smsc_running = 1;
     return 0;
 }
 
+/*
+ * Recompile the routing table from the current smsc list.
+ * NOTE: Caller must hold the smsc_list write lock!
+ */
+static void smsc2_rebuild_routes(void)
+{
+    route_table_destroy(route_table);
+    route_table = route_table_create(smsc_list);
+}
+
 /*
  * Find a matching smsc-id in the smsc list starting at position start.
  * NOTE: Caller must ensure that smsc_list is properly locked!
@@ -891,6 +1099,8 @@ int smsc2_restart_smsc(Octstr *id)
         success = 1;
         num++;
     }
+    if (success)
+        smsc2_rebuild_routes();
 
     gw_rwlock_unlock(&smsc_list_lock);
     
@@ -898,9 +1108,8 @@ int smsc2_restart_smsc(Octstr *id)
         error(0, "SMSC %s not found", octstr_get_cstr(id));
         return -1;
     }
-    /* wake-up the router */
-    if (router_thread >= 0)
-        gwthread_wakeup(router_thread);
+    /* wake-up the routers */
+    router_wakeup();
     return 0;
 }
 
@@ -924,6 +1133,8 @@ int smsc2_remove_smsc(Octstr *id)
         success = 1;
     }
     gwlist_remove_producer(smsc_list);
+    if (success)
+        smsc2_rebuild_routes();
 
     gw_rwlock_unlock(&smsc_list_lock);
     if (success == 0) {
@@ -979,6 +1190,8 @@ int smsc2_add_smsc(Octstr *id)
         }
     }
     gwlist_remove_producer(smsc_list);
+    if (success)
+        smsc2_rebuild_routes();
     gw_rwlock_unlock(&smsc_list_lock);
     if (success == 0) {
         error(0, "SMSC %s not found", octstr_get_cstr(id));
@@ -1018,6 +1231,12 @@ int smsc2_reload_lists(void)
         }
     }
 
+    if (smsc_running) {
+        gw_rwlock_wrlock(&smsc_list_lock);
+        smsc2_rebuild_routes();
+        gw_rwlock_unlock(&smsc_list_lock);
+    }
+
     return rc;
 }
 
@@ -1041,8 +1260,7 @@ void smsc2_resume(int is_init)
     }
     gw_rwlock_unlock(&smsc_list_lock);
     
-    if (router_thread >= 0)
-        gwthread_wakeup(router_thread);
+    router_wakeup();
 }
 
 
@@ -1080,8 +1298,11 @@ int smsc2_shutdown(void)
 	smscconn_shutdown(conn, 1);
     }
     gw_rwlock_unlock(&smsc_list_lock);
-    if (router_thread >= 0)
-	gwthread_wakeup(router_thread);
+    router_wakeup();
+    if (dispatch_thread >= 0)
+        gwthread_wakeup(dispatch_thread);
+    if (resend_thread >= 0)
+        gwthread_wakeup(resend_thread);
 
     /* start avalanche by calling shutdown */
 
@@ -1101,6 +1322,7 @@ int smsc2_shutdown(void)
 void smsc2_cleanup(void)
 {
     SMSCConn *conn;
+    Msg *msg;
     long i;
 
     if (!smsc_running)
@@ -1115,7 +1337,25 @@ void smsc2_cleanup(void)
     }
     gwlist_destroy(smsc_list, NULL);
     smsc_list = NULL;
+    route_table_destroy(route_table);
+    route_table = NULL;
     gw_rwlock_unlock(&smsc_list_lock);
+    token_bucket_shutdown();
+    /* hand left-overs back to the global queue */
+    while ((msg = gw_prioqueue_remove(resend_queue)) != NULL)
+        gwlist_append(outgoing_sms, msg);
+    gw_prioqueue_destroy(resend_queue, NULL);
+    resend_queue = NULL;
+    for (i = 0; i < router_queue_count; i++) {
+        while ((msg = gwlist_extract_first(router_queues[i])) != NULL)
+            gwlist_append(outgoing_sms, msg);
+        gwlist_destroy(router_queues[i], NULL);
+    }
+    gw_free(router_queues);
+    router_queues = NULL;
+    gw_free(router_threads);
+    router_threads = NULL;
+    router_queue_count = 0;
     gwlist_destroy(smsc_groups, NULL);
     octstr_destroy(unified_prefix);    
     numhash_destroy(white_list);
@@ -1150,6 +1390,8 @@ Octstr *smsc2_status(int status_type)
     const Octstr *conn_id = NULL;
     const Octstr *conn_admin_id = NULL;
     const Octstr *conn_name = NULL;
+    Octstr *details;
+    List *lines;
     float incoming_sms_load_0, incoming_sms_load_1, incoming_sms_load_2;
     float outgoing_sms_load_0, outgoing_sms_load_1, outgoing_sms_load_2;
     float incoming_dlr_load_0, incoming_dlr_load_1, incoming_dlr_load_2;
@@ -1223,7 +1465,11 @@ Octstr *smsc2_status(int status_type)
         switch (info.status) {
             case SMSCCONN_ACTIVE:
             case SMSCCONN_ACTIVE_RECV:
-                sprintf(tmp3, "online %lds", info.online);
+                if (info.binds > 1)
+                    sprintf(tmp3, "online %lds, binds %ld/%ld", info.online,
+                            info.binds_active, info.binds);
+                else
+                    sprintf(tmp3, "online %lds", info.online);
                 incoming_sms_load_0 = load_get(conn->incoming_sms_load,0);
                 incoming_sms_load_1 = load_get(conn->incoming_sms_load,1);
                 incoming_sms_load_2 = load_get(conn->incoming_sms_load,2);
@@ -1267,8 +1513,7 @@ Octstr *smsc2_status(int status_type)
                 "\t\t\t<sent>%ld</sent>\n"
                 "\t\t\t<inbound>%.2f,%.2f,%.2f</inbound>\n"
                 "\t\t\t<outbound>%.2f,%.2f,%.2f</outbound>\n"
-                "\t\t</dlr>\n"
-                "\t</smsc>\n", tmp3,
+                "\t\t</dlr>\n", tmp3,
                 info.failed, info.queued, info.received, info.sent,
                 incoming_sms_load_0, incoming_sms_load_1, incoming_sms_load_2,
                 outgoing_sms_load_0, outgoing_sms_load_1, outgoing_sms_load_2,
@@ -1291,6 +1536,27 @@ Octstr *smsc2_status(int status_type)
                 info.failed,
                 info.queued,
                 lb);
+
+        /* driver specific details, one indented line each */
+        details = smscconn_status_details(conn);
+        if (details != NULL) {
+            lines = octstr_split(details, octstr_imm("\n"));
+            while (gwlist_len(lines) > 0) {
+                Octstr *line = gwlist_extract_first(lines);
+                if (status_type == BBSTATUS_XML)
+                    octstr_format_append(tmp, "\t\t<details>%S</details>\n", line);
+                else if (status_type == BBSTATUS_HTML)
+                    octstr_format_append(tmp, "&nbsp;&nbsp;&nbsp;&nbsp;"
+                                         "&nbsp;&nbsp;&nbsp;&nbsp;%S%s", line, lb);
+                else
+                    octstr_format_append(tmp, "        %S%s", line, lb);
+                octstr_destroy(line);
+            }
+            gwlist_destroy(lines, NULL);
+            octstr_destroy(details);
+        }
+        if (status_type == BBSTATUS_XML)
+            octstr_append_cstr(tmp, "\t</smsc>\n");
     }
 
 
@@ -1321,9 +1587,9 @@ Octstr *smsc2_status(int status_type)
 long smsc2_rout(Msg *msg, int resend)
 {
     StatusInfo info;
-    SMSCConn *conn, *best_preferred, *best_ok;
-    long bp_load, bo_load;
-    int i, s, ret, bad_found, full_found;
+    SMSCConn *conn, *best_preferred, *best_ok, **candidates;
+    long bp_load, bo_load, num_candidates;
+    int i, s, ret, bad_found, full_found, *usable;
     long max_queue, queue_length;
     char *uf;
 
@@ -1365,24 +1631,32 @@ long smsc2_rout(Msg *msg, int resend)
     	 * and 80% for new msgs. So we can guarantee that old msgs find
     	 * place in the SMSC's queue.
     	 */
-    	if (gwlist_len(outgoing_sms) > 0) {
+    	if (smsc2_outgoing_queue() > 0) {
     		max_queue = (resend ? max_outgoing_sms_qlength :
     		max_outgoing_sms_qlength * 0.8);
     	} else
     		max_queue = max_outgoing_sms_qlength;
 
+    	/* the sum of all queues is only of interest for new msgs */
+    	if (max_outgoing_sms_qlength > 0 && !resend) {
+    		for (i = 0; i < gwlist_len(smsc_list); i++) {
+    			smscconn_info(gwlist_get(smsc_list, i), &info);
+    			queue_length += (info.queued > 0 ? info.queued : 0);
+    		}
+    	}
+
     	s = gw_rand() % gwlist_len(smsc_list);
 
+    	candidates = gw_malloc(sizeof(candidates[0]) * route_table_size(route_table));
+    	usable = gw_malloc(sizeof(usable[0]) * route_table_size(route_table));
+    	num_candidates = route_table_find(route_table, msg, s, candidates, usable);
+
     	conn = NULL;
-    	for (i = 0; i < gwlist_len(smsc_list); i++) {
-    		conn = gwlist_get(smsc_list,  (i+s) % gwlist_len(smsc_list));
+    	for (i = 0; i < num_candidates; i++) {
+    		conn = candidates[i];
+    		ret = usable[i];
 
     		smscconn_info(conn, &info);
-    		queue_length += (info.queued > 0 ? info.queued : 0);
-
-    		ret = smscconn_usable(conn,msg);
-    		if (ret == -1)
-    			continue;
 
     		/* if we already have a preferred one, skip non-preferred */
     		if (ret != 1 && best_preferred)
@@ -1410,7 +1684,9 @@ long smsc2_rout(Msg *msg, int resend)
     			bo_load = info.load;
     		}
     	}
-    	queue_length += gwlist_len(outgoing_sms);
+    	gw_free(candidates);
+    	gw_free(usable);
+    	queue_length += smsc2_outgoing_queue();
     	if (max_outgoing_sms_qlength > 0 && !resend &&
     	    queue_length > gwlist_len(smsc_list) * max_outgoing_sms_qlength) {
     		gw_rwlock_unlock(&smsc_list_lock);
@@ -1430,8 +1706,8 @@ long smsc2_rout(Msg *msg, int resend)
         ret = smscconn_send(best_ok, msg);
     else if (bad_found) {
         gw_rwlock_unlock(&smsc_list_lock);
-        if (max_outgoing_sms_qlength < 0 || gwlist_len(outgoing_sms) < max_outgoing_sms_qlength) {
-            gwlist_produce(outgoing_sms, msg);
+        if (max_outgoing_sms_qlength < 0 || smsc2_outgoing_queue() < max_outgoing_sms_qlength) {
+            sms_queue_produce(msg);
             return SMSCCONN_QUEUED;
         }
         debug("bb.sms", 0, "bad_found queue full");
@@ -1523,6 +1799,11 @@ static long route_incoming_to_smsc(SMSCConn *conn, Msg *msg)
  * incoming concatenated messages handling
  */
 
+/* number of independently locked parts of the reassembly table */
+#define CONCAT_SHARDS 16
+
+struct ConcatShard;
+
 typedef struct ConcatMsg {
     int refnum;
     int total_parts;
@@ -1533,10 +1814,30 @@ typedef struct ConcatMsg {
     int ack;     /* set to the type of ack to send when deleting. */
     /* array of parts */
     Msg **parts;
+    /* shard holding it and position in the expiry list of the shard */
+    struct ConcatShard *shard;
+    struct ConcatMsg *prev, *next;
 } ConcatMsg;
 
-static Dict *incoming_concat_msgs;
-static Mutex *concat_lock;
+/*
+ * Pending messages are spread over shards by the hash of their key, each
+ * with its own lock, dict and expiry list. As every message times out the
+ * same time after its last part arrived, keeping the messages of a shard
+ * in the order their last part arrived orders the list by expiry time:
+ * new and updated messages go to the tail, and a cleanup run only takes
+ * messages from the head until it finds one that is not due yet.
+ */
+typedef struct ConcatShard {
+    Mutex *lock;
+    Dict *msgs;
+    ConcatMsg *head, *tail;
+} ConcatShard;
+
+static ConcatShard *concat_shards;
+
+static Counter *concat_pending_counter;
+static Counter *concat_completed_counter;
+static Counter *concat_timedout_counter;
 
 static void destroy_concatMsg(void *x)
 {
@@ -1556,111 +1857,202 @@ static void destroy_concatMsg(void *x)
     gw_free(msg);
 }
 
+/* Shard lock must be held for the expiry list functions. */
+static void concat_unlink(ConcatMsg *x)
+{
+    ConcatShard *shard = x->shard;
+
+    if (x->prev != NULL)
+        x->prev->next = x->next;
+    else
+        shard->head = x->next;
+    if (x->next != NULL)
+        x->next->prev = x->prev;
+    else
+        shard->tail = x->prev;
+    x->prev = x->next = NULL;
+}
+
+static void concat_link_tail(ConcatMsg *x)
+{
+    ConcatShard *shard = x->shard;
+
+    x->next = NULL;
+    x->prev = shard->tail;
+    if (shard->tail != NULL)
+        shard->tail->next = x;
+    else
+        shard->head = x;
+    shard->tail = x;
+}
+
+static void concat_link_head(ConcatMsg *x)
+{
+    ConcatShard *shard = x->shard;
+
+    x->prev = NULL;
+    x->next = shard->head;
+    if (shard->head != NULL)
+        shard->head->prev = x;
+    else
+        shard->tail = x;
+    shard->head = x;
+}
+
 static void init_concat_handler(void)
 {
-    if (incoming_concat_msgs != NULL) /* already initialised? */
+    long size;
+    int i;
+
+    if (concat_shards != NULL) /* already initialised? */
         return;
-    incoming_concat_msgs = dict_create(max_incoming_sms_qlength > 0 ? max_incoming_sms_qlength : 1024, 
-                                       destroy_concatMsg);
-    concat_lock = mutex_create();
+
+    size = (max_incoming_sms_qlength > 0 ? max_incoming_sms_qlength : 1024) / CONCAT_SHARDS;
+    if (size < 64)
+        size = 64;
+
+    concat_shards = gw_malloc(CONCAT_SHARDS * sizeof(*concat_shards));
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        concat_shards[i].lock = mutex_create();
+        concat_shards[i].msgs = dict_create(size, destroy_concatMsg);
+        concat_shards[i].head = concat_shards[i].tail = NULL;
+    }
+    concat_pending_counter = counter_create();
+    concat_completed_counter = counter_create();
+    concat_timedout_counter = counter_create();
     debug("bb.sms",0,"MO concatenated message handling enabled");
 }
 
 static void shutdown_concat_handler(void)
 {
-    if (incoming_concat_msgs == NULL)
-        return;
-    dict_destroy(incoming_concat_msgs);
-    mutex_destroy(concat_lock);
+    int i;
 
-    incoming_concat_msgs = NULL;
-    concat_lock = NULL;
+    if (concat_shards == NULL)
+        return;
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        dict_destroy(concat_shards[i].msgs);
+        mutex_destroy(concat_shards[i].lock);
+    }
+    gw_free(concat_shards);
+    concat_shards = NULL;
+    counter_destroy(concat_pending_counter);
+    counter_destroy(concat_completed_counter);
+    counter_destroy(concat_timedout_counter);
+    concat_pending_counter = concat_completed_counter = concat_timedout_counter = NULL;
     debug("bb.sms",0,"MO concatenated message handling cleaned up");
 }
 
-static void clear_old_concat_parts(void)
+/*
+ * Send the parts of a timed out message on as they are. Parts that can't
+ * be routed now are put back, in front of the expiry list of their shard,
+ * and retried on the next run.
+ */
+static void expire_concatMsg(ConcatMsg *x)
 {
-    List *keys;
-    Octstr *key;
-
-    /* not initialised, go away */
-    if (incoming_concat_msgs == NULL)
-        return;
-
-    debug("bb.sms.splits", 0, "clear_old_concat_parts called");
-
-    /* Remove any pending messages that are too old. */
-    keys = dict_keys(incoming_concat_msgs);
-    while((key = gwlist_extract_first(keys)) != NULL) {
-        ConcatMsg *x;
-        Msg *msg;
-        int i, destroy = 1;
-
-        mutex_lock(concat_lock);
-        x = dict_get(incoming_concat_msgs, key);
-        octstr_destroy(key);
-        if (x == NULL || difftime(time(NULL), x->trecv) < concatenated_mo_timeout) {
-            mutex_unlock(concat_lock);
+    ConcatMsg *x1;
+    Msg *msg;
+    int i, destroy = 1;
+
+    warning(0, "Time-out waiting for concatenated message '%s'. Send message parts as is.",
+            octstr_get_cstr(x->key));
+    for (i = 0; i < x->total_parts && destroy == 1; i++) {
+        if (x->parts[i] == NULL)
             continue;
+        msg = msg_duplicate(x->parts[i]);
+        store_save_ack(x->parts[i], ack_success);
+        switch(bb_smscconn_receive(NULL, msg)) {
+        case SMSCCONN_FAILED_REJECTED:
+        case SMSCCONN_SUCCESS:
+            msg_destroy(x->parts[i]);
+            x->parts[i] = NULL;
+            x->num_parts--;
+            break;
+        case SMSCCONN_FAILED_TEMPORARILY:
+        case SMSCCONN_FAILED_QFULL:
+        default:
+            /* oops put it back into dict and retry on next run */
+            store_save(x->parts[i]);
+            destroy = 0;
+            break;
         }
-        dict_remove(incoming_concat_msgs, x->key);
-        mutex_unlock(concat_lock);
-        warning(0, "Time-out waiting for concatenated message '%s'. Send message parts as is.",
-                octstr_get_cstr(x->key));
-        for (i = 0; i < x->total_parts && destroy == 1; i++) {
+    }
+    if (destroy) {
+        destroy_concatMsg(x);
+        counter_decrease(concat_pending_counter);
+        counter_increase(concat_timedout_counter);
+        return;
+    }
+
+    mutex_lock(x->shard->lock);
+    x1 = dict_get(x->shard->msgs, x->key);
+    if (x1 != NULL) {
+        /*
+         * oops we have new part. The key includes the number of parts,
+         * so both are the same message and the new one takes the parts.
+         */
+        for (i = 0; i < x->total_parts; i++) {
             if (x->parts[i] == NULL)
                 continue;
-            msg = msg_duplicate(x->parts[i]);
-            store_save_ack(x->parts[i], ack_success);
-            switch(bb_smscconn_receive(NULL, msg)) {
-            case SMSCCONN_FAILED_REJECTED:
-            case SMSCCONN_SUCCESS:
-                msg_destroy(x->parts[i]);
+            if (x1->parts[i] == NULL) {
+                x1->parts[i] = x->parts[i];
+                x1->num_parts++;
                 x->parts[i] = NULL;
-                x->num_parts--;
-                break;
-            case SMSCCONN_FAILED_TEMPORARILY:
-            case SMSCCONN_FAILED_QFULL:
-            default:
-                /* oops put it back into dict and retry on next run */
-                store_save(x->parts[i]);
-                destroy = 0;
-                break;
             }
         }
-        if (destroy) {
-            destroy_concatMsg(x);
-        } else {
-            ConcatMsg *x1;
-            mutex_lock(concat_lock);
-            x1 = dict_get(incoming_concat_msgs, x->key);
-            if (x1 != NULL) { /* oops we have new part */
-                int i;
-                if (x->total_parts != x1->total_parts) {
-                    /* broken handset, don't know what todo here??
-                     * for now just put old concatMsg into dict with
-                     * another key and it will be cleaned up on next run.
-                     */
-                    octstr_format_append(x->key, " %d", x->total_parts);
-                    dict_put(incoming_concat_msgs, x->key, x);
-                } else {
-                    for (i = 0; i < x->total_parts; i++) {
-                        if (x->parts[i] == NULL)
-                            continue;
-                        if (x1->parts[i] == NULL) {
-                            x1->parts[i] = x->parts[i];
-                            x->parts[i] = NULL;
-                        }
-                    }
-                    destroy_concatMsg(x);
-                }
-            } else {
-                dict_put(incoming_concat_msgs, x->key, x);
-            }
-            mutex_unlock(concat_lock);
+        destroy_concatMsg(x);
+        counter_decrease(concat_pending_counter);
+    } else {
+        dict_put(x->shard->msgs, x->key, x);
+        concat_link_head(x);
+    }
+    mutex_unlock(x->shard->lock);
+}
+
+static void clear_old_concat_parts(void)
+{
+    List *due;
+    ConcatShard *shard;
+    ConcatMsg *x;
+    time_t now;
+    int i;
+
+    /* not initialised, go away */
+    if (concat_shards == NULL)
+        return;
+
+    /* Remove any pending messages that are too old. */
+    due = gwlist_create();
+    now = time(NULL);
+    for (i = 0; i < CONCAT_SHARDS; i++) {
+        shard = &concat_shards[i];
+        mutex_lock(shard->lock);
+        while ((x = shard->head) != NULL &&
+               difftime(now, x->trecv) >= concatenated_mo_timeout) {
+            concat_unlink(x);
+            dict_remove(shard->msgs, x->key);
+            gwlist_append(due, x);
         }
+        mutex_unlock(shard->lock);
+    }
+
+    if (gwlist_len(due) > 0)
+        debug("bb.sms.splits", 0, "clear_old_concat_parts: %ld messages timed out",
+              gwlist_len(due));
+
+    while ((x = gwlist_extract_first(due)) != NULL)
+        expire_concatMsg(x);
+    gwlist_destroy(due, NULL);
+}
+
+void smsc2_concat_status(long *pending, long *completed, long *timedout)
+{
+    if (concat_shards == NULL) {
+        *pending = *completed = *timedout = 0;
+        return;
     }
-    gwlist_destroy(keys, octstr_destroy_item);
+    *pending = counter_value(concat_pending_counter);
+    *completed = counter_value(concat_completed_counter);
+    *timedout = counter_value(concat_timedout_counter);
 }
 
 /* Checks if message is concatenated. Returns:
@@ -1674,10 +2066,11 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
     int l, iel = 0, refnum, pos, c, part, totalparts, i, sixteenbit;
     Octstr *udh = msg->sms.udhdata, *key;
     ConcatMsg *cmsg;
+    ConcatShard *shard;
     int ret = concat_complete;
 
     /* ... module not initialised or there is no UDH or smscid is NULL. */
-    if (incoming_concat_msgs == NULL || (l = octstr_len(udh)) == 0 || smscid == NULL)
+    if (concat_shards == NULL || (l = octstr_len(udh)) == 0 || smscid == NULL)
         return concat_none;
 
     for (pos = 1, c = -1; pos < l - 1; pos += iel + 2) {
@@ -1715,8 +2108,10 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
     msg_dump(msg, 0);
      
     key = octstr_format("'%S' '%S' '%S' '%d' '%d' '%H'", msg->sms.sender, msg->sms.receiver, smscid, refnum, totalparts, udh);
-    mutex_lock(concat_lock);
-    if ((cmsg = dict_get(incoming_concat_msgs, key)) == NULL) {
+    /* use other bits of the hash than the dicts do for their buckets */
+    shard = &concat_shards[(octstr_hash_key(key) >> 8) % CONCAT_SHARDS];
+    mutex_lock(shard->lock);
+    if ((cmsg = dict_get(shard->msgs, key)) == NULL) {
         cmsg = gw_malloc(sizeof(*cmsg));
         cmsg->refnum = refnum;
         cmsg->total_parts = totalparts;
@@ -1727,8 +2122,12 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
         cmsg->ack = ack_success;
         cmsg->parts = gw_malloc(totalparts * sizeof(*cmsg->parts));
         memset(cmsg->parts, 0, cmsg->total_parts * sizeof(*cmsg->parts)); /* clear it. */
+        cmsg->shard = shard;
+        cmsg->trecv = time(NULL);
+        concat_link_tail(cmsg);
 
-        dict_put(incoming_concat_msgs, key, cmsg);
+        dict_put(shard->msgs, key, cmsg);
+        counter_increase(concat_pending_counter);
     }
     octstr_destroy(key);
     octstr_destroy(udh);
@@ -1745,11 +2144,13 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
         cmsg->num_parts++;
         /* always update receive time so we have it from last part and don't timeout */
         cmsg->trecv = time(NULL);
+        concat_unlink(cmsg);
+        concat_link_tail(cmsg);
     }
 
     if (cmsg->num_parts < cmsg->total_parts) {  /* wait for more parts. */
         *pmsg = msg = NULL;
-        mutex_unlock(concat_lock);
+        mutex_unlock(shard->lock);
         return concat_pending;
     }
 
@@ -1765,7 +2166,7 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
 
     /* Attempt to save the new one, if that fails, then reply with fail. */
     if (store_save(msg) == -1) {	  
-        mutex_unlock(concat_lock);
+        mutex_unlock(shard->lock);
         msg_destroy(msg);
         *pmsg = msg = NULL;
         return concat_error;
@@ -1779,8 +2180,11 @@ static int check_concatenation(Msg **pmsg, Octstr *smscid)
 
     /* Delete it from the queue and from the Dict. */
     /* Note: dict_put with NULL value delete and destroy value */
-    dict_put(incoming_concat_msgs, cmsg->key, NULL);
-    mutex_unlock(concat_lock);
+    concat_unlink(cmsg);
+    dict_put(shard->msgs, cmsg->key, NULL);
+    mutex_unlock(shard->lock);
+    counter_decrease(concat_pending_counter);
+    counter_increase(concat_completed_counter);
 
     debug("bb.sms.splits", 0, "Got full message [ref %d] of message from %s to %s. Dumping: ",
           refnum, octstr_get_cstr(msg->sms.sender), octstr_get_cstr(msg->sms.receiver));
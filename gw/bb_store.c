@@ -79,7 +79,7 @@ Msg* (*store_msg_unpack)(Octstr *os);
  
 
 int store_init(const Octstr *type, const Octstr *fname, long dump_freq,
-               void *pack_func, void *unpack_func)
+               long sync_interval, void *pack_func, void *unpack_func)
 {
     int ret;
     
@@ -87,9 +87,13 @@ int store_init(const Octstr *type, const Octstr *fname, long dump_freq,
     store_msg_unpack = unpack_func;
 
     if (type == NULL || octstr_str_compare(type, "file") == 0) {
-        ret = store_file_init(fname, dump_freq);
+        ret = store_file_init(fname, dump_freq, 0, -1);
+    } else if (octstr_str_compare(type, "wal") == 0) {
+        ret = store_file_init(fname, dump_freq, 1, sync_interval);
     } else if (octstr_str_compare(type, "spool") == 0) {
         ret = store_spool_init(fname);
+    } else if (octstr_str_compare(type, "segment") == 0) {
+        ret = store_segment_init(fname, dump_freq);
     } else {
         error(0, "Unknown 'store-type' defined.");
         ret = -1;
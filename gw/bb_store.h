@@ -97,9 +97,13 @@ extern int (*store_dump)(void);
 extern Octstr* (*store_msg_pack)(Msg *msg);
 extern Msg* (*store_msg_unpack)(Octstr *os);
 
-/* initialize system. Return -1 if fname is bad (too long). */
+/*
+ * initialize system. Return -1 if fname is bad (too long).
+ * sync_interval is used by the 'wal' store type: -1 never sync to disk,
+ * 0 sync each commit, otherwise sync interval in milliseconds.
+ */
 int store_init(const Octstr *type, const Octstr *fname, long dump_freq,
-               void *pack_func, void *unpack_func);
+               long sync_interval, void *pack_func, void *unpack_func);
 
 /* init shutdown (system dies when all acks have been processed) */
 extern void (*store_shutdown)(void);
@@ -111,7 +115,8 @@ extern Octstr* (*store_status)(int status_type);
  * Init functions for different store types.
  */
 int store_spool_init(const Octstr *fname);
-int store_file_init(const Octstr *fname, long dump_freq);
+int store_segment_init(const Octstr *fname, long dump_freq);
+int store_file_init(const Octstr *fname, long dump_freq, int wal, long sync_interval);
 
 
 #endif /*BB_STORE_H_*/
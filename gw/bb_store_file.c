@@ -66,6 +66,17 @@
  *  - acks are no longer saved (to memory), they simply delete
  *    messages from dict
  *  - better choice when dump done; configurable frequency
+ *
+ * Write-ahead log mode (store-type 'wal'):
+ *  - saves and acks are appended to numbered segment files
+ *    ('<store-location>.wal.<seq>'), the store is never rewritten
+ *    as a whole
+ *  - group commit: concurrent saves are collected and written with
+ *    one write(), optionally followed by one fdatasync()
+ *  - checkpoints delete the oldest segments once all their messages
+ *    are acknowledged; live messages of mostly dead segments are
+ *    re-appended to the current segment first
+ *  - segments are unpacked in parallel on load
  */
 
 #include <errno.h>
@@ -78,11 +89,14 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <dirent.h>
 
 #include "gwlib/gwlib.h"
 #include "msg.h"
 #include "bearerbox.h"
 #include "sms.h"
+#include "load.h"
 
 static FILE *file = NULL;
 static Octstr *filename = NULL;
@@ -98,6 +112,53 @@ static int active = 1;
 static time_t last_dict_mod = 0;
 static List *loaded;
 
+static int store_to_dict(Msg *msg);
+
+/* segment size after which a new one is started */
+#define WAL_SEGMENT_SIZE (16 * 1024 * 1024)
+/* segments allowed beyond twice what the live messages need, before the
+ * oldest one is compacted regardless of its use */
+#define WAL_MAX_SEGMENTS 4
+/* max threads used to unpack segments while loading */
+#define WAL_LOAD_THREADS 4
+
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+#define wal_fdatasync(fd) fdatasync(fd)
+#else
+#define wal_fdatasync(fd) fsync(fd)
+#endif
+
+typedef struct {
+    long seq;
+    Octstr *name;
+    int fd;         /* -1 if closed */
+    long size;      /* bytes appended */
+    long saved;     /* sms records appended */
+    long live;      /* of these, still not acknowledged */
+    List *msgs;     /* unpacked records, used while loading */
+} WalSegment;
+
+static int wal_mode = 0;
+/* -1: never sync, 0: sync every commit, otherwise interval in msec */
+static long wal_sync_interval = -1;
+/* segments, oldest first; guarded by file_mutex */
+static List *wal_segments = NULL;
+static WalSegment *wal_current = NULL;
+/* sms id -> segment holding its latest record */
+static Dict *wal_index = NULL;
+/* records not yet written, and the commit tickets */
+static Octstr *wal_buffer = NULL;
+static long long wal_appended = 0;
+/* guarded by wal_write_mutex */
+static Mutex *wal_write_mutex = NULL;
+static long long wal_written = 0;
+static int wal_unsynced = 0;
+static long wal_commits = 0;
+static long wal_syncs = 0;
+static double wal_sync_total = 0;
+static double wal_sync_max = 0;
+static Load *wal_save_load = NULL;
+
 
 static void write_msg(Msg *msg)
 {
@@ -206,6 +267,548 @@ static int do_dump(void)
 }
 
 
+/*------------------------------------------------------
+ * write-ahead log mode
+ */
+
+static WalSegment *wal_segment_create(long seq, int do_open)
+{
+    WalSegment *seg;
+
+    seg = gw_malloc(sizeof(*seg));
+    seg->seq = seq;
+    seg->name = octstr_format("%S.wal.%08ld", filename, seq);
+    seg->fd = -1;
+    seg->size = seg->saved = seg->live = 0;
+    seg->msgs = NULL;
+
+    if (do_open) {
+        seg->fd = open(octstr_get_cstr(seg->name), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (seg->fd == -1) {
+            error(errno, "Failed to open '%s' for writing, cannot create store segment",
+                  octstr_get_cstr(seg->name));
+            octstr_destroy(seg->name);
+            gw_free(seg);
+            return NULL;
+        }
+    }
+    return seg;
+}
+
+
+static void wal_segment_destroy(WalSegment *seg, int remove)
+{
+    if (seg == NULL)
+        return;
+    if (seg->fd != -1)
+        close(seg->fd);
+    if (remove && unlink(octstr_get_cstr(seg->name)) == -1 && errno != ENOENT)
+        error(errno, "Failed to remove store segment '%s'", octstr_get_cstr(seg->name));
+    gwlist_destroy(seg->msgs, msg_destroy_item);
+    octstr_destroy(seg->name);
+    gw_free(seg);
+}
+
+
+static void wal_segment_destroy_item(void *seg)
+{
+    wal_segment_destroy(seg, 0);
+}
+
+
+static int wal_segment_cmp(const void *a, const void *b)
+{
+    const WalSegment *sa = *(WalSegment**) a, *sb = *(WalSegment**) b;
+
+    return (sa->seq > sb->seq) - (sa->seq < sb->seq);
+}
+
+
+/* NOTE: caller must hold wal_write_mutex */
+static void wal_sync(WalSegment *seg)
+{
+    struct timeval start, end;
+    double elapsed;
+
+    gettimeofday(&start, NULL);
+    if (wal_fdatasync(seg->fd) == -1)
+        error(errno, "Failed to sync store segment '%s'", octstr_get_cstr(seg->name));
+    gettimeofday(&end, NULL);
+
+    elapsed = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+    wal_syncs++;
+    wal_sync_total += elapsed;
+    if (elapsed > wal_sync_max)
+        wal_sync_max = elapsed;
+}
+
+
+static int wal_write(int fd, Octstr *os)
+{
+    const char *data = octstr_get_cstr(os);
+    long len = octstr_len(os);
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/*
+ * Append message record to the write buffer and account it to the
+ * current segment. Return commit ticket of this record.
+ * NOTE: caller must hold file_mutex
+ */
+static long long wal_append(Msg *msg)
+{
+    WalSegment *seg;
+    Octstr *id_os, *pack;
+    unsigned char buf[4];
+    char id[UUID_STR_LEN + 1];
+
+    if (msg_type(msg) == sms) {
+        uuid_unparse(msg->sms.id, id);
+        id_os = octstr_create(id);
+        if ((seg = dict_get(wal_index, id_os)) != NULL)
+            seg->live--;
+        wal_current->saved++;
+        wal_current->live++;
+        dict_put(wal_index, id_os, wal_current);
+        octstr_destroy(id_os);
+    } else if (msg_type(msg) == ack) {
+        uuid_unparse(msg->ack.id, id);
+        id_os = octstr_create(id);
+        if ((seg = dict_remove(wal_index, id_os)) != NULL)
+            seg->live--;
+        octstr_destroy(id_os);
+    }
+
+    pack = store_msg_pack(msg);
+    encode_network_long(buf, octstr_len(pack));
+    octstr_append_data(wal_buffer, (char*) buf, 4);
+    octstr_append(wal_buffer, pack);
+    wal_current->size += octstr_len(pack) + 4;
+    octstr_destroy(pack);
+
+    return ++wal_appended;
+}
+
+
+/*
+ * Make sure everything up to ticket is written. Whoever gets the write
+ * lock first writes all records appended so far, so concurrent callers
+ * share one write() (and sync).
+ * NOTE: caller must hold wal_write_mutex
+ */
+static int wal_commit_locked(long long ticket, int sync)
+{
+    WalSegment *seg, *next;
+    Octstr *batch;
+    long long last;
+    int ret = 0;
+
+    if (wal_written >= ticket)
+        return 0;
+
+    mutex_lock(file_mutex);
+    batch = wal_buffer;
+    wal_buffer = octstr_create("");
+    last = wal_appended;
+    seg = wal_current;
+    next = NULL;
+    if (seg->size >= WAL_SEGMENT_SIZE &&
+        (next = wal_segment_create(seg->seq + 1, 1)) != NULL) {
+        gwlist_append(wal_segments, next);
+        wal_current = next;
+    }
+    mutex_unlock(file_mutex);
+
+    if (wal_write(seg->fd, batch) == -1) {
+        error(errno, "Failed to write to store segment '%s'", octstr_get_cstr(seg->name));
+        ret = -1;
+    }
+    wal_commits++;
+    if (sync || (next != NULL && wal_sync_interval >= 0))
+        wal_sync(seg);
+    else if (wal_sync_interval > 0)
+        wal_unsynced = 1;
+    if (next != NULL) {
+        close(seg->fd);
+        seg->fd = -1;
+    }
+    wal_written = last;
+
+    octstr_destroy(batch);
+    return ret;
+}
+
+
+static int wal_commit(long long ticket, int sync)
+{
+    int ret;
+
+    mutex_lock(wal_write_mutex);
+    ret = wal_commit_locked(ticket, sync);
+    mutex_unlock(wal_write_mutex);
+
+    return ret;
+}
+
+
+struct wal_collect {
+    WalSegment *seg;
+    List *ids;
+};
+
+static void wal_collect_ids(Octstr *key, void *value, void *data)
+{
+    struct wal_collect *c = data;
+
+    if (value == c->seg)
+        gwlist_append(c->ids, octstr_duplicate(key));
+}
+
+
+static int wal_checkpoint(void)
+{
+    struct wal_collect c;
+    WalSegment *seg;
+    Octstr *key;
+    Msg *msg;
+    long long ticket = 0, last;
+    double live_size = 0;
+    long i, needed, removable;
+    int ret = 0;
+
+    if (wal_current == NULL)
+        return 0;
+
+    /*
+     * If the oldest segment is mostly acknowledged, or if it holds back
+     * the removal of many more segments than the live messages need,
+     * re-append its live messages, so that it can be removed. The cap
+     * scales with the backlog, so a large queue is not rewritten over
+     * and over again.
+     */
+    mutex_lock(file_mutex);
+    for (i = 0; i < gwlist_len(wal_segments); i++) {
+        seg = gwlist_get(wal_segments, i);
+        if (seg->saved > 0)
+            live_size += (double) seg->size * seg->live / seg->saved;
+    }
+    needed = live_size / WAL_SEGMENT_SIZE + 1;
+    seg = gwlist_get(wal_segments, 0);
+    if (seg != wal_current && seg->live > 0 &&
+        (seg->live * 4 <= seg->saved ||
+         gwlist_len(wal_segments) > 2 * needed + WAL_MAX_SEGMENTS)) {
+        debug("bb.store", 0, "Moving %ld messages out of store segment `%s'",
+              seg->live, octstr_get_cstr(seg->name));
+        c.seg = seg;
+        c.ids = gwlist_create();
+        dict_traverse(wal_index, wal_collect_ids, &c);
+        while ((key = gwlist_extract_first(c.ids)) != NULL) {
+            if ((msg = dict_get(sms_dict, key)) != NULL)
+                ticket = wal_append(msg);
+            octstr_destroy(key);
+        }
+        gwlist_destroy(c.ids, NULL);
+    }
+    mutex_unlock(file_mutex);
+
+    if (ticket > 0)
+        ret = wal_commit(ticket, wal_sync_interval >= 0);
+
+    /*
+     * Remove leading segments without live messages. The records that
+     * superseded their messages may still be buffered, so write them
+     * out first. Later records only affect later segments' counts.
+     */
+    mutex_lock(wal_write_mutex);
+    mutex_lock(file_mutex);
+    for (removable = 0; removable < gwlist_len(wal_segments); removable++) {
+        seg = gwlist_get(wal_segments, removable);
+        if (seg == wal_current || seg->live > 0)
+            break;
+    }
+    last = wal_appended;
+    mutex_unlock(file_mutex);
+
+    if (removable > 0 && wal_commit_locked(last, wal_sync_interval >= 0) == -1) {
+        ret = -1;
+        removable = 0;
+    }
+
+    mutex_lock(file_mutex);
+    while (removable-- > 0) {
+        seg = gwlist_extract_first(wal_segments);
+        debug("bb.store", 0, "Removing store segment `%s'", octstr_get_cstr(seg->name));
+        wal_segment_destroy(seg, 1);
+    }
+    mutex_unlock(file_mutex);
+    mutex_unlock(wal_write_mutex);
+
+    return ret;
+}
+
+
+/* periodic sync for sync interval > 0 */
+static void wal_sync_pending(void)
+{
+    mutex_lock(wal_write_mutex);
+    if (wal_unsynced) {
+        wal_sync(wal_current);
+        wal_unsynced = 0;
+    }
+    mutex_unlock(wal_write_mutex);
+}
+
+
+/* find segments of our store, oldest first */
+static List *wal_scan(void)
+{
+    List *segs;
+    Octstr *dir, *prefix, *name;
+    WalSegment *seg;
+    DIR *dh;
+    struct dirent *ent;
+    long pos, seq;
+
+    if ((pos = octstr_rsearch_char(filename, '/', octstr_len(filename) - 1)) == -1) {
+        dir = octstr_create(".");
+        prefix = octstr_format("%S.wal.", filename);
+    } else {
+        dir = octstr_copy(filename, 0, pos == 0 ? 1 : pos);
+        prefix = octstr_format("%S.wal.", filename);
+        octstr_delete(prefix, 0, pos + 1);
+    }
+
+    segs = gwlist_create();
+    if ((dh = opendir(octstr_get_cstr(dir))) == NULL) {
+        error(errno, "Failed to open directory '%s'", octstr_get_cstr(dir));
+    } else {
+        while ((ent = readdir(dh)) != NULL) {
+            name = octstr_create(ent->d_name);
+            if (octstr_ncompare(name, prefix, octstr_len(prefix)) == 0 &&
+                octstr_parse_long(&seq, name, octstr_len(prefix), 10) == octstr_len(name) &&
+                (seg = wal_segment_create(seq, 0)) != NULL)
+                gwlist_append(segs, seg);
+            octstr_destroy(name);
+        }
+        closedir(dh);
+    }
+    gwlist_sort(segs, wal_segment_cmp);
+
+    octstr_destroy(dir);
+    octstr_destroy(prefix);
+    return segs;
+}
+
+
+/* unpack all records of a store file into a list */
+static List *wal_unpack(Octstr *name)
+{
+    Octstr *content;
+    List *msgs;
+    Msg *msg;
+    long pos;
+
+    msgs = gwlist_create();
+    if ((content = octstr_read_file(octstr_get_cstr(name))) == NULL)
+        return msgs;
+
+    pos = 0;
+    while (pos < octstr_len(content)) {
+        if (read_msg(&msg, content, &pos) == -1) {
+            /* most likely a torn write at the end */
+            error(0, "Garbage at store segment `%s' offset %ld, rest skipped.",
+                  octstr_get_cstr(name), pos);
+            break;
+        }
+        gwlist_append(msgs, msg);
+    }
+    octstr_destroy(content);
+    return msgs;
+}
+
+
+static void wal_unpack_thread(void *arg)
+{
+    List *work = arg;
+    WalSegment *seg;
+
+    while ((seg = gwlist_consume(work)) != NULL)
+        seg->msgs = wal_unpack(seg->name);
+}
+
+
+static int wal_load(void(*receive_msg)(Msg*))
+{
+    List *segs, *work, *keys;
+    WalSegment *seg;
+    Octstr *key, *legacy;
+    Msg *msg;
+    long i, threads[WAL_LOAD_THREADS], nthreads, msgs;
+    long long ticket;
+    char id[UUID_STR_LEN + 1];
+
+    segs = wal_scan();
+    info(0, "Loading %ld store segments of `%s'", gwlist_len(segs),
+         octstr_get_cstr(filename));
+
+    /* unpack segments in parallel */
+    work = gwlist_create();
+    gwlist_add_producer(work);
+    for (i = 0; i < gwlist_len(segs); i++)
+        gwlist_produce(work, gwlist_get(segs, i));
+    nthreads = (gwlist_len(segs) < WAL_LOAD_THREADS ? gwlist_len(segs) : WAL_LOAD_THREADS);
+    for (i = 0; i < nthreads; i++) {
+        if ((threads[i] = gwthread_create(wal_unpack_thread, work)) == -1)
+            panic(0, "Failed to create a store load thread!");
+    }
+    gwlist_remove_producer(work);
+    for (i = 0; i < nthreads; i++)
+        gwthread_join(threads[i]);
+    gwlist_destroy(work, NULL);
+
+    /* a store file of the plain file mode is taken over as oldest segment */
+    if (access(octstr_get_cstr(legacy = filename), F_OK) == 0 ||
+        access(octstr_get_cstr(legacy = newfile), F_OK) == 0 ||
+        access(octstr_get_cstr(legacy = bakfile), F_OK) == 0) {
+        info(0, "Loading store file `%s'", octstr_get_cstr(legacy));
+        seg = wal_segment_create(0, 0);
+        seg->msgs = wal_unpack(legacy);
+        gwlist_insert(segs, 0, seg);
+    }
+
+    /* replay in order */
+    msgs = 0;
+    for (i = 0; i < gwlist_len(segs); i++) {
+        seg = gwlist_get(segs, i);
+        while ((msg = gwlist_extract_first(seg->msgs)) != NULL) {
+            if (msg_type(msg) == sms) {
+                store_to_dict(msg);
+                msgs++;
+            } else if (msg_type(msg) == ack) {
+                /* acks may refer to messages of already removed segments */
+                uuid_unparse(msg->ack.id, id);
+                key = octstr_create(id);
+                msg_destroy(dict_remove(sms_dict, key));
+                octstr_destroy(key);
+            } else {
+                warning(0, "Strange message in store segment, discarded, "
+                    "dump follows:");
+                msg_dump(msg, 0);
+            }
+            msg_destroy(msg);
+        }
+    }
+
+    info(0, "Retrieved %ld messages, non-acknowledged messages: %ld",
+        msgs, dict_key_count(sms_dict));
+
+    /* write a fresh segment out of messages left */
+    seg = gwlist_len(segs) > 0 ? gwlist_get(segs, gwlist_len(segs) - 1) : NULL;
+    wal_current = wal_segment_create(seg ? seg->seq + 1 : 1, 1);
+    if (wal_current == NULL) {
+        gwlist_destroy(segs, wal_segment_destroy_item);
+        return -1;
+    }
+    gwlist_append(wal_segments, wal_current);
+
+    ticket = 0;
+    keys = dict_keys(sms_dict);
+    for (i = 0; i < gwlist_len(keys); i++) {
+        if ((msg = dict_get(sms_dict, gwlist_get(keys, i))) != NULL)
+            ticket = wal_append(msg);
+    }
+    mutex_unlock(file_mutex);
+    if (wal_commit(ticket, wal_sync_interval >= 0) == -1) {
+        mutex_lock(file_mutex);
+        gwlist_destroy(keys, octstr_destroy_item);
+        gwlist_destroy(segs, wal_segment_destroy_item);
+        return -1;
+    }
+    mutex_lock(file_mutex);
+
+    /* the old segments are not needed anymore */
+    while ((seg = gwlist_extract_first(segs)) != NULL)
+        wal_segment_destroy(seg, seg->seq != 0);
+    gwlist_destroy(segs, NULL);
+    unlink(octstr_get_cstr(filename));
+    unlink(octstr_get_cstr(newfile));
+    unlink(octstr_get_cstr(bakfile));
+
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        msg = dict_remove(sms_dict, key);
+        if (store_to_dict(msg) != -1) {
+            receive_msg(msg);
+        } else {
+            error(0, "Found unknown message type in store file.");
+            msg_dump(msg, 0);
+            msg_destroy(msg);
+        }
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, octstr_destroy_item);
+
+    return 0;
+}
+
+
+static void wal_status(Octstr *ret, int status_type)
+{
+    long segments, size, i;
+    long commits, syncs;
+    double sync_avg, sync_max;
+    WalSegment *seg;
+
+    mutex_lock(wal_write_mutex);
+    commits = wal_commits;
+    syncs = wal_syncs;
+    sync_avg = (wal_syncs > 0 ? wal_sync_total / wal_syncs : 0);
+    sync_max = wal_sync_max;
+    mutex_unlock(wal_write_mutex);
+
+    mutex_lock(file_mutex);
+    segments = gwlist_len(wal_segments);
+    for (i = size = 0; i < segments; i++) {
+        seg = gwlist_get(wal_segments, i);
+        size += seg->size;
+    }
+    mutex_unlock(file_mutex);
+
+    if (status_type == BBSTATUS_HTML) {
+        octstr_format_append(ret, "<p>Write-ahead log: %ld segments, %ld bytes, "
+            "saves (%.2f,%.2f,%.2f) msg/sec, %ld commits, %ld syncs "
+            "(avg %.3f ms, max %.3f ms)</p>\n", segments, size,
+            load_get(wal_save_load, 0), load_get(wal_save_load, 1), load_get(wal_save_load, 2),
+            commits, syncs, sync_avg, sync_max);
+    } else if (status_type == BBSTATUS_XML) {
+        octstr_format_append(ret, "<wal>\n\t<segments>%ld</segments>\n\t<size>%ld</size>\n\t"
+            "<saves>%.2f,%.2f,%.2f</saves>\n\t<commits>%ld</commits>\n\t"
+            "<syncs>%ld</syncs>\n\t<sync-avg>%.3f</sync-avg>\n\t<sync-max>%.3f</sync-max>\n"
+            "</wal>\n", segments, size,
+            load_get(wal_save_load, 0), load_get(wal_save_load, 1), load_get(wal_save_load, 2),
+            commits, syncs, sync_avg, sync_max);
+    } else {
+        octstr_format_append(ret, "Write-ahead log: %ld segments, %ld bytes, "
+            "saves (%.2f,%.2f,%.2f) msg/sec, %ld commits, %ld syncs "
+            "(avg %.3f ms, max %.3f ms)\n\n", segments, size,
+            load_get(wal_save_load, 0), load_get(wal_save_load, 1), load_get(wal_save_load, 2),
+            commits, syncs, sync_avg, sync_max);
+    }
+}
+
+
 /*
  * thread to write current store to file now and then, to prevent
  * it from becoming far too big (slows startup)
@@ -214,6 +817,7 @@ static void store_dumper(void *arg)
 {
     time_t now;
     int busy = 0;
+    long slept;
 
     while (active) {
         now = time(NULL);
@@ -238,11 +842,32 @@ static void store_dumper(void *arg)
         } else {
             busy = (now - last_dict_mod) > 0;
         }
-        gwthread_sleep(dump_frequency);
+        if (wal_mode && wal_sync_interval > 0) {
+            /* sync pending writes while waiting for the next dump */
+            for (slept = 0; active && slept < dump_frequency * 1000; slept += wal_sync_interval) {
+                gwthread_sleep(wal_sync_interval / 1000.0);
+                wal_sync_pending();
+            }
+        } else
+            gwthread_sleep(dump_frequency);
     }
     store_dump();
     if (file != NULL)
        fclose(file);
+    if (wal_mode) {
+        wal_sync_pending();
+        gwlist_destroy(wal_segments, wal_segment_destroy_item);
+        dict_destroy(wal_index);
+        octstr_destroy(wal_buffer);
+        mutex_destroy(wal_write_mutex);
+        load_destroy(wal_save_load);
+        wal_segments = NULL;
+        wal_current = NULL;
+        wal_index = NULL;
+        wal_buffer = NULL;
+        wal_write_mutex = NULL;
+        wal_save_load = NULL;
+    }
     octstr_destroy(filename);
     octstr_destroy(newfile);
     octstr_destroy(bakfile);
@@ -270,6 +895,9 @@ static Octstr *store_file_status(int status_type)
 
     ret = octstr_create("");
 
+    if (wal_mode && filename != NULL)
+        wal_status(ret, status_type);
+
     /* set the type based header */
     if (status_type == BBSTATUS_HTML) {
         octstr_append_cstr(ret, "<table border=1>\n"
@@ -408,6 +1036,8 @@ static int store_to_dict(Msg *msg)
     
 static int store_file_save(Msg *msg)
 {
+    long long ticket;
+
     if (filename == NULL)
         return 0;
 
@@ -420,6 +1050,13 @@ static int store_file_save(Msg *msg)
         mutex_unlock(file_mutex);
         return -1;
     }
+
+    if (wal_mode) {
+        ticket = wal_append(msg);
+        mutex_unlock(file_mutex);
+        load_increase(wal_save_load);
+        return wal_commit(ticket, wal_sync_interval == 0);
+    }
     
     /* write to file, too */
     write_msg(msg);
@@ -469,6 +1106,11 @@ static int store_file_load(void(*receive_msg)(Msg*))
         return 0;
 
     mutex_lock(file_mutex);
+    if (wal_mode) {
+        retval = wal_load(receive_msg);
+        goto end;
+    }
+
     if (file != NULL) {
         fclose(file);
         file = NULL;
@@ -560,6 +1202,9 @@ static int store_file_dump(void)
 {
     int retval;
 
+    if (wal_mode)
+        return wal_checkpoint();
+
     debug("bb.store", 0, "Dumping %ld messages to store",
 	  dict_key_count(sms_dict));
     mutex_lock(file_mutex);
@@ -589,7 +1234,7 @@ static void store_file_shutdown(void)
 }
 
 
-int store_file_init(const Octstr *fname, long dump_freq)
+int store_file_init(const Octstr *fname, long dump_freq, int wal, long sync_interval)
 {
     /* Initialize function pointers */
     store_messages = store_file_messages;
@@ -621,6 +1266,19 @@ int store_file_init(const Octstr *fname, long dump_freq)
     file_mutex = mutex_create();
     active = 1;
 
+    wal_mode = wal;
+    if (wal_mode) {
+        wal_sync_interval = sync_interval;
+        wal_segments = gwlist_create();
+        wal_index = dict_create(1024, NULL);
+        wal_buffer = octstr_create("");
+        wal_write_mutex = mutex_create();
+        wal_save_load = load_create();
+        load_add_interval(wal_save_load, 60);
+        load_add_interval(wal_save_load, 300);
+        load_add_interval(wal_save_load, -1);
+    }
+
     loaded = gwlist_create();
     gwlist_add_producer(loaded);
 
@@ -0,0 +1,943 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/**
+ * bb_store_segment.c - bearerbox box SMS storage/retrieval module using
+ * append-only segment files in a spool directory
+ *
+ * Messages and acks are appended as records to numbered segment files
+ * (<store-location>/<seq>.seg). Only an index of the live message ids,
+ * pointing to their records, is kept in memory. Each record starts with
+ * the record type and the message id, so the index is rebuilt on load
+ * without unpacking the messages. Segments whose messages are all
+ * acknowledged are removed; live messages of mostly acknowledged
+ * segments are copied to the current segment first (compaction).
+ *
+ * Segments are only removed from the front, so an ack record never
+ * outlives the message record it refers to.
+ */
+
+#include "gw-config.h"
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "gwlib/gwlib.h"
+#include "msg.h"
+#include "sms.h"
+#include "bearerbox.h"
+#include "bb_store.h"
+
+
+/* segment size after which a new one is started */
+#define SEGMENT_SIZE (16 * 1024 * 1024)
+/* segments allowed beyond twice what the live messages need, before the
+ * oldest one is compacted regardless of its use */
+#define MAX_SEGMENTS 4
+/* record header: payload length, type, message id */
+#define RECORD_HEADER (4 + 1 + 16)
+#define RECORD_SMS 'S'
+#define RECORD_ACK 'A'
+/* initial size of the index */
+#define INDEX_SIZE 1024
+
+typedef struct {
+    long seq;
+    Octstr *name;
+    int fd;         /* -1 if not the current segment */
+    long size;
+    long saved;     /* sms records */
+    long live;      /* of these, still not acknowledged */
+} Segment;
+
+typedef struct IndexEntry IndexEntry;
+struct IndexEntry {
+    uuid_t id;
+    Segment *seg;
+    long offset;    /* of the record within seg */
+    long len;       /* of the whole record */
+    IndexEntry *next;
+};
+
+static Octstr *spool;
+static List *loaded;
+/* oldest first; everything below guarded by store_mutex */
+static List *segments;
+static Segment *current;
+static Mutex *store_mutex;
+static IndexEntry **index_tab;
+static unsigned long index_size;
+static unsigned long index_count;
+
+/* compaction thread */
+static Mutex *compact_mutex;
+static long compact_thread = -1;
+static long compact_frequency;
+static volatile sig_atomic_t active;
+
+
+/*------------------------------------------------------
+ * index of live messages
+ */
+
+static unsigned long index_hash(const uuid_t id)
+{
+    unsigned long h = 2166136261UL;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        h = (h ^ id[i]) * 16777619UL;
+    return h;
+}
+
+
+static IndexEntry *index_find(const uuid_t id)
+{
+    IndexEntry *e;
+
+    for (e = index_tab[index_hash(id) & (index_size - 1)]; e != NULL; e = e->next) {
+        if (uuid_compare(e->id, id) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+
+static void index_grow(void)
+{
+    IndexEntry **tab, *e, *next;
+    unsigned long i, size;
+
+    size = index_size * 2;
+    tab = gw_malloc(sizeof(*tab) * size);
+    memset(tab, 0, sizeof(*tab) * size);
+    for (i = 0; i < index_size; i++) {
+        for (e = index_tab[i]; e != NULL; e = next) {
+            next = e->next;
+            e->next = tab[index_hash(e->id) & (size - 1)];
+            tab[index_hash(e->id) & (size - 1)] = e;
+        }
+    }
+    gw_free(index_tab);
+    index_tab = tab;
+    index_size = size;
+}
+
+
+/* point id to the given record, return the entry */
+static IndexEntry *index_put(const uuid_t id, Segment *seg, long offset, long len)
+{
+    IndexEntry *e;
+    unsigned long i;
+
+    if ((e = index_find(id)) != NULL) {
+        e->seg->live--;
+    } else {
+        if (index_count >= index_size)
+            index_grow();
+        e = gw_malloc(sizeof(*e));
+        uuid_copy(e->id, id);
+        i = index_hash(id) & (index_size - 1);
+        e->next = index_tab[i];
+        index_tab[i] = e;
+        index_count++;
+    }
+    e->seg = seg;
+    e->offset = offset;
+    e->len = len;
+    seg->saved++;
+    seg->live++;
+    return e;
+}
+
+
+/* remove id from index, return 0 if found */
+static int index_remove(const uuid_t id)
+{
+    IndexEntry **p, *e;
+
+    for (p = &index_tab[index_hash(id) & (index_size - 1)]; (e = *p) != NULL; p = &e->next) {
+        if (uuid_compare(e->id, id) == 0) {
+            *p = e->next;
+            e->seg->live--;
+            gw_free(e);
+            index_count--;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/* is record at offset of seg the live one for id? */
+static int index_is_live(const uuid_t id, Segment *seg, long offset)
+{
+    IndexEntry *e = index_find(id);
+
+    return e != NULL && e->seg == seg && e->offset == offset;
+}
+
+
+/*------------------------------------------------------
+ * segment files
+ */
+
+static Segment *segment_create(long seq, int do_open)
+{
+    Segment *seg;
+
+    seg = gw_malloc(sizeof(*seg));
+    seg->seq = seq;
+    seg->name = octstr_format("%S/%08ld.seg", spool, seq);
+    seg->fd = -1;
+    seg->size = seg->saved = seg->live = 0;
+
+    if (do_open) {
+        seg->fd = open(octstr_get_cstr(seg->name), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                       S_IRUSR | S_IWUSR);
+        if (seg->fd == -1) {
+            error(errno, "Could not open file `%s'.", octstr_get_cstr(seg->name));
+            octstr_destroy(seg->name);
+            gw_free(seg);
+            return NULL;
+        }
+    }
+    return seg;
+}
+
+
+static void segment_destroy(Segment *seg, int remove)
+{
+    if (seg == NULL)
+        return;
+    if (seg->fd != -1)
+        close(seg->fd);
+    if (remove && unlink(octstr_get_cstr(seg->name)) == -1)
+        error(errno, "Could not unlink file `%s'.", octstr_get_cstr(seg->name));
+    octstr_destroy(seg->name);
+    gw_free(seg);
+}
+
+
+static void segment_destroy_item(void *seg)
+{
+    segment_destroy(seg, 0);
+}
+
+
+static int segment_cmp(const void *a, const void *b)
+{
+    const Segment *sa = *(Segment**) a, *sb = *(Segment**) b;
+
+    return (sa->seq > sb->seq) - (sa->seq < sb->seq);
+}
+
+
+/*
+ * Parse record header at offset. Return length of the whole record or
+ * -1 if there is no complete record.
+ */
+static long record_parse(Octstr *os, long offset, int *type, uuid_t id)
+{
+    unsigned char buf[4];
+    long len;
+
+    if (offset + RECORD_HEADER > octstr_len(os))
+        return -1;
+    octstr_get_many_chars((char*) buf, os, offset, 4);
+    len = decode_network_long(buf);
+    if (len < 0 || offset + RECORD_HEADER + len > octstr_len(os))
+        return -1;
+    *type = octstr_get_char(os, offset + 4);
+    octstr_get_many_chars((char*) id, os, offset + 5, 16);
+    return RECORD_HEADER + len;
+}
+
+
+static Octstr *record_create(int type, const uuid_t id, Octstr *payload)
+{
+    unsigned char buf[4];
+    Octstr *os;
+
+    encode_network_long(buf, payload ? octstr_len(payload) : 0);
+    os = octstr_create_from_data((char*) buf, 4);
+    octstr_append_char(os, type);
+    octstr_append_data(os, (const char*) id, 16);
+    if (payload != NULL)
+        octstr_append(os, payload);
+    return os;
+}
+
+
+static Msg *record_unpack(Octstr *os, long offset, long len)
+{
+    Octstr *pack;
+    Msg *msg;
+
+    pack = octstr_copy(os, offset + RECORD_HEADER, len - RECORD_HEADER);
+    msg = store_msg_unpack(pack);
+    octstr_destroy(pack);
+    return msg;
+}
+
+
+static int write_all(int fd, Octstr *os)
+{
+    const char *data = octstr_get_cstr(os);
+    long len = octstr_len(os);
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/*
+ * Append data to the current segment, start a new one if full.
+ * Return offset of data within the segment written to, which is
+ * stored in seg, or -1 on error.
+ * NOTE: caller must hold store_mutex
+ */
+static long segment_append(Octstr *data, Segment **seg)
+{
+    Segment *next;
+    long offset;
+
+    if (write_all(current->fd, data) == -1) {
+        error(errno, "Could not write to `%s'.", octstr_get_cstr(current->name));
+        return -1;
+    }
+    *seg = current;
+    offset = current->size;
+    current->size += octstr_len(data);
+
+    if (current->size >= SEGMENT_SIZE &&
+        (next = segment_create(current->seq + 1, 1)) != NULL) {
+        close(current->fd);
+        current->fd = -1;
+        gwlist_append(segments, next);
+        current = next;
+    }
+    return offset;
+}
+
+
+/* NOTE: caller must hold store_mutex */
+static Segment *segment_find(long seq)
+{
+    Segment *seg;
+    long i;
+
+    for (i = 0; i < gwlist_len(segments); i++) {
+        seg = gwlist_get(segments, i);
+        if (seg->seq == seq)
+            return seg;
+    }
+    return NULL;
+}
+
+
+/* find segment files, oldest first */
+static List *segment_scan(void)
+{
+    List *segs;
+    Segment *seg;
+    Octstr *name;
+    DIR *dir;
+    struct dirent *ent;
+    long seq, pos;
+
+    segs = gwlist_create();
+    if ((dir = opendir(octstr_get_cstr(spool))) == NULL) {
+        error(errno, "Could not open directory `%s'", octstr_get_cstr(spool));
+        return segs;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        name = octstr_create(ent->d_name);
+        pos = octstr_parse_long(&seq, name, 0, 10);
+        if (pos > 0 && pos == octstr_len(name) - 4 &&
+            octstr_str_compare(name, ent->d_name) == 0 &&
+            strcmp(ent->d_name + pos, ".seg") == 0) {
+            seg = segment_create(seq, 0);
+            gwlist_append(segs, seg);
+        }
+        octstr_destroy(name);
+    }
+    closedir(dir);
+    gwlist_sort(segs, segment_cmp);
+
+    return segs;
+}
+
+
+/*
+ * Copy live messages of the oldest segment to the current one if it is
+ * mostly acknowledged, or if it holds back the removal of many more
+ * segments than the live messages need, and remove leading segments
+ * without live messages.
+ */
+static int segment_compact(void)
+{
+    Segment *seg, *to;
+    Octstr *content, *batch;
+    List *moved;
+    IndexEntry *e;
+    uuid_t id;
+    long offset, len, i, needed;
+    double live_size = 0;
+    int type, ret = 0;
+
+    mutex_lock(compact_mutex);
+
+    mutex_lock(store_mutex);
+    while ((seg = gwlist_get(segments, 0)) != current && seg->live == 0) {
+        debug("bb.store", 0, "Removing store segment `%s'", octstr_get_cstr(seg->name));
+        gwlist_delete(segments, 0, 1);
+        segment_destroy(seg, 1);
+    }
+    for (i = 0; i < gwlist_len(segments); i++) {
+        to = gwlist_get(segments, i);
+        if (to->saved > 0)
+            live_size += (double) to->size * to->live / to->saved;
+    }
+    needed = live_size / SEGMENT_SIZE + 1;
+    if (seg == current || (seg->live * 2 > seg->saved &&
+                           gwlist_len(segments) <= 2 * needed + MAX_SEGMENTS)) {
+        mutex_unlock(store_mutex);
+        mutex_unlock(compact_mutex);
+        return 0;
+    }
+    mutex_unlock(store_mutex);
+
+    /* closed segments don't change anymore, read it without lock */
+    if ((content = octstr_read_file(octstr_get_cstr(seg->name))) == NULL) {
+        mutex_unlock(compact_mutex);
+        return -1;
+    }
+
+    debug("bb.store", 0, "Compacting store segment `%s' with %ld live messages",
+          octstr_get_cstr(seg->name), seg->live);
+
+    mutex_lock(store_mutex);
+    batch = octstr_create("");
+    moved = gwlist_create();
+    for (offset = 0; (len = record_parse(content, offset, &type, id)) != -1; offset += len) {
+        if (type == RECORD_SMS && index_is_live(id, seg, offset)) {
+            gwlist_append(moved, index_find(id));
+            octstr_append_data(batch, octstr_get_cstr(content) + offset, len);
+        }
+    }
+    /* copy all at once, then point the index to the copies */
+    if (octstr_len(batch) > 0) {
+        if ((offset = segment_append(batch, &to)) == -1) {
+            ret = -1;
+        } else {
+            while ((e = gwlist_extract_first(moved)) != NULL) {
+                e->seg->live--;
+                e->seg = to;
+                e->offset = offset;
+                to->saved++;
+                to->live++;
+                offset += e->len;
+            }
+        }
+    }
+    if (ret == 0 && seg->live == 0) {
+        gwlist_delete_equal(segments, seg);
+        segment_destroy(seg, 1);
+    }
+    mutex_unlock(store_mutex);
+
+    gwlist_destroy(moved, NULL);
+    octstr_destroy(batch);
+    octstr_destroy(content);
+    mutex_unlock(compact_mutex);
+
+    return ret;
+}
+
+
+static void compactor(void *arg)
+{
+    while (active) {
+        gwthread_sleep(compact_frequency);
+        segment_compact();
+    }
+}
+
+
+/*------------------------------------------------------
+ * store interface
+ */
+
+static int store_segment_dump(void)
+{
+    if (spool == NULL || current == NULL)
+        return 0;
+    return segment_compact();
+}
+
+
+static long store_segment_messages(void)
+{
+    long ret;
+
+    if (spool == NULL)
+        return -1;
+    mutex_lock(store_mutex);
+    ret = index_count;
+    mutex_unlock(store_mutex);
+    return ret;
+}
+
+
+/*
+ * Call cb for every live message of the store, segment by segment.
+ * Messages are unpacked without holding the lock.
+ */
+static void for_each_msg(void(*cb)(Msg*, void*), void *data)
+{
+    List *seqs, *offsets;
+    Segment *seg;
+    Octstr *name, *content;
+    Msg *msg;
+    uuid_t id;
+    long i, offset, len, *pos, *p;
+    int type;
+
+    mutex_lock(store_mutex);
+    seqs = gwlist_create();
+    for (i = 0; i < gwlist_len(segments); i++) {
+        seg = gwlist_get(segments, i);
+        pos = gw_malloc(sizeof(*pos));
+        *pos = seg->seq;
+        gwlist_append(seqs, pos);
+    }
+    mutex_unlock(store_mutex);
+
+    while ((pos = gwlist_extract_first(seqs)) != NULL) {
+        name = octstr_format("%S/%08ld.seg", spool, *pos);
+        /* may have been removed meanwhile, its messages are elsewhere then */
+        content = octstr_read_file(octstr_get_cstr(name));
+
+        /* find live records, unpack them outside of the lock */
+        offsets = gwlist_create();
+        mutex_lock(store_mutex);
+        seg = segment_find(*pos);
+        for (offset = 0; seg != NULL && content != NULL &&
+             (len = record_parse(content, offset, &type, id)) != -1; offset += len) {
+            if (type == RECORD_SMS && index_is_live(id, seg, offset)) {
+                p = gw_malloc(sizeof(*p) * 2);
+                p[0] = offset;
+                p[1] = len;
+                gwlist_append(offsets, p);
+            }
+        }
+        mutex_unlock(store_mutex);
+        gw_free(pos);
+
+        while ((pos = gwlist_extract_first(offsets)) != NULL) {
+            if ((msg = record_unpack(content, pos[0], pos[1])) != NULL)
+                cb(msg, data);
+            else
+                error(0, "Could not unpack message at `%s' offset %ld.",
+                      octstr_get_cstr(name), pos[0]);
+            gw_free(pos);
+        }
+        gwlist_destroy(offsets, NULL);
+        octstr_destroy(content);
+        octstr_destroy(name);
+    }
+    gwlist_destroy(seqs, NULL);
+}
+
+
+struct status {
+    const char *format;
+    Octstr *status;
+};
+
+
+static void status_cb(Msg *msg, void *d)
+{
+    struct status *data = d;
+    struct tm tm;
+    char id[UUID_STR_LEN + 1];
+
+    /* transform the time value */
+#if LOG_TIMESTAMP_LOCALTIME
+    tm = gw_localtime(msg->sms.time);
+#else
+    tm = gw_gmtime(msg->sms.time);
+#endif
+    if (msg->sms.udhdata)
+        octstr_binary_to_hex(msg->sms.udhdata, 1);
+    if (msg->sms.msgdata &&
+        (msg->sms.coding == DC_8BIT || msg->sms.coding == DC_UCS2 ||
+        (msg->sms.coding == DC_UNDEF && msg->sms.udhdata)))
+        octstr_binary_to_hex(msg->sms.msgdata, 1);
+
+    uuid_unparse(msg->sms.id, id);
+
+    octstr_format_append(data->status, data->format,
+        id,
+        (msg->sms.sms_type == mo ? "MO" :
+        msg->sms.sms_type == mt_push ? "MT-PUSH" :
+        msg->sms.sms_type == mt_reply ? "MT-REPLY" :
+        msg->sms.sms_type == report_mo ? "DLR-MO" :
+        msg->sms.sms_type == report_mt ? "DLR-MT" : ""),
+        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+        tm.tm_hour, tm.tm_min, tm.tm_sec,
+        (msg->sms.sender ? octstr_get_cstr(msg->sms.sender) : ""),
+        (msg->sms.receiver ? octstr_get_cstr(msg->sms.receiver) : ""),
+        (msg->sms.smsc_id ? octstr_get_cstr(msg->sms.smsc_id) : ""),
+        (msg->sms.boxc_id ? octstr_get_cstr(msg->sms.boxc_id) : ""),
+        (msg->sms.udhdata ? octstr_get_cstr(msg->sms.udhdata) : ""),
+        (msg->sms.msgdata ? octstr_get_cstr(msg->sms.msgdata) : ""));
+
+    msg_destroy(msg);
+}
+
+
+static Octstr *store_segment_status(int status_type)
+{
+    Octstr *ret = octstr_create("");
+    const char *format;
+    struct status data;
+
+    /* check if we are active */
+    if (spool == NULL)
+        return ret;
+
+    /* set the type based header */
+    if (status_type == BBSTATUS_HTML) {
+        octstr_append_cstr(ret, "<table border=1>\n"
+            "<tr><td>SMS ID</td><td>Type</td><td>Time</td><td>Sender</td><td>Receiver</td>"
+            "<td>SMSC ID</td><td>BOX ID</td><td>UDH</td><td>Message</td>"
+            "</tr>\n");
+
+        format = "<tr><td>%s</td><td>%s</td>"
+                "<td>%04d-%02d-%02d %02d:%02d:%02d</td>"
+                "<td>%s</td><td>%s</td><td>%s</td>"
+                "<td>%s</td><td>%s</td><td>%s</td></tr>\n";
+    } else if (status_type == BBSTATUS_XML) {
+        format = "<message>\n\t<id>%s</id>\n\t<type>%s</type>\n\t"
+                "<time>%04d-%02d-%02d %02d:%02d:%02d</time>\n\t"
+                "<sender>%s</sender>\n\t"
+                "<receiver>%s</receiver>\n\t<smsc-id>%s</smsc-id>\n\t"
+                "<box-id>%s</box-id>\n\t"
+                "<udh-data>%s</udh-data>\n\t<msg-data>%s</msg-data>\n\t"
+                "</message>\n";
+    } else {
+        octstr_append_cstr(ret, "[SMS ID] [Type] [Time] [Sender] [Receiver] [SMSC ID] [BOX ID] [UDH] [Message]\n");
+        format = "[%s] [%s] [%04d-%02d-%02d %02d:%02d:%02d] [%s] [%s] [%s] [%s] [%s] [%s]\n";
+    }
+
+    data.format = format;
+    data.status = ret;
+    for_each_msg(status_cb, &data);
+
+    /* set the type based footer */
+    if (status_type == BBSTATUS_HTML) {
+        octstr_append_cstr(ret,"</table>");
+    }
+
+    return ret;
+}
+
+
+static void dispatch(Msg *msg, void *data)
+{
+    void(*receive_msg)(Msg*) = data;
+
+    receive_msg(msg);
+}
+
+
+static int store_segment_load(void(*receive_msg)(Msg*))
+{
+    List *segs;
+    Segment *seg;
+    Octstr *content;
+    uuid_t id;
+    long i, offset, len, records;
+    int type;
+
+    /* check if we are active */
+    if (spool == NULL)
+        return 0;
+
+    /* sanity check */
+    if (receive_msg == NULL)
+        return -1;
+
+    /* rebuild index from record headers */
+    segs = segment_scan();
+    records = 0;
+    mutex_lock(store_mutex);
+    for (i = 0; i < gwlist_len(segs); i++) {
+        seg = gwlist_get(segs, i);
+        if ((content = octstr_read_file(octstr_get_cstr(seg->name))) == NULL)
+            continue;
+        for (offset = 0; (len = record_parse(content, offset, &type, id)) != -1; offset += len) {
+            if (type == RECORD_SMS)
+                index_put(id, seg, offset, len);
+            else if (type == RECORD_ACK)
+                index_remove(id);
+            records++;
+        }
+        if (offset < octstr_len(content))
+            error(0, "Garbage at `%s' offset %ld, rest skipped.",
+                  octstr_get_cstr(seg->name), offset);
+        seg->size = offset;
+        octstr_destroy(content);
+        gwlist_append(segments, seg);
+    }
+    gwlist_destroy(segs, NULL);
+
+    /* always continue in a new segment */
+    seg = gwlist_len(segments) > 0 ? gwlist_get(segments, gwlist_len(segments) - 1) : NULL;
+    if ((current = segment_create(seg ? seg->seq + 1 : 1, 1)) == NULL) {
+        mutex_unlock(store_mutex);
+        return -1;
+    }
+    gwlist_append(segments, current);
+    mutex_unlock(store_mutex);
+
+    info(0, "Read %ld records from %ld store segments, %ld messages to load.",
+         records, gwlist_len(segments) - 1, store_segment_messages());
+
+    for_each_msg(dispatch, receive_msg);
+
+    info(0, "Loaded %ld messages from store.", store_segment_messages());
+
+    /* allow using of storage */
+    gwlist_remove_producer(loaded);
+
+    /* start compaction thread */
+    if ((compact_thread = gwthread_create(compactor, NULL)) == -1)
+        panic(0, "Failed to create a store compaction thread!");
+
+    return 0;
+}
+
+
+static int store_segment_save(Msg *msg)
+{
+    Segment *seg;
+    Octstr *os, *record;
+    long offset;
+    char id[UUID_STR_LEN + 1];
+
+    /* always set msg id and timestamp */
+    if (msg_type(msg) == sms && uuid_is_null(msg->sms.id))
+        uuid_generate(msg->sms.id);
+
+    if (msg_type(msg) == sms && msg->sms.time == MSG_PARAM_UNDEFINED)
+        time(&msg->sms.time);
+
+    if (spool == NULL)
+        return 0;
+
+    /* block here if store still not loaded */
+    gwlist_consume(loaded);
+
+    switch(msg_type(msg)) {
+        case sms:
+            if ((os = store_msg_pack(msg)) == NULL) {
+                error(0, "Could not pack message.");
+                return -1;
+            }
+            record = record_create(RECORD_SMS, msg->sms.id, os);
+            octstr_destroy(os);
+            mutex_lock(store_mutex);
+            if ((offset = segment_append(record, &seg)) == -1) {
+                mutex_unlock(store_mutex);
+                octstr_destroy(record);
+                return -1;
+            }
+            index_put(msg->sms.id, seg, offset, octstr_len(record));
+            mutex_unlock(store_mutex);
+            octstr_destroy(record);
+            break;
+
+        case ack:
+            record = record_create(RECORD_ACK, msg->ack.id, NULL);
+            mutex_lock(store_mutex);
+            if (index_remove(msg->ack.id) == -1) {
+                mutex_unlock(store_mutex);
+                octstr_destroy(record);
+                uuid_unparse(msg->ack.id, id);
+                error(0, "Could not find message `%s' in store.", id);
+                return -1;
+            }
+            offset = segment_append(record, &seg);
+            mutex_unlock(store_mutex);
+            octstr_destroy(record);
+            if (offset == -1)
+                return -1;
+            break;
+
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int store_segment_save_ack(Msg *msg, ack_status_t status)
+{
+    int ret;
+    Msg *nack = msg_create(ack);
+
+    nack->ack.nack = status;
+    uuid_copy(nack->ack.id, msg->sms.id);
+    nack->ack.time = msg->sms.time;
+    ret = store_segment_save(nack);
+    msg_destroy(nack);
+
+    return ret;
+}
+
+
+static void store_segment_shutdown(void)
+{
+    IndexEntry *e, *next;
+    unsigned long i;
+
+    if (spool == NULL)
+        return;
+
+    active = 0;
+    if (compact_thread != -1) {
+        gwthread_wakeup(compact_thread);
+        gwthread_join(compact_thread);
+    }
+
+    for (i = 0; i < index_size; i++) {
+        for (e = index_tab[i]; e != NULL; e = next) {
+            next = e->next;
+            gw_free(e);
+        }
+    }
+    gw_free(index_tab);
+    index_tab = NULL;
+    index_size = index_count = 0;
+
+    gwlist_destroy(segments, segment_destroy_item);
+    segments = NULL;
+    current = NULL;
+    mutex_destroy(store_mutex);
+    mutex_destroy(compact_mutex);
+    octstr_destroy(spool);
+    spool = NULL;
+    gwlist_destroy(loaded, NULL);
+}
+
+
+int store_segment_init(const Octstr *store_dir, long dump_freq)
+{
+    DIR *dir;
+
+    store_messages = store_segment_messages;
+    store_save = store_segment_save;
+    store_save_ack = store_segment_save_ack;
+    store_load = store_segment_load;
+    store_dump = store_segment_dump;
+    store_shutdown = store_segment_shutdown;
+    store_status = store_segment_status;
+
+    if (store_dir == NULL)
+        return 0;
+
+    /* check if we can open directory */
+    if ((dir = opendir(octstr_get_cstr(store_dir))) == NULL) {
+        error(errno, "Could not open directory `%s'", octstr_get_cstr(store_dir));
+        return -1;
+    }
+    closedir(dir);
+
+    loaded = gwlist_create();
+    gwlist_add_producer(loaded);
+    spool = octstr_duplicate(store_dir);
+    segments = gwlist_create();
+    current = NULL;
+    store_mutex = mutex_create();
+    compact_mutex = mutex_create();
+    index_size = INDEX_SIZE;
+    index_tab = gw_malloc(sizeof(*index_tab) * index_size);
+    memset(index_tab, 0, sizeof(*index_tab) * index_size);
+    index_count = 0;
+    compact_frequency = (dump_freq > 0 ? dump_freq : BB_STORE_DEFAULT_DUMP_FREQ);
+    active = 1;
+
+    return 0;
+}
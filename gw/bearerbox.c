@@ -370,7 +370,7 @@ static Cfg *init_bearerbox(Cfg *cfg)
 {
     CfgGroup *grp;
     Octstr *log, *val;
-    long loglevel, store_dump_freq, value;
+    long loglevel, store_dump_freq, store_sync_interval, value;
     int lf, m;
 #ifdef HAVE_LIBSSL
     Octstr *ssl_server_cert_file;
@@ -414,6 +414,13 @@ static Cfg *init_bearerbox(Cfg *cfg)
         log_set_syslog(NULL, 0);
     }
 
+    /* write log lines from a separate thread */
+    if (cfg_get_integer(&value, grp, octstr_imm("log-async-buffer")) == 0 && value > 0) {
+        int drop = 0;
+        cfg_get_bool(&drop, grp, octstr_imm("log-async-drop"));
+        log_set_async(value, drop);
+    }
+
     if (check_config(cfg) == -1)
         panic(0, "Cannot start with corrupted configuration");
 
@@ -451,7 +458,11 @@ static Cfg *init_bearerbox(Cfg *cfg)
         log = cfg_get(grp, octstr_imm("store-location"));
         val = cfg_get(grp, octstr_imm("store-type"));
     }
-    if (store_init(val, log, store_dump_freq, msg_pack, msg_unpack_wrapper) == -1)
+    if (cfg_get_integer(&store_sync_interval, grp,
+                           octstr_imm("store-sync-interval")) == -1)
+        store_sync_interval = -1;
+    if (store_init(val, log, store_dump_freq, store_sync_interval,
+                   msg_pack, msg_unpack_wrapper) == -1)
         panic(0, "Could not start with store init failed.");
     octstr_destroy(val);
     octstr_destroy(log);
@@ -967,11 +978,13 @@ Octstr *bb_print_status(int status_type)
     char *frmt, *footer;
     Octstr *ret, *str, *version;
     time_t t;
+    long concat_pending, concat_combined, concat_timedout;
 
     if ((lb = bb_status_linebreak(status_type)) == NULL)
         return octstr_create("Un-supported format");
 
     t = time(NULL) - start_time;
+    smsc2_concat_status(&concat_pending, &concat_combined, &concat_timedout);
     
     if (bb_status == BB_RUNNING)
         s = "running";
@@ -993,6 +1006,7 @@ Octstr *bb_print_status(int status_type)
                "(%ld queued)</p>\n\n"
                " <p>SMS: received %ld (%ld queued), sent %ld "
                "(%ld queued), store size %ld<br>\n"
+               " SMS: concatenated MO %ld pending, %ld combined, %ld timed out<br>\n"
                " SMS: inbound (%.2f,%.2f,%.2f) msg/sec, "
                "outbound (%.2f,%.2f,%.2f) msg/sec</p>\n\n"
                " <p>DLR: received %ld, sent %ld<br>\n"
@@ -1007,6 +1021,7 @@ Octstr *bb_print_status(int status_type)
                "   <p>SMS: received %ld (%ld queued)<br/>\n"
                "      SMS: sent %ld (%ld queued)<br/>\n"
                "      SMS: store size %ld<br/>\n"
+               "      SMS: concatenated MO %ld pending, %ld combined, %ld timed out<br/>\n"
                "      SMS: inbound (%.2f,%.2f,%.2f) msg/sec<br/>\n"
                "      SMS: outbound (%.2f,%.2f,%.2f) msg/sec</p>\n"
                "   <p>DLR: received %ld<br/>\n"
@@ -1025,6 +1040,8 @@ Octstr *bb_print_status(int status_type)
                "\t<sms>\n\t\t<received><total>%ld</total><queued>%ld</queued>"
                "</received>\n\t\t<sent><total>%ld</total><queued>%ld</queued>"
                "</sent>\n\t\t<storesize>%ld</storesize>\n\t\t"
+               "<concatenated><pending>%ld</pending><combined>%ld</combined>"
+               "<timedout>%ld</timedout></concatenated>\n\t\t"
                "<inbound>%.2f,%.2f,%.2f</inbound>\n\t\t"
                "<outbound>%.2f,%.2f,%.2f</outbound>\n\t\t"
                "</sms>\n"
@@ -1038,6 +1055,7 @@ Octstr *bb_print_status(int status_type)
         frmt = "%s\n\nStatus: %s, uptime %ldd %ldh %ldm %lds\n\n"
                "WDP: received %ld (%ld queued), sent %ld (%ld queued)\n\n"
                "SMS: received %ld (%ld queued), sent %ld (%ld queued), store size %ld\n"
+               "SMS: concatenated MO %ld pending, %ld combined, %ld timed out\n"
                "SMS: inbound (%.2f,%.2f,%.2f) msg/sec, "
                "outbound (%.2f,%.2f,%.2f) msg/sec\n\n"
                "DLR: received %ld, sent %ld\n"
@@ -1053,8 +1071,9 @@ Octstr *bb_print_status(int status_type)
         gwlist_len(incoming_wdp) + boxc_incoming_wdp_queue(),
         counter_value(outgoing_wdp_counter), gwlist_len(outgoing_wdp) + udp_outgoing_queue(),
         counter_value(incoming_sms_counter), gwlist_len(incoming_sms),
-        counter_value(outgoing_sms_counter), gwlist_len(outgoing_sms),
+        counter_value(outgoing_sms_counter), smsc2_outgoing_queue(),
         store_messages(),
+        concat_pending, concat_combined, concat_timedout,
         load_get(incoming_sms_load,0), load_get(incoming_sms_load,1), load_get(incoming_sms_load,2),
         load_get(outgoing_sms_load,0), load_get(outgoing_sms_load,1), load_get(outgoing_sms_load,2),
         counter_value(incoming_dlr_counter), counter_value(outgoing_dlr_counter),
@@ -1064,6 +1083,7 @@ Octstr *bb_print_status(int status_type)
 
     octstr_destroy(version);
     
+    append_status(ret, str, dlr_status, status_type);
     append_status(ret, str, boxc_status, status_type);
     append_status(ret, str, smsc2_status, status_type);
     octstr_append_cstr(ret, footer);
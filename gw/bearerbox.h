@@ -157,6 +157,10 @@ int smsc2_shutdown(void);
 void smsc2_cleanup(void); /* final clean-up */
 
 Octstr *smsc2_status(int status_type);
+/* tell total number of outgoing messages waiting for routing */
+long smsc2_outgoing_queue(void);
+/* tell number of concatenated MO messages waiting for parts, combined and timed out */
+void smsc2_concat_status(long *pending, long *completed, long *timedout);
 
 /* function to route outgoing SMS'es
  *
@@ -89,6 +89,7 @@
 
 #include "gwlib/gwlib.h"
 #include "sms.h"
+#include "bearerbox.h"
 #include "dlr.h"
 #include "dlr_p.h"
 
@@ -224,6 +225,467 @@ void dlr_db_fields_destroy(struct dlr_db_fields *fields)
     gw_free(fields);
 }
 
+static int dlr_key_equal(const struct dlr_entry *a, const struct dlr_entry *b)
+{
+    if (octstr_compare(a->smsc, b->smsc) != 0 ||
+        octstr_compare(a->timestamp, b->timestamp) != 0)
+        return 0;
+    if (a->destination == NULL || b->destination == NULL)
+        return a->destination == b->destination;
+
+    return octstr_compare(a->destination, b->destination) == 0;
+}
+
+long dlr_key_repeats(List *keys, long from, long count, long pos)
+{
+    struct dlr_entry *key;
+    long i, n;
+
+    key = gwlist_get(keys, pos);
+    for (i = from; i < pos; i++) {
+        if (dlr_key_equal(gwlist_get(keys, i), key))
+            return 0;
+    }
+    for (n = 1, i = pos + 1; i < from + count; i++) {
+        if (dlr_key_equal(gwlist_get(keys, i), key))
+            n++;
+    }
+
+    return n;
+}
+
+/*
+ * Asynchronous DLR writer.
+ *
+ * With 'dlr-batch-size' set, dlr_add() and the removes and updates done by
+ * dlr_find() only queue the operation. A writer thread applies the queue in
+ * order, handing runs of adds and removes to the storage in batches. Adds
+ * that are not written yet are kept in a read-through cache, so dlr_find()
+ * sees them, and a remove of such an add simply cancels it.
+ */
+enum { DLR_OP_ADD, DLR_OP_REMOVE, DLR_OP_UPDATE };
+
+struct dlr_op {
+    int type;
+    struct dlr_entry *entry;    /* full entry for adds, key for the others */
+    Octstr *key;
+    int status;                 /* new status for updates */
+    int cancelled;              /* removed again before written */
+    int written;                /* handed to the storage already */
+};
+
+static List *writer_queue = NULL;
+static Dict *writer_adds = NULL;       /* smsc+ts -> List of pending adds */
+static Dict *writer_removes = NULL;    /* smsc+ts+dst -> pending remove */
+static Mutex *writer_lock = NULL;
+static long writer_thread = -1;
+static long writer_pending = 0;        /* adds not written yet */
+static long writer_max = 0;            /* largest batch so far */
+static Counter *writer_batches = NULL;
+static Counter *writer_written = NULL;
+static Counter *writer_cancelled = NULL;
+static long batch_size = 0;
+static long batch_delay = 0;           /* in milliseconds */
+
+
+static struct dlr_op *dlr_op_create(int type, struct dlr_entry *entry, Octstr *key)
+{
+    struct dlr_op *op;
+
+    op = gw_malloc(sizeof(*op));
+    op->type = type;
+    op->entry = entry;
+    op->key = key;
+    op->status = 0;
+    op->cancelled = op->written = 0;
+
+    return op;
+}
+
+static void dlr_op_destroy(struct dlr_op *op)
+{
+    dlr_entry_destroy(op->entry);
+    octstr_destroy(op->key);
+    gw_free(op);
+}
+
+static struct dlr_entry *dlr_key_create(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    struct dlr_entry *key;
+
+    key = dlr_entry_create();
+    key->smsc = octstr_duplicate(smsc);
+    key->timestamp = octstr_duplicate(ts);
+    key->destination = octstr_duplicate(dst);
+
+    return key;
+}
+
+/* dst is the shortened destination dlr_find() looks for, if any */
+static int dlr_dst_matches(const struct dlr_entry *dlr, const Octstr *dst)
+{
+    long pos;
+
+    if (dst == NULL)
+        return 1;
+    pos = octstr_len(dlr->destination) - octstr_len(dst);
+
+    return pos >= 0 && octstr_search(dlr->destination, dst, pos) == pos;
+}
+
+static void dlr_storage_add(struct dlr_entry *dlr)
+{
+    struct dlr_op *op;
+    List *pending;
+
+    if (writer_queue == NULL) {
+        handles->dlr_add(dlr);
+        return;
+    }
+
+    op = dlr_op_create(DLR_OP_ADD, dlr, octstr_format("%S %S", dlr->smsc, dlr->timestamp));
+
+    mutex_lock(writer_lock);
+    if ((pending = dict_get(writer_adds, op->key)) == NULL) {
+        pending = gwlist_create();
+        dict_put(writer_adds, op->key, pending);
+    }
+    gwlist_append(pending, op);
+    writer_pending++;
+    mutex_unlock(writer_lock);
+
+    gwlist_produce(writer_queue, op);
+    if (gwlist_len(writer_queue) >= batch_size)
+        gwthread_wakeup(writer_thread);
+}
+
+static struct dlr_entry *dlr_storage_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    struct dlr_entry *res = NULL;
+    struct dlr_op *op;
+    List *pending;
+    Octstr *key;
+    long i;
+
+    if (writer_queue == NULL)
+        return handles->dlr_get(smsc, ts, dst);
+
+    key = octstr_format("%S %S", smsc, ts);
+    mutex_lock(writer_lock);
+    pending = dict_get(writer_adds, key);
+    for (i = 0; res == NULL && i < gwlist_len(pending); i++) {
+        op = gwlist_get(pending, i);
+        if (dlr_dst_matches(op->entry, dst))
+            res = dlr_entry_duplicate(op->entry);
+    }
+    mutex_unlock(writer_lock);
+    octstr_destroy(key);
+
+    /*
+     * A pending remove doesn't hide the key: it deletes one entry only,
+     * and e.g. the parts of a multipart message share smsc, ts and dst.
+     */
+    if (res != NULL)
+        return res;
+
+    return handles->dlr_get(smsc, ts, dst);
+}
+
+static void dlr_storage_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    struct dlr_op *op = NULL;
+    List *pending;
+    Octstr *key;
+    long i;
+
+    if (writer_queue == NULL) {
+        handles->dlr_remove(smsc, ts, dst);
+        return;
+    }
+
+    key = octstr_format("%S %S", smsc, ts);
+    mutex_lock(writer_lock);
+    pending = dict_get(writer_adds, key);
+    for (i = 0; i < gwlist_len(pending); i++) {
+        op = gwlist_get(pending, i);
+        if (!op->written && dlr_dst_matches(op->entry, dst))
+            break;
+        op = NULL;
+    }
+    if (op != NULL) {
+        /* never reached the storage, so there is nothing to delete */
+        op->cancelled = 1;
+        writer_pending--;
+        gwlist_delete(pending, i, 1);
+        if (gwlist_len(pending) == 0) {
+            dict_remove(writer_adds, key);
+            gwlist_destroy(pending, NULL);
+        }
+        mutex_unlock(writer_lock);
+        octstr_destroy(key);
+        counter_increase(writer_cancelled);
+        return;
+    }
+    octstr_format_append(key, " %S", dst);
+    op = dlr_op_create(DLR_OP_REMOVE, dlr_key_create(smsc, ts, dst), key);
+    dict_put(writer_removes, key, op);
+    mutex_unlock(writer_lock);
+
+    gwlist_produce(writer_queue, op);
+    if (gwlist_len(writer_queue) >= batch_size)
+        gwthread_wakeup(writer_thread);
+}
+
+static void dlr_storage_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
+{
+    struct dlr_op *op;
+
+    if (writer_queue == NULL) {
+        handles->dlr_update(smsc, ts, dst, status);
+        return;
+    }
+
+    op = dlr_op_create(DLR_OP_UPDATE, dlr_key_create(smsc, ts, dst), NULL);
+    op->status = status;
+    gwlist_produce(writer_queue, op);
+}
+
+static void dlr_writer_account(long n)
+{
+    counter_increase(writer_batches);
+    counter_increase_with(writer_written, n);
+    if (n > writer_max)
+        writer_max = n;
+}
+
+/*
+ * Write a run of adds. The entries stay visible in the cache until
+ * the storage has them.
+ */
+static void dlr_writer_add(List *run)
+{
+    struct dlr_op *op;
+    List *entries, *pending;
+    long i;
+
+    entries = gwlist_create();
+    mutex_lock(writer_lock);
+    for (i = 0; i < gwlist_len(run); i++) {
+        op = gwlist_get(run, i);
+        if (op->cancelled)
+            continue;
+        op->written = 1;
+        gwlist_append(entries, op->entry);
+    }
+    mutex_unlock(writer_lock);
+
+    if (gwlist_len(entries) > 0) {
+        if (handles->dlr_add_batch != NULL) {
+            handles->dlr_add_batch(entries);
+        } else {
+            for (i = 0; i < gwlist_len(entries); i++)
+                handles->dlr_add(dlr_entry_duplicate(gwlist_get(entries, i)));
+        }
+        dlr_writer_account(gwlist_len(entries));
+    }
+    gwlist_destroy(entries, NULL);
+
+    mutex_lock(writer_lock);
+    while ((op = gwlist_extract_first(run)) != NULL) {
+        if (!op->cancelled) {
+            writer_pending--;
+            /* dlr_flush() may have dropped the cache meanwhile */
+            if ((pending = dict_get(writer_adds, op->key)) != NULL) {
+                gwlist_delete_equal(pending, op);
+                if (gwlist_len(pending) == 0) {
+                    dict_remove(writer_adds, op->key);
+                    gwlist_destroy(pending, NULL);
+                }
+            }
+        }
+        dlr_op_destroy(op);
+    }
+    mutex_unlock(writer_lock);
+}
+
+static void dlr_writer_remove(List *run)
+{
+    struct dlr_op *op;
+    struct dlr_entry *key;
+    List *keys;
+    long i;
+
+    keys = gwlist_create();
+    for (i = 0; i < gwlist_len(run); i++) {
+        op = gwlist_get(run, i);
+        gwlist_append(keys, op->entry);
+    }
+
+    if (handles->dlr_remove_batch != NULL) {
+        handles->dlr_remove_batch(keys);
+    } else {
+        for (i = 0; i < gwlist_len(keys); i++) {
+            key = gwlist_get(keys, i);
+            handles->dlr_remove(key->smsc, key->timestamp, key->destination);
+        }
+    }
+    dlr_writer_account(gwlist_len(keys));
+    gwlist_destroy(keys, NULL);
+
+    mutex_lock(writer_lock);
+    while ((op = gwlist_extract_first(run)) != NULL) {
+        if (dict_get(writer_removes, op->key) == op)
+            dict_remove(writer_removes, op->key);
+        dlr_op_destroy(op);
+    }
+    mutex_unlock(writer_lock);
+}
+
+/*
+ * Apply a batch of queued operations in order, passing each run of
+ * adds or removes to the storage in one go.
+ */
+static void dlr_writer_apply(List *batch)
+{
+    struct dlr_op *op, *next;
+    List *run;
+
+    run = gwlist_create();
+    while ((op = gwlist_extract_first(batch)) != NULL) {
+        if (op->type == DLR_OP_UPDATE) {
+            handles->dlr_update(op->entry->smsc, op->entry->timestamp,
+                                op->entry->destination, op->status);
+            dlr_op_destroy(op);
+            continue;
+        }
+        gwlist_append(run, op);
+        while (gwlist_len(batch) > 0 && (next = gwlist_get(batch, 0))->type == op->type)
+            gwlist_append(run, gwlist_extract_first(batch));
+
+        if (op->type == DLR_OP_ADD)
+            dlr_writer_add(run);
+        else
+            dlr_writer_remove(run);
+    }
+    gwlist_destroy(run, NULL);
+}
+
+static void dlr_writer(void *arg)
+{
+    struct dlr_op *op;
+    List *batch;
+
+    batch = gwlist_create();
+    while ((op = gwlist_consume(writer_queue)) != NULL) {
+        /* give the queue a moment to fill up to a full batch */
+        if (batch_delay > 0 && gwlist_len(writer_queue) + 1 < batch_size)
+            gwthread_sleep(batch_delay / 1000.0);
+
+        gwlist_append(batch, op);
+        while (gwlist_len(batch) < batch_size &&
+               (op = gwlist_extract_first(writer_queue)) != NULL)
+            gwlist_append(batch, op);
+
+        dlr_writer_apply(batch);
+    }
+    gwlist_destroy(batch, NULL);
+}
+
+static void dlr_writer_start(void)
+{
+    writer_queue = gwlist_create();
+    gwlist_add_producer(writer_queue);
+    writer_adds = dict_create(1024, NULL);
+    writer_removes = dict_create(1024, NULL);
+    writer_lock = mutex_create();
+    writer_batches = counter_create();
+    writer_written = counter_create();
+    writer_cancelled = counter_create();
+
+    if ((writer_thread = gwthread_create(dlr_writer, NULL)) == -1)
+        panic(0, "DLR: could not start writer thread");
+}
+
+static void dlr_writer_stop(void)
+{
+    if (writer_queue == NULL)
+        return;
+
+    /* the writer drains the queue before it exits */
+    gwlist_remove_producer(writer_queue);
+    gwthread_wakeup(writer_thread);
+    gwthread_join(writer_thread);
+
+    gwlist_destroy(writer_queue, NULL);
+    writer_queue = NULL;
+    dict_destroy(writer_adds);
+    dict_destroy(writer_removes);
+    mutex_destroy(writer_lock);
+    counter_destroy(writer_batches);
+    counter_destroy(writer_written);
+    counter_destroy(writer_cancelled);
+}
+
+/*
+ * Drop all adds that were not handed to the storage yet.
+ */
+static void dlr_writer_flush(void)
+{
+    struct dlr_op *op;
+    List *keys, *pending;
+    Octstr *key;
+
+    mutex_lock(writer_lock);
+    keys = dict_keys(writer_adds);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        pending = dict_remove(writer_adds, key);
+        while ((op = gwlist_extract_first(pending)) != NULL) {
+            if (!op->written) {
+                op->cancelled = 1;
+                writer_pending--;
+            }
+        }
+        gwlist_destroy(pending, NULL);
+        octstr_destroy(key);
+    }
+    mutex_unlock(writer_lock);
+    gwlist_destroy(keys, NULL);
+}
+
+static Octstr *dlr_writer_status(int status_type)
+{
+    long pending, batches, written;
+    char *frmt;
+
+    mutex_lock(writer_lock);
+    pending = writer_pending;
+    mutex_unlock(writer_lock);
+    batches = counter_value(writer_batches);
+    written = counter_value(writer_written);
+
+    if (status_type == BBSTATUS_HTML) {
+        frmt = " <p>DLR writer: %ld queued, %ld unwritten adds, %ld cancelled, "
+               "%ld batches, %.1f avg batch, %ld max batch</p>\n\n";
+    } else if (status_type == BBSTATUS_WML) {
+        frmt = "   <p>DLR writer: %ld queued<br/>\n"
+               "      DLR writer: %ld unwritten adds<br/>\n"
+               "      DLR writer: %ld cancelled<br/>\n"
+               "      DLR writer: %ld batches, %.1f avg batch, %ld max batch</p>\n\n";
+    } else if (status_type == BBSTATUS_XML) {
+        frmt = "\t<dlr-writer>\n\t\t<queued>%ld</queued>\n\t\t"
+               "<unwritten>%ld</unwritten>\n\t\t<cancelled>%ld</cancelled>\n\t\t"
+               "<batches>%ld</batches>\n\t\t<avg-batch>%.1f</avg-batch>\n\t\t"
+               "<max-batch>%ld</max-batch>\n\t</dlr-writer>\n";
+    } else {
+        frmt = "DLR writer: %ld queued, %ld unwritten adds, %ld cancelled, "
+               "%ld batches, %.1f avg batch, %ld max batch\n\n";
+    }
+
+    return octstr_format(frmt, gwlist_len(writer_queue), pending,
+                         counter_value(writer_cancelled), batches,
+                         batches > 0 ? (double) written / batches : 0.0, writer_max);
+}
+
 
 /*
  * Initialize specifically dlr storage. If defined storage is unknown
@@ -286,6 +748,16 @@ void dlr_init(Cfg* cfg)
     /* get info from storage */
     info(0, "DLR using storage type: %s", handles->type);
 
+    /* hand storage writes to the asynchronous writer if wanted */
+    if (cfg_get_integer(&batch_size, grp, octstr_imm("dlr-batch-size")) == -1 || batch_size < 0)
+        batch_size = 0;
+    if (cfg_get_integer(&batch_delay, grp, octstr_imm("dlr-batch-delay")) == -1 || batch_delay < 0)
+        batch_delay = 50;
+    if (batch_size > 0) {
+        info(0, "DLR: writing asynchronously in batches of up to %ld entries", batch_size);
+        dlr_writer_start();
+    }
+
     /* cleanup */
     octstr_destroy(dlr_type);
 }
@@ -295,6 +767,7 @@ void dlr_init(Cfg* cfg)
  */
 void dlr_shutdown()
 {
+    dlr_writer_stop();
     if (handles != NULL && handles->dlr_shutdown != NULL)
         handles->dlr_shutdown();
 }
@@ -304,8 +777,20 @@ void dlr_shutdown()
  */
 long dlr_messages(void)
 {
-    if (handles != NULL && handles->dlr_messages != NULL)
-        return handles->dlr_messages();
+    long msgs;
+
+    if (handles != NULL && handles->dlr_messages != NULL) {
+        msgs = handles->dlr_messages();
+        if (msgs >= 0 && writer_queue != NULL) {
+            /* account for what the writer did not apply yet */
+            mutex_lock(writer_lock);
+            msgs += writer_pending - dict_key_count(writer_removes);
+            mutex_unlock(writer_lock);
+            if (msgs < 0)
+                msgs = 0;
+        }
+        return msgs;
+    }
 
     return -1;
 }
@@ -321,6 +806,28 @@ const char* dlr_type(void)
     return "unknown";
 }
  
+/*
+ * Return storage specific status information. Empty if the storage
+ * type doesn't provide any.
+ */
+Octstr *dlr_status(int status_type)
+{
+    Octstr *ret, *writer;
+
+    if (handles != NULL && handles->dlr_status != NULL)
+        ret = handles->dlr_status(status_type);
+    else
+        ret = octstr_create("");
+
+    if (writer_queue != NULL) {
+        writer = dlr_writer_status(status_type);
+        octstr_append(ret, writer);
+        octstr_destroy(writer);
+    }
+
+    return ret;
+}
+
 /*
  * Add new dlr entry into dlr storage.
  */
@@ -373,7 +880,7 @@ void dlr_add(const Octstr *smsc, const Octstr *ts, Msg *msg, int use_dst)
           octstr_get_cstr(dlr->source), octstr_get_cstr(dlr->destination), dlr->mask, octstr_get_cstr(dlr->boxc_id));
 	
     /* call registered function */
-    handles->dlr_add(dlr);
+    dlr_storage_add(dlr);
 }
 
 /*
@@ -406,7 +913,7 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
     debug("dlr.dlr", 0, "DLR[%s]: Looking for DLR smsc=%s, ts=%s, dst=%s, type=%d",
                                  dlr_type(), octstr_get_cstr(smsc), octstr_get_cstr(ts), octstr_get_cstr(dst), typ);
 
-    dlr = handles->dlr_get(smsc, ts, dst_min);
+    dlr = dlr_storage_get(smsc, ts, dst_min);
     if (dlr == NULL)  {
         warning(0, "DLR[%s]: DLR from SMSC<%s> for DST<%s> not found.",
                 dlr_type(), octstr_get_cstr(smsc), octstr_get_cstr(dst));         
@@ -455,12 +962,12 @@ Msg *dlr_find(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int typ,
         debug("dlr.dlr", 0, "DLR[%s]: DLR not destroyed, still waiting for other delivery report", dlr_type());
         /* update dlr entry status if function defined */
         if (handles != NULL && handles->dlr_update != NULL){
-            handles->dlr_update(smsc, ts, dst_min, typ);
+            dlr_storage_update(smsc, ts, dst_min, typ);
         }
     } else {
         if (handles != NULL && handles->dlr_remove != NULL){
             /* it's not good for internal storage, but better for all others */
-            handles->dlr_remove(smsc, ts, dst_min);
+            dlr_storage_remove(smsc, ts, dst_min);
         } else {
             warning(0, "DLR[%s]: Storage don't have remove operation defined", dlr_type());
         }
@@ -478,6 +985,8 @@ void dlr_flush(void)
     info(0, "Flushing all %ld queued DLR messages in %s storage", dlr_messages(), 
             dlr_type());
  
+    if (writer_queue != NULL)
+        dlr_writer_flush();
     if (handles != NULL && handles->dlr_flush != NULL)
         handles->dlr_flush();
 }
@@ -119,6 +119,8 @@ void dlr_flush(void);
  */
 const char* dlr_type(void);
 
+Octstr *dlr_status(int status_type);
+
 /*
  * Helper function, create DLR from given message
  */
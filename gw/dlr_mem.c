@@ -65,25 +65,370 @@
  * Alexander Malysh <a.malysh@centrium.de> 2003
  */
 
+#include <time.h>
+#include <signal.h>
+
 #include "gwlib/gwlib.h"
+#include "bearerbox.h"
 #include "dlr_p.h"
 
 /*
- * This is the global list where all messages being sent out are being kept track
- * of his list is looked up once a delivery report comes in
+ * Number of independently locked partitions of the index. Must be
+ * a power of two, since the partition is selected by the low hash bits.
+ */
+#define DLR_MEM_STRIPE_BITS 6
+#define DLR_MEM_STRIPES (1 << DLR_MEM_STRIPE_BITS)
+
+/*
+ * Initial bucket count of each partition, a power of two as well.
+ * Partitions double their bucket count when the load factor exceeds 1.
+ */
+#define DLR_MEM_INITIAL_BUCKETS 256
+
+/*
+ * Number of slots of the expiry wheel of each partition. The slot width
+ * is chosen at init time, so that the largest configured TTL fits into
+ * one turn of the wheel.
+ */
+#define DLR_MEM_WHEEL_SLOTS 1024
+
+/*
+ * Rough per Octstr allocation overhead, used to account the memory
+ * held by an entry against dlr-memory-limit.
+ */
+#define DLR_MEM_OCTSTR_OVERHEAD 32
+
+/*
+ * All messages being sent out are kept track of in a chained hash index
+ * keyed on (smsc, timestamp). The destination suffix is only checked
+ * for entries whose key matches, since e.g. for UCP the timestamp alone
+ * is not unique (it's even without milliseconds).
+ *
+ * The index is split into stripes, each one guarded by its own rwlock,
+ * so reports for different messages don't contend on a single lock.
+ * Entries with the same key are kept in insertion order within a chain,
+ * so the oldest one matches first, as it did with the former linear list.
+ *
+ * Each stripe additionally links its entries into an age list, used to
+ * evict the oldest entries if the memory limit is hit, and, if a TTL
+ * applies, into a slot of its expiry wheel.
+ */
+struct dlr_mem_node {
+    struct dlr_mem_node *next;
+    struct dlr_mem_node *age_prev, *age_next;
+    struct dlr_mem_node *wheel_prev, *wheel_next;
+    long wheel_slot;
+    unsigned long hash;
+    time_t expire;
+    long size;
+    struct dlr_entry *dlr;
+};
+
+struct dlr_mem_stripe {
+    RWLock lock;
+    struct dlr_mem_node **buckets;
+    unsigned long size;
+    unsigned long count;
+    long bytes;
+    struct dlr_mem_node *oldest, *newest;
+    struct dlr_mem_node **wheel;
+    long wheel_tick;
+};
+
+static struct dlr_mem_stripe stripes[DLR_MEM_STRIPES];
+
+/* TTL in seconds for entries of smsc-ids without own dlr-ttl, 0 is forever */
+static long default_ttl = 0;
+/* smsc-id -> TTL in seconds, as given via smsc group dlr-ttl */
+static Dict *smsc_ttl = NULL;
+/* seconds per expiry wheel slot, 0 if expiry is disabled */
+static long wheel_tick_len = 0;
+/* upper bound of memory held by each stripe, 0 if unlimited */
+static long stripe_memory_limit = 0;
+
+static Counter *expired_counter;
+static Counter *evicted_counter;
+
+static volatile sig_atomic_t expire_running = 0;
+static long expire_thread = -1;
+
+
+static unsigned long dlr_mem_hash(const Octstr *smsc, const Octstr *ts)
+{
+    unsigned long hash;
+
+    hash = octstr_hash_key((Octstr *) smsc) * 31 + octstr_hash_key((Octstr *) ts);
+
+    /* spread the bits, stripe and bucket are taken from different ends */
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+#define STRIPE_OF(hash) (&stripes[(hash) & (DLR_MEM_STRIPES - 1)])
+#define BUCKET_OF(stripe, hash) (((hash) >> DLR_MEM_STRIPE_BITS) & ((stripe)->size - 1))
+
+static long dlr_mem_entry_size(struct dlr_entry *dlr)
+{
+#define O_SIZE(a) (octstr_len(a) + DLR_MEM_OCTSTR_OVERHEAD)
+
+    return sizeof(struct dlr_mem_node) + sizeof(*dlr) +
+           O_SIZE(dlr->smsc) + O_SIZE(dlr->timestamp) + O_SIZE(dlr->source) +
+           O_SIZE(dlr->destination) + O_SIZE(dlr->service) + O_SIZE(dlr->url) +
+           O_SIZE(dlr->boxc_id);
+
+#undef O_SIZE
+}
+
+static long dlr_mem_ttl(const Octstr *smsc)
+{
+    long *ttl;
+
+    if (smsc_ttl != NULL && (ttl = dict_get(smsc_ttl, (Octstr *) smsc)) != NULL)
+        return *ttl;
+
+    return default_ttl;
+}
+
+static void dlr_mem_stripe_init(struct dlr_mem_stripe *stripe)
+{
+    stripe->size = DLR_MEM_INITIAL_BUCKETS;
+    stripe->count = 0;
+    stripe->bytes = 0;
+    stripe->buckets = gw_malloc(sizeof(stripe->buckets[0]) * stripe->size);
+    memset(stripe->buckets, 0, sizeof(stripe->buckets[0]) * stripe->size);
+    stripe->oldest = stripe->newest = NULL;
+
+    if (wheel_tick_len > 0) {
+        stripe->wheel = gw_malloc(sizeof(stripe->wheel[0]) * DLR_MEM_WHEEL_SLOTS);
+        memset(stripe->wheel, 0, sizeof(stripe->wheel[0]) * DLR_MEM_WHEEL_SLOTS);
+        /* the slot of the current tick is not complete yet */
+        stripe->wheel_tick = time(NULL) / wheel_tick_len - 1;
+    } else {
+        stripe->wheel = NULL;
+        stripe->wheel_tick = 0;
+    }
+}
+
+/*
+ * Destroy all entries of the stripe. Caller must hold the write lock.
+ */
+static void dlr_mem_stripe_clear(struct dlr_mem_stripe *stripe)
+{
+    struct dlr_mem_node *node, *next;
+
+    for (node = stripe->oldest; node != NULL; node = next) {
+        next = node->age_next;
+        dlr_entry_destroy(node->dlr);
+        gw_free(node);
+    }
+    gw_free(stripe->buckets);
+    gw_free(stripe->wheel);
+    stripe->buckets = stripe->wheel = NULL;
+    stripe->oldest = stripe->newest = NULL;
+    stripe->size = stripe->count = 0;
+    stripe->bytes = 0;
+}
+
+/*
+ * Double the bucket count of the stripe, keeping the chain order.
+ * Caller must hold the write lock.
+ */
+static void dlr_mem_stripe_grow(struct dlr_mem_stripe *stripe)
+{
+    struct dlr_mem_node **old, **tails, *node, *next;
+    unsigned long i, old_size, b;
+
+    old = stripe->buckets;
+    old_size = stripe->size;
+
+    stripe->size = old_size * 2;
+    stripe->buckets = gw_malloc(sizeof(stripe->buckets[0]) * stripe->size);
+    memset(stripe->buckets, 0, sizeof(stripe->buckets[0]) * stripe->size);
+    tails = gw_malloc(sizeof(tails[0]) * stripe->size);
+    memset(tails, 0, sizeof(tails[0]) * stripe->size);
+
+    for (i = 0; i < old_size; i++) {
+        for (node = old[i]; node != NULL; node = next) {
+            next = node->next;
+            node->next = NULL;
+            b = BUCKET_OF(stripe, node->hash);
+            if (tails[b] == NULL)
+                stripe->buckets[b] = node;
+            else
+                tails[b]->next = node;
+            tails[b] = node;
+        }
+    }
+
+    gw_free(tails);
+    gw_free(old);
+}
+
+/*
+ * Link node into the index, the age list and the expiry wheel.
+ * Caller must hold the write lock.
+ */
+static void dlr_mem_link(struct dlr_mem_stripe *stripe, struct dlr_mem_node *node)
+{
+    struct dlr_mem_node **pos;
+    long tick, slot;
+
+    if (stripe->count >= stripe->size)
+        dlr_mem_stripe_grow(stripe);
+    for (pos = &stripe->buckets[BUCKET_OF(stripe, node->hash)]; *pos != NULL; pos = &(*pos)->next)
+        ;
+    *pos = node;
+
+    node->age_next = NULL;
+    node->age_prev = stripe->newest;
+    if (stripe->newest != NULL)
+        stripe->newest->age_next = node;
+    else
+        stripe->oldest = node;
+    stripe->newest = node;
+
+    node->wheel_prev = node->wheel_next = NULL;
+    node->wheel_slot = -1;
+    if (node->expire > 0 && stripe->wheel != NULL) {
+        tick = node->expire / wheel_tick_len;
+        if (tick <= stripe->wheel_tick)
+            tick = stripe->wheel_tick + 1;
+        slot = tick % DLR_MEM_WHEEL_SLOTS;
+        node->wheel_slot = slot;
+        node->wheel_next = stripe->wheel[slot];
+        if (node->wheel_next != NULL)
+            node->wheel_next->wheel_prev = node;
+        stripe->wheel[slot] = node;
+    }
+
+    stripe->count++;
+    stripe->bytes += node->size;
+}
+
+/*
+ * Unlink node from the index, the age list and the expiry wheel.
+ * `pos' is the link pointing to node in its hash chain, or NULL if
+ * it has to be looked up. Caller must hold the write lock.
+ */
+static void dlr_mem_unlink(struct dlr_mem_stripe *stripe, struct dlr_mem_node **pos,
+                           struct dlr_mem_node *node)
+{
+    if (pos == NULL) {
+        for (pos = &stripe->buckets[BUCKET_OF(stripe, node->hash)]; *pos != node; pos = &(*pos)->next)
+            gw_assert(*pos != NULL);
+    }
+    *pos = node->next;
+
+    if (node->age_prev != NULL)
+        node->age_prev->age_next = node->age_next;
+    else
+        stripe->oldest = node->age_next;
+    if (node->age_next != NULL)
+        node->age_next->age_prev = node->age_prev;
+    else
+        stripe->newest = node->age_prev;
+
+    if (node->wheel_prev != NULL)
+        node->wheel_prev->wheel_next = node->wheel_next;
+    else if (node->wheel_slot != -1)
+        stripe->wheel[node->wheel_slot] = node->wheel_next;
+    if (node->wheel_next != NULL)
+        node->wheel_next->wheel_prev = node->wheel_prev;
+
+    stripe->count--;
+    stripe->bytes -= node->size;
+}
+
+static void dlr_mem_node_destroy(struct dlr_mem_node *node)
+{
+    dlr_entry_destroy(node->dlr);
+    gw_free(node);
+}
+
+/*
+ * Expire all entries in the slots whose time span has passed completely.
+ * Entries are destroyed outside of the lock.
  */
-static List *dlr_waiting_list;
-static RWLock rwlock;
+static void dlr_mem_stripe_expire(struct dlr_mem_stripe *stripe, time_t now)
+{
+    struct dlr_mem_node *node, *next, *dead = NULL;
+    long tick, last, slot;
+
+    gw_rwlock_wrlock(&stripe->lock);
+    if (stripe->wheel == NULL) {
+        gw_rwlock_unlock(&stripe->lock);
+        return;
+    }
+    last = now / wheel_tick_len - 1;
+    tick = stripe->wheel_tick + 1;
+    if (last - tick >= DLR_MEM_WHEEL_SLOTS)
+        tick = last - DLR_MEM_WHEEL_SLOTS + 1;
+    for (; tick <= last; tick++) {
+        slot = tick % DLR_MEM_WHEEL_SLOTS;
+        for (node = stripe->wheel[slot]; node != NULL; node = next) {
+            next = node->wheel_next;
+            if (node->expire > now)
+                continue;
+            dlr_mem_unlink(stripe, NULL, node);
+            node->next = dead;
+            dead = node;
+        }
+    }
+    if (last > stripe->wheel_tick)
+        stripe->wheel_tick = last;
+    gw_rwlock_unlock(&stripe->lock);
+
+    for (; dead != NULL; dead = next) {
+        next = dead->next;
+        debug("dlr.dlr", 0, "DLR[internal]: Expired DLR smsc=%s, ts=%s, dst=%s",
+              octstr_get_cstr(dead->dlr->smsc), octstr_get_cstr(dead->dlr->timestamp),
+              octstr_get_cstr(dead->dlr->destination));
+        dlr_mem_node_destroy(dead);
+        counter_increase(expired_counter);
+    }
+}
+
+static void dlr_mem_expire_thread(void *arg)
+{
+    long i;
+
+    while (expire_running) {
+        gwthread_sleep(wheel_tick_len);
+        if (!expire_running)
+            break;
+        for (i = 0; i < DLR_MEM_STRIPES; i++)
+            dlr_mem_stripe_expire(&stripes[i], time(NULL));
+    }
+}
 
 /*
- * Destroy dlr_waiting_list.
+ * Destroy the index.
  */
 static void dlr_mem_shutdown()
 {
-    gw_rwlock_wrlock(&rwlock);
-    gwlist_destroy(dlr_waiting_list, (gwlist_item_destructor_t *)dlr_entry_destroy);
-    gw_rwlock_unlock(&rwlock);
-    gw_rwlock_destroy(&rwlock);
+    long i;
+
+    if (expire_thread != -1) {
+        expire_running = 0;
+        gwthread_wakeup(expire_thread);
+        gwthread_join(expire_thread);
+        expire_thread = -1;
+    }
+
+    for (i = 0; i < DLR_MEM_STRIPES; i++) {
+        gw_rwlock_wrlock(&stripes[i].lock);
+        dlr_mem_stripe_clear(&stripes[i]);
+        gw_rwlock_unlock(&stripes[i].lock);
+        gw_rwlock_destroy(&stripes[i].lock);
+    }
+
+    dict_destroy(smsc_ttl);
+    smsc_ttl = NULL;
+    counter_destroy(expired_counter);
+    counter_destroy(evicted_counter);
 }
 
 /*
@@ -91,32 +436,68 @@ static void dlr_mem_shutdown()
  */
 static long dlr_mem_messages(void)
 {
-    return gwlist_len(dlr_waiting_list);
+    long i, ret = 0;
+
+    for (i = 0; i < DLR_MEM_STRIPES; i++) {
+        gw_rwlock_rdlock(&stripes[i].lock);
+        ret += stripes[i].count;
+        gw_rwlock_unlock(&stripes[i].lock);
+    }
+
+    return ret;
 }
 
 static void dlr_mem_flush(void)
 {
     long i;
-    long len;
 
-    gw_rwlock_wrlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i = 0; i < len; i++) {
-        struct dlr_entry *dlr = gwlist_get(dlr_waiting_list, 0);
-        gwlist_delete(dlr_waiting_list, 0, 1);
-        dlr_entry_destroy(dlr);
+    for (i = 0; i < DLR_MEM_STRIPES; i++) {
+        gw_rwlock_wrlock(&stripes[i].lock);
+        dlr_mem_stripe_clear(&stripes[i]);
+        dlr_mem_stripe_init(&stripes[i]);
+        gw_rwlock_unlock(&stripes[i].lock);
     }
-    gw_rwlock_unlock(&rwlock);
 }
 
 /*
- * add struct dlr_entry to list
+ * add struct dlr_entry to index
  */
 static void dlr_mem_add(struct dlr_entry *dlr)
 {
-    gw_rwlock_wrlock(&rwlock);
-    gwlist_append(dlr_waiting_list,dlr);
-    gw_rwlock_unlock(&rwlock);
+    struct dlr_mem_stripe *stripe;
+    struct dlr_mem_node *node, *victim, *next, *dead = NULL;
+    long ttl;
+
+    node = gw_malloc(sizeof(*node));
+    node->next = NULL;
+    node->hash = dlr_mem_hash(dlr->smsc, dlr->timestamp);
+    node->size = dlr_mem_entry_size(dlr);
+    node->dlr = dlr;
+    ttl = dlr_mem_ttl(dlr->smsc);
+    node->expire = (ttl > 0 ? time(NULL) + ttl : 0);
+
+    stripe = STRIPE_OF(node->hash);
+
+    gw_rwlock_wrlock(&stripe->lock);
+    dlr_mem_link(stripe, node);
+    /* make room by evicting the oldest entries of this stripe */
+    while (stripe_memory_limit > 0 && stripe->bytes > stripe_memory_limit &&
+           stripe->oldest != node) {
+        victim = stripe->oldest;
+        dlr_mem_unlink(stripe, NULL, victim);
+        victim->next = dead;
+        dead = victim;
+    }
+    gw_rwlock_unlock(&stripe->lock);
+
+    for (; dead != NULL; dead = next) {
+        next = dead->next;
+        warning(0, "DLR[internal]: Memory limit reached, dropping DLR smsc=%s, ts=%s, dst=%s",
+                octstr_get_cstr(dead->dlr->smsc), octstr_get_cstr(dead->dlr->timestamp),
+                octstr_get_cstr(dead->dlr->destination));
+        dlr_mem_node_destroy(dead);
+        counter_increase(evicted_counter);
+    }
 }
 
 /*
@@ -142,26 +523,40 @@ static int dlr_mem_entry_match(struct dlr_entry *dlr, const Octstr *smsc, const
     return 1;
 }
 
+/*
+ * Return the link pointing to the first matching node, so the caller
+ * may unlink it, or NULL if there is none. Caller must hold a lock.
+ */
+static struct dlr_mem_node **dlr_mem_lookup(struct dlr_mem_stripe *stripe, unsigned long hash,
+                                            const Octstr *smsc, const Octstr *ts, const Octstr *dst)
+{
+    struct dlr_mem_node **pos;
+
+    for (pos = &stripe->buckets[BUCKET_OF(stripe, hash)]; *pos != NULL; pos = &(*pos)->next) {
+        if ((*pos)->hash == hash && dlr_mem_entry_match((*pos)->dlr, smsc, ts, dst) == 0)
+            return pos;
+    }
+
+    return NULL;
+}
+
 /*
  * Find matching entry and return copy of it, otherwise NULL
  */
 static struct dlr_entry *dlr_mem_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    long i;
-    long len;
-    struct dlr_entry *dlr = NULL, *ret = NULL;
+    struct dlr_mem_stripe *stripe;
+    struct dlr_mem_node **pos;
+    struct dlr_entry *ret = NULL;
+    unsigned long hash;
 
-    gw_rwlock_rdlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i=0; i < len; i++) {
-        dlr = gwlist_get(dlr_waiting_list, i);
+    hash = dlr_mem_hash(smsc, ts);
+    stripe = STRIPE_OF(hash);
 
-        if (dlr_mem_entry_match(dlr, smsc, ts, dst) == 0) {
-            ret = dlr_entry_duplicate(dlr);
-            break;
-        }
-    }
-    gw_rwlock_unlock(&rwlock);
+    gw_rwlock_rdlock(&stripe->lock);
+    if ((pos = dlr_mem_lookup(stripe, hash, smsc, ts, dst)) != NULL)
+        ret = dlr_entry_duplicate((*pos)->dlr);
+    gw_rwlock_unlock(&stripe->lock);
 
     /* we couldnt find a matching entry */
     return ret;
@@ -172,22 +567,51 @@ static struct dlr_entry *dlr_mem_get(const Octstr *smsc, const Octstr *ts, const
  */
 static void dlr_mem_remove(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
-    long i;
-    long len;
-    struct dlr_entry *dlr = NULL;
+    struct dlr_mem_stripe *stripe;
+    struct dlr_mem_node **pos, *node = NULL;
+    unsigned long hash;
 
-    gw_rwlock_wrlock(&rwlock);
-    len = gwlist_len(dlr_waiting_list);
-    for (i=0; i < len; i++) {
-        dlr = gwlist_get(dlr_waiting_list, i);
+    hash = dlr_mem_hash(smsc, ts);
+    stripe = STRIPE_OF(hash);
 
-        if (dlr_mem_entry_match(dlr, smsc, ts, dst) == 0) {
-            gwlist_delete(dlr_waiting_list, i, 1);
-            dlr_entry_destroy(dlr);
-            break;
-        }
+    gw_rwlock_wrlock(&stripe->lock);
+    if ((pos = dlr_mem_lookup(stripe, hash, smsc, ts, dst)) != NULL) {
+        node = *pos;
+        dlr_mem_unlink(stripe, pos, node);
     }
-    gw_rwlock_unlock(&rwlock);
+    gw_rwlock_unlock(&stripe->lock);
+
+    if (node != NULL)
+        dlr_mem_node_destroy(node);
+}
+
+static Octstr *dlr_mem_status(int status_type)
+{
+    long i, bytes = 0;
+    char *frmt;
+
+    for (i = 0; i < DLR_MEM_STRIPES; i++) {
+        gw_rwlock_rdlock(&stripes[i].lock);
+        bytes += stripes[i].bytes;
+        gw_rwlock_unlock(&stripes[i].lock);
+    }
+
+    if (status_type == BBSTATUS_HTML) {
+        frmt = " <p>DLR: %ld expired, %ld evicted, %ld bytes used (limit %ld)</p>\n\n";
+    } else if (status_type == BBSTATUS_WML) {
+        frmt = "   <p>DLR: %ld expired<br/>\n"
+               "      DLR: %ld evicted<br/>\n"
+               "      DLR: %ld bytes used (limit %ld)</p>\n\n";
+    } else if (status_type == BBSTATUS_XML) {
+        frmt = "\t<dlr-storage>\n\t\t<expired>%ld</expired>\n\t\t"
+               "<evicted>%ld</evicted>\n\t\t<memory>%ld</memory>\n\t\t"
+               "<memory-limit>%ld</memory-limit>\n\t</dlr-storage>\n";
+    } else {
+        frmt = "DLR: %ld expired, %ld evicted, %ld bytes used (limit %ld)\n\n";
+    }
+
+    return octstr_format(frmt, counter_value(expired_counter), counter_value(evicted_counter),
+                         bytes, stripe_memory_limit * DLR_MEM_STRIPES);
 }
 
 static struct dlr_storage  handles = {
@@ -197,16 +621,87 @@ static struct dlr_storage  handles = {
     .dlr_remove = dlr_mem_remove,
     .dlr_shutdown = dlr_mem_shutdown,
     .dlr_messages = dlr_mem_messages,
-    .dlr_flush = dlr_mem_flush
+    .dlr_flush = dlr_mem_flush,
+    .dlr_status = dlr_mem_status
 };
 
+static void dlr_mem_ttl_destroy(void *ttl)
+{
+    gw_free(ttl);
+}
+
+/*
+ * Read TTL and memory limit configuration, returns the largest TTL.
+ */
+static long dlr_mem_configure(Cfg *cfg)
+{
+    CfgGroup *grp;
+    List *grplist;
+    Octstr *id;
+    long ttl, max_ttl, limit, *val;
+
+    grp = cfg_get_single_group(cfg, octstr_imm("core"));
+    if (cfg_get_integer(&default_ttl, grp, octstr_imm("dlr-ttl")) == -1 || default_ttl < 0)
+        default_ttl = 0;
+    if (cfg_get_integer(&limit, grp, octstr_imm("dlr-memory-limit")) == -1 || limit < 0)
+        limit = 0;
+    if (limit > 0) {
+        stripe_memory_limit = limit / DLR_MEM_STRIPES;
+        if (stripe_memory_limit == 0)
+            stripe_memory_limit = 1;
+        info(0, "DLR[internal]: Memory limit set to %ld bytes.", limit);
+    }
+
+    max_ttl = default_ttl;
+    smsc_ttl = dict_create(32, dlr_mem_ttl_destroy);
+    grplist = cfg_get_multi_group(cfg, octstr_imm("smsc"));
+    while (grplist && (grp = gwlist_extract_first(grplist)) != NULL) {
+        if ((id = cfg_get(grp, octstr_imm("smsc-id"))) == NULL)
+            continue;
+        if (cfg_get_integer(&ttl, grp, octstr_imm("dlr-ttl")) != -1) {
+            val = gw_malloc(sizeof(*val));
+            *val = (ttl < 0 ? 0 : ttl);
+            dict_put(smsc_ttl, id, val);
+            if (*val > max_ttl)
+                max_ttl = *val;
+        }
+        octstr_destroy(id);
+    }
+    gwlist_destroy(grplist, NULL);
+
+    return max_ttl;
+}
+
 /*
- * Initialize dlr_waiting_list and return out storage handles.
+ * Initialize the index and return out storage handles.
  */
 struct dlr_storage *dlr_init_mem(Cfg *cfg)
 {
-    dlr_waiting_list = gwlist_create();
-    gw_rwlock_init_static(&rwlock);
+    long i, max_ttl = 0;
+
+    if (cfg != NULL)
+        max_ttl = dlr_mem_configure(cfg);
+
+    /* all entries must fit into one turn of the wheel */
+    if (max_ttl > 0) {
+        wheel_tick_len = (max_ttl + DLR_MEM_WHEEL_SLOTS - 2) / (DLR_MEM_WHEEL_SLOTS - 1);
+        if (wheel_tick_len < 1)
+            wheel_tick_len = 1;
+    }
+
+    for (i = 0; i < DLR_MEM_STRIPES; i++) {
+        gw_rwlock_init_static(&stripes[i].lock);
+        dlr_mem_stripe_init(&stripes[i]);
+    }
+    expired_counter = counter_create();
+    evicted_counter = counter_create();
+
+    if (wheel_tick_len > 0) {
+        info(0, "DLR[internal]: Expiring entries, checking every %ld seconds.", wheel_tick_len);
+        expire_running = 1;
+        if ((expire_thread = gwthread_create(dlr_mem_expire_thread, NULL)) == -1)
+            panic(0, "DLR[internal]: Could not start expiry thread.");
+    }
 
     return &handles;
 }
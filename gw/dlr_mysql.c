@@ -136,6 +136,91 @@ static void dlr_mysql_add(struct dlr_entry *entry)
     dlr_entry_destroy(entry);
 }
 
+/*
+ * MySQL allows at most 65535 placeholders per statement, so batches are
+ * written in chunks of this many rows.
+ */
+#define MYSQL_BATCH_ROWS 500
+
+/* insert count entries starting at from with one statement */
+static int dlr_mysql_insert_rows(DBPoolConn *pconn, List *entries, long from, long count)
+{
+    Octstr *sql, *os_mask;
+    struct dlr_entry *entry;
+    List *binds, *masks;
+    long n;
+    int res;
+
+    sql = octstr_format("INSERT INTO `%S` (`%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`, `%S`) VALUES ",
+                        fields->table, fields->field_smsc, fields->field_ts,
+                        fields->field_src, fields->field_dst, fields->field_serv,
+                        fields->field_url, fields->field_mask, fields->field_boxc,
+                        fields->field_status);
+    binds = gwlist_create();
+    masks = gwlist_create();
+    for (n = 0; n < count; n++) {
+        entry = gwlist_get(entries, from + n);
+        octstr_append_cstr(sql, n > 0 ? ", (?, ?, ?, ?, ?, ?, ?, ?, 0)" : "(?, ?, ?, ?, ?, ?, ?, ?, 0)");
+        os_mask = octstr_format("%d", entry->mask);
+        gwlist_append(masks, os_mask);
+        gwlist_append(binds, entry->smsc);
+        gwlist_append(binds, entry->timestamp);
+        gwlist_append(binds, entry->source);
+        gwlist_append(binds, entry->destination);
+        gwlist_append(binds, entry->service);
+        gwlist_append(binds, entry->url);
+        gwlist_append(binds, os_mask);
+        gwlist_append(binds, entry->boxc_id);
+    }
+
+#if defined(DLR_TRACE)
+    debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(sql));
+#endif
+    res = dbpool_conn_update(pconn, sql, binds);
+
+    octstr_destroy(sql);
+    gwlist_destroy(binds, NULL);
+    gwlist_destroy(masks, octstr_destroy_item);
+    return res;
+}
+
+static void dlr_mysql_add_batch(List *entries)
+{
+    DBPoolConn *pconn;
+    struct dlr_entry *entry;
+    long i, j, n;
+    int res;
+
+    debug("dlr.mysql", 0, "adding %ld DLR entries into database", gwlist_len(entries));
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    for (i = 0; i < gwlist_len(entries); i += n) {
+        n = gwlist_len(entries) - i;
+        if (n > MYSQL_BATCH_ROWS)
+            n = MYSQL_BATCH_ROWS;
+        if ((res = dlr_mysql_insert_rows(pconn, entries, i, n)) >= 0) {
+            if (res < n)
+                warning(0, "DLR: MYSQL: Only %d of %ld dlr entries inserted", res, n);
+            continue;
+        }
+        /* don't lose the whole chunk because of one bad row */
+        warning(0, "DLR: MYSQL: Error while adding %ld dlr entries, retrying one by one", n);
+        for (j = i; j < i + n; j++) {
+            entry = gwlist_get(entries, j);
+            if ((res = dlr_mysql_insert_rows(pconn, entries, j, 1)) == -1)
+                error(0, "DLR: MYSQL: Error while adding dlr entry for DST<%s>", octstr_get_cstr(entry->destination));
+            else if (!res)
+                warning(0, "DLR: MYSQL: No dlr inserted for DST<%s>", octstr_get_cstr(entry->destination));
+        }
+    }
+
+    dbpool_conn_produce(pconn);
+}
+
 static struct dlr_entry* dlr_mysql_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
     Octstr *sql, *like;
@@ -246,6 +331,54 @@ static void dlr_mysql_remove(const Octstr *smsc, const Octstr *ts, const Octstr
     octstr_destroy(like);
 }
 
+/*
+ * MySQL can't LIMIT a subquery on the table it deletes from, so a batch of
+ * removes is one "DELETE ... LIMIT 1" per key, all on one connection.
+ */
+static void dlr_mysql_remove_batch(List *keys)
+{
+    Octstr *sql, *sql_dst;
+    DBPoolConn *pconn;
+    struct dlr_entry *key;
+    List *binds;
+    long i;
+    int res;
+
+    debug("dlr.mysql", 0, "removing %ld DLRs from database", gwlist_len(keys));
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    sql = octstr_format("DELETE FROM `%S` WHERE `%S`=? AND `%S`=? LIMIT 1",
+                        fields->table, fields->field_smsc, fields->field_ts);
+    sql_dst = octstr_format("DELETE FROM `%S` WHERE `%S`=? AND `%S`=? AND `%S` LIKE CONCAT('%%', ?) LIMIT 1",
+                            fields->table, fields->field_smsc, fields->field_ts,
+                            fields->field_dst);
+    binds = gwlist_create();
+    for (i = 0; i < gwlist_len(keys); i++) {
+        key = gwlist_get(keys, i);
+        gwlist_append(binds, key->smsc);
+        gwlist_append(binds, key->timestamp);
+        if (key->destination)
+            gwlist_append(binds, key->destination);
+#if defined(DLR_TRACE)
+        debug("dlr.mysql", 0, "sql: %s", octstr_get_cstr(key->destination ? sql_dst : sql));
+#endif
+        if ((res = dbpool_conn_update(pconn, key->destination ? sql_dst : sql, binds)) == -1)
+            error(0, "DLR: MYSQL: Error while removing dlr entry for DST<%s>", octstr_get_cstr(key->destination));
+        else if (!res)
+            warning(0, "DLR: MYSQL: No dlr deleted for DST<%s>", octstr_get_cstr(key->destination));
+        gwlist_delete(binds, 0, gwlist_len(binds));
+    }
+
+    dbpool_conn_produce(pconn);
+    gwlist_destroy(binds, NULL);
+    octstr_destroy(sql);
+    octstr_destroy(sql_dst);
+}
+
 static void dlr_mysql_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
 {
     Octstr *sql, *os_status, *like;
@@ -358,7 +491,9 @@ static struct dlr_storage handles = {
     .dlr_remove = dlr_mysql_remove,
     .dlr_shutdown = dlr_mysql_shutdown,
     .dlr_messages = dlr_mysql_messages,
-    .dlr_flush = dlr_mysql_flush
+    .dlr_flush = dlr_mysql_flush,
+    .dlr_add_batch = dlr_mysql_add_batch,
+    .dlr_remove_batch = dlr_mysql_remove_batch
 };
 
 struct dlr_storage *dlr_init_mysql(Cfg *cfg)
@@ -140,6 +140,25 @@ struct dlr_storage {
      * Shutdown storage
      */
     void (*dlr_shutdown) (void);
+    /*
+     * Return storage specific status information for the
+     * bearerbox status page, formatted for given status type.
+     */
+    Octstr* (*dlr_status) (int status_type);
+    /*
+     * Optional: add a list of dlr entries with as few statements as
+     * possible. Used by the asynchronous DLR writer if defined.
+     * NOTE: the caller keeps ownership of list and entries.
+     */
+    void (*dlr_add_batch) (List *entries);
+    /*
+     * Optional: remove a list of entries, each given as struct dlr_entry
+     * with smsc, timestamp and (possibly NULL) destination set. Like
+     * dlr_remove, every key removes one entry, so a key given twice
+     * removes two.
+     * NOTE: the caller keeps ownership of list and entries.
+     */
+    void (*dlr_remove_batch) (List *keys);
 };
 
 /*
@@ -163,6 +182,14 @@ struct dlr_db_fields {
 struct dlr_db_fields *dlr_db_fields_create(CfgGroup *grp);
 void dlr_db_fields_destroy(struct dlr_db_fields *fields);
 
+/*
+ * Helper for dlr_remove_batch: each key removes exactly one entry, even
+ * if several keys are equal. Returns 0 if the key at pos already occurs
+ * in keys at from..pos-1, else how often it occurs at pos..from+count-1,
+ * i.e. how many entries one statement has to delete for it.
+ */
+long dlr_key_repeats(List *keys, long from, long count, long pos);
+
 /*
  * Storages we have already. This will gone in future
  * if we have module API implemented.
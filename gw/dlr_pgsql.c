@@ -161,6 +161,63 @@ static void dlr_pgsql_add(struct dlr_entry *entry)
     dlr_entry_destroy(entry);
 }
 
+/* rows per statement when writing batches */
+#define PGSQL_BATCH_ROWS 500
+
+/* insert count entries starting at from with one statement */
+static int pgsql_insert_rows(List *entries, long from, long count)
+{
+    struct dlr_entry *entry;
+    Octstr *sql;
+    long n;
+    int res;
+
+    sql = octstr_format("INSERT INTO \"%S\" (\"%S\", \"%S\", \"%S\", \"%S\", \"%S\", \"%S\", \"%S\", \"%S\", \"%S\") VALUES ",
+                        fields->table, fields->field_smsc, fields->field_ts,
+                        fields->field_src, fields->field_dst, fields->field_serv,
+                        fields->field_url, fields->field_mask, fields->field_boxc,
+                        fields->field_status);
+    for (n = 0; n < count; n++) {
+        entry = gwlist_get(entries, from + n);
+        octstr_format_append(sql, "%s('%S', '%S', '%S', '%S', '%S', '%S', '%d', '%S', '%d')",
+                             n > 0 ? ", " : "",
+                             entry->smsc, entry->timestamp, entry->source,
+                             entry->destination, entry->service, entry->url,
+                             entry->mask, entry->boxc_id, 0);
+    }
+    octstr_append_char(sql, ';');
+
+    res = pgsql_update(sql);
+    octstr_destroy(sql);
+    return res;
+}
+
+static void dlr_pgsql_add_batch(List *entries)
+{
+    struct dlr_entry *entry;
+    long i, j, n;
+    int res;
+
+    for (i = 0; i < gwlist_len(entries); i += n) {
+        n = gwlist_len(entries) - i;
+        if (n > PGSQL_BATCH_ROWS)
+            n = PGSQL_BATCH_ROWS;
+        if ((res = pgsql_insert_rows(entries, i, n)) >= 0) {
+            if (res < n)
+                warning(0, "DLR: PGSQL: Only %d of %ld dlr entries inserted", res, n);
+            continue;
+        }
+        /* don't lose the whole chunk because of one bad row */
+        warning(0, "DLR: PGSQL: Error while adding %ld dlr entries, retrying one by one", n);
+        for (j = i; j < i + n; j++) {
+            entry = gwlist_get(entries, j);
+            if ((res = pgsql_insert_rows(entries, j, 1)) == -1)
+                error(0, "DLR: PGSQL: Error while adding dlr entry for DST<%s>", octstr_get_cstr(entry->destination));
+            else if (!res)
+                warning(0, "DLR: PGSQL: No dlr inserted for DST<%s>", octstr_get_cstr(entry->destination));
+        }
+    }
+}
 
 static struct dlr_entry *dlr_pgsql_get(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
@@ -239,6 +296,67 @@ static void dlr_pgsql_remove(const Octstr *smsc, const Octstr *ts, const Octstr
     octstr_destroy(like);
 }
 
+/*
+ * Delete one row for each of count keys starting at from with one
+ * statement. Like in dlr_pgsql_remove(), rows are picked by oid, so that
+ * equal keys don't delete more rows than they were given.
+ */
+static int pgsql_delete_rows(List *keys, long from, long count)
+{
+    struct dlr_entry *key;
+    Octstr *sql;
+    long n, repeats;
+    int first = 1, res;
+
+    sql = octstr_format("DELETE FROM \"%S\" WHERE ", fields->table);
+    for (n = from; n < from + count; n++) {
+        if ((repeats = dlr_key_repeats(keys, from, count, n)) == 0)
+            continue;
+        key = gwlist_get(keys, n);
+        octstr_format_append(sql, "%soid IN (SELECT oid FROM \"%S\" WHERE \"%S\"='%S' AND \"%S\"='%S'",
+                             first ? "" : " OR ", fields->table,
+                             fields->field_smsc, key->smsc, fields->field_ts, key->timestamp);
+        if (key->destination)
+            octstr_format_append(sql, " AND \"%S\" LIKE '%%%S'", fields->field_dst, key->destination);
+        octstr_format_append(sql, " LIMIT %ld)", repeats);
+        first = 0;
+    }
+    octstr_append_char(sql, ';');
+
+    res = pgsql_update(sql);
+    octstr_destroy(sql);
+    return res;
+}
+
+static void dlr_pgsql_remove_batch(List *keys)
+{
+    struct dlr_entry *key;
+    long i, j, n;
+    int res;
+
+    debug("dlr.pgsql", 0, "removing %ld DLRs from database", gwlist_len(keys));
+
+    for (i = 0; i < gwlist_len(keys); i += n) {
+        n = gwlist_len(keys) - i;
+        if (n > PGSQL_BATCH_ROWS)
+            n = PGSQL_BATCH_ROWS;
+        if ((res = pgsql_delete_rows(keys, i, n)) >= 0) {
+            if (res < n)
+                warning(0, "DLR: PGSQL: Only %d of %ld dlr entries deleted", res, n);
+            continue;
+        }
+        warning(0, "DLR: PGSQL: Error while removing %ld dlr entries, retrying one by one", n);
+        for (j = i; j < i + n; j++) {
+            key = gwlist_get(keys, j);
+            if ((res = pgsql_delete_rows(keys, j, 1)) == -1)
+                error(0, "DLR: PGSQL: Error while removing dlr entry for DST<%s>", octstr_get_cstr(key->destination));
+            else if (!res)
+                warning(0, "DLR: PGSQL: No dlr deleted for DST<%s>", octstr_get_cstr(key->destination));
+        }
+    }
+}
+
+
 
 static void dlr_pgsql_update(const Octstr *smsc, const Octstr *ts, const Octstr *dst, int status)
 {
@@ -306,7 +424,9 @@ static struct dlr_storage handles = {
     .dlr_remove = dlr_pgsql_remove,
     .dlr_shutdown = dlr_pgsql_shutdown,
     .dlr_messages = dlr_pgsql_messages,
-    .dlr_flush = dlr_pgsql_flush
+    .dlr_flush = dlr_pgsql_flush,
+    .dlr_add_batch = dlr_pgsql_add_batch,
+    .dlr_remove_batch = dlr_pgsql_remove_batch
 };
 
 
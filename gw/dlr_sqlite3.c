@@ -169,6 +169,90 @@ static void dlr_add_sqlite3(struct dlr_entry *entry)
     dlr_entry_destroy(entry);
 }
 
+/*
+ * Older SQLite versions allow at most 999 host parameters per statement,
+ * so batches are written in chunks of this many rows.
+ */
+#define SQLITE3_BATCH_ROWS 100
+
+/* insert count entries starting at from with one statement */
+static int sqlite3_insert_rows(DBPoolConn *pconn, List *entries, long from, long count)
+{
+    Octstr *sql, *os_mask;
+    struct dlr_entry *entry;
+    List *binds, *masks;
+    long n;
+    int res;
+
+    sql = octstr_format("INSERT INTO %S (%S, %S, %S, %S, %S, %S, %S, %S, %S) VALUES ",
+                        fields->table, fields->field_smsc, fields->field_ts,
+                        fields->field_src, fields->field_dst, fields->field_serv,
+                        fields->field_url, fields->field_mask, fields->field_boxc,
+                        fields->field_status);
+    binds = gwlist_create();
+    masks = gwlist_create();
+    for (n = 0; n < count; n++) {
+        entry = gwlist_get(entries, from + n);
+        octstr_append_cstr(sql, n > 0 ? ", (?, ?, ?, ?, ?, ?, ?, ?, 0)" : "(?, ?, ?, ?, ?, ?, ?, ?, 0)");
+        os_mask = octstr_format("%d", entry->mask);
+        gwlist_append(masks, os_mask);
+        gwlist_append(binds, entry->smsc);
+        gwlist_append(binds, entry->timestamp);
+        gwlist_append(binds, entry->source);
+        gwlist_append(binds, entry->destination);
+        gwlist_append(binds, entry->service);
+        gwlist_append(binds, entry->url);
+        gwlist_append(binds, os_mask);
+        gwlist_append(binds, entry->boxc_id);
+    }
+#if defined(DLR_TRACE)
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+#endif
+    res = dbpool_conn_update(pconn, sql, binds);
+
+    octstr_destroy(sql);
+    gwlist_destroy(binds, NULL);
+    gwlist_destroy(masks, octstr_destroy_item);
+    return res;
+}
+
+static void dlr_add_batch_sqlite3(List *entries)
+{
+    DBPoolConn *pconn;
+    struct dlr_entry *entry;
+    long i, j, n;
+    int res;
+
+    debug("dlr.sqlite3", 0, "adding %ld DLR entries into database", gwlist_len(entries));
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    for (i = 0; i < gwlist_len(entries); i += n) {
+        n = gwlist_len(entries) - i;
+        if (n > SQLITE3_BATCH_ROWS)
+            n = SQLITE3_BATCH_ROWS;
+        if ((res = sqlite3_insert_rows(pconn, entries, i, n)) >= 0) {
+            if (res < n)
+                warning(0, "DLR: SQLite3: Only %d of %ld dlr entries inserted", res, n);
+            continue;
+        }
+        /* don't lose the whole chunk because of one bad row */
+        warning(0, "DLR: SQLite3: Error while adding %ld dlr entries, retrying one by one", n);
+        for (j = i; j < i + n; j++) {
+            entry = gwlist_get(entries, j);
+            if ((res = sqlite3_insert_rows(pconn, entries, j, 1)) == -1)
+                error(0, "DLR: SQLite3: Error while adding dlr entry for DST<%s>", octstr_get_cstr(entry->destination));
+            else if (!res)
+                warning(0, "DLR: SQLite3: No dlr inserted for DST<%s>", octstr_get_cstr(entry->destination));
+        }
+    }
+
+    dbpool_conn_produce(pconn);
+}
+
 static void dlr_remove_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
     Octstr *sql, *like;
@@ -211,6 +295,83 @@ static void dlr_remove_sqlite3(const Octstr *smsc, const Octstr *ts, const Octst
     octstr_destroy(like);
 }
 
+/*
+ * Delete one row for each of count keys starting at from with one
+ * statement. Like in dlr_remove_sqlite3(), rows are picked by ROWID, so
+ * that equal keys don't delete more rows than they were given.
+ */
+static int sqlite3_delete_rows(DBPoolConn *pconn, List *keys, long from, long count)
+{
+    Octstr *sql;
+    struct dlr_entry *key;
+    List *binds;
+    long n, repeats;
+    int first = 1, res;
+
+    sql = octstr_format("DELETE FROM %S WHERE ", fields->table);
+    binds = gwlist_create();
+    for (n = from; n < from + count; n++) {
+        if ((repeats = dlr_key_repeats(keys, from, count, n)) == 0)
+            continue;
+        key = gwlist_get(keys, n);
+        octstr_format_append(sql, "%sROWID IN (SELECT ROWID FROM %S WHERE %S=? AND %S=?",
+                             first ? "" : " OR ", fields->table,
+                             fields->field_smsc, fields->field_ts);
+        gwlist_append(binds, key->smsc);
+        gwlist_append(binds, key->timestamp);
+        if (key->destination) {
+            octstr_format_append(sql, " AND %S LIKE '%%' || ?", fields->field_dst);
+            gwlist_append(binds, key->destination);
+        }
+        octstr_format_append(sql, " LIMIT %ld)", repeats);
+        first = 0;
+    }
+#if defined(DLR_TRACE)
+    debug("dlr.sqlite3", 0, "sql: %s", octstr_get_cstr(sql));
+#endif
+    res = dbpool_conn_update(pconn, sql, binds);
+
+    octstr_destroy(sql);
+    gwlist_destroy(binds, NULL);
+    return res;
+}
+
+static void dlr_remove_batch_sqlite3(List *keys)
+{
+    DBPoolConn *pconn;
+    struct dlr_entry *key;
+    long i, j, n;
+    int res;
+
+    debug("dlr.sqlite3", 0, "removing %ld DLRs from database", gwlist_len(keys));
+
+    pconn = dbpool_conn_consume(pool);
+    /* just for sure */
+    if (pconn == NULL)
+        return;
+
+    for (i = 0; i < gwlist_len(keys); i += n) {
+        n = gwlist_len(keys) - i;
+        if (n > SQLITE3_BATCH_ROWS)
+            n = SQLITE3_BATCH_ROWS;
+        if ((res = sqlite3_delete_rows(pconn, keys, i, n)) >= 0) {
+            if (res < n)
+                warning(0, "DLR: SQLite3: Only %d of %ld dlr entries deleted", res, n);
+            continue;
+        }
+        warning(0, "DLR: SQLite3: Error while removing %ld dlr entries, retrying one by one", n);
+        for (j = i; j < i + n; j++) {
+            key = gwlist_get(keys, j);
+            if ((res = sqlite3_delete_rows(pconn, keys, j, 1)) == -1)
+                error(0, "DLR: SQLite3: Error while removing dlr entry for DST<%s>", octstr_get_cstr(key->destination));
+            else if (!res)
+                warning(0, "DLR: SQLite3: No dlr deleted for DST<%s>", octstr_get_cstr(key->destination));
+        }
+    }
+
+    dbpool_conn_produce(pconn);
+}
+
 static struct dlr_entry* dlr_get_sqlite3(const Octstr *smsc, const Octstr *ts, const Octstr *dst)
 {
     Octstr *sql, *like;
@@ -352,7 +513,9 @@ static struct dlr_storage handles = {
     .dlr_get = dlr_get_sqlite3,
     .dlr_remove = dlr_remove_sqlite3,
     .dlr_update = dlr_update_sqlite3,
-    .dlr_flush = dlr_flush_sqlite3
+    .dlr_flush = dlr_flush_sqlite3,
+    .dlr_add_batch = dlr_add_batch_sqlite3,
+    .dlr_remove_batch = dlr_remove_batch_sqlite3
 };
 
 struct dlr_storage *dlr_init_sqlite3(Cfg *cfg)
@@ -64,7 +64,9 @@
  */
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 
@@ -83,8 +85,23 @@ static int parse_integer(long *i, Octstr *packed, int *off);
 static int parse_string(Octstr **os, Octstr *packed, int *off);
 static int parse_uuid(uuid_t id, Octstr *packed, int *off);
 
+static void append_varint(Octstr *os, uint64_t i);
+static int parse_varint(uint64_t *i, const unsigned char *data, long len, long *off);
+static Octstr *msg_pack_v2(Msg *msg);
+static Msg *msg_unpack_v2(Octstr *os, const char *file, long line, const char *func);
+
 static char *type_as_str(Msg *msg);
 
+/*
+ * A V1 packed Msg starts with the most significant byte of its type,
+ * which is always zero, so a V2 one is told apart by its first byte.
+ */
+#define MSG_V2_MAGIC 0x02
+
+/* signed integers are zigzag encoded to keep small negatives short */
+#define ZIGZAG(i) (((unsigned long) (i) << 1) ^ (unsigned long) ((i) < 0 ? -1L : 0L))
+#define UNZIGZAG(u) ((long) ((u) >> 1) ^ -(long) ((u) & 1))
+
 
 /**********************************************************************
  * Implementations of the exported functions.
@@ -203,12 +220,24 @@ Octstr *msg_pack(Msg *msg)
 }
 
 
+Octstr *msg_pack_format(Msg *msg, int format)
+{
+    if (format == MSG_FORMAT_V2)
+        return msg_pack_v2(msg);
+
+    return msg_pack(msg);
+}
+
+
 Msg *msg_unpack_real(Octstr *os, const char *file, long line, const char *func)
 {
     Msg *msg;
     int off;
     long i;
 
+    if (octstr_len(os) > 0 && octstr_get_char(os, 0) == MSG_V2_MAGIC)
+        return msg_unpack_v2(os, file, line, func);
+
     msg = msg_create_real(0, file, line, func);
     if (msg == NULL)
         goto error;
@@ -350,6 +379,186 @@ static int parse_uuid(uuid_t id, Octstr *packed, int *off)
    return 0;
 }
 
+static void append_varint(Octstr *os, uint64_t i)
+{
+    unsigned char buf[(sizeof(i) * 8 + 6) / 7];
+    int n = 0;
+
+    while (i >= 0x80) {
+        buf[n++] = (i & 0x7f) | 0x80;
+        i >>= 7;
+    }
+    buf[n++] = i;
+    octstr_append_data(os, (char *) buf, n);
+}
+
+static int parse_varint(uint64_t *i, const unsigned char *data, long len, long *off)
+{
+    uint64_t res = 0;
+    int shift;
+
+    for (shift = 0; *off < len && shift < sizeof(res) * 8; shift += 7) {
+        res |= (uint64_t) (data[*off] & 0x7f) << shift;
+        if ((data[(*off)++] & 0x80) == 0) {
+            *i = res;
+            return 0;
+        }
+    }
+    error(0, "Packet too short while unpacking Msg.");
+    return -1;
+}
+
+/*
+ * V2 layout: magic byte, varint type, varint bitmap of the fields that
+ * are set (in msg-decl.h order, VOIDs not counted), then the set fields.
+ * Integers are zigzag varints, strings a varint length plus data and
+ * UUIDs their 16 raw bytes. Unset integers are MSG_PARAM_UNDEFINED,
+ * unset strings NULL and unset UUIDs null ones.
+ */
+
+/* the 64 bit bitmap has to hold all fields of every message type */
+#define INTEGER(name) char name;
+#define OCTSTR(name) char name;
+#define UUID(name) char name;
+#define VOID(name)
+#define MSG(type, stmt) \
+    struct type##_v2_fields stmt; \
+    typedef char type##_v2_fields_fit[sizeof(struct type##_v2_fields) <= 64 ? 1 : -1];
+#include "msg-decl.h"
+
+static Octstr *msg_pack_v2(Msg *msg)
+{
+    Octstr *os;
+    uint64_t present = 0, bit;
+
+    bit = UINT64_C(1);
+#define INTEGER(name) if (p->name != MSG_PARAM_UNDEFINED) present |= bit; bit <<= 1;
+#define OCTSTR(name) if (p->name != NULL) present |= bit; bit <<= 1;
+#define UUID(name) if (!uuid_is_null(p->name)) present |= bit; bit <<= 1;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; stmt } break;
+
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        panic(0, "Internal error: unknown message type: %d",
+              msg->type);
+    }
+    os = octstr_create("");
+    octstr_append_char(os, MSG_V2_MAGIC);
+    append_varint(os, msg->type);
+    append_varint(os, present);
+
+    bit = UINT64_C(1);
+#define INTEGER(name) \
+    if (present & bit) append_varint(os, ZIGZAG(p->name)); \
+    bit <<= 1;
+#define OCTSTR(name) \
+    if (present & bit) { \
+        append_varint(os, octstr_len(p->name)); \
+        octstr_append(os, p->name); \
+    } \
+    bit <<= 1;
+#define UUID(name) \
+    if (present & bit) octstr_append_data(os, (char *) p->name, sizeof(uuid_t)); \
+    bit <<= 1;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; stmt } break;
+
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+    return os;
+}
+
+/*
+ * Strings are created straight from the received buffer. The Msg is
+ * initialized here rather than by msg_create(), which would generate
+ * UUIDs that get overwritten anyway.
+ */
+static Msg *msg_unpack_v2(Octstr *os, const char *file, long line, const char *func)
+{
+    const unsigned char *data;
+    uint64_t type, present, bit, i;
+    long len, off;
+    Msg *msg;
+
+    data = (const unsigned char *) octstr_get_cstr(os);
+    len = octstr_len(os);
+    off = 1;
+
+    if (parse_varint(&type, data, len, &off) == -1 ||
+        parse_varint(&present, data, len, &off) == -1) {
+        error(0, "Msg packet was invalid.");
+        return NULL;
+    }
+    if (type >= msg_type_count) {
+        error(0, "Internal error: unknown message type: %ld", (long) type);
+        return NULL;
+    }
+
+    msg = gw_malloc_trace(sizeof(Msg), file, line, func);
+    msg->type = type;
+
+    /* a Msg carries the fields of all types */
+#define INTEGER(name) p->name = MSG_PARAM_UNDEFINED;
+#define OCTSTR(name) p->name = NULL;
+#define UUID(name) uuid_clear(p->name);
+#define VOID(name) p->name = NULL;
+#define MSG(type, stmt) { struct type *p = &msg->type; stmt }
+#include "msg-decl.h"
+
+    bit = UINT64_C(1);
+#define INTEGER(name) \
+    if (present & bit) { \
+        if (parse_varint(&i, data, len, &off) == -1) goto error; \
+        p->name = UNZIGZAG(i); \
+    } \
+    bit <<= 1;
+#define OCTSTR(name) \
+    if (present & bit) { \
+        if (parse_varint(&i, data, len, &off) == -1) goto error; \
+        if (i > len - off) { \
+            error(0, "Packet too short while unpacking Msg."); \
+            goto error; \
+        } \
+        p->name = octstr_create_from_data_trace((const char *) data + off, i, file, line, func); \
+        off += i; \
+    } \
+    bit <<= 1;
+#define UUID(name) \
+    if (present & bit) { \
+        if (off + (long) sizeof(uuid_t) > len) { \
+            error(0, "Packet too short while unpacking Msg."); \
+            goto error; \
+        } \
+        memcpy(p->name, data + off, sizeof(uuid_t)); \
+        off += sizeof(uuid_t); \
+    } \
+    bit <<= 1;
+#define VOID(name)
+#define MSG(type, stmt) \
+    case type: { struct type *p = &msg->type; stmt } break;
+
+    switch (msg->type) {
+#include "msg-decl.h"
+    default:
+        break;
+    }
+
+    return msg;
+
+error:
+    msg_destroy(msg);
+    error(0, "Msg packet was invalid.");
+    return NULL;
+}
+
 static char *type_as_str(Msg *msg)
 {
     switch (msg->type) {
@@ -116,7 +116,20 @@ enum {
     cmd_suspend = 1,
     cmd_resume = 2,
     cmd_identify = 3,
-    cmd_restart = 4
+    cmd_restart = 4,
+    cmd_msg_v2 = 5      /* sender reads MSG_FORMAT_V2 */
+};
+
+/*
+ * Msg wire formats. V1 packs every field as a 4 byte length prefixed
+ * value, V2 packs only the set fields behind a presence bitmap, using
+ * varint integers and binary UUIDs. msg_unpack() reads both; boxes
+ * offer V2 with a cmd_msg_v2 admin message after connecting and
+ * the bearerbox answers the same way if it agrees.
+ */
+enum {
+    MSG_FORMAT_V1 = 1,
+    MSG_FORMAT_V2 = 2
 };
 
 /* ack message status */
@@ -175,8 +188,15 @@ Octstr *msg_pack(Msg *msg);
 
 
 /*
- * Unpack an Msg from an Octstr. Return NULL for failure, otherwise a pointer
- * to the Msg.
+ * Pack an Msg into an Octstr using the given MSG_FORMAT_*.
+ * Panics if fails.
+ */
+Octstr *msg_pack_format(Msg *msg, int format);
+
+
+/*
+ * Unpack an Msg from an Octstr in either format. Return NULL for failure,
+ * otherwise a pointer to the Msg.
  */
 Msg *msg_unpack_real(Octstr *os, const char *file, long line, const char *func);
 #define msg_unpack(os) \
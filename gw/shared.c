@@ -79,6 +79,9 @@ volatile enum program_status program_status = starting_up;
  * established from a foobarbox to bearerbox. */
 static Connection *bb_conn;
 
+/* Msg format used towards bb_conn, agreed on after connecting */
+static volatile int bb_msg_format = MSG_FORMAT_V1;
+
 
 Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *our_host)
 {
@@ -107,9 +110,20 @@ Connection *connect_to_bearerbox_real(Octstr *host, int port, int ssl, Octstr *o
 
 void connect_to_bearerbox(Octstr *host, int port, int ssl, Octstr *our_host)
 {
+    Msg *msg;
+
     bb_conn = connect_to_bearerbox_real(host, port, ssl, our_host);
     if (bb_conn == NULL)
         panic(0, "Couldn't connect to the bearerbox.");
+
+    /*
+     * Offer the compact Msg format. Bearerboxes that don't know it
+     * ignore this and we keep on using the old one.
+     */
+    bb_msg_format = MSG_FORMAT_V1;
+    msg = msg_create(admin);
+    msg->admin.command = cmd_msg_v2;
+    write_to_bearerbox(msg);
 }
 
 
@@ -130,7 +144,7 @@ void write_to_bearerbox_real(Connection *conn, Msg *pmsg)
 {
     Octstr *pack;
 
-    pack = msg_pack(pmsg);
+    pack = msg_pack_format(pmsg, conn == bb_conn ? bb_msg_format : MSG_FORMAT_V1);
     if (conn_write_withlen(conn, pack) == -1)
     	error(0, "Couldn't write Msg to bearerbox.");
 
@@ -150,7 +164,7 @@ int deliver_to_bearerbox_real(Connection *conn, Msg *msg)
      
     Octstr *pack;
     
-    pack = msg_pack(msg);
+    pack = msg_pack_format(msg, conn == bb_conn ? bb_msg_format : MSG_FORMAT_V1);
     if (conn_write_withlen(conn, pack) == -1) {
     	error(0, "Couldn't deliver Msg to bearerbox.");
         octstr_destroy(pack);
@@ -174,6 +188,7 @@ int read_from_bearerbox_real(Connection *conn, Msg **msg, double seconds)
     int ret;
     Octstr *pack;
 
+again:
     pack = NULL;
     *msg = NULL;
     while (program_status != shutting_down) {
@@ -213,6 +228,14 @@ int read_from_bearerbox_real(Connection *conn, Msg **msg, double seconds)
         return -1;
     }
 
+    /* bearerbox accepted our offer of the compact Msg format */
+    if (conn == bb_conn && msg_type(*msg) == admin && (*msg)->admin.command == cmd_msg_v2) {
+        debug("gw.shared", 0, "Bearerbox agreed on Msg format v2.");
+        bb_msg_format = MSG_FORMAT_V2;
+        msg_destroy(*msg);
+        goto again;
+    }
+
     return 0;
 }
 
@@ -244,58 +244,80 @@ void prepend_catenation_udh(Msg *sms, int part_no, int num_messages,
 }
 
 
-static Octstr *extract_msgdata_part(Octstr *msgdata, Octstr *split_chars,
-    	    	    	    	    int max_part_len)
+/*
+ * Return the number of octets to take for the next part starting at
+ * offset start of msgdata, at most max_part_len. If the rest doesn't fit
+ * and split_chars is given, the part ends after the last split char in
+ * that range.
+ */
+static long msgdata_part_len(Octstr *msgdata, long start, long max_part_len,
+                             Octstr *split_chars)
 {
     long i, len;
-    Octstr *part;
 
+    if (max_part_len < 0)
+        max_part_len = 0;
     len = max_part_len;
-    if (max_part_len < octstr_len(msgdata) && split_chars != NULL)
+    if (start + max_part_len < octstr_len(msgdata) && split_chars != NULL)
 	for (i = max_part_len; i > 0; i--)
 	    if (octstr_search_char(split_chars,
-				   octstr_get_char(msgdata, i - 1), 0) != -1) {
+				   octstr_get_char(msgdata, start + i - 1), 0) != -1) {
 		len = i;
 		break;
 	    }
-    part = octstr_copy(msgdata, 0, len);
-    octstr_delete(msgdata, 0, len);
-    return part;
+    if (start + len > octstr_len(msgdata))
+        len = octstr_len(msgdata) - start;
+    return len;
 }
 
 
-static Octstr *extract_msgdata_part_by_coding(Msg *msg, Octstr *split_chars,
-        int max_part_len)
+/*
+ * Measure a 7-bit message text in a single pass. The text is reduced to
+ * the characters GSM can represent, then for every character boundary i
+ * offsets[i] holds the octet offset in the UTF-8 text and septets[i]
+ * the number of GSM septets in front of it (escaped characters count
+ * two). Returns the number of characters.
+ */
+static long measure_gsm_text(Octstr *text, long **offsets, long **septets)
 {
-    Octstr *temp = NULL, *temp_utf;
-
-    if (msg->sms.coding == DC_8BIT || msg->sms.coding == DC_UCS2) {
-        /* nothing to do here, just call the original extract_msgdata_part */
-        return extract_msgdata_part(msg->sms.msgdata, split_chars, max_part_len);
-    }
+    Octstr *gsm;
+    long n, pos, gpos, len, glen;
+    int c;
 
     /* convert to and the from gsm, so we drop all non GSM chars */
-    charset_utf8_to_gsm(msg->sms.msgdata);
-    charset_gsm_to_utf8(msg->sms.msgdata);
-
-    /* 
-     * else we need to do something special. I'll just get charset_gsm_truncate to
-     * cut the string to the required length and then count real characters. 
-     */
-     temp = octstr_duplicate(msg->sms.msgdata);
-     charset_utf8_to_gsm(temp);
-     charset_gsm_truncate(temp, max_part_len);
-
-     /* calculate utf-8 length */
-     temp_utf = octstr_duplicate(temp);
-     charset_gsm_to_utf8(temp_utf);
-     max_part_len = octstr_len(temp_utf);
-
-     octstr_destroy(temp);
-     octstr_destroy(temp_utf);
+    charset_utf8_to_gsm(text);
+    charset_gsm_to_utf8(text);
+    gsm = octstr_duplicate(text);
+    charset_utf8_to_gsm(gsm);
+
+    len = octstr_len(text);
+    glen = octstr_len(gsm);
+    *offsets = gw_malloc((len + 1) * sizeof(long));
+    *septets = gw_malloc((len + 1) * sizeof(long));
+
+    /* every UTF-8 character now maps to exactly one GSM character */
+    n = pos = gpos = 0;
+    while (pos < len) {
+        (*offsets)[n] = pos;
+        (*septets)[n] = gpos;
+        n++;
+        c = octstr_get_char(text, pos);
+        if ((c & 0xE0) == 0xC0)
+            pos += 2;
+        else if ((c & 0xF0) == 0xE0)
+            pos += 3;
+        else
+            pos++;
+        if (octstr_get_char(gsm, gpos) == 27 && gpos + 1 < glen)
+            gpos += 2;
+        else
+            gpos++;
+    }
+    (*offsets)[n] = len;
+    (*septets)[n] = glen;
+    octstr_destroy(gsm);
 
-     /* now just call the original extract_msgdata_part with the new length */
-     return extract_msgdata_part(msg->sms.msgdata, split_chars, max_part_len);
+    return n;
 }
 
 
@@ -306,7 +328,10 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
 {
     long max_part_len, udh_len, hf_len, nlsuf_len;
     unsigned long total_messages, msgno;
-    long last;
+    long last, start, end, len, nchars, first, limit;
+    long *offsets = NULL, *septets = NULL;
+    int gsm;
+    Octstr *msgdata;
     List *list;
     Msg *part, *temp;
 
@@ -334,14 +359,30 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
     /* ensure max_part_len is never negativ */
     max_part_len = max_part_len > 0 ? max_part_len : 0;
 
+    /*
+     * The parts are sliced out of one copy of the text. For 7-bit texts
+     * the septet offsets of all characters are computed once up front,
+     * so neither conversions nor copies of the rest are needed per part.
+     */
+    msgdata = octstr_duplicate(orig->sms.msgdata);
+    if (msgdata == NULL)
+        msgdata = octstr_create("");
+    gsm = (orig->sms.coding != DC_8BIT && orig->sms.coding != DC_UCS2);
+    nchars = gsm ? measure_gsm_text(msgdata, &offsets, &septets) : 0;
+
+    /* parts are copied from a template without text */
     temp = msg_duplicate(orig);
+    octstr_destroy(temp->sms.msgdata);
+    temp->sms.msgdata = NULL;
+
     msgno = 0;
     list = gwlist_create();
 
     last = 0;
+    start = first = 0;
     do {
         msgno++;
-        part = msg_duplicate(orig);
+        part = msg_duplicate(temp);
 
         /* 
          * if its a DLR request message getting split, 
@@ -352,13 +393,35 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
             part->sms.dlr_url = NULL;
             part->sms.dlr_mask = 0;
         }
-        octstr_destroy(part->sms.msgdata);
-        if (sms_msgdata_len(temp) <= max_part_len || msgno == max_messages)
+
+        if (msgno == 1)
+            len = sms_msgdata_len(orig);
+        else if (orig->sms.coding == DC_7BIT)
+            len = septets[nchars] - septets[first];
+        else
+            len = octstr_len(msgdata) - start;
+        if (len <= max_part_len || msgno == max_messages)
             last = 1;
 
-        part->sms.msgdata = 
-            extract_msgdata_part_by_coding(temp, split_chars,
-                                           max_part_len - nlsuf_len);
+        if (gsm) {
+            /* the most whole characters that fit into the septet limit */
+            limit = septets[first] + max_part_len - nlsuf_len;
+            end = first;
+            while (end < nchars && septets[end + 1] <= limit)
+                end++;
+            len = msgdata_part_len(msgdata, start, offsets[end] - start,
+                                   split_chars);
+            /* continue at the character boundary behind the part */
+            while (end > first && offsets[end] > start + len)
+                end--;
+            len = offsets[end] - start;
+            first = end;
+        } else
+            len = msgdata_part_len(msgdata, start, max_part_len - nlsuf_len,
+                                   split_chars);
+        part->sms.msgdata = octstr_copy(msgdata, start, len);
+        start += len;
+
         /* create new id for every part, except last */
         if (!last)
             uuid_generate(part->sms.id);
@@ -374,6 +437,9 @@ List *sms_split(Msg *orig, Octstr *header, Octstr *footer,
 
     total_messages = msgno;
     msg_destroy(temp);
+    octstr_destroy(msgdata);
+    gw_free(offsets);
+    gw_free(septets);
     if (catenate && total_messages > 1) {
         for (msgno = 1; msgno <= total_messages; msgno++) {
             part = gwlist_get(list, msgno - 1);
@@ -58,6 +58,7 @@
  * smsbox.c - main program of the smsbox
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
@@ -101,6 +102,10 @@
 #define HTTP_MAX_RETRIES    0
 #define HTTP_RETRY_DELAY    10 /* in sec. */
 #define HTTP_MAX_PENDING    512 /* max requests handled in parallel */
+#define HTTP_RESULT_THREADS 1   /* threads processing HTTP results */
+
+/* Default number of threads serving sendsms-port requests */
+#define SENDSMS_THREADS     1
 
 /* Timer item structure for HTTP retrying */
 typedef struct TimerItem {
@@ -120,6 +125,7 @@ static Octstr *smsbox_id = NULL;
 static Octstr *sendsms_url = NULL;
 static Octstr *sendota_url = NULL;
 static Octstr *xmlrpc_url = NULL;
+static Octstr *sendsms_batch_url = NULL;
 static Octstr *bb_host;
 static Octstr *accepted_chars = NULL;
 static int only_try_http = 0;
@@ -149,6 +155,12 @@ static Timerset *timerset = NULL;
 /* Maximum requests that we handle in parallel */
 static Semaphore *max_pending_requests;
 
+/* Maximum requests in flight towards one single HTTP server, 0 = no limit */
+static long max_pending_per_host = 0;
+
+/* Number of url_result_thread instances */
+static long http_result_threads = HTTP_RESULT_THREADS;
+
 int charset_processing (Octstr *charset, Octstr *text, int coding);
 
 /* for delayed HTTP answers.
@@ -439,6 +451,7 @@ struct receiver {
     List *http_headers; 
     Octstr *body; /* body content of the request */
     unsigned long retries; /* number of performed retries */
+    struct host_queue *host; /* per-host dispatch queue, if limited */
 };
 
 /*
@@ -476,6 +489,7 @@ static void *remember_receiver(Msg *msg, URLTranslation *trans, int method,
     receiver->http_headers = http_header_duplicate(headers);
     receiver->body = octstr_duplicate(body);
     receiver->retries = retries;
+    receiver->host = NULL;
 
     return receiver;
 }
@@ -506,6 +520,137 @@ static long outstanding_requests(void)
 }
 
 
+/***********************************************************************
+ * Per-host dispatching of MO/DLR HTTP requests. If max-pending-per-host
+ * is set, at most that many requests are in flight towards the same
+ * HTTP server (host:port of the URL). Further requests for that server
+ * are parked in its queue and started as soon as one of its requests
+ * completes, so a slow server can't tie up the connections to all the
+ * other ones.
+ *
+ * A request takes a max-pending-requests slot before it is dispatched.
+ * Parked requests give their slot back, and a completed request hands
+ * its slot over to the next request parked for the same server, so only
+ * requests actually in flight count against the global limit.
+ */
+
+struct host_queue {
+    long pending;  /* requests started and not yet completed */
+    List *queue;   /* struct receiver waiting for a free slot */
+};
+
+static Dict *host_queues = NULL;
+static Mutex *host_queues_lock = NULL;
+
+
+static void host_queue_destroy(void *item)
+{
+    struct host_queue *hq = item;
+    struct receiver *receiver;
+
+    /* requests still parked on shutdown are dropped */
+    while ((receiver = gwlist_extract_first(hq->queue)) != NULL) {
+        msg_destroy(receiver->msg);
+        octstr_destroy(receiver->url);
+        http_destroy_headers(receiver->http_headers);
+        octstr_destroy(receiver->body);
+        gw_free(receiver);
+        counter_decrease(num_outstanding_requests);
+    }
+    gwlist_destroy(hq->queue, NULL);
+    gw_free(hq);
+}
+
+
+/*
+ * Return the "host:port" part of an URL, lower-cased, to be used as key
+ * for the per-host queues. The userinfo part is skipped.
+ */
+static Octstr *host_queue_key(Octstr *url)
+{
+    Octstr *key;
+    long start, end, at;
+
+    start = octstr_search(url, octstr_imm("://"), 0);
+    start = (start == -1) ? 0 : start + 3;
+    for (end = start; end < octstr_len(url); end++) {
+        int c = octstr_get_char(url, end);
+        if (c == '/' || c == '?' || c == '#')
+            break;
+    }
+    at = octstr_search_char(url, '@', start);
+    if (at != -1 && at < end)
+        start = at + 1;
+
+    key = octstr_copy(url, start, end - start);
+    octstr_convert_range(key, 0, octstr_len(key), tolower);
+
+    return key;
+}
+
+
+static void dispatch_request(struct receiver *receiver)
+{
+    struct host_queue *hq;
+    Octstr *key;
+
+    if (max_pending_per_host > 0) {
+        key = host_queue_key(receiver->url);
+        mutex_lock(host_queues_lock);
+        if ((hq = dict_get(host_queues, key)) == NULL) {
+            hq = gw_malloc(sizeof(*hq));
+            hq->pending = 0;
+            hq->queue = gwlist_create();
+            dict_put(host_queues, key, hq);
+        }
+        receiver->host = hq;
+        if (hq->pending >= max_pending_per_host) {
+            gwlist_append(hq->queue, receiver);
+            debug("sms.http", 0, "HTTP: Server <%s> busy, deferring request (%ld queued)",
+                  octstr_get_cstr(key), gwlist_len(hq->queue));
+            mutex_unlock(host_queues_lock);
+            octstr_destroy(key);
+            semaphore_up(max_pending_requests);
+            return;
+        }
+        hq->pending++;
+        mutex_unlock(host_queues_lock);
+        octstr_destroy(key);
+    }
+
+    http_start_request(caller, receiver->method, receiver->url,
+                       receiver->http_headers, receiver->body, 1, receiver, NULL);
+}
+
+
+/*
+ * A request has completed. Hand its slots over to the next request parked
+ * for the same server, if any. Return 1 if that happened, 0 if the caller
+ * has to give back the max-pending-requests slot. Has to be called before
+ * get_receiver().
+ */
+static int dispatch_done(void *id)
+{
+    struct receiver *receiver = id, *next;
+    struct host_queue *hq = receiver->host;
+
+    if (hq == NULL)
+        return 0;
+
+    mutex_lock(host_queues_lock);
+    if ((next = gwlist_extract_first(hq->queue)) == NULL)
+        hq->pending--;
+    mutex_unlock(host_queues_lock);
+
+    if (next == NULL)
+        return 0;
+
+    http_start_request(caller, next->method, next->url,
+                       next->http_headers, next->body, 1, next, NULL);
+    return 1;
+}
+
+
 /***********************************************************************
  * Thread for receiving reply from HTTP query and sending it to phone.
  */
@@ -1028,8 +1173,8 @@ static void http_queue_thread(void *arg)
                   octstr_get_cstr(req_url), retries, max_http_retries);
 
             /* re-queue this request to the HTTPCaller list */
-            http_start_request(caller, method, req_url, req_headers, req_body,
-                               1, id, NULL);
+            semaphore_down(max_pending_requests);
+            dispatch_request(id);
         }
 
         msg_destroy(msg);
@@ -1070,7 +1215,8 @@ static void url_result_thread(void *arg)
     for (;;) {
         queued = 0;
         id = http_receive_result(caller, &status, &final_url, &reply_headers, &reply_body);
-        semaphore_up(max_pending_requests);
+        if (id == NULL || !dispatch_done(id))
+            semaphore_up(max_pending_requests);
         if (id == NULL)
             break;
 
@@ -1295,8 +1441,7 @@ static int obey_request(Octstr **result, URLTranslation *trans, Msg *msg)
 
     	id = remember_receiver(msg, trans, HTTP_METHOD_GET, pattern, request_headers, NULL, 0);
     	semaphore_down(max_pending_requests);
-    	http_start_request(caller, HTTP_METHOD_GET, pattern, request_headers,
-                           NULL, 1, id, NULL);
+    	dispatch_request(id);
     	octstr_destroy(pattern);
     	http_destroy_headers(request_headers);
     	*result = NULL;
@@ -1422,8 +1567,7 @@ static int obey_request(Octstr **result, URLTranslation *trans, Msg *msg)
     	id = remember_receiver(msg, trans, HTTP_METHOD_POST, pattern,
     			               request_headers, msg->sms.msgdata, 0);
     	semaphore_down(max_pending_requests);
-    	http_start_request(caller, HTTP_METHOD_POST, pattern, request_headers,
-     			           msg->sms.msgdata, 1, id, NULL);
+    	dispatch_request(id);
     	octstr_destroy(pattern);
     	http_destroy_headers(request_headers);
     	*result = NULL;
@@ -1605,8 +1749,7 @@ static int obey_request(Octstr **result, URLTranslation *trans, Msg *msg)
     	id = remember_receiver(msg, trans, HTTP_METHOD_POST, pattern,
     			               request_headers, msg->sms.msgdata, 0);
     	semaphore_down(max_pending_requests);
-    	http_start_request(caller, HTTP_METHOD_POST, pattern, request_headers,
-    			           msg->sms.msgdata, 1, id, NULL);
+    	dispatch_request(id);
     	octstr_destroy(pattern);
     	http_destroy_headers(request_headers);
     	*result = NULL;
@@ -1814,13 +1957,20 @@ error:
 
 typedef const struct pam_message pam_message_type;
 
-static const char *PAM_username;
-static const char *PAM_password;
+/*
+ * Credentials handed to PAM_conv via appdata_ptr, so that several
+ * sendsms threads may authenticate at the same time.
+ */
+struct PAM_credentials {
+    const char *username;
+    const char *password;
+};
 
 static int PAM_conv (int num_msg, pam_message_type **msg,
 		     struct pam_response **resp,
 		     void *appdata_ptr)
 {
+    struct PAM_credentials *cred = appdata_ptr;
     int count = 0, replies = 0;
     struct pam_response *repl = NULL;
     int size = sizeof(struct pam_response);
@@ -1835,14 +1985,14 @@ static int PAM_conv (int num_msg, pam_message_type **msg,
 	case PAM_PROMPT_ECHO_ON:
 	    GET_MEM;
 	    repl[replies].resp_retcode = PAM_SUCCESS;
-	    repl[replies++].resp = COPY_STRING(PAM_username);
+	    repl[replies++].resp = COPY_STRING(cred->username);
 	    /* PAM frees resp */
 	    break;
 
 	case PAM_PROMPT_ECHO_OFF:
 	    GET_MEM;
 	    repl[replies].resp_retcode = PAM_SUCCESS;
-	    repl[replies++].resp = COPY_STRING(PAM_password);
+	    repl[replies++].resp = COPY_STRING(cred->password);
 	    /* PAM frees resp */
 	    break;
 
@@ -1863,19 +2013,17 @@ static int PAM_conv (int num_msg, pam_message_type **msg,
     return PAM_SUCCESS;
 }
 
-static struct pam_conv PAM_conversation = {
-    &PAM_conv,
-    NULL
-};
-
-
 static int authenticate(const char *login, const char *passwd)
 {
     pam_handle_t *pamh;
     int pam_error;
+    struct PAM_credentials cred;
+    struct pam_conv PAM_conversation;
     
-    PAM_username = login;
-    PAM_password = passwd;
+    cred.username = login;
+    cred.password = passwd;
+    PAM_conversation.conv = &PAM_conv;
+    PAM_conversation.appdata_ptr = &cred;
     
     pam_error = pam_start("kannel", login, &PAM_conversation, &pamh);
     if (pam_error != PAM_SUCCESS ||
@@ -2288,7 +2436,7 @@ static Octstr *smsbox_req_handle(URLTranslation *t, Octstr *client_ip,
      */
     failed_id = gwlist_create();
 
-    if (!immediate_sendsms_reply) {
+    if (!immediate_sendsms_reply && client != NULL) {
         stored_uuid = store_uuid(msg);
         dict_put(client_dict, stored_uuid, client);
     }
@@ -2363,7 +2511,7 @@ transmit_error:
     *status = HTTP_INTERNAL_SERVER_ERROR;
     returnerror = octstr_create("Sending failed.");
 
-    if (!immediate_sendsms_reply)
+    if (stored_uuid != NULL)
         dict_remove(client_dict, stored_uuid);
 
     /* 
@@ -2682,6 +2830,231 @@ error:
 }
 
 
+/*
+ * Return the next CSV field of a batch body starting at *pos. Fields
+ * may be quoted with '"', a quote inside a quoted field is written as
+ * '""'. Sets *eol if the field ended the record and advances *pos
+ * behind the separator.
+ */
+static Octstr *batch_csv_field(Octstr *body, long *pos, int *eol)
+{
+    Octstr *field;
+    long i, start, len;
+    int c, quoted;
+
+    field = octstr_create("");
+    len = octstr_len(body);
+    i = *pos;
+    quoted = 0;
+    if (i < len && octstr_get_char(body, i) == '"') {
+        quoted = 1;
+        i++;
+    }
+
+    start = i;
+    while (i < len) {
+        c = octstr_get_char(body, i);
+        if (quoted) {
+            if (c == '"') {
+                octstr_append_data(field, octstr_get_cstr(body) + start, i - start);
+                if (i + 1 < len && octstr_get_char(body, i + 1) == '"') {
+                    /* escaped quote, keep one of them */
+                    i++;
+                    start = i;
+                } else {
+                    quoted = 0;
+                    start = i + 1;
+                }
+            }
+        } else if (c == ',' || c == '\r' || c == '\n')
+            break;
+        i++;
+    }
+    octstr_append_data(field, octstr_get_cstr(body) + start, i - start);
+
+    *eol = 1;
+    if (i < len && octstr_get_char(body, i) == ',') {
+        *eol = 0;
+        i++;
+    } else {
+        if (i < len && octstr_get_char(body, i) == '\r')
+            i++;
+        if (i < len && octstr_get_char(body, i) == '\n')
+            i++;
+    }
+    *pos = i;
+
+    return field;
+}
+
+
+/*
+ * Parse the next record of a batch body starting at *pos into receiver,
+ * text and optional sender. text/plain records are "to text" lines,
+ * text/csv records are "to,text[,from]". Empty records are skipped.
+ * Return -1 at the end of the body, 0 otherwise.
+ */
+static int batch_next_record(Octstr *body, long *pos, int csv,
+                             Octstr **to, Octstr **text, Octstr **from)
+{
+    Octstr *extra;
+    long end, sp;
+    int eol;
+
+    *to = *text = *from = NULL;
+
+    while (*pos < octstr_len(body)) {
+        if (csv) {
+            *to = batch_csv_field(body, pos, &eol);
+            if (!eol)
+                *text = batch_csv_field(body, pos, &eol);
+            if (!eol)
+                *from = batch_csv_field(body, pos, &eol);
+            /* ignore any further columns */
+            while (!eol) {
+                extra = batch_csv_field(body, pos, &eol);
+                octstr_destroy(extra);
+            }
+        } else {
+            if ((end = octstr_search_char(body, '\n', *pos)) == -1)
+                end = octstr_len(body);
+            sp = octstr_search_char(body, ' ', *pos);
+            if (sp == -1 || sp > end)
+                sp = end;
+            *to = octstr_copy(body, *pos, sp - *pos);
+            if (sp < end)
+                *text = octstr_copy(body, sp + 1, end - sp - 1);
+            *pos = end + 1;
+            if (*text != NULL && octstr_get_char(*text, octstr_len(*text) - 1) == '\r')
+                octstr_delete(*text, octstr_len(*text) - 1, 1);
+            else if (octstr_get_char(*to, octstr_len(*to) - 1) == '\r')
+                octstr_delete(*to, octstr_len(*to) - 1, 1);
+        }
+        octstr_strip_blanks(*to);
+        if (octstr_len(*to) > 0 || octstr_len(*text) > 0 || octstr_len(*from) > 0)
+            return 0;
+        octstr_destroy(*to);
+        octstr_destroy(*text);
+        octstr_destroy(*from);
+        *to = *text = *from = NULL;
+    }
+
+    return -1;
+}
+
+
+/*
+ * Create and send a batch of SMS messages from one POST request. The
+ * body holds one message per record, see batch_next_record(). The
+ * credentials and all parameters common to the messages are CGI
+ * variables as for a sendsms GET request. Each record goes through
+ * smsbox_req_handle() as soon as it is parsed, the reply holds one
+ * result line "<record>: <status> <answer>" per message.
+ */
+static Octstr *smsbox_sendsms_batch(List *args, List *headers, Octstr *body,
+                                    Octstr *client_ip, int *status)
+{
+    URLTranslation *t = NULL;
+    Octstr *ret, *type, *charset, *answer, *tmp_string;
+    Octstr *to, *text, *from, *def_from, *smsc, *account, *dlr_url, *binfo;
+    Octstr *meta_data;
+    int dlr_mask, mclass, coding, validity, deferred, priority;
+    int csv, msg_status;
+    long pos, records, accepted;
+
+    t = authorise_user(args, client_ip);
+    if (t == NULL) {
+        *status = HTTP_FORBIDDEN;
+        return octstr_create("Authorization failed for sendsms");
+    }
+
+    http_header_get_content_type(headers, &type, &charset);
+    if (octstr_case_compare(type, octstr_imm("text/csv")) == 0)
+        csv = 1;
+    else if (octstr_case_compare(type, octstr_imm("text/plain")) == 0)
+        csv = 0;
+    else {
+        error(0, "%s got weird content type %s", octstr_get_cstr(sendsms_batch_url),
+              octstr_get_cstr(type));
+        octstr_destroy(type);
+        octstr_destroy(charset);
+        *status = HTTP_UNSUPPORTED_MEDIA_TYPE;
+        return octstr_create("Unsupported content-type, rejected");
+    }
+    octstr_destroy(type);
+
+    dlr_mask = mclass = coding = validity = deferred = priority = SMS_PARAM_UNDEFINED;
+
+    def_from = http_cgi_variable(args, "from");
+    smsc = http_cgi_variable(args, "smsc");
+    account = http_cgi_variable(args, "account");
+    binfo = http_cgi_variable(args, "binfo");
+    dlr_url = http_cgi_variable(args, "dlr-url");
+    meta_data = http_cgi_variable(args, "meta-data");
+
+    tmp_string = http_cgi_variable(args, "dlr-mask");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &dlr_mask);
+
+    tmp_string = http_cgi_variable(args, "mclass");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &mclass);
+
+    tmp_string = http_cgi_variable(args, "coding");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &coding);
+
+    tmp_string = http_cgi_variable(args, "validity");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &validity);
+
+    tmp_string = http_cgi_variable(args, "deferred");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &deferred);
+
+    tmp_string = http_cgi_variable(args, "priority");
+    if (tmp_string != NULL)
+        sscanf(octstr_get_cstr(tmp_string), "%d", &priority);
+
+    ret = octstr_create("");
+    records = accepted = 0;
+    pos = 0;
+    while (batch_next_record(body, &pos, csv, &to, &text, &from) == 0) {
+        records++;
+        if (octstr_len(to) == 0) {
+            msg_status = HTTP_BAD_REQUEST;
+            answer = octstr_create("Empty receiver number not allowed, rejected");
+        } else {
+            /* the HTTP client is not handed over, we answer right away */
+            answer = smsbox_req_handle(t, client_ip, NULL,
+                                       octstr_len(from) > 0 ? from : def_from,
+                                       to, text, charset, NULL, smsc, mclass,
+                                       SMS_PARAM_UNDEFINED, coding,
+                                       SMS_PARAM_UNDEFINED, validity, deferred,
+                                       &msg_status, dlr_mask, dlr_url, account,
+                                       SMS_PARAM_UNDEFINED, SMS_PARAM_UNDEFINED,
+                                       SMS_PARAM_UNDEFINED, NULL, binfo,
+                                       priority, meta_data);
+        }
+        if (msg_status == HTTP_ACCEPTED)
+            accepted++;
+        octstr_format_append(ret, "%ld: %d %S\n", records, msg_status, answer);
+        octstr_destroy(answer);
+        octstr_destroy(to);
+        octstr_destroy(text);
+        octstr_destroy(from);
+    }
+    octstr_destroy(charset);
+
+    info(0, "%s: %ld messages, %ld accepted, %ld rejected (%s)",
+         octstr_get_cstr(sendsms_batch_url), records, accepted,
+         records - accepted, octstr_get_cstr(client_ip));
+
+    *status = HTTP_OK;
+    return ret;
+}
+
+
 /*
  * Create and send an SMS message from a XML-RPC request.
  * Answer with a valid XML-RPC response for a successful request.
@@ -3195,6 +3568,14 @@ static void sendsms_thread(void *arg)
             else
                 answer = smsbox_sendota_post(hdrs, body, ip, &status, client);
         }
+        /* batch sendsms */
+        else if (octstr_compare(url, sendsms_batch_url) == 0) {
+            if (body == NULL) {
+                answer = octstr_create("Incomplete request.");
+                status = HTTP_BAD_REQUEST;
+            } else
+                answer = smsbox_sendsms_batch(args, hdrs, body, ip, &status);
+        }
         /* add aditional URI compares here */
         else {
             answer = octstr_create("Unknown request.");
@@ -3291,7 +3672,7 @@ static Cfg *init_smsbox(Cfg *cfg)
     Octstr *http_proxy_exceptions_regex = NULL;
     int ssl = 0;
     int lf, m;
-    long max_req;
+    long max_req, sendsms_threads, i;
 
     bb_port = BB_DEFAULT_SMSBOX_PORT;
     bb_ssl = 0;
@@ -3421,6 +3802,8 @@ static Cfg *init_smsbox(Cfg *cfg)
         xmlrpc_url = octstr_imm("/cgi-bin/xmlrpc");
     if ((sendota_url = cfg_get(grp, octstr_imm("sendota-url"))) == NULL)
         sendota_url = octstr_imm("/cgi-bin/sendota");
+    if ((sendsms_batch_url = cfg_get(grp, octstr_imm("sendsms-batch-url"))) == NULL)
+        sendsms_batch_url = octstr_imm("/cgi-bin/sendsms-batch");
 
     global_sender = cfg_get(grp, octstr_imm("global-sender"));
     accepted_chars = cfg_get(grp, octstr_imm("sendsms-chars"));
@@ -3452,6 +3835,13 @@ static Cfg *init_smsbox(Cfg *cfg)
     } else {
         log_set_syslog(NULL, 0);
     }
+
+    /* write log lines from a separate thread */
+    if (cfg_get_integer(&value, grp, octstr_imm("log-async-buffer")) == 0 && value > 0) {
+        int drop = 0;
+        cfg_get_bool(&drop, grp, octstr_imm("log-async-drop"));
+        log_set_async(value, drop);
+    }
     if (global_sender != NULL) {
 	info(0, "Service global sender set as '%s'", 
 	     octstr_get_cstr(global_sender));
@@ -3487,8 +3877,14 @@ static Cfg *init_smsbox(Cfg *cfg)
             else
                 panic(0, "Failed to open HTTP socket");
         } else {
-            info(0, "Set up send sms service at port %ld", sendsms_port);
-            gwthread_create(sendsms_thread, NULL);
+            if (cfg_get_integer(&sendsms_threads, grp,
+                                octstr_imm("sendsms-threads")) == -1 ||
+                sendsms_threads < 1)
+                sendsms_threads = SENDSMS_THREADS;
+            info(0, "Set up send sms service at port %ld (%ld threads)",
+                 sendsms_port, sendsms_threads);
+            for (i = 0; i < sendsms_threads; i++)
+                gwthread_create(sendsms_thread, NULL);
         }
     }
 
@@ -3497,6 +3893,23 @@ static Cfg *init_smsbox(Cfg *cfg)
         max_req = HTTP_MAX_PENDING; 
     max_pending_requests = semaphore_create(max_req);
 
+    /* limit requests in flight towards each HTTP server */
+    if (cfg_get_integer(&max_pending_per_host, grp,
+                        octstr_imm("max-pending-requests-per-host")) == -1 ||
+        max_pending_per_host < 0)
+        max_pending_per_host = 0;
+    if (max_pending_per_host > 0) {
+        /* no use keeping more idle connections than can be in flight */
+        http_set_client_pool_size(max_pending_per_host);
+        info(0, "Limiting MO/DLR HTTP requests to %ld per server.",
+             max_pending_per_host);
+    }
+
+    if (cfg_get_integer(&http_result_threads, grp,
+                        octstr_imm("http-result-threads")) == -1 ||
+        http_result_threads < 1)
+        http_result_threads = HTTP_RESULT_THREADS;
+
     if (cfg_get_integer(&value, grp, octstr_imm("http-timeout")) == 0)
        http_set_client_timeout(value);
 
@@ -3537,6 +3950,7 @@ static int check_args(int i, int argc, char **argv) {
 int main(int argc, char **argv)
 {
     int cf_index;
+    long i;
     Octstr *filename;
     double heartbeat_freq = DEFAULT_HEARTBEAT;
 
@@ -3590,7 +4004,10 @@ int main(int argc, char **argv)
     num_outstanding_requests = counter_create();
     catenated_sms_counter = counter_create();
     gwthread_create(obey_request_thread, NULL);
-    gwthread_create(url_result_thread, NULL);
+    host_queues = dict_create(64, host_queue_destroy);
+    host_queues_lock = mutex_create();
+    for (i = 0; i < http_result_threads; i++)
+        gwthread_create(url_result_thread, NULL);
     gwthread_create(http_queue_thread, NULL);
 
     connect_to_bearerbox(bb_host, bb_port, bb_ssl, NULL /* bb_our_host */);
@@ -3624,6 +4041,8 @@ int main(int argc, char **argv)
     gwlist_destroy(smsbox_requests, NULL);
     gwlist_destroy(smsbox_http_requests, NULL);
     http_caller_destroy(caller);
+    dict_destroy(host_queues);
+    mutex_destroy(host_queues_lock);
     gw_timerset_destroy(timerset);
     counter_destroy(num_outstanding_requests);
     counter_destroy(catenated_sms_counter);
@@ -3634,6 +4053,7 @@ int main(int argc, char **argv)
     octstr_destroy(sendsms_url);
     octstr_destroy(sendota_url);
     octstr_destroy(xmlrpc_url);
+    octstr_destroy(sendsms_batch_url);
     octstr_destroy(reply_emptymessage);
     octstr_destroy(reply_requestfailed);
     octstr_destroy(reply_couldnotfetch);
@@ -71,6 +71,8 @@
 #define MAX_SMPP_PDU_LEN    (7424)
 /* we use ; in the middle because ; is split char in smsc-id and can't be in the smsc-id */
 #define DEFAULT_SMSC_ID "def;ault"
+/* size hint of the per PDU Dict of configured TLVs, few are ever used */
+#define SMPP_PDU_TLV_HINT   8
 
 struct smpp_tlv {
     Octstr *name;
@@ -79,8 +81,19 @@ struct smpp_tlv {
     enum { SMPP_TLV_OCTETS = 0, SMPP_TLV_NULTERMINATED = 1, SMPP_TLV_INTEGER = 2 } type;
 };
 
-/* Dict(smsc_id, Dict(tag, tlv)) */
+/*
+ * Configured TLVs of one smsc-id keyed by tag, open addressing with
+ * linear probing.  The TLVs of the default smsc-id are merged into every
+ * table, so decoding needs only one lookup per tag.
+ */
+struct smpp_tlv_table {
+    long size;      /* power of two */
+    struct smpp_tlv **slots;
+};
+
+/* Dict(smsc_id, struct smpp_tlv_table) */
 static Dict *tlvs_by_tag;
+static struct smpp_tlv_table *default_tlvs_by_tag;
 /* Dict(smsc_id, Dict(tag_name, tlv)) */
 static Dict *tlvs_by_name;
 static List *tlvs;
@@ -118,46 +131,132 @@ static struct smpp_tlv *smpp_tlv_get_by_name(Octstr *smsc_id, Octstr *name)
     return res;
 }
 
-static struct smpp_tlv *smpp_tlv_get_by_tag(Octstr *smsc_id, long tag)
+static struct smpp_tlv_table *smpp_tlv_table_create(long count)
 {
-    struct smpp_tlv *res = NULL;
-    Dict *tmp_dict;
-    Octstr *tmp;
+    struct smpp_tlv_table *table;
+    long i;
+
+    table = gw_malloc(sizeof(*table));
+    /* keep the table at most half full */
+    for (table->size = 8; table->size < count * 2; table->size *= 2)
+        ;
+    table->slots = gw_malloc(table->size * sizeof(table->slots[0]));
+    for (i = 0; i < table->size; i++)
+        table->slots[i] = NULL;
+
+    return table;
+}
+
+static void smpp_tlv_table_destroy(struct smpp_tlv_table *table)
+{
+    if (table == NULL)
+        return;
+    gw_free(table->slots);
+    gw_free(table);
+}
+
+static long smpp_tlv_table_slot(struct smpp_tlv_table *table, long tag)
+{
+    long i;
+
+    i = (((unsigned long) tag * 0x9E3779B1UL) >> 8) & (table->size - 1);
+    while (table->slots[i] != NULL && table->slots[i]->tag != tag)
+        i = (i + 1) & (table->size - 1);
+
+    return i;
+}
+
+/* Return 0 if a TLV with the same tag is in the table already. */
+static int smpp_tlv_table_add(struct smpp_tlv_table *table, struct smpp_tlv *tlv)
+{
+    long i;
+
+    i = smpp_tlv_table_slot(table, tlv->tag);
+    if (table->slots[i] != NULL)
+        return 0;
+    table->slots[i] = tlv;
+
+    return 1;
+}
+
+/* Find the TLV table for smsc_id once per PDU, see smpp_tlv_get_by_tag. */
+static struct smpp_tlv_table *smpp_tlv_table_get(Octstr *smsc_id)
+{
+    struct smpp_tlv_table *res = NULL;
 
     if (tlvs_by_tag == NULL)
         return NULL;
 
-    tmp = octstr_format("%ld", tag);
+    if (smsc_id != NULL)
+        res = dict_get(tlvs_by_tag, smsc_id);
 
-    if (smsc_id != NULL) {
-        tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, tmp);
-    }
-    if (res == NULL) {
-        /* try default smsc_id */
-        smsc_id = octstr_imm(DEFAULT_SMSC_ID);
-        tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-        if (tmp_dict != NULL)
-            res = dict_get(tmp_dict, tmp);
+    return (res != NULL ? res : default_tlvs_by_tag);
+}
+
+static struct smpp_tlv *smpp_tlv_get_by_tag(struct smpp_tlv_table *table, long tag)
+{
+    if (table == NULL)
+        return NULL;
+
+    return table->slots[smpp_tlv_table_slot(table, tag)];
+}
+
+/*
+ * Build tlvs_by_tag from Dict(smsc_id, List(tlv)) collected while reading
+ * the configuration.  Return -1 on a double tag for the same smsc-id.
+ */
+static int smpp_tlv_tables_build(Dict *tlvs_by_id)
+{
+    List *keys, *l, *def;
+    Octstr *smsc_id;
+    struct smpp_tlv_table *table;
+    struct smpp_tlv *tlv;
+    long i;
+    int ret = 0;
+
+    def = dict_get(tlvs_by_id, octstr_imm(DEFAULT_SMSC_ID));
+    keys = dict_keys(tlvs_by_id);
+    while (ret == 0 && (smsc_id = gwlist_extract_first(keys)) != NULL) {
+        l = dict_get(tlvs_by_id, smsc_id);
+        table = smpp_tlv_table_create(gwlist_len(l) + (l != def ? gwlist_len(def) : 0));
+        dict_put(tlvs_by_tag, smsc_id, table);
+        for (i = 0; i < gwlist_len(l); i++) {
+            tlv = gwlist_get(l, i);
+            if (!smpp_tlv_table_add(table, tlv)) {
+                error(0, "SMPP: Double TLV tag %ld found.", tlv->tag);
+                ret = -1;
+                break;
+            }
+        }
+        /* the default TLVs for every tag not configured for this smsc-id */
+        for (i = 0; l != def && i < gwlist_len(def); i++)
+            smpp_tlv_table_add(table, gwlist_get(def, i));
+        octstr_destroy(smsc_id);
     }
+    gwlist_destroy(keys, octstr_destroy_item);
+    default_tlvs_by_tag = dict_get(tlvs_by_tag, octstr_imm(DEFAULT_SMSC_ID));
 
-    octstr_destroy(tmp);
+    return ret;
+}
 
-    return res;
+static void smpp_tlv_list_destroy(void *l)
+{
+    gwlist_destroy(l, NULL);
 }
 
 int smpp_pdu_init(Cfg *cfg)
 {
     CfgGroup *grp;
     List *l;
+    Dict *tlvs_by_id;
 
     if (initialized)
         return 0;
 
     l = cfg_get_multi_group(cfg, octstr_imm("smpp-tlv"));
     tlvs = gwlist_create();
-    tlvs_by_tag = dict_create(1024, (void(*)(void*))dict_destroy);
+    tlvs_by_tag = dict_create(1024, (void(*)(void*))smpp_tlv_table_destroy);
+    tlvs_by_id = dict_create(1024, smpp_tlv_list_destroy);
     tlvs_by_name = dict_create(1024, (void(*)(void*))dict_destroy);
     while (l != NULL && (grp = gwlist_extract_first(l)) != NULL) {
         struct smpp_tlv *tlv;
@@ -212,6 +311,7 @@ int smpp_pdu_init(Cfg *cfg)
         }
         while(l2 != NULL && (smsc_id = gwlist_extract_first(l2)) != NULL) {
             Dict *tmp_dict;
+            List *tmp_list;
 
             debug("sms.smpp", 0, "adding smpp-tlv for smsc-id=%s", octstr_get_cstr(smsc_id));
 
@@ -227,33 +327,35 @@ int smpp_pdu_init(Cfg *cfg)
                 goto failed;
             }
 
-            tmp_dict = dict_get(tlvs_by_tag, smsc_id);
-            if (tmp_dict == NULL) {
-                tmp_dict = dict_create(1024, NULL);
-                dict_put(tlvs_by_tag, smsc_id, tmp_dict);
+            tmp_list = dict_get(tlvs_by_id, smsc_id);
+            if (tmp_list == NULL) {
+                tmp_list = gwlist_create();
+                dict_put(tlvs_by_id, smsc_id, tmp_list);
             }
-            tmp = octstr_format("%ld", tlv->tag);
-            if (!dict_put_once(tmp_dict, tmp, tlv)) {
-                error(0, "SMPP: Double TLV tag %s found.", octstr_get_cstr(tmp));
-                gwlist_destroy(l2, octstr_destroy_item);
-                octstr_destroy(tmp);
-                octstr_destroy(smsc_id);
-                goto failed;
-            }
-            octstr_destroy(tmp);
+            gwlist_append(tmp_list, tlv);
             octstr_destroy(smsc_id);
         }
         gwlist_destroy(l2, octstr_destroy_item);
     }
     gwlist_destroy(l, NULL);
+    l = NULL;
+
+    if (smpp_tlv_tables_build(tlvs_by_id) == -1)
+        goto failed;
+    dict_destroy(tlvs_by_id);
 
     initialized = 1;
     return 0;
 
 failed:
+    gwlist_destroy(l, NULL);
     gwlist_destroy(tlvs, (void(*)(void*))smpp_tlv_destroy);
+    dict_destroy(tlvs_by_id);
     dict_destroy(tlvs_by_tag);
     dict_destroy(tlvs_by_name);
+    tlvs = NULL;
+    tlvs_by_tag = tlvs_by_name = NULL;
+    default_tlvs_by_tag = NULL;
     return -1;
 }
 
@@ -269,22 +371,27 @@ int smpp_pdu_shutdown(void)
     dict_destroy(tlvs_by_tag);
     dict_destroy(tlvs_by_name);
     tlvs_by_tag = tlvs_by_name = NULL;
+    default_tlvs_by_tag = NULL;
 
     return 0;
 }
 
 
-static long decode_integer(Octstr *os, long pos, int octets)
+/*
+ * The decoder works on a plain buffer, usually a view into the input
+ * buffer of the connection, and copies only the fields it keeps.
+ */
+static long decode_integer(const unsigned char *data, long len, long pos, int octets)
 {
     unsigned long u;
     int i;
 
-    if (octstr_len(os) < pos + octets) 
+    if (len < pos + octets) 
         return -1;
 
     u = 0;
     for (i = 0; i < octets; ++i)
-    	u = (u << 8) | octstr_get_char(os, pos + i);
+    	u = (u << 8) | data[pos + i];
 
     return u;
 }
@@ -292,30 +399,49 @@ static long decode_integer(Octstr *os, long pos, int octets)
 
 static void append_encoded_integer(Octstr *os, unsigned long u, long octets)
 {
+    unsigned char buf[sizeof(u)];
     long i;
 
+    /* configured TLVs may be wider than a long, pad with zeros */
+    for (; octets > (long) sizeof(buf); --octets)
+        octstr_append_char(os, 0);
     for (i = 0; i < octets; ++i)
-    	octstr_append_char(os, (u >> ((octets - i - 1) * 8)) & 0xFF);
+    	buf[i] = (u >> ((octets - i - 1) * 8)) & 0xFF;
+    octstr_append_data(os, (char *) buf, octets);
 }
 
 
-static int copy_until_nul(const char *field_name, Octstr *os, long *pos, long max_octets, Octstr **data)
+/* Like octstr_copy, a short or empty result if the data ends early. */
+static Octstr *copy_octets(const unsigned char *data, long len, long pos, long octets)
 {
-    long nul;
+    if (pos >= len || octets <= 0)
+        return octstr_create("");
+    if (pos + octets > len)
+        octets = len - pos;
+    return octstr_create_from_data((const char *) data + pos, octets);
+}
 
-    *data = NULL;
 
-    nul = octstr_search_char(os, '\0', *pos);
-    if (nul == -1) {
+static int copy_until_nul(const char *field_name, const unsigned char *data, long len,
+                          long *pos, long max_octets, Octstr **res)
+{
+    const unsigned char *nul;
+    long end;
+
+    *res = NULL;
+
+    nul = (*pos < len) ? memchr(data + *pos, '\0', len - *pos) : NULL;
+    if (nul == NULL) {
         warning(0, "SMPP: PDU NULL terminated string (%s) has no NULL.", field_name);
         return -1;
     }
-    if (*pos + max_octets < nul) {
+    end = nul - data;
+    if (*pos + max_octets < end) {
         error(0, "SMPP: PDU NULL terminated string (%s) longer than allowed.", field_name);
         return -1;
     }
-    *data = (nul - *pos > 0) ? octstr_copy(os, *pos, nul - *pos) : NULL;
-    *pos = nul + 1;
+    *res = (end - *pos > 0) ? octstr_create_from_data((const char *) data + *pos, end - *pos) : NULL;
+    *pos = end + 1;
     return 0;
 }
 
@@ -332,7 +458,7 @@ SMPP_PDU *smpp_pdu_create(unsigned long type, unsigned long seq_no)
     #define TLV_INTEGER(name, octets) p->name = -1;
     #define TLV_NULTERMINATED(name, max_len) p->name = NULL;
     #define TLV_OCTETS(name, min_len, max_len) p->name = NULL;
-    #define OPTIONAL_END p->tlv = dict_create(1024, octstr_destroy_item);
+    #define OPTIONAL_END p->tlv = dict_create(SMPP_PDU_TLV_HINT, octstr_destroy_item);
     #define INTEGER(name, octets) p->name = 0;
     #define NULTERMINATED(name, max_octets) p->name = NULL;
     #define OCTETS(name, field_giving_octetst) p->name = NULL;
@@ -381,12 +507,14 @@ void smpp_pdu_destroy(SMPP_PDU *pdu)
 Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
 {
     Octstr *os;
-    Octstr *temp;
-
-    os = octstr_create("");
+    long len;
+    int i;
 
     gw_assert(pdu != NULL);
 
+    /* room for the command_length, filled in at the end */
+    os = octstr_create_from_data("\0\0\0\0", 4);
+
     /*
      * Fix lengths of octet string fields.
      */
@@ -490,11 +618,9 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
                 warning(0, "SMPP: PDU element <%s> too long " \
                         "(length is %ld, should be %d)", \
                         #name, octstr_len(p->name), max_octets-1); \
-                temp = octstr_copy(p->name, 0, max_octets-1); \
+                octstr_append_data(os, octstr_get_cstr(p->name), max_octets-1); \
             } else \
-                temp = octstr_duplicate(p->name); \
-            octstr_append(os, temp); \
-            octstr_destroy(temp); \
+                octstr_append(os, p->name); \
         } \
         octstr_append_char(os, '\0');
     #define OCTETS(name, field_giving_octets) \
@@ -506,31 +632,37 @@ Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu)
         error(0, "Unknown SMPP_PDU type, internal error while packing.");
     }
 
-    temp = octstr_create("");
-    append_encoded_integer(temp, octstr_len(os) + 4, 4);
-    octstr_insert(os, temp, 0);
-    octstr_destroy(temp);
+    len = octstr_len(os);
+    for (i = 0; i < 4; ++i)
+        octstr_set_char(os, i, (len >> ((3 - i) * 8)) & 0xFF);
 
     return os;
 }
 
 
 SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
+{
+    return smpp_pdu_unpack_data(smsc_id, (unsigned char *) octstr_get_cstr(data_without_len),
+                                octstr_len(data_without_len));
+}
+
+
+SMPP_PDU *smpp_pdu_unpack_data(Octstr *smsc_id, const unsigned char *data, long len)
 {
     SMPP_PDU *pdu;
     unsigned long type;
-    long len, pos;
-
-    len = octstr_len(data_without_len);
+    long pos;
+    struct smpp_tlv_table *tlv_table = NULL;
+    int tlv_table_found = 0;
+    Octstr *os;
 
     if (len < 4) {
-        error(0, "SMPP: PDU was too short (%ld bytes).",
-              octstr_len(data_without_len));
+        error(0, "SMPP: PDU was too short (%ld bytes).", len);
         return NULL;
     }
 
     /* get the PDU type */
-    if ((type = decode_integer(data_without_len, 0, 4)) == -1)
+    if ((type = decode_integer(data, len, 0, 4)) == -1)
         return NULL;
 
     /* create a coresponding representation structure */
@@ -546,12 +678,15 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
             while (pos + 4 <= len) { \
                 struct smpp_tlv *tlv; \
                 unsigned long opt_tag, opt_len; \
-                opt_tag = decode_integer(data_without_len, pos, 2); pos += 2; \
-                debug("sms.smpp", 0, "Optional parameter tag (0x%04lx)", opt_tag);  \
-                opt_len = decode_integer(data_without_len, pos, 2); pos += 2;  \
-                debug("sms.smpp", 0, "Optional parameter length read as %ld", opt_len); \
+                opt_tag = decode_integer(data, len, pos, 2); pos += 2; \
+                opt_len = decode_integer(data, len, pos, 2); pos += 2;  \
+                debug("sms.smpp", 0, "Optional parameter tag (0x%04lx) length %ld", opt_tag, opt_len); \
                 /* check configured TLVs */ \
-                tlv = smpp_tlv_get_by_tag(smsc_id, opt_tag); \
+                if (!tlv_table_found) { \
+                    tlv_table = smpp_tlv_table_get(smsc_id); \
+                    tlv_table_found = 1; \
+                } \
+                tlv = smpp_tlv_get_by_tag(tlv_table, opt_tag); \
                 if (tlv != NULL) debug("sms.smpp", 0, "Found configured optional parameter `%s'", octstr_get_cstr(tlv->name));
     #define TLV_INTEGER(mname, octets) \
                 if (SMPP_##mname == opt_tag) { \
@@ -572,7 +707,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                         pos += opt_len; \
                         continue; \
                     } \
-                    copy_until_nul(#mname, data_without_len, &pos, opt_len, &p->mname); \
+                    copy_until_nul(#mname, data, len, &pos, opt_len, &p->mname); \
                     if (tlv != NULL) dict_put(p->tlv, tlv->name, octstr_duplicate(p->mname)); \
                 } else
     #define TLV_OCTETS(mname, min_len, max_len) \
@@ -584,7 +719,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                         pos += opt_len; \
                         continue; \
                     } \
-                    p->mname = octstr_copy(data_without_len, pos, opt_len); \
+                    p->mname = copy_octets(data, len, pos, opt_len); \
                     pos += opt_len; \
                     if (tlv != NULL) dict_put(p->tlv, tlv->name, octstr_duplicate(p->mname)); \
                 } else
@@ -603,7 +738,7 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                         switch (tlv->type) { \
                         case SMPP_TLV_INTEGER: { \
                             long val_i; \
-                            if ((val_i = decode_integer(data_without_len, pos, opt_len)) == -1) \
+                            if ((val_i = decode_integer(data, len, pos, opt_len)) == -1) \
                                 goto err; \
                             val = octstr_format("%ld", val_i); \
                             dict_put(p->tlv, tlv->name, val); \
@@ -611,13 +746,13 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                             break; \
                         } \
                         case SMPP_TLV_OCTETS: { \
-                            val = octstr_copy(data_without_len, pos, opt_len); \
+                            val = copy_octets(data, len, pos, opt_len); \
                             dict_put(p->tlv, tlv->name, val); \
                             pos += opt_len; \
                             break; \
                         } \
                         case SMPP_TLV_NULTERMINATED: { \
-                            if (copy_until_nul(octstr_get_cstr(tlv->name), data_without_len, &pos, opt_len, &val) == 0) \
+                            if (copy_until_nul(octstr_get_cstr(tlv->name), data, len, &pos, opt_len, &val) == 0) \
                                 dict_put(p->tlv, tlv->name, val); \
                             break; \
                         } \
@@ -626,11 +761,8 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
                             break; \
                         } \
                     }  else { \
-                        val = octstr_copy(data_without_len, pos, opt_len); \
-                        if (val) \
-                            octstr_binary_to_hex(val, 0); \
-                        else \
-                            val = octstr_create(""); \
+                        val = copy_octets(data, len, pos, opt_len); \
+                        octstr_binary_to_hex(val, 0); \
                         warning(0, "SMPP: Unknown TLV(0x%04lx,0x%04lx,%s) for PDU type (%s) received!", \
                             opt_tag, opt_len, octstr_get_cstr(val), pdu->type_name); \
                         octstr_destroy(val); \
@@ -640,15 +772,14 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
             } \
         }
     #define INTEGER(name, octets) \
-        if ((p->name = decode_integer(data_without_len, pos, octets)) == -1) \
+        if ((p->name = decode_integer(data, len, pos, octets)) == -1) \
             goto err; \
         pos += octets;
     #define NULTERMINATED(name, max_octets) \
         /* just warn about errors but not fail */ \
-        copy_until_nul(#name, data_without_len, &pos, max_octets, &p->name);
+        copy_until_nul(#name, data, len, &pos, max_octets, &p->name);
     #define OCTETS(name, field_giving_octets) \
-    	p->name = octstr_copy(data_without_len, pos, \
-	    	    	      p->field_giving_octets); \
+    	p->name = copy_octets(data, len, pos, p->field_giving_octets); \
         if (p->field_giving_octets != (unsigned long) octstr_len(p->name)) { \
             error(0, "smpp_pdu: error while unpacking '" #name "', " \
                      "len is %ld but should have been %ld, dropping.", \
@@ -668,7 +799,9 @@ SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len)
     
 err:
     smpp_pdu_destroy(pdu);
-    octstr_dump(data_without_len, 0);
+    os = octstr_create_from_data((const char *) data, len);
+    octstr_dump(os, 0);
+    octstr_destroy(os);
     return NULL;
 }
 
@@ -725,16 +858,12 @@ void smpp_pdu_dump(Octstr *smsc_id, SMPP_PDU *pdu)
 
 long smpp_pdu_read_len(Connection *conn)
 {
-    Octstr *os;
-    unsigned char buf[4];    /* The length is 4 octets. */
+    const unsigned char *buf;    /* The length is 4 octets. */
     long len;
 
-    os = conn_read_fixed(conn, sizeof(buf));
-    if (os == NULL)
+    if (conn_read_fixed_view(conn, 4, &buf) == -1)
     	return 0;
-    octstr_get_many_chars((char*) buf, os, 0, sizeof(buf));
-    octstr_destroy(os);
-    len = decode_network_long(buf);
+    len = decode_network_long((unsigned char *) buf);
     if (len < MIN_SMPP_PDU_LEN) {
 	error(0, "SMPP: PDU length was too small (%ld, minimum is %ld).",
 	      len, (long) MIN_SMPP_PDU_LEN);
@@ -758,6 +887,16 @@ Octstr *smpp_pdu_read_data(Connection *conn, long len)
 }
 
 
+const unsigned char *smpp_pdu_read_data_view(Connection *conn, long len)
+{
+    const unsigned char *data;
+
+    if (conn_read_fixed_view(conn, len - 4, &data) == -1)
+        return NULL;
+    return data;
+}
+
+
 /*
  * Return error string for given error code
  * NOTE: If you add new error strings here please use
@@ -236,10 +236,16 @@ void smpp_pdu_destroy(SMPP_PDU *pdu);
 int smpp_pdu_is_valid(SMPP_PDU *pdu); /* XXX */
 Octstr *smpp_pdu_pack(Octstr *smsc_id, SMPP_PDU *pdu);
 SMPP_PDU *smpp_pdu_unpack(Octstr *smsc_id, Octstr *data_without_len);
+/* Same as smpp_pdu_unpack, but from len octets at data, which may be
+ * a view into the input buffer of a connection. */
+SMPP_PDU *smpp_pdu_unpack_data(Octstr *smsc_id, const unsigned char *data, long len);
 void smpp_pdu_dump(Octstr *smsc_id, SMPP_PDU *pdu);
 
 long smpp_pdu_read_len(Connection *conn);
 Octstr *smpp_pdu_read_data(Connection *conn, long len);
+/* Same as smpp_pdu_read_data, but return a view into the input buffer
+ * of conn, valid until the next read, instead of a copy. */
+const unsigned char *smpp_pdu_read_data_view(Connection *conn, long len);
 
 /*
  * Return error string for given error code
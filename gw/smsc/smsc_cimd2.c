@@ -95,6 +95,20 @@
 #include "dlr.h"
 
 
+/* Send sequence numbers are odd and run from 1 to 255, so at most this
+ * many requests can be waiting for their response at the same time. */
+#define CIMD2_SEQ_SLOTS 128
+
+/* A request sent to the SMSC that has not been answered yet.  The slot
+ * is indexed by seq / 2.  msg is the message of a submit, NULL for
+ * other requests. */
+struct cimd2_pending {
+    struct packet *packet;
+    Msg *msg;
+    time_t sent_time;
+    int tries;
+};
+
 typedef struct privdata {
     Octstr  *username;
     Octstr  *password;
@@ -114,6 +128,10 @@ typedef struct privdata {
 
     time_t  next_ping;
 
+    long    window;   /* max. requests waiting for their response */
+    long    pending_count;
+    struct cimd2_pending pending[CIMD2_SEQ_SLOTS];
+
     List *outgoing_queue;
     SMSCConn *conn;
     int io_thread;
@@ -127,6 +145,9 @@ typedef struct privdata {
 /* Microseconds before giving up on a request */
 #define RESPONSE_TIMEOUT (60 * 1000000)
 
+/* Seconds to wait for outstanding responses when shutting down */
+#define SHUTDOWN_TIMEOUT 10
+
 /* Textual names for the operation codes defined by the CIMD 2 spec. */
 /* If you make changes here, also change the operation table. */
 enum {
@@ -1909,26 +1930,146 @@ static void cimd2_logout(SMSCConn *conn)
     packet_destroy(packet);
 }
 
+/* Send a request without waiting for its response.  It gets the next
+ * sequence number that is not in use by another pending request, and
+ * is remembered until the response arrives.  Ownership of the packet
+ * (and of msg, if any) passes to the pending table.
+ *
+ * Return -1 if the request could not be written to the socket, in which
+ * case the caller should reopen the connection. */
+static int cimd2_send_request(SMSCConn *conn, struct packet *request,
+                              Msg *msg, int tries)
+{
+    PrivData *pdata = conn->data;
+    struct cimd2_pending *slot;
+    int i;
+
+    gw_assert(operation_can_send(request->operation));
+    gw_assert(pdata->pending_count < CIMD2_SEQ_SLOTS);
+
+    /* skip sequence numbers that still wait for their response */
+    for (i = 0; i < CIMD2_SEQ_SLOTS &&
+                pdata->pending[pdata->send_seq / 2].packet != NULL; i++) {
+        pdata->send_seq += 2;
+        if (pdata->send_seq > 256)
+            pdata->send_seq = 1;
+    }
+
+    packet_set_send_sequence(request, pdata);
+    packet_set_checksum(request);
+
+    slot = &pdata->pending[request->seq / 2];
+    slot->packet = request;
+    slot->msg = msg;
+    slot->sent_time = time(NULL);
+    slot->tries = tries;
+    pdata->pending_count++;
+
+    debug("bb.sms.cimd2", 0, "CIMD2[%s]: sending <%s>",
+          octstr_get_cstr(conn->id),
+          octstr_get_cstr(request->data));
+
+    if (octstr_write_to_socket(pdata->socket, request->data) < 0)
+        return -1;
+
+    return 0;
+}
+
+/* Take the pending request with sequence number seq out of the table.
+ * Return 0 if there is no such request. */
+static int cimd2_pending_remove(PrivData *pdata, int seq,
+                                struct cimd2_pending *pending)
+{
+    struct cimd2_pending *slot;
+
+    if (seq < 0 || seq % 2 != 1 || pdata->pending[seq / 2].packet == NULL)
+        return 0;
+
+    slot = &pdata->pending[seq / 2];
+    *pending = *slot;
+    slot->packet = NULL;
+    slot->msg = NULL;
+    pdata->pending_count--;
+    return 1;
+}
+
+/* Return the send time of the oldest request still waiting for its
+ * response, or 0 if nothing is pending. */
+static time_t cimd2_pending_oldest(PrivData *pdata)
+{
+    time_t oldest = 0;
+    int i;
+
+    if (pdata->pending_count == 0)
+        return 0;
+
+    for (i = 0; i < CIMD2_SEQ_SLOTS; i++) {
+        if (pdata->pending[i].packet != NULL &&
+            (oldest == 0 || pdata->pending[i].sent_time < oldest))
+            oldest = pdata->pending[i].sent_time;
+    }
+    return oldest;
+}
+
+/* Give up on all pending requests.  Their messages are reported
+ * as failed with the given reason. */
+static void cimd2_fail_pending(SMSCConn *conn, long reason)
+{
+    PrivData *pdata = conn->data;
+    int i;
+
+    for (i = 0; i < CIMD2_SEQ_SLOTS && pdata->pending_count > 0; i++) {
+        if (pdata->pending[i].packet == NULL)
+            continue;
+        if (pdata->pending[i].msg != NULL)
+            bb_smscconn_send_failed(conn, pdata->pending[i].msg, reason, NULL);
+        packet_destroy(pdata->pending[i].packet);
+        pdata->pending[i].packet = NULL;
+        pdata->pending[i].msg = NULL;
+        pdata->pending_count--;
+    }
+}
+
+/* Send a pending request again with a fresh sequence number.  Return -1
+ * if we gave up on it, in which case the connection should be reopened. */
+static int cimd2_retransmit(SMSCConn *conn, int seq)
+{
+    PrivData *pdata = conn->data;
+    struct cimd2_pending pending;
+
+    if (!cimd2_pending_remove(pdata, seq, &pending))
+        return 0;
+
+    if (++pending.tries < 3) {
+        warning(0, "CIMD2[%s]: Retransmitting (take %d)",
+                octstr_get_cstr(conn->id),
+                pending.tries);
+        return cimd2_send_request(conn, pending.packet, pending.msg,
+                                  pending.tries);
+    }
+
+    warning(0, "CIMD2[%s]: Giving up.",
+            octstr_get_cstr(conn->id));
+    if (pending.msg != NULL)
+        bb_smscconn_send_failed(conn, pending.msg,
+                                SMSCCONN_FAILED_TEMPORARILY, NULL);
+    packet_destroy(pending.packet);
+    return -1;
+}
+
 static int cimd2_send_alive(SMSCConn *conn)
 {
     struct packet *packet = NULL;
-    int ret;
 
     packet = packet_create(ALIVE, BOGUS_SEQUENCE);
-    ret = cimd2_request(packet, conn, NULL);
-    packet_destroy(packet);
-
-    if (ret < 0)
-        warning(0, "CIMD2[%s]: SMSC not alive.",
-                octstr_get_cstr(conn->id));
-
-    return ret;
+    return cimd2_send_request(conn, packet, NULL, 0);
 }
 
 
 static void cimd2_destroy(PrivData *pdata)
 {
     int discarded;
+    int i;
 
     if (pdata == NULL) 
         return;
@@ -1945,20 +2086,28 @@ static void cimd2_destroy(PrivData *pdata)
                 octstr_get_cstr(pdata->conn->id), 
                 discarded);
 
+    for (i = 0; i < CIMD2_SEQ_SLOTS; i++) {
+        packet_destroy(pdata->pending[i].packet);
+        msg_destroy(pdata->pending[i].msg);
+    }
+
     gwlist_destroy(pdata->received, msg_destroy_item);
-    gwlist_destroy(pdata->outgoing_queue, NULL);
+    gwlist_destroy(pdata->outgoing_queue, msg_destroy_item);
     gwlist_destroy(pdata->stopped, NULL);
 
     gw_free(pdata);
 }
 
 
+/* Send a message to the SMSC.  The result is reported to the bearerbox
+ * when the response arrives, see cimd2_handle_response().
+ *
+ * Return -1 if the message could not be encoded, and -2 if the socket
+ * failed and the connection should be reopened. */
 static int cimd2_submit_msg(SMSCConn *conn, Msg *msg)
 {
     PrivData *pdata = conn->data;
     struct packet *packet;
-    Octstr *ts = NULL;
-    int ret;
 
     gw_assert(pdata != NULL);
     debug("bb.sms.cimd2", 0, "CIMD2[%s]: sending message",
@@ -1974,111 +2123,200 @@ static int cimd2_submit_msg(SMSCConn *conn, Msg *msg)
         return -1;
     }
 
-    ret = cimd2_request(packet, conn, &ts);
-    if ((ret == 0) && (ts) && DLR_IS_SUCCESS_OR_FAIL(msg->sms.dlr_mask) && !pdata->no_dlr) {
-        dlr_add(conn->name, ts, msg, 1);
-    }
-    octstr_destroy(ts);
-    packet_destroy(packet);
-    
-    if (ret == -1) {
-        bb_smscconn_send_failed(conn, msg,
-	            SMSCCONN_FAILED_REJECTED, octstr_create("REJECTED"));
-    }
-    else if (ret == -2) {
-        cimd2_close_socket(pdata);
-        bb_smscconn_send_failed(conn, msg, SMSCCONN_FAILED_TEMPORARILY, NULL);
-        mutex_lock(conn->flow_mutex);
-        conn->status = SMSCCONN_DISCONNECTED;
-        mutex_unlock(conn->flow_mutex);
-    }
-    else {
-        bb_smscconn_sent(conn,msg, NULL);
-    }
+    /* if writing fails, the message stays pending and is failed
+     * together with the others when the connection is closed */
+    if (cimd2_send_request(conn, packet, msg, 0) < 0)
+        return -2;
 
-    return ret;
+    return 0;
 }
 
-static int cimd2_receive_msg(SMSCConn *conn, Msg **msg)
+/* Match a response from the SMSC with the pending request it answers.
+ * If the SMSC complains, attempt to correct and retry.
+ *
+ * Return -1 if the connection should be reopened, 0 otherwise. */
+static int cimd2_handle_response(struct packet *reply, SMSCConn *conn)
 {
     PrivData *pdata = conn->data;
-    long ret;
-    struct packet *packet;
+    struct cimd2_pending pending;
+    Octstr *ts;
+    int errorcode;
+    int seq;
 
-    gw_assert(pdata != NULL);
+    errorcode = packet_display_error(reply,conn);
 
-    if (gwlist_len(pdata->received) > 0) {
-        *msg = gwlist_consume(pdata->received);
-        return 1;
+    if (reply->operation == NACK) {
+        warning(0, "CIMD2[%s]: received NACK",
+                octstr_get_cstr(conn->id));
+        octstr_dump(reply->data, 0);
+        seq = reply->seq;
+        if (seq < 0 || seq % 2 != 1 || pdata->pending[seq / 2].packet == NULL) {
+            /* Correct sequence number if server says it was wrong,
+             * but only if server's number is sane. */
+            if (seq >= 0 && seq % 2 == 1) {
+                warning(0, "CIMD2[%s]: correcting sequence number from %ld to %ld.",
+                        octstr_get_cstr(conn->id),
+                        (long) pdata->send_seq,
+                        (long) seq);
+                pdata->send_seq = seq;
+            }
+            /* we can only tell which request was meant if there is
+             * exactly one */
+            if (pdata->pending_count != 1)
+                return 0;
+            for (seq = 1; pdata->pending[seq / 2].packet == NULL; seq += 2)
+                ;
+        }
+        return cimd2_retransmit(conn, seq);
     }
 
-    if (pdata->socket < 0) {
-        /* XXX We have to assume that smsc_send_message is
-         * currently trying to reopen, so we have to make
-         * this thread wait.  It should be done in a nicer
-         * way. */
+    if (reply->operation == GENERAL_ERROR_RESPONSE) {
+        error(0, "CIMD2[%s]: received general error response",
+              octstr_get_cstr(conn->id));
+        return -1;
+    }
+
+    if (reply->seq < 0 || reply->seq % 2 != 1 ||
+        pdata->pending[reply->seq / 2].packet == NULL) {
+        /* We got a response to a request we did not send, or that
+         * was already answered.  Strange. */
+        warning(0, "CIMD2[%s]: response had unexpected sequence number; ignoring.",
+                octstr_get_cstr(conn->id));
         return 0;
     }
-    
-    ret = read_available(pdata->socket, 0);
-    if (ret == 0) {
-        if (pdata->keepalive > 0 && pdata->next_ping < time(NULL)) {
-            if (cimd2_send_alive(conn) < 0)
-		return -1;
+
+    if (reply->operation !=
+            pdata->pending[reply->seq / 2].packet->operation + RESPONSE) {
+        /* We got a response that didn't match our request */
+        Octstr *request_name =
+            operation_name(pdata->pending[reply->seq / 2].packet->operation);
+        Octstr *reply_name = operation_name(reply->operation);
+        warning(0, "CIMD2[%s]: %s request got a %s",
+                octstr_get_cstr(conn->id),
+                octstr_get_cstr(request_name),
+                octstr_get_cstr(reply_name));
+
+        octstr_destroy(request_name);
+        octstr_destroy(reply_name);
+        octstr_dump(reply->data, 0);
+        return cimd2_retransmit(conn, reply->seq);
+    }
+
+    cimd2_pending_remove(pdata, reply->seq, &pending);
+
+    if (pending.msg == NULL) {
+        /* a refused keepalive means the SMSC does not want us anymore */
+        packet_destroy(pending.packet);
+        if (errorcode > 0) {
+            warning(0, "CIMD2[%s]: SMSC not alive.",
+                    octstr_get_cstr(conn->id));
+            return -1;
         }
         return 0;
     }
 
-    if (ret < 0) {
-        warning(errno, "CIMD2[%s]: cimd2_receive_msg: read_available failed",
-                octstr_get_cstr(conn->id));
-        return -1;
+    if (errorcode > 0) {
+        bb_smscconn_send_failed(conn, pending.msg,
+	            SMSCCONN_FAILED_REJECTED, octstr_create("REJECTED"));
     }
+    else {
+        ts = packet_get_parm(reply, P_MC_TIMESTAMP);
+        if (ts && DLR_IS_SUCCESS_OR_FAIL(pending.msg->sms.dlr_mask) && !pdata->no_dlr)
+            dlr_add(conn->name, ts, pending.msg, 1);
+        octstr_destroy(ts);
+        bb_smscconn_sent(conn, pending.msg, NULL);
+    }
+    packet_destroy(pending.packet);
 
-    /* We have some data waiting... see if it is an sms delivery. */
-    ret = octstr_append_from_socket(pdata->inbuffer, pdata->socket);
+    return 0;
+}
 
-    if (ret == 0) {
-        warning(0, "CIMD2[%s]: cimd2_receive_msg: service center closed connection.",
-                octstr_get_cstr(conn->id));
-        return -1;
-    }
+/* Read whatever the SMSC has sent us, without blocking, and handle
+ * the complete packets.  Return -1 if the connection should be
+ * reopened, 0 otherwise. */
+static int cimd2_read_packets(SMSCConn *conn)
+{
+    PrivData *pdata = conn->data;
+    long ret;
+    struct packet *packet;
+
+    gw_assert(pdata != NULL);
+
+    ret = read_available(pdata->socket, 0);
     if (ret < 0) {
-        warning(0, "CIMD2[%s]: cimd2_receive_msg: read failed",
+        warning(errno, "CIMD2[%s]: cimd2_read_packets: read_available failed",
                 octstr_get_cstr(conn->id));
         return -1;
     }
 
+    if (ret > 0) {
+        ret = octstr_append_from_socket(pdata->inbuffer, pdata->socket);
+        if (ret == 0) {
+            warning(0, "CIMD2[%s]: cimd2_read_packets: service center closed connection.",
+                    octstr_get_cstr(conn->id));
+            return -1;
+        }
+        if (ret < 0) {
+            warning(0, "CIMD2[%s]: cimd2_read_packets: read failed",
+                    octstr_get_cstr(conn->id));
+            return -1;
+        }
+    }
 
-    for (;;) {
-        packet = packet_extract(pdata->inbuffer,conn);
-        if (!packet)
-            break;
-
+    /* the buffer may also hold packets left over from cimd2_request() */
+    while ((packet = packet_extract(pdata->inbuffer, conn)) != NULL) {
         packet_check(packet,conn);
         packet_check_can_receive(packet,conn);
         debug("bb.sms.cimd2", 0, "CIMD2[%s]: received: <%s>",
               octstr_get_cstr(pdata->conn->id), 
               octstr_get_cstr(packet->data));
 
+        if (pdata->keepalive > 0)
+            pdata->next_ping = time(NULL) + pdata->keepalive;
+
         if (packet->operation < RESPONSE)
             cimd2_handle_request(packet, conn);
-        else {
-            error(0, "CIMD2[%s]: cimd2_receive_msg: unexpected response packet",
-                octstr_get_cstr(conn->id));
-            octstr_dump(packet->data, 0);
+        else if (cimd2_handle_response(packet, conn) < 0) {
+            packet_destroy(packet);
+            return -1;
         }
 
         packet_destroy(packet);
     }
 
-    if (gwlist_len(pdata->received) > 0) {
-	*msg = gwlist_consume(pdata->received);
-        return 1;
-    }
     return 0;
 }
 
+/* Pass the messages and reports received so far to the bearerbox. */
+static void cimd2_deliver_received(SMSCConn *conn)
+{
+    PrivData *pdata = conn->data;
+    Msg *msg;
+
+    while ((msg = gwlist_extract_first(pdata->received)) != NULL) {
+        /* if any smsc_id available, use it */
+        octstr_destroy(msg->sms.smsc_id);
+        msg->sms.smsc_id = octstr_duplicate(conn->id);
+        debug("bb.sms.cimd2", 0, "CIMD2[%s]: new message received",
+              octstr_get_cstr(conn->id));
+        bb_smscconn_receive(conn, msg);
+    }
+}
+
+/* Drop the connection.  Messages waiting for their response are
+ * failed temporarily, so that they will be sent again. */
+static void cimd2_disconnect(SMSCConn *conn)
+{
+    PrivData *pdata = conn->data;
+
+    mutex_lock(conn->flow_mutex);
+    cimd2_close_socket(pdata);
+    conn->status = SMSCCONN_DISCONNECTED;
+    mutex_unlock(conn->flow_mutex);
+
+    octstr_delete(pdata->inbuffer, 0, octstr_len(pdata->inbuffer));
+    cimd2_fail_pending(conn, SMSCCONN_FAILED_TEMPORARILY);
+}
 
 
 static Msg *cimd2_accept_delivery_report_message(struct packet *request,
@@ -2134,37 +2372,14 @@ static Msg *cimd2_accept_delivery_report_message(struct packet *request,
     return msg;
  }
 
-static Msg *sms_receive(SMSCConn *conn)
-{
-    PrivData *pdata = conn->data;
-    int ret;
-    Msg *newmsg = NULL;
-
-    ret = cimd2_receive_msg(conn, &newmsg);
-    if (ret == 1) {
-        /* if any smsc_id available, use it */
-        newmsg->sms.smsc_id = octstr_duplicate(conn->id);
-        return newmsg;
-    } 
-    else if (ret == 0) { /* no message, just retry... */
-        return NULL;
-    } 
-    /* error. reconnect. */
-    msg_destroy(newmsg);
-    mutex_lock(conn->flow_mutex);
-    cimd2_close_socket(pdata);
-    conn->status = SMSCCONN_DISCONNECTED;
-    mutex_unlock(conn->flow_mutex);
-    return NULL;
-}
-
-
 static void io_thread (void *arg)
 {
     Msg       *msg;
     SMSCConn  *conn = arg;
     PrivData *pdata = conn->data;
-    double    sleep = 0.0001;
+    double    throttle, timeout;
+    time_t    now, oldest;
+    int       ret;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
@@ -2191,46 +2406,87 @@ static void io_thread (void *arg)
             conn->connect_time = time(NULL);
             bb_smscconn_connected(conn);
             mutex_unlock(conn->flow_mutex);
+            if (pdata->keepalive > 0)
+                pdata->next_ping = time(NULL) + pdata->keepalive;
         }
 
-        /* receive messages */
-        do { 
-            msg = sms_receive(conn);
-            if (msg) {
-                sleep = 0;
-                debug("bb.sms.cimd2", 0, "CIMD2[%s]: new message received",
-                      octstr_get_cstr(conn->id));
-                bb_smscconn_receive(conn, msg);
-            }
-        } while (msg);
+        /* receive messages and responses */
+        if (cimd2_read_packets(conn) < 0) {
+            cimd2_deliver_received(conn);
+            cimd2_disconnect(conn);
+            continue;
+        }
+        cimd2_deliver_received(conn);
  
-        /* send messages */
-        do {
+        /* send messages, as far as the window and our throughput allow */
+        throttle = 0;
+        ret = 0;
+        while (pdata->pending_count < pdata->window &&
+               gwlist_len(pdata->outgoing_queue) > 0 &&
+               (throttle = smscconn_throughput_take(conn)) == 0) {
             msg = gwlist_extract_first(pdata->outgoing_queue);
-            if (msg) {
-                sleep = 0;
-                if (cimd2_submit_msg(conn,msg) != 0) break;
+            if (msg == NULL) {
+                smscconn_throughput_return(conn);
+                break;
             }
-        } while (msg);
- 
-        if (sleep > 0) {
-
-            /* note that this implementations means that we sleep even
-             * when we fail connection.. but time is very short, anyway
-             */
-            gwthread_sleep(sleep);
-            /* gradually sleep longer and longer times until something starts to
-             * happen - this of course reduces response time, but that's better than
-             * extensive CPU usage when it is not used
-             */
-            sleep *= 2;
-            if (sleep >= 2.0)
-                sleep = 1.999999;
+            if ((ret = cimd2_submit_msg(conn, msg)) == -2)
+                break;
         }
-        else {
-            sleep = 0.0001;
+        if (ret == -2) {
+            cimd2_disconnect(conn);
+            continue;
         }
+
+        now = time(NULL);
+        oldest = cimd2_pending_oldest(pdata);
+        if (oldest > 0 && oldest + RESPONSE_TIMEOUT / 1000000 <= now) {
+            warning(0, "CIMD2[%s]: SMSC is not responding",
+                    octstr_get_cstr(conn->id));
+            cimd2_disconnect(conn);
+            continue;
+        }
+
+        /* the responses keep the link alive while we are busy */
+        if (pdata->keepalive > 0 && pdata->pending_count == 0 &&
+            pdata->next_ping <= now) {
+            if (cimd2_send_alive(conn) < 0) {
+                cimd2_disconnect(conn);
+                continue;
+            }
+            oldest = now;
+        }
+
+        /* Wait for the SMSC, or until new messages are queued (we get
+         * woken up), or the next timer is due. */
+        if (throttle == 0 && pdata->pending_count < pdata->window &&
+            gwlist_len(pdata->outgoing_queue) > 0)
+            continue;
+        timeout = -1;
+        if (oldest > 0)
+            timeout = oldest + RESPONSE_TIMEOUT / 1000000 - now;
+        else if (pdata->keepalive > 0)
+            timeout = pdata->next_ping - now;
+        if (throttle > 0 && (timeout < 0 || throttle < timeout))
+            timeout = throttle;
+        if (timeout != 0)
+            gwthread_pollfd(pdata->socket, POLLIN, timeout);
+    }
+
+    /* Let the SMSC answer what it already got, then log out. */
+    if (conn->status == SMSCCONN_ACTIVE && pdata->socket >= 0) {
+        now = time(NULL);
+        while (pdata->pending_count > 0 && time(NULL) < now + SHUTDOWN_TIMEOUT) {
+            if (gwthread_pollfd(pdata->socket, POLLIN, 1.0) < 0 ||
+                cimd2_read_packets(conn) < 0)
+                break;
+        }
+        cimd2_deliver_received(conn);
+        if (pdata->pending_count == 0)
+            cimd2_logout(conn);
     }
+    cimd2_fail_pending(conn, SMSCCONN_FAILED_SHUTDOWN);
+    while ((msg = gwlist_extract_first(pdata->outgoing_queue)) != NULL)
+        bb_smscconn_send_failed(conn, msg, SMSCCONN_FAILED_SHUTDOWN, NULL);
 }
 
 
@@ -2268,7 +2524,6 @@ static int cimd2_shutdown_cb (SMSCConn *conn, int finish_sending)
         }
     }
 
-    cimd2_logout(conn);
     if (conn->is_stopped) {
         gwlist_remove_producer(pdata->stopped);
         conn->is_stopped = 0;
@@ -2333,6 +2588,8 @@ int smsc_cimd2_create(SMSCConn *conn, CfgGroup *grp)
     pdata->inbuffer = octstr_create("");
     pdata->send_seq = 1;
     pdata->receive_seq = 0;
+    pdata->pending_count = 0;
+    memset(pdata->pending, 0, sizeof(pdata->pending));
     pdata->outgoing_queue = gwlist_create();
     pdata->stopped = gwlist_create();
     gwlist_add_producer(pdata->outgoing_queue);
@@ -2350,6 +2607,14 @@ int smsc_cimd2_create(SMSCConn *conn, CfgGroup *grp)
     pdata->my_number = cfg_get(grp, octstr_imm("my-number"));
     if (cfg_get_integer(&(pdata->keepalive), grp,octstr_imm("keepalive")) == -1)
         pdata->keepalive = 0;
+    if (cfg_get_integer(&(pdata->window), grp, octstr_imm("window")) == -1)
+        pdata->window = 1;
+    if (pdata->window < 1 || pdata->window > CIMD2_SEQ_SLOTS) {
+        warning(0, "CIMD2[%s]: window must be between 1 and %d, using %d",
+                octstr_get_cstr(conn->id), CIMD2_SEQ_SLOTS,
+                pdata->window < 1 ? 1 : CIMD2_SEQ_SLOTS);
+        pdata->window = pdata->window < 1 ? 1 : CIMD2_SEQ_SLOTS;
+    }
 
     cfg_get_bool(&pdata->no_dlr, grp, octstr_imm("no-dlr"));
     
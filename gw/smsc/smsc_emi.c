@@ -939,7 +939,12 @@ static void clear_sent(PrivData *privdata)
 static EMI2Event emi2_wait (SMSCConn *conn, Connection *server, double seconds)
 {
     if (emi2_can_send(conn) && gw_prioqueue_len(PRIVDATA(conn)->outgoing_queue)) {
-	return EMI2_SENDREQ;
+	/* wait no longer than our throughput requires */
+	double delay = smscconn_throughput_wait(conn);
+	if (delay <= 0)
+	    return EMI2_SENDREQ;
+	if (delay < seconds)
+	    seconds = delay;
     }
     
     if (server != NULL) {
@@ -1006,19 +1011,21 @@ static int emi2_do_send(SMSCConn *conn, Connection *server)
 {
     struct emimsg *emimsg;
     Msg *msg;
-    double delay = 0;
 
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
-    
-    /* Send messages if there's room in the sending window */
+    /*
+     * Send messages if there's room in the sending window and our
+     * throughput allows. Otherwise emi2_wait() wakes us up in time.
+     */
     while (emi2_can_send(conn) &&
-           (msg = gw_prioqueue_remove(PRIVDATA(conn)->outgoing_queue)) != NULL) {
-        int nexttrn = emi2_next_trn(conn);
+           gw_prioqueue_len(PRIVDATA(conn)->outgoing_queue) > 0 &&
+           smscconn_throughput_take(conn) == 0) {
+        int nexttrn;
 
-        if (conn->throughput > 0)
-            gwthread_sleep(delay);
+        if ((msg = gw_prioqueue_remove(PRIVDATA(conn)->outgoing_queue)) == NULL) {
+            smscconn_throughput_return(conn);
+            break;
+        }
+        nexttrn = emi2_next_trn(conn);
 
         /* convert the generic Kannel message into an EMI type message */
         emimsg = msg_to_emimsg(msg, nexttrn, PRIVDATA(conn));
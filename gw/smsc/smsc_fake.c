@@ -243,11 +243,7 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
     PrivData *privdata = conn->data;
     Octstr *line;
     Msg	*msg;
-    double delay = 0;
-
-    if (conn->throughput > 0) {
-        delay = 1.0 / conn->throughput;
-    }
+    double delay;
 
     while (1) {
         while (!conn->is_stopped && !privdata->shutdown &&
@@ -267,6 +263,10 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 
         while ((msg = gwlist_extract_first(privdata->outgoing_queue)) != NULL) {
 
+            /* obey throughput speed limit, if any */
+            while ((delay = smscconn_throughput_take(conn)) > 0)
+                gwthread_sleep(delay);
+
             /* pass msg to fakesmsc daemon */            
             if (sms_to_client(client, msg) == 1) {
                 Msg *copy = msg_duplicate(msg);
@@ -310,11 +310,6 @@ static void main_connection_loop(SMSCConn *conn, Connection *client)
 		            SMSCCONN_FAILED_REJECTED, octstr_create("REJECTED"));
                 goto error;
             }
-
-            /* obey throughput speed limit, if any */
-            if (conn->throughput > 0) {
-                gwthread_sleep(delay);
-            }
         }
         if (privdata->shutdown) {
             debug("bb.sms", 0, "smsc_fake shutting down, closing client socket");
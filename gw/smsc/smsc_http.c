@@ -283,15 +283,11 @@ static void httpsmsc_sender(void *arg)
     SMSCConn *conn = arg;
     ConnData *conndata = conn->data;
     Msg *msg;
-    double delay = 0;
+    double delay;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(conn->log_idx);
 
-    if (conn->throughput) {
-        delay = 1.0 / conn->throughput;
-    }
-
     while (conndata->shutdown == 0) {
         /* check if we can send ; otherwise block on semaphore */
         if (conndata->max_pending_sends)
@@ -308,9 +304,9 @@ static void httpsmsc_sender(void *arg)
             break;
 
         /* obey throughput speed limit, if any */
-        if (conn->throughput > 0) {
+        while ((delay = smscconn_throughput_take(conn)) > 0)
             gwthread_sleep(delay);
-        }
+
         counter_increase(conndata->open_sends);
         if (conndata->callbacks->send_sms(conn, msg) == -1) {
             counter_decrease(conndata->open_sends);
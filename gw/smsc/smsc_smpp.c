@@ -79,7 +79,6 @@
 #include "dlr.h"
 #include "bearerbox.h"
 #include "meta_data.h"
-#include "load.h"
 
 #define SMPP_DEFAULT_CHARSET "UTF-8"
 
@@ -117,6 +116,16 @@
 #define SMPP_DEFAULT_WAITACK        60
 #define SMPP_DEFAULT_SHUTDOWN_TIMEOUT 30
 
+/*
+ * Adaptive window: a window is cut in half if the smoothed submit_sm
+ * round trip time exceeds SMPP_RTT_RISE times the lowest one seen plus
+ * SMPP_RTT_SLACK seconds. Round trip times are counted in
+ * SMPP_RTT_BUCKETS buckets of powers of two milliseconds.
+ */
+#define SMPP_RTT_RISE               2.0
+#define SMPP_RTT_SLACK              0.005
+#define SMPP_RTT_BUCKETS            14
+
 
 /*
  * Some defines
@@ -132,10 +141,8 @@
 
 
 typedef struct {
-    long transmitter;
-    long receiver;
+    List *binds;
     gw_prioqueue_t *msgs_to_send;
-    Dict *sent_msgs;
     List *received_msgs;
     Counter *message_id_counter;
     Octstr *host;
@@ -158,12 +165,13 @@ typedef struct {
     int use_ssl;
     Octstr *ssl_client_certkey_file;
     volatile int quitting;
+    volatile int start_failed;  /* smsc_smpp_create() joins and frees */
     long enquire_link_interval;
     long max_pending_submits;
+    int adaptive_window;    /* max_pending_submits is only the upper limit */
     int version;
     int priority;       /* set default priority for messages */
     int validityperiod;
-    time_t throttling_err_time;
     int smpp_msg_id_type;  /* msg id in C string, hex or decimal */
     int autodetect_addr;
     Octstr *alt_charset;
@@ -172,26 +180,78 @@ typedef struct {
     long wait_ack;
     int wait_ack_action;
     int esm_class;
-    Load *load;
     SMSCConn *conn;
+    long next_bind;     /* round robin start for waking up binds */
 } SMPP;
 
 
 struct smpp_msg {
     time_t sent_time;
+    double sent_at;     /* sent_time with sub-second resolution */
+    long sequence_number;
     Msg *msg;
 };
 
 
+/*
+ * Submits waiting for their response, keyed by sequence number.  Open
+ * addressing with linear probing; sequence numbers are handed out in
+ * order, so the low bits alone spread them over the slots.
+ */
+struct smpp_sent_table {
+    Mutex *lock;
+    long size;      /* power of two */
+    long count;
+    struct smpp_msg **slots;
+};
+
+
+/*
+ * One session to the SMSC and the io_thread running it.  With `binds'
+ * set, several transmitter or transceiver sessions share msgs_to_send,
+ * each with its own window of pending submits.  The first bind owns the
+ * SMPP struct and joins the others when shutting down.
+ */
+struct smpp_bind {
+    SMPP *smpp;
+    int transmitter;    /* 0 receiver, 1 transmitter, 2 transceiver */
+    long thread;
+    int status;         /* this session's part of smpp->conn->status */
+    long pending_submits;
+    struct smpp_sent_table *sent_msgs;
+    time_t throttling_err_time;
+
+    /* flow control, see smpp_window_update() */
+    Mutex *window_lock;
+    double window;              /* submits allowed in flight */
+    double window_threshold;    /* end of slow start */
+    double window_decreased;    /* time of the last decrease */
+    double srtt;                /* smoothed submit_sm round trip time */
+    double min_rtt;             /* lowest round trip time seen */
+    unsigned long rtt_histogram[SMPP_RTT_BUCKETS];
+};
+
+
+static double smpp_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
 /*
  * create smpp_msg struct
  */
-static inline struct smpp_msg* smpp_msg_create(Msg *msg)
+static inline struct smpp_msg* smpp_msg_create(Msg *msg, long sequence_number)
 {
     struct smpp_msg *result = gw_malloc(sizeof(struct smpp_msg));
 
     gw_assert(result != NULL);
-    result->sent_time = time(NULL);
+    result->sent_at = smpp_now();
+    result->sent_time = (time_t) result->sent_at;
+    result->sequence_number = sequence_number;
     result->msg = msg;
 
     return result;
@@ -214,6 +274,420 @@ static inline void smpp_msg_destroy(struct smpp_msg *msg, int destroy_msg)
 }
 
 
+static struct smpp_sent_table *smpp_sent_table_create(long hint)
+{
+    struct smpp_sent_table *table;
+    long i;
+
+    table = gw_malloc(sizeof(*table));
+    table->lock = mutex_create();
+    for (table->size = 16; table->size < hint * 2; table->size *= 2)
+        ;
+    table->count = 0;
+    table->slots = gw_malloc(table->size * sizeof(table->slots[0]));
+    for (i = 0; i < table->size; i++)
+        table->slots[i] = NULL;
+
+    return table;
+}
+
+
+static void smpp_sent_table_destroy(struct smpp_sent_table *table)
+{
+    long i;
+
+    if (table == NULL)
+        return;
+
+    for (i = 0; i < table->size; i++)
+        smpp_msg_destroy(table->slots[i], 1);
+    mutex_destroy(table->lock);
+    gw_free(table->slots);
+    gw_free(table);
+}
+
+
+/* Slot of sequence_number, or of the free slot ending its probe chain. */
+static long smpp_sent_table_slot(struct smpp_sent_table *table, long sequence_number)
+{
+    long i;
+
+    i = sequence_number & (table->size - 1);
+    while (table->slots[i] != NULL && table->slots[i]->sequence_number != sequence_number)
+        i = (i + 1) & (table->size - 1);
+
+    return i;
+}
+
+
+static void smpp_sent_table_grow(struct smpp_sent_table *table)
+{
+    struct smpp_msg **old;
+    long i, old_size;
+
+    old = table->slots;
+    old_size = table->size;
+    table->size *= 2;
+    table->slots = gw_malloc(table->size * sizeof(table->slots[0]));
+    for (i = 0; i < table->size; i++)
+        table->slots[i] = NULL;
+    for (i = 0; i < old_size; i++) {
+        if (old[i] != NULL)
+            table->slots[smpp_sent_table_slot(table, old[i]->sequence_number)] = old[i];
+    }
+    gw_free(old);
+}
+
+
+/* Add smpp_msg under its sequence number, replacing and returning an old one. */
+static struct smpp_msg *smpp_sent_table_put(struct smpp_sent_table *table, struct smpp_msg *smpp_msg)
+{
+    struct smpp_msg *old;
+    long i;
+
+    mutex_lock(table->lock);
+    if ((table->count + 1) * 2 > table->size)
+        smpp_sent_table_grow(table);
+    i = smpp_sent_table_slot(table, smpp_msg->sequence_number);
+    old = table->slots[i];
+    table->slots[i] = smpp_msg;
+    if (old == NULL)
+        table->count++;
+    mutex_unlock(table->lock);
+
+    return old;
+}
+
+
+/* Must be called with table->lock held. */
+static struct smpp_msg *smpp_sent_table_remove_locked(struct smpp_sent_table *table, long sequence_number)
+{
+    struct smpp_msg *res;
+    long i, j, home;
+
+    i = smpp_sent_table_slot(table, sequence_number);
+    res = table->slots[i];
+    if (res != NULL) {
+        table->count--;
+        /* shift back later entries of the probe chain to close the gap */
+        for (j = (i + 1) & (table->size - 1); table->slots[j] != NULL; j = (j + 1) & (table->size - 1)) {
+            home = table->slots[j]->sequence_number & (table->size - 1);
+            if (((j - home) & (table->size - 1)) >= ((j - i) & (table->size - 1))) {
+                table->slots[i] = table->slots[j];
+                i = j;
+            }
+        }
+        table->slots[i] = NULL;
+    }
+
+    return res;
+}
+
+
+static struct smpp_msg *smpp_sent_table_remove(struct smpp_sent_table *table, long sequence_number)
+{
+    struct smpp_msg *res;
+
+    mutex_lock(table->lock);
+    res = smpp_sent_table_remove_locked(table, sequence_number);
+    mutex_unlock(table->lock);
+
+    return res;
+}
+
+
+/*
+ * Remove and return as a List all messages sent before `before', or all
+ * messages if `before' is -1.
+ */
+static List *smpp_sent_table_extract(struct smpp_sent_table *table, time_t before)
+{
+    List *res;
+    long i;
+
+    res = gwlist_create();
+    mutex_lock(table->lock);
+    for (i = 0; i < table->size; i++) {
+        if (table->slots[i] != NULL &&
+            (before == -1 || table->slots[i]->sent_time < before))
+            gwlist_append(res, table->slots[i]);
+    }
+    /* remove them before a late response can take them out too */
+    for (i = 0; i < gwlist_len(res); i++)
+        smpp_sent_table_remove_locked(table, ((struct smpp_msg *) gwlist_get(res, i))->sequence_number);
+    mutex_unlock(table->lock);
+
+    return res;
+}
+
+
+/* Return whether a message sent before `before' is waiting for its response. */
+static int smpp_sent_table_has_older(struct smpp_sent_table *table, time_t before)
+{
+    long i;
+    int res = 0;
+
+    mutex_lock(table->lock);
+    for (i = 0; res == 0 && i < table->size; i++)
+        res = (table->slots[i] != NULL && table->slots[i]->sent_time < before);
+    mutex_unlock(table->lock);
+
+    return res;
+}
+
+
+static struct smpp_bind *smpp_bind_create(SMPP *smpp, int transmitter)
+{
+    struct smpp_bind *bind;
+
+    bind = gw_malloc(sizeof(*bind));
+    bind->smpp = smpp;
+    bind->transmitter = transmitter;
+    bind->thread = -1;
+    bind->status = SMSCCONN_CONNECTING;
+    bind->pending_submits = -1;
+    bind->sent_msgs = smpp_sent_table_create(smpp->max_pending_submits);
+    bind->throttling_err_time = 0;
+    bind->window_lock = mutex_create();
+    bind->window = 1;
+    bind->window_threshold = smpp->max_pending_submits;
+    bind->window_decreased = 0;
+    bind->srtt = 0;
+    bind->min_rtt = 0;
+    memset(bind->rtt_histogram, 0, sizeof(bind->rtt_histogram));
+
+    return bind;
+}
+
+
+static void smpp_bind_destroy(struct smpp_bind *bind)
+{
+    if (bind == NULL)
+        return;
+
+    smpp_sent_table_destroy(bind->sent_msgs);
+    mutex_destroy(bind->window_lock);
+    gw_free(bind);
+}
+
+
+/*
+ * Return the number of submits the bind may have in flight.
+ */
+static long smpp_bind_window(struct smpp_bind *bind)
+{
+    if (!bind->smpp->adaptive_window)
+        return bind->smpp->max_pending_submits;
+    return (long) bind->window;
+}
+
+
+/*
+ * Start a new session of the bind in slow start. The round trip times
+ * of the old session say nothing about the new one; the histogram is
+ * kept for the status page.
+ */
+static void smpp_window_reset(struct smpp_bind *bind)
+{
+    mutex_lock(bind->window_lock);
+    bind->window = 1;
+    bind->window_threshold = bind->smpp->max_pending_submits;
+    bind->window_decreased = 0;
+    bind->srtt = 0;
+    bind->min_rtt = 0;
+    mutex_unlock(bind->window_lock);
+}
+
+
+/*
+ * Cut the window in half, at most once per round trip so that all
+ * responses to the same congested window count as one event. The
+ * window_lock has to be held.
+ */
+static void smpp_window_decrease(struct smpp_bind *bind, double now)
+{
+    if (now - bind->window_decreased < bind->srtt)
+        return;
+
+    bind->window_threshold = bind->window / 2;
+    if (bind->window_threshold < 1)
+        bind->window_threshold = 1;
+    bind->window = bind->window_threshold;
+    bind->window_decreased = now;
+    debug("bb.sms.smpp", 0, "SMPP[%s]: window decreased to %ld.",
+          octstr_get_cstr(bind->smpp->conn->id), (long) bind->window);
+}
+
+
+/*
+ * Account the response to `smpp_msg' with `command_status'. Records the
+ * round trip time and, with adaptive-window, grows the window by one per
+ * response in slow start and by one per window afterwards, as long as
+ * the window is used and the round trip time stays low. Throttling
+ * errors, a full message queue and a rising round trip time cut it in
+ * half.
+ *
+ * Return 1 if the caller should back off for SMPP_THROTTLING_SLEEP_TIME
+ * because of a throttling error: always with a fixed window, and with an
+ * adaptive one when it could not get any smaller.
+ */
+static int smpp_window_update(struct smpp_bind *bind, struct smpp_msg *smpp_msg,
+                              long command_status)
+{
+    SMPP *smpp = bind->smpp;
+    double now, rtt;
+    long ms, i;
+    int backoff;
+
+    now = smpp_now();
+    rtt = now - smpp_msg->sent_at;
+    if (rtt < 0)
+        rtt = 0;
+
+    mutex_lock(bind->window_lock);
+
+    for (i = 0, ms = rtt * 1000; i < SMPP_RTT_BUCKETS - 1 && ms >= (1L << i); i++)
+        ;
+    bind->rtt_histogram[i]++;
+
+    if (bind->srtt == 0)
+        bind->srtt = rtt;
+    else
+        bind->srtt += (rtt - bind->srtt) / 8;
+    if (bind->min_rtt == 0 || rtt < bind->min_rtt)
+        bind->min_rtt = rtt;
+
+    backoff = (command_status == SMPP_ESME_RTHROTTLED);
+    if (!smpp->adaptive_window) {
+        mutex_unlock(bind->window_lock);
+        return backoff;
+    }
+
+    if (command_status == SMPP_ESME_RTHROTTLED ||
+        command_status == SMPP_ESME_RMSGQFUL) {
+        backoff = (bind->window < 2);
+        smpp_window_decrease(bind, now);
+    } else if (bind->srtt > bind->min_rtt * SMPP_RTT_RISE + SMPP_RTT_SLACK) {
+        /*
+         * With a window of one there is no queue of ours at the SMSC;
+         * the link itself got slower, take that as the new base.
+         */
+        if (bind->window < 2)
+            bind->min_rtt = bind->srtt;
+        smpp_window_decrease(bind, now);
+    } else if (command_status == 0 && bind->pending_submits >= (long) bind->window) {
+        if (bind->window < bind->window_threshold)
+            bind->window += 1;
+        else
+            bind->window += 1 / bind->window;
+        if (bind->window > smpp->max_pending_submits)
+            bind->window = smpp->max_pending_submits;
+    }
+
+    mutex_unlock(bind->window_lock);
+
+    return backoff;
+}
+
+
+/*
+ * Append the flow control state of the transmitting binds to `os', one
+ * line per bind.
+ */
+static void smpp_window_status(SMPP *smpp, Octstr *os)
+{
+    struct smpp_bind *bind;
+    long i, j;
+
+    for (i = 0; i < gwlist_len(smpp->binds); i++) {
+        bind = gwlist_get(smpp->binds, i);
+        if (!bind->transmitter)
+            continue;
+
+        mutex_lock(bind->window_lock);
+        if (octstr_len(os) > 0)
+            octstr_append_char(os, '\n');
+        octstr_format_append(os, "bind %ld: window %ld/%ld%s, pending %ld, "
+                             "rtt %.1f ms (min %.1f ms), rtt histogram",
+                             i + 1, smpp_bind_window(bind), smpp->max_pending_submits,
+                             smpp->adaptive_window ? " adaptive" : "",
+                             bind->pending_submits > 0 ? bind->pending_submits : 0,
+                             bind->srtt * 1000, bind->min_rtt * 1000);
+        for (j = 0; j < SMPP_RTT_BUCKETS; j++) {
+            if (bind->rtt_histogram[j] == 0)
+                continue;
+            if (j < SMPP_RTT_BUCKETS - 1)
+                octstr_format_append(os, " %ldms:%lu", 1L << j, bind->rtt_histogram[j]);
+            else
+                octstr_format_append(os, " %ldms+:%lu", 1L << (j - 1), bind->rtt_histogram[j]);
+        }
+        mutex_unlock(bind->window_lock);
+    }
+}
+
+
+/*
+ * Set the status of one bind and derive the status of the SMSCConn from
+ * all of them: active as long as one transmitting bind is, receiving
+ * only if just receivers are bound, otherwise the best of the rest.
+ */
+static void smpp_bind_set_status(struct smpp_bind *bind, int status)
+{
+    SMPP *smpp = bind->smpp;
+    struct smpp_bind *other;
+    int conn_status, was_active;
+    long i, active;
+
+    mutex_lock(smpp->conn->flow_mutex);
+    was_active = (smpp->conn->status == SMSCCONN_ACTIVE || smpp->conn->status == SMSCCONN_ACTIVE_RECV);
+    bind->status = status;
+    conn_status = SMSCCONN_DISCONNECTED;
+    active = 0;
+    for (i = 0; i < gwlist_len(smpp->binds); i++) {
+        other = gwlist_get(smpp->binds, i);
+        switch (other->status) {
+        case SMSCCONN_ACTIVE:
+            active++;
+            conn_status = SMSCCONN_ACTIVE;
+            break;
+        case SMSCCONN_ACTIVE_RECV:
+            active++;
+            if (conn_status != SMSCCONN_ACTIVE)
+                conn_status = SMSCCONN_ACTIVE_RECV;
+            break;
+        case SMSCCONN_CONNECTING:
+        case SMSCCONN_RECONNECTING:
+            if (conn_status == SMSCCONN_DISCONNECTED || conn_status == SMSCCONN_CONNECTING)
+                conn_status = other->status;
+            break;
+        }
+    }
+    smpp->conn->status = conn_status;
+    smpp->conn->binds_active = active;
+    if (!was_active && active > 0)
+        time(&smpp->conn->connect_time);
+    mutex_unlock(smpp->conn->flow_mutex);
+}
+
+
+/* Return whether a bind other than this one can send submits. */
+static int smpp_bind_other_transmitting(struct smpp_bind *bind)
+{
+    struct smpp_bind *other;
+    long i;
+    int res = 0;
+
+    mutex_lock(bind->smpp->conn->flow_mutex);
+    for (i = 0; res == 0 && i < gwlist_len(bind->smpp->binds); i++) {
+        other = gwlist_get(bind->smpp->binds, i);
+        res = (other != bind && other->transmitter && other->status == SMSCCONN_ACTIVE);
+    }
+    mutex_unlock(bind->smpp->conn->flow_mutex);
+
+    return res;
+}
+
+
 static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
                          int receive_port, int our_port, int our_receiver_port, Octstr *system_type,
                          Octstr *username, Octstr *password,
@@ -230,10 +704,9 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     SMPP *smpp;
 
     smpp = gw_malloc(sizeof(*smpp));
-    smpp->transmitter = -1;
-    smpp->receiver = -1;
+    smpp->binds = gwlist_create();
+    smpp->next_bind = 0;
     smpp->msgs_to_send = gw_prioqueue_create(sms_priority_compare);
-    smpp->sent_msgs = dict_create(max_pending_submits, NULL);
     gw_prioqueue_add_producer(smpp->msgs_to_send);
     smpp->received_msgs = gwlist_create();
     smpp->message_id_counter = counter_create();
@@ -256,11 +729,11 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     smpp->enquire_link_interval = enquire_link_interval;
     smpp->max_pending_submits = max_pending_submits;
     smpp->quitting = 0;
+    smpp->start_failed = 0;
     smpp->version = version;
     smpp->priority = priority;
     smpp->validityperiod = validity;
     smpp->conn = conn;
-    smpp->throttling_err_time = 0;
     smpp->smpp_msg_id_type = smpp_msg_id_type;
     smpp->autodetect_addr = autodetect_addr;
     smpp->alt_charset = octstr_duplicate(alt_charset);
@@ -272,8 +745,6 @@ static SMPP *smpp_create(SMSCConn *conn, Octstr *host, int transmit_port,
     smpp->bind_addr_npi = 0;
     smpp->use_ssl = 0;
     smpp->ssl_client_certkey_file = NULL;
-    smpp->load = load_create_real(0);
-    load_add_interval(smpp->load, 1);
     smpp->esm_class = esm_class;
 
     return smpp;
@@ -284,7 +755,7 @@ static void smpp_destroy(SMPP *smpp)
 {
     if (smpp != NULL) {
         gw_prioqueue_destroy(smpp->msgs_to_send, msg_destroy_item);
-        dict_destroy(smpp->sent_msgs);
+        gwlist_destroy(smpp->binds, (void(*)(void*)) smpp_bind_destroy);
         gwlist_destroy(smpp->received_msgs, msg_destroy_item);
         counter_destroy(smpp->message_id_counter);
         octstr_destroy(smpp->host);
@@ -297,7 +768,6 @@ static void smpp_destroy(SMPP *smpp)
         octstr_destroy(smpp->alt_charset);
         octstr_destroy(smpp->alt_addr_charset);
         octstr_destroy(smpp->ssl_client_certkey_file);
-        load_destroy(smpp->load);
         gw_free(smpp);
     }
 }
@@ -314,6 +784,8 @@ static void smpp_destroy(SMPP *smpp)
  */
 static int read_pdu(SMPP *smpp, Connection *conn, long *len, SMPP_PDU **pdu)
 {
+    const unsigned char *data;
+    long data_len;
     Octstr *os;
 
     if (*len == 0) {
@@ -329,26 +801,28 @@ static int read_pdu(SMPP *smpp, Connection *conn, long *len, SMPP_PDU **pdu)
         }
     }
 
-    os = smpp_pdu_read_data(conn, *len);
-    if (os == NULL) {
+    /* decode straight from the connection buffer, only we read it */
+    data = smpp_pdu_read_data_view(conn, *len);
+    if (data == NULL) {
         if (conn_eof(conn) || conn_error(conn))
             return -1;
         return 0;
     }
+    data_len = *len - 4;
     *len = 0;
 
-    *pdu = smpp_pdu_unpack(smpp->conn->id, os);
+    *pdu = smpp_pdu_unpack_data(smpp->conn->id, data, data_len);
     if (*pdu == NULL) {
         error(0, "SMPP[%s]: PDU unpacking failed.",
               octstr_get_cstr(smpp->conn->id));
         debug("bb.sms.smpp", 0, "SMPP[%s]: Failed PDU follows.",
               octstr_get_cstr(smpp->conn->id));
+        os = octstr_create_from_data((const char *) data, data_len);
         octstr_dump(os, 0);
         octstr_destroy(os);
         return -2;
     }
 
-    octstr_destroy(os);
     return 1;
 }
 
@@ -1127,29 +1601,30 @@ static int send_pdu(Connection *conn, Octstr *id, SMPP_PDU *pdu)
 }
 
 
-static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
+static int send_messages(SMPP *smpp, Connection *conn, struct smpp_bind *bind)
 {
     Msg *msg;
     SMPP_PDU *pdu;
-    Octstr *os;
+    double delay;
 
-    if (*pending_submits == -1)
+    if (bind->pending_submits == -1)
         return 0;
 
-    while (*pending_submits < smpp->max_pending_submits) {
-        /* check our throughput */
-        if (smpp->conn->throughput > 0 && load_get(smpp->load, 0) >= smpp->conn->throughput) {
-            debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit exceeded (%.02f,%.02f)",
-                  octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
+    while (bind->pending_submits < smpp_bind_window(bind) &&
+           gw_prioqueue_len(smpp->msgs_to_send) > 0) {
+        /* check our throughput, io_thread wakes us up when we may go on */
+        if ((delay = smscconn_throughput_take(smpp->conn)) > 0) {
+            debug("bb.sms.smpp", 0, "SMPP[%s]: throughput limit reached, next message in %.03f sec.",
+                  octstr_get_cstr(smpp->conn->id), delay);
             break;
         }
-        debug("bb.sms.smpp", 0, "SMPP[%s]: throughput (%.02f,%.02f)",
-              octstr_get_cstr(smpp->conn->id), load_get(smpp->load, 0), smpp->conn->throughput);
 
-        /* Get next message, quit if none to be sent */
+        /* Get next message, quit if another bind took the last one */
         msg = gw_prioqueue_remove(smpp->msgs_to_send);
-        if (msg == NULL)
+        if (msg == NULL) {
+            smscconn_throughput_return(smpp->conn);
             break;
+        }
 
         /* Send PDU, record it as waiting for ack from SMS center */
         pdu = msg_to_pdu(smpp, msg);
@@ -1159,13 +1634,18 @@ static int send_messages(SMPP *smpp, Connection *conn, long *pending_submits)
         }
         /* check for write errors */
         if (send_pdu(conn, smpp->conn->id, pdu) == 0) {
-            struct smpp_msg *smpp_msg = smpp_msg_create(msg);
-            os = octstr_format("%ld", pdu->u.submit_sm.sequence_number);
-            dict_put(smpp->sent_msgs, os, smpp_msg);
+            struct smpp_msg *smpp_msg = smpp_msg_create(msg, pdu->u.submit_sm.sequence_number);
+            smpp_msg = smpp_sent_table_put(bind->sent_msgs, smpp_msg);
             smpp_pdu_destroy(pdu);
-            octstr_destroy(os);
-            ++(*pending_submits);
-            load_increase(smpp->load);
+            if (smpp_msg != NULL) {
+                /* sequence numbers wrapped onto a message never acked */
+                warning(0, "SMPP[%s]: Sequence number %ld still in use, dropping old entry.",
+                        octstr_get_cstr(smpp->conn->id), smpp_msg->sequence_number);
+                bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY, NULL);
+                smpp_msg_destroy(smpp_msg, 0);
+                --bind->pending_submits;
+            }
+            ++bind->pending_submits;
         }
         else { /* write error occurs */
             smpp_pdu_destroy(pdu);
@@ -1595,14 +2075,14 @@ static long smscconn_failure_reason_to_smpp_status(long reason)
 
 
 static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
-                       long *pending_submits)
+                       struct smpp_bind *bind)
 {
     SMPP_PDU *resp = NULL;
-    Octstr *os;
     Msg *msg = NULL, *dlrmsg=NULL;
     struct smpp_msg *smpp_msg = NULL;
     long reason, cmd_stat;
     int ret = 0;
+    int backoff;
 
     switch (pdu->type) {
         case data_sm:
@@ -1734,9 +2214,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
             break;
 
         case submit_sm_resp:
-            os = octstr_format("%ld", pdu->u.submit_sm_resp.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = smpp_sent_table_remove(bind->sent_msgs, pdu->u.submit_sm_resp.sequence_number);
             if (smpp_msg == NULL) {
                 warning(0, "SMPP[%s]: SMSC sent submit_sm_resp "
                         "with wrong sequence number 0x%08lx",
@@ -1744,6 +2222,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                         pdu->u.submit_sm_resp.sequence_number);
                 break;
             }
+            backoff = smpp_window_update(bind, smpp_msg, pdu->u.submit_sm_resp.command_status);
             msg = smpp_msg->msg;
             smpp_msg_destroy(smpp_msg, 0);
 
@@ -1765,14 +2244,14 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                  * check to see if we got a "throttling error", in which case we'll just
                  * sleep for a while
                  */
-                if (pdu->u.submit_sm_resp.command_status == SMPP_ESME_RTHROTTLED)
-                    time(&(smpp->throttling_err_time));
+                if (pdu->u.submit_sm_resp.command_status == SMPP_ESME_RTHROTTLED && backoff)
+                    time(&(bind->throttling_err_time));
                 else
-                    smpp->throttling_err_time = 0;
+                    bind->throttling_err_time = 0;
 
                 bb_smscconn_send_failed(smpp->conn, msg, reason, octstr_format("0x%08lx/%s", pdu->u.submit_sm_resp.command_status,
                                         smpp_error_to_string(pdu->u.submit_sm_resp.command_status)));
-                --(*pending_submits);
+                --bind->pending_submits;
             }
             else if (pdu->u.submit_sm_resp.message_id != NULL) {
                 Octstr *tmp;
@@ -1799,7 +2278,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 
                 octstr_destroy(tmp);
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --bind->pending_submits;
             } /* end if for SMSC ACK */
             else {
                 error(0, "SMPP[%s]: SMSC returned error code 0x%08lx (%s) "
@@ -1808,7 +2287,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       pdu->u.submit_sm_resp.command_status,
                       smpp_error_to_string(pdu->u.submit_sm_resp.command_status));
                 bb_smscconn_sent(smpp->conn, msg, NULL);
-                --(*pending_submits);
+                --bind->pending_submits;
             }
             break;
 
@@ -1819,20 +2298,16 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_transmitter_resp.command_status,
                 smpp_error_to_string(pdu->u.bind_transmitter_resp.command_status));
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_DISCONNECTED;
-                mutex_unlock(smpp->conn->flow_mutex);
+                smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
                 if (pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVSYSID ||
                     pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVPASWD ||
                     pdu->u.bind_transmitter_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                     smpp->quitting = 1;
                 }
             } else {
-                *pending_submits = 0;
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
-                mutex_unlock(smpp->conn->flow_mutex);
+                bind->pending_submits = 0;
+                smpp_window_reset(bind);
+                smpp_bind_set_status(bind, SMSCCONN_ACTIVE);
                 bb_smscconn_connected(smpp->conn);
             }
             break;
@@ -1844,20 +2319,16 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_transceiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_transceiver_resp.command_status));
-                 mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
-                 mutex_unlock(smpp->conn->flow_mutex);
+                 smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
                  if (pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVPASWD ||
                      pdu->u.bind_transceiver_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                      smpp->quitting = 1;
                  }
             } else {
-                *pending_submits = 0;
-                mutex_lock(smpp->conn->flow_mutex);
-                smpp->conn->status = SMSCCONN_ACTIVE;
-                time(&smpp->conn->connect_time);
-                mutex_unlock(smpp->conn->flow_mutex);
+                bind->pending_submits = 0;
+                smpp_window_reset(bind);
+                smpp_bind_set_status(bind, SMSCCONN_ACTIVE);
                 bb_smscconn_connected(smpp->conn);
             }
             break;
@@ -1869,45 +2340,32 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       octstr_get_cstr(smpp->conn->id),
                       pdu->u.bind_receiver_resp.command_status,
                  smpp_error_to_string(pdu->u.bind_receiver_resp.command_status));
-                 mutex_lock(smpp->conn->flow_mutex);
-                 smpp->conn->status = SMSCCONN_DISCONNECTED;
-                 mutex_unlock(smpp->conn->flow_mutex);
+                 smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
                  if (pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVSYSID ||
                      pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVPASWD ||
                      pdu->u.bind_receiver_resp.command_status == SMPP_ESME_RINVSYSTYP) {
                      smpp->quitting = 1;
                  }
             } else {
-                /* set only receive status if no transmit is bind */
-                mutex_lock(smpp->conn->flow_mutex);
-                if (smpp->conn->status != SMSCCONN_ACTIVE) {
-                    smpp->conn->status = SMSCCONN_ACTIVE_RECV;
-                    time(&smpp->conn->connect_time);
-                }
-                mutex_unlock(smpp->conn->flow_mutex);
+                /* only receive status if no transmit is bound */
+                smpp_bind_set_status(bind, SMSCCONN_ACTIVE_RECV);
             }
             break;
 
         case unbind:
             resp = smpp_pdu_create(unbind_resp, pdu->u.unbind.sequence_number);
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
-            mutex_unlock(smpp->conn->flow_mutex);
-            *pending_submits = -1;
+            smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
+            bind->pending_submits = -1;
             break;
 
         case unbind_resp:
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_DISCONNECTED;
-            mutex_unlock(smpp->conn->flow_mutex);
+            smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
             break;
 
         case generic_nack:
             cmd_stat  = pdu->u.generic_nack.command_status;
 
-            os = octstr_format("%ld", pdu->u.generic_nack.sequence_number);
-            smpp_msg = dict_remove(smpp->sent_msgs, os);
-            octstr_destroy(os);
+            smpp_msg = smpp_sent_table_remove(bind->sent_msgs, pdu->u.generic_nack.sequence_number);
 
             if (smpp_msg == NULL) {
                 error(0, "SMPP[%s]: SMSC rejected last command, code 0x%08lx (%s).",
@@ -1915,6 +2373,7 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                       cmd_stat,
                 smpp_error_to_string(cmd_stat));
             } else {
+                backoff = smpp_window_update(bind, smpp_msg, cmd_stat);
                 msg = smpp_msg->msg;
                 smpp_msg_destroy(smpp_msg, 0);
 
@@ -1927,15 +2386,15 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
                  * check to see if we got a "throttling error", in which case we'll just
                  * sleep for a while
                  */
-                if (cmd_stat == SMPP_ESME_RTHROTTLED)
-                    time(&(smpp->throttling_err_time));
+                if (cmd_stat == SMPP_ESME_RTHROTTLED && backoff)
+                    time(&(bind->throttling_err_time));
                 else
-                    smpp->throttling_err_time = 0;
+                    bind->throttling_err_time = 0;
 
                 reason = smpp_status_to_smscconn_failure_reason(cmd_stat);
                 bb_smscconn_send_failed(smpp->conn, msg, reason,
                                         octstr_format("0x%08lx/%s", cmd_stat, smpp_error_to_string(cmd_stat)));
-                --(*pending_submits);
+                --bind->pending_submits;
             }
             break;
         
@@ -1959,81 +2418,58 @@ static int handle_pdu(SMPP *smpp, Connection *conn, SMPP_PDU *pdu,
 }
 
 
-struct io_arg {
-    SMPP *smpp;
-    int transmitter;
-};
-
-
-static struct io_arg *io_arg_create(SMPP *smpp, int transmitter)
-{
-    struct io_arg *io_arg;
-
-    io_arg = gw_malloc(sizeof(*io_arg));
-    io_arg->smpp = smpp;
-    io_arg->transmitter = transmitter;
-    return io_arg;
-}
-
-
 /*
  * sent queue cleanup.
  * @return 1 if io_thread should reconnect; 0 if not
  */
-static int do_queue_cleanup(SMPP *smpp, long *pending_submits)
+static int do_queue_cleanup(SMPP *smpp, struct smpp_bind *bind)
 {
-    List *keys;
-    Octstr *key;
+    List *expired;
     struct smpp_msg *smpp_msg;
     time_t now = time(NULL);
 
-    if (*pending_submits <= 0)
+    if (bind->pending_submits <= 0)
         return 0;
 
     /* check if action set to wait ack for ever */
     if (smpp->wait_ack_action == SMPP_WAITACK_NEVER_EXPIRE)
         return 0;
 
-    keys = dict_keys(smpp->sent_msgs);
-    if (keys == NULL)
-        return 0;
-
-    while ((key = gwlist_extract_first(keys)) != NULL) {
-        smpp_msg = dict_get(smpp->sent_msgs, key);
-        if (smpp_msg != NULL && difftime(now, smpp_msg->sent_time) > smpp->wait_ack) {
-            switch(smpp->wait_ack_action) {
-                case SMPP_WAITACK_RECONNECT: /* reconnect */
-                    /* found at least one not acked msg */
-                    warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
-                                   octstr_get_cstr(smpp->conn->id));
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 1; /* io_thread will reconnect */
-                case SMPP_WAITACK_REQUEUE: /* requeue */
-                    smpp_msg = dict_remove(smpp->sent_msgs, key);
-                    if (smpp_msg != NULL) {
-                        warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
-                                   " SENT<%ld>sec. ago, SEQ<%s>, DST<%s>",
-                                   octstr_get_cstr(smpp->conn->id),
-                                   (long)difftime(now, smpp_msg->sent_time) ,
-                                   octstr_get_cstr(key),
-                                   octstr_get_cstr(smpp_msg->msg->sms.receiver));
-                        bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
-                        smpp_msg_destroy(smpp_msg, 0);
-                        (*pending_submits)--;
-                    }
-                    break;
-                default:
-                    error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
-                          octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
-                    octstr_destroy(key);
-                    gwlist_destroy(keys, octstr_destroy_item);
-                    return 0;
+    switch(smpp->wait_ack_action) {
+        case SMPP_WAITACK_RECONNECT: /* reconnect */
+            if (smpp_sent_table_has_older(bind->sent_msgs, now - smpp->wait_ack)) {
+                /* found at least one not acked msg */
+                warning(0, "SMPP[%s]: Not ACKED message found, reconnecting.",
+                               octstr_get_cstr(smpp->conn->id));
+                return 1; /* io_thread will reconnect */
             }
-        }
-        octstr_destroy(key);
+            break;
+        case SMPP_WAITACK_REQUEUE: /* requeue */
+            expired = smpp_sent_table_extract(bind->sent_msgs, now - smpp->wait_ack);
+            if (gwlist_len(expired) > 0 && smpp->adaptive_window) {
+                /* lost submits are the strongest congestion signal */
+                mutex_lock(bind->window_lock);
+                smpp_window_decrease(bind, smpp_now());
+                mutex_unlock(bind->window_lock);
+            }
+            while ((smpp_msg = gwlist_extract_first(expired)) != NULL) {
+                warning(0, "SMPP[%s]: Not ACKED message found, will retransmit."
+                           " SENT<%ld>sec. ago, SEQ<%ld>, DST<%s>",
+                           octstr_get_cstr(smpp->conn->id),
+                           (long)difftime(now, smpp_msg->sent_time) ,
+                           smpp_msg->sequence_number,
+                           octstr_get_cstr(smpp_msg->msg->sms.receiver));
+                bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, SMSCCONN_FAILED_TEMPORARILY,NULL);
+                smpp_msg_destroy(smpp_msg, 0);
+                bind->pending_submits--;
+            }
+            gwlist_destroy(expired, NULL);
+            break;
+        default:
+            error(0, "SMPP[%s] Unknown clenup action defined 0x%02x.",
+                  octstr_get_cstr(smpp->conn->id), smpp->wait_ack_action);
+            break;
     }
-    gwlist_destroy(keys, octstr_destroy_item);
 
     return 0;
 }
@@ -2048,25 +2484,23 @@ static int do_queue_cleanup(SMPP *smpp, long *pending_submits)
 static void io_thread(void *arg)
 {
     SMPP *smpp;
-    struct io_arg *io_arg;
+    struct smpp_bind *bind, *other;
     int transmitter;
     Connection *conn;
     int ret;
-    long pending_submits;
-    long len;
+    long len, i;
     SMPP_PDU *pdu;
     double timeout;
     time_t last_cleanup, last_enquire_sent, last_response, now;
 
-    io_arg = arg;
-    smpp = io_arg->smpp;
-    transmitter = io_arg->transmitter;
-    gw_free(io_arg);
+    bind = arg;
+    smpp = bind->smpp;
+    transmitter = bind->transmitter;
 
     /* Make sure we log into our own log-file if defined */
     log_thread_to(smpp->conn->log_idx);
 
-#define IS_ACTIVE (smpp->conn->status == SMSCCONN_ACTIVE || smpp->conn->status == SMSCCONN_ACTIVE_RECV)
+#define IS_ACTIVE (bind->status == SMSCCONN_ACTIVE || bind->status == SMSCCONN_ACTIVE_RECV)
 
     conn = NULL;
     while (!smpp->quitting) {
@@ -2077,7 +2511,7 @@ static void io_thread(void *arg)
         else
             conn = open_receiver(smpp);
         
-        pending_submits = -1;
+        bind->pending_submits = -1;
         len = 0;
         last_response = last_cleanup = last_enquire_sent = time(NULL);
         while(conn != NULL) {
@@ -2097,7 +2531,7 @@ static void io_thread(void *arg)
             } else if (ret == 1) { /* data available */
                 /* Deal with the PDU we just got */
                 dump_pdu("Got PDU:", smpp->conn->id, pdu);
-                ret = handle_pdu(smpp, conn, pdu, &pending_submits);
+                ret = handle_pdu(smpp, conn, pdu, bind);
                 smpp_pdu_destroy(pdu);
                 if (ret == -1) {
                     error(0, "SMPP[%s]: I/O error or other error. Re-connecting.",
@@ -2110,7 +2544,7 @@ static void io_thread(void *arg)
                  * Note: Function handle_pdu will set status to SMSCCONN_DISCONNECTED
                  * when unbind was received.
                  */
-                if (smpp->conn->status == SMSCCONN_DISCONNECTED)
+                if (bind->status == SMSCCONN_DISCONNECTED)
                     break;
                 
                 /*
@@ -2144,13 +2578,15 @@ static void io_thread(void *arg)
                 if (!IS_ACTIVE && timeout <= 0)
                     timeout = smpp->enquire_link_interval;
                 if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
-                    smpp->throttling_err_time > 0 && pending_submits < smpp->max_pending_submits) {
-                    time_t tr_timeout = smpp->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME - now;
+                    bind->throttling_err_time > 0 && bind->pending_submits < smpp_bind_window(bind)) {
+                    time_t tr_timeout = bind->throttling_err_time + SMPP_THROTTLING_SLEEP_TIME - now;
                     timeout = timeout > tr_timeout ? tr_timeout : timeout;
-                } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 && smpp->conn->throughput > 0 &&
-                           smpp->max_pending_submits > pending_submits) {
-                    double t = 1.0 / smpp->conn->throughput;
-                    timeout = t < timeout ? t : timeout;
+                } else if (transmitter && gw_prioqueue_len(smpp->msgs_to_send) > 0 &&
+                           smpp_bind_window(bind) > bind->pending_submits) {
+                    /* wake up right when the throughput allows the next message */
+                    double t = smscconn_throughput_wait(smpp->conn);
+                    if (t > 0 && t < timeout)
+                        timeout = t;
                 }
                 /* sleep a while */
                 if (timeout > 0 && conn_wait(conn, timeout) == -1)
@@ -2163,15 +2599,15 @@ static void io_thread(void *arg)
             
             /* cleanup sent queue */
             if (transmitter && difftime(time(NULL), last_cleanup) > smpp->wait_ack) {
-                if (do_queue_cleanup(smpp, &pending_submits))
+                if (do_queue_cleanup(smpp, bind))
                     break; /* reconnect */
                 time(&last_cleanup);
             }
             
             /* make sure we send */
-            if (transmitter && difftime(time(NULL), smpp->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
-                smpp->throttling_err_time = 0;
-                if (send_messages(smpp, conn, &pending_submits) == -1)
+            if (transmitter && difftime(time(NULL), bind->throttling_err_time) > SMPP_THROTTLING_SLEEP_TIME) {
+                bind->throttling_err_time = 0;
+                if (send_messages(smpp, conn, bind) == -1)
                     break;
             }
             
@@ -2187,7 +2623,7 @@ static void io_thread(void *arg)
                       difftime(time(NULL), last_response) < SMPP_DEFAULT_SHUTDOWN_TIMEOUT) {
                     if (read_pdu(smpp, conn, &len, &pdu) == 1) {
                         dump_pdu("Got PDU:", smpp->conn->id, pdu);
-                        handle_pdu(smpp, conn, pdu, &pending_submits);
+                        handle_pdu(smpp, conn, pdu, bind);
                         smpp_pdu_destroy(pdu);
                     }
                 }
@@ -2206,35 +2642,30 @@ static void io_thread(void *arg)
         if (!smpp->quitting) {
             error(0, "SMPP[%s]: Couldn't connect to SMS center (retrying in %ld seconds).",
                   octstr_get_cstr(smpp->conn->id), smpp->conn->reconnect_delay);
-            mutex_lock(smpp->conn->flow_mutex);
-            smpp->conn->status = SMSCCONN_RECONNECTING;
-            mutex_unlock(smpp->conn->flow_mutex);
+            smpp_bind_set_status(bind, SMSCCONN_RECONNECTING);
             gwthread_sleep(smpp->conn->reconnect_delay);
-        }
+        } else
+            smpp_bind_set_status(bind, SMSCCONN_DISCONNECTED);
         /*
          * put all queued messages back into global queue,so if
          * we have another link running than messages will be delivered
-         * quickly
+         * quickly. Leave them to our other binds if one is still up.
          */
         if (transmitter) {
             Msg *msg;
             struct smpp_msg *smpp_msg;
             List *noresp;
-            Octstr *key;
 
             long reason = (smpp->quitting?SMSCCONN_FAILED_SHUTDOWN:SMSCCONN_FAILED_TEMPORARILY);
 
-            while((msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
+            while(!smpp_bind_other_transmitting(bind) &&
+                  (msg = gw_prioqueue_remove(smpp->msgs_to_send)) != NULL)
                 bb_smscconn_send_failed(smpp->conn, msg, reason, NULL);
 
-            noresp = dict_keys(smpp->sent_msgs);
-            while((key = gwlist_extract_first(noresp)) != NULL) {
-                smpp_msg = dict_remove(smpp->sent_msgs, key);
-                if (smpp_msg != NULL) {
-                    bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
-                    smpp_msg_destroy(smpp_msg, 0);
-                }
-                octstr_destroy(key);
+            noresp = smpp_sent_table_extract(bind->sent_msgs, -1);
+            while((smpp_msg = gwlist_extract_first(noresp)) != NULL) {
+                bb_smscconn_send_failed(smpp->conn, smpp_msg->msg, reason, NULL);
+                smpp_msg_destroy(smpp_msg, 0);
             }
             gwlist_destroy(noresp, NULL);
         }
@@ -2244,14 +2675,19 @@ static void io_thread(void *arg)
     
     /*
      * Shutdown sequence as follow:
-     *    1) if this is TX session so join receiver and free SMPP
-     *    2) if RX session available but no TX session so nothing to join then free SMPP
+     *    1) the first bind, TX if there is one, joins all other binds
+     *    2) and then frees SMPP
+     * unless not all binds could be started, then smsc_smpp_create()
+     * does both.
      */
-    if (transmitter && smpp->receiver != -1) {
-        gwthread_wakeup(smpp->receiver);
-        gwthread_join(smpp->receiver);
-    }
-    if (transmitter || smpp->transmitter == -1) {
+    if (bind == gwlist_get(smpp->binds, 0) && !smpp->start_failed) {
+        for (i = 1; i < gwlist_len(smpp->binds); i++) {
+            other = gwlist_get(smpp->binds, i);
+            if (other->thread != -1) {
+                gwthread_wakeup(other->thread);
+                gwthread_join(other->thread);
+            }
+        }
         debug("bb.smpp", 0, "SMSCConn %s shut down.",
               octstr_get_cstr(smpp->conn->name));
         
@@ -2282,13 +2718,48 @@ static long queued_cb(SMSCConn *conn)
 }
 
 
+static Octstr *status_details_cb(SMSCConn *conn)
+{
+    SMPP *smpp;
+    Octstr *details;
+
+    smpp = conn->data;
+    if (smpp == NULL)
+        return NULL;
+
+    details = octstr_create("");
+    smpp_window_status(smpp, details);
+    if (octstr_len(details) == 0) {
+        octstr_destroy(details);
+        return NULL;
+    }
+    return details;
+}
+
+
 static int send_msg_cb(SMSCConn *conn, Msg *msg)
 {
     SMPP *smpp;
+    struct smpp_bind *bind;
+    long i, n;
 
     smpp = conn->data;
     gw_prioqueue_produce(smpp->msgs_to_send, msg_duplicate(msg));
-    gwthread_wakeup(smpp->transmitter);
+
+    /*
+     * Wake up the next transmitting bind with room in its window. If all
+     * windows are full the message goes out with the next response.
+     */
+    n = gwlist_len(smpp->binds);
+    for (i = 0; i < n; i++) {
+        bind = gwlist_get(smpp->binds, (smpp->next_bind + i) % n);
+        if (bind->transmitter && bind->pending_submits >= 0 &&
+            bind->pending_submits < smpp_bind_window(bind)) {
+            smpp->next_bind = (smpp->next_bind + i + 1) % n;
+            gwthread_wakeup(bind->thread);
+            break;
+        }
+    }
     return 0;
 }
 
@@ -2296,6 +2767,8 @@ static int send_msg_cb(SMSCConn *conn, Msg *msg)
 static int shutdown_cb(SMSCConn *conn, int finish_sending)
 {
     SMPP *smpp;
+    struct smpp_bind *bind;
+    long i;
 
     if (conn == NULL)
         return -1;
@@ -2315,11 +2788,11 @@ static int shutdown_cb(SMSCConn *conn, int finish_sending)
     }
 
     smpp->quitting = 1;
-    if  (smpp->transmitter != -1)
-        gwthread_wakeup(smpp->transmitter);
-
-    if (smpp->receiver != -1)
-        gwthread_wakeup(smpp->receiver);
+    for (i = 0; i < gwlist_len(smpp->binds); i++) {
+        bind = gwlist_get(smpp->binds, i);
+        if (bind->thread != -1)
+            gwthread_wakeup(bind->thread);
+    }
 
     mutex_unlock(conn->flow_mutex);
 
@@ -2366,6 +2839,8 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     Octstr *alt_addr_charset;
     long connection_timeout, wait_ack, wait_ack_action;
     long esm_class;
+    long binds, i;
+    struct smpp_bind *bind;
 
     my_number = alt_addr_charset = alt_charset = NULL;
     transceiver_mode = 0;
@@ -2411,6 +2886,8 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
     if (cfg_get_integer(&max_pending_submits, grp,
                         octstr_imm("max-pending-submits")) == -1)
         max_pending_submits = SMPP_MAX_PENDING_SUBMITS;
+    if (cfg_get_integer(&binds, grp, octstr_imm("binds")) == -1)
+        binds = 1;
 
     /* Check that config is OK */
     ok = 1;
@@ -2438,6 +2915,14 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
         warning(0, "SMPP: receive-port for transceiver mode defined, ignoring.");
         receive_port = 0;
     } 
+    if (binds < 1) {
+        error(0, "SMPP: binds must be at least 1.");
+        ok = 0;
+    }
+    if (binds > 1 && our_port != 0) {
+        error(0, "SMPP: our-port can't be used with more than one bind.");
+        ok = 0;
+    }
 
     if (!ok)
         return -1;
@@ -2524,6 +3009,9 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
                        smpp_msg_id_type, autodetect_addr, alt_charset, alt_addr_charset,
                        service_type, connection_timeout, wait_ack, wait_ack_action, esm_class);
 
+    if (cfg_get_bool(&smpp->adaptive_window, grp, octstr_imm("adaptive-window")) == -1)
+        smpp->adaptive_window = 0;
+
     cfg_get_integer(&smpp->bind_addr_ton, grp, octstr_imm("bind-addr-ton"));
     cfg_get_integer(&smpp->bind_addr_npi, grp, octstr_imm("bind-addr-npi"));
 
@@ -2564,32 +3052,41 @@ int smsc_smpp_create(SMSCConn *conn, CfgGroup *grp)
      * have been configured with positive numbers. Use 0 to
      * disable the creation of the corresponding thread.
      */
-    if (port != 0)
-        smpp->transmitter = gwthread_create(io_thread, io_arg_create(smpp,
-                                           (transceiver_mode ? 2 : 1)));
+    for (i = 0; port != 0 && i < binds; i++)
+        gwlist_append(smpp->binds, smpp_bind_create(smpp, (transceiver_mode ? 2 : 1)));
     if (receive_port != 0)
-        smpp->receiver = gwthread_create(io_thread, io_arg_create(smpp, 0));
+        gwlist_append(smpp->binds, smpp_bind_create(smpp, 0));
+    conn->binds = gwlist_len(smpp->binds);
+    conn->binds_active = 0;
+
+    ok = 1;
+    for (i = 0; ok && i < gwlist_len(smpp->binds); i++) {
+        bind = gwlist_get(smpp->binds, i);
+        bind->thread = gwthread_create(io_thread, bind);
+        ok = (bind->thread != -1);
+    }
 
-    if ((port != 0 && smpp->transmitter == -1) ||
-        (receive_port != 0 && smpp->receiver == -1)) {
+    if (!ok) {
         error(0, "SMPP[%s]: Couldn't start I/O threads.",
               octstr_get_cstr(smpp->conn->id));
+        /* the started binds just stop, we clean up */
+        smpp->start_failed = 1;
         smpp->quitting = 1;
-        if (smpp->transmitter != -1) {
-            gwthread_wakeup(smpp->transmitter);
-            gwthread_join(smpp->transmitter);
-        }
-        if (smpp->receiver != -1) {
-            gwthread_wakeup(smpp->receiver);
-            gwthread_join(smpp->receiver);
+        for (i = gwlist_len(smpp->binds) - 1; i >= 0; i--) {
+            bind = gwlist_get(smpp->binds, i);
+            if (bind->thread != -1) {
+                gwthread_wakeup(bind->thread);
+                gwthread_join(bind->thread);
+            }
         }
-        smpp_destroy(conn->data);
+        smpp_destroy(smpp);
         conn->data = NULL;
         return -1;
     }
 
     conn->shutdown = shutdown_cb;
     conn->queued = queued_cb;
+    conn->status_details = status_details_cb;
     conn->send_msg = send_msg_cb;
 
     return 0;
@@ -146,6 +146,44 @@ static void init_reroute(SMSCConn *conn, CfgGroup *grp)
 }
 
 
+/*
+ * Create the token buckets limiting the throughput of this connection
+ * and of all connections sharing its smsc-id.
+ */
+static void init_throughput(SMSCConn *conn, CfgGroup *grp)
+{
+    Octstr *tmp;
+    double burst, id_throughput = 0;
+
+    burst = 1;
+    if ((tmp = cfg_get(grp, octstr_imm("throughput-burst"))) != NULL) {
+        if (octstr_parse_double(&burst, tmp, 0) == -1 || burst < 1) {
+            warning(0, "Invalid 'throughput-burst' for smsc id <%s>, using 1.",
+                    octstr_get_cstr(conn->id));
+            burst = 1;
+        }
+        octstr_destroy(tmp);
+    }
+
+    if (conn->throughput > 0)
+        conn->throughput_bucket = token_bucket_create(conn->throughput, burst);
+
+    if ((tmp = cfg_get(grp, octstr_imm("smsc-id-throughput"))) != NULL) {
+        if (octstr_parse_double(&id_throughput, tmp, 0) == -1)
+            id_throughput = 0;
+        octstr_destroy(tmp);
+    }
+    if (id_throughput > 0 && conn->id == NULL) {
+        warning(0, "'smsc-id-throughput' needs 'smsc-id', ignored.");
+    } else if (id_throughput > 0) {
+        conn->id_throughput_bucket =
+            token_bucket_create_shared(conn->id, id_throughput, burst);
+        info(0, "Set throughput to %.3f for all connections of smsc id <%s>",
+             id_throughput, octstr_get_cstr(conn->id));
+    }
+}
+
+
 SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
 {
     SMSCConn *conn;
@@ -249,6 +287,7 @@ SMSCConn *smscconn_create(CfgGroup *grp, int start_as_stopped)
         octstr_destroy(tmp);
         info(0, "Set throughput to %.3f for smsc id <%s>", conn->throughput, octstr_get_cstr(conn->id));
     }
+    init_throughput(conn, grp);
     /* Sets the admin_id. Equals to connection id if empty */
     GET_OPTIONAL_VAL(conn->admin_id, "smsc-admin-id");
     if (conn->admin_id == NULL)
@@ -378,6 +417,9 @@ int smscconn_destroy(SMSCConn *conn)
     load_destroy(conn->outgoing_sms_load);
     load_destroy(conn->outgoing_dlr_load);
 
+    token_bucket_destroy(conn->throughput_bucket);
+    token_bucket_destroy(conn->id_throughput_bucket);
+
     octstr_destroy(conn->name);
     octstr_destroy(conn->id);
     octstr_destroy(conn->admin_id);
@@ -619,6 +661,24 @@ int smscconn_send(SMSCConn *conn, Msg *msg)
 }
 
 
+double smscconn_throughput_take(SMSCConn *conn)
+{
+    return token_bucket_take(conn->throughput_bucket, conn->id_throughput_bucket);
+}
+
+
+double smscconn_throughput_wait(SMSCConn *conn)
+{
+    return token_bucket_wait(conn->throughput_bucket, conn->id_throughput_bucket);
+}
+
+
+void smscconn_throughput_return(SMSCConn *conn)
+{
+    token_bucket_return(conn->throughput_bucket, conn->id_throughput_bucket);
+}
+
+
 int smscconn_status(SMSCConn *conn)
 {
     gw_assert(conn != NULL);
@@ -638,6 +698,8 @@ int smscconn_info(SMSCConn *conn, StatusInfo *infotable)
     infotable->killed = conn->why_killed;
     infotable->is_stopped = conn->is_stopped;
     infotable->online = time(NULL) - conn->connect_time;
+    infotable->binds = conn->binds;
+    infotable->binds_active = conn->binds_active;
     
     infotable->sent = counter_value(conn->sent);
     infotable->received = counter_value(conn->received);
@@ -658,3 +720,19 @@ int smscconn_info(SMSCConn *conn, StatusInfo *infotable)
 }
 
 
+Octstr *smscconn_status_details(SMSCConn *conn)
+{
+    Octstr *details = NULL;
+
+    if (conn == NULL)
+        return NULL;
+
+    mutex_lock(conn->flow_mutex);
+    if (conn->status_details != NULL && conn->status != SMSCCONN_DEAD)
+        details = conn->status_details(conn);
+    mutex_unlock(conn->flow_mutex);
+
+    return details;
+}
+
+
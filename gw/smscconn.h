@@ -120,6 +120,8 @@ typedef struct smsc_state {
     unsigned long failed;	/* total number */
     long queued;	/* set our internal outgoing queue length */
     long online;	/* in seconds */
+    long binds;		/* sessions to the SMSC, 0 if not counted */
+    long binds_active;	/* how many of them are bound */
     int load;		/* subjective value 'how loaded we are' for
 			 * routing purposes, similar to sms/wapbox load */
 } StatusInfo;
@@ -199,5 +201,11 @@ int smscconn_status(SMSCConn *smscconn);
  */
 int smscconn_info(SMSCConn *smscconn, StatusInfo *infotable);
 
+/* return driver specific status details, e.g. the state of flow control,
+ * as lines of plain text separated by newlines, or NULL if the driver
+ * has none. The caller must destroy the result.
+ */
+Octstr *smscconn_status_details(SMSCConn *smscconn);
+
 
 #endif
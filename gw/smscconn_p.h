@@ -145,6 +145,7 @@
 #include "gwlib/regex.h"
 #include "smscconn.h"
 #include "load.h"
+#include "token_bucket.h"
 
 struct smscconn {
     /* variables set by appropriate SMSCConn driver */
@@ -153,6 +154,9 @@ struct smscconn {
     smscconn_killed_t why_killed;	/* time to die with reason, set when
 				* shutdown called */
     time_t 	connect_time;	/* When connection to SMSC was established */
+    long 	binds;		/* sessions to the SMSC, 0 if the driver
+				 * doesn't count them */
+    long 	binds_active;	/* how many of them are bound */
 
     Mutex 	*flow_mutex;	/* used to lock SMSCConn structure (both
 				 *  in smscconn.c and specific driver) */
@@ -199,6 +203,8 @@ struct smscconn {
     int alt_dcs; /* use alternate DCS 0xFX */
 
     double throughput;     /* message thoughput per sec. to be delivered to SMSC */
+    TokenBucket *throughput_bucket;     /* limits this connection, or NULL */
+    TokenBucket *id_throughput_bucket;  /* shared by all of this smsc-id, or NULL */
 
     /* Stores rerouting information for this specific smsc-id */
     int reroute;                /* simply turn MO into MT and process internally */
@@ -237,6 +243,10 @@ struct smscconn {
      * to SMSCConn structure (above) */
     long (*queued) (SMSCConn *conn);
 
+    /* pointer to function which returns driver specific status details
+     * for smscconn_status_details(), or NULL. If not set, there are none */
+    Octstr *(*status_details) (SMSCConn *conn);
+
     /* pointers to functions called when connection started/stopped
      * (suspend/resume), if not NULL */
 
@@ -247,6 +257,19 @@ struct smscconn {
     void *data;			/* SMSC specific stuff */
 };
 
+/*
+ * Throughput shaping for the drivers. smscconn_throughput_take() takes
+ * the right to send one message from the connection's 'throughput' and
+ * 'smsc-id-throughput' limits; it returns 0 if the message may be sent
+ * now, or the seconds until it may be sent. smscconn_throughput_wait()
+ * only returns the seconds to wait. smscconn_throughput_return() gives
+ * back a right taken for a message that then wasn't there, e.g. because
+ * another bind sent it first.
+ */
+double smscconn_throughput_take(SMSCConn *conn);
+double smscconn_throughput_wait(SMSCConn *conn);
+void smscconn_throughput_return(SMSCConn *conn);
+
 /*
  * Initializers for various SMSC connection implementations,
  * each should take same arguments and return an int,
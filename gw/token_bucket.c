@@ -0,0 +1,276 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * token_bucket.c - token bucket rate limiter
+ *
+ * See token_bucket.h for the idea. Tokens are refilled lazily from the
+ * time passed since the last refill, so a bucket needs no thread.
+ */
+
+#include <sys/time.h>
+#include <math.h>
+
+#include "gwlib/gwlib.h"
+#include "token_bucket.h"
+
+/* tolerance for rounding errors when waking up right on time */
+#define TOKEN_EPSILON 1e-9
+
+struct TokenBucket {
+    Mutex *lock;
+    double rate;        /* tokens per second */
+    double burst;       /* maximum tokens in the bucket */
+    double tokens;      /* tokens in the bucket at `last' */
+    double last;        /* time of the last refill */
+    Octstr *name;       /* name if shared, else NULL */
+    long refs;          /* references to a shared bucket */
+};
+
+static Dict *shared_buckets = NULL;
+static Mutex *shared_lock = NULL;
+
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ * Refill the bucket up to `now' and return the seconds until it holds
+ * one token. The bucket has to be locked. A full bucket holds exactly
+ * `burst' tokens, so with a burst of 1 messages are never closer than
+ * 1 / rate; the price is that time a sender oversleeps is lost.
+ */
+static double bucket_delay(TokenBucket *bucket, double now)
+{
+    if (now > bucket->last) {
+        bucket->tokens += (now - bucket->last) * bucket->rate;
+        if (bucket->tokens > bucket->burst)
+            bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+
+    if (bucket->tokens >= 1 - TOKEN_EPSILON)
+        return 0;
+    /* callers sleep in poll(), round up to its millisecond resolution */
+    return ceil((1 - bucket->tokens) / bucket->rate * 1000) / 1000;
+}
+
+
+/*
+ * Take a token from `bucket' and `parent', or return the time to wait
+ * for them when `take' is set; only return the time otherwise.
+ */
+static double bucket_take(TokenBucket *bucket, TokenBucket *parent, int take)
+{
+    double now, delay, parent_delay = 0;
+
+    if (bucket == NULL) {
+        bucket = parent;
+        parent = NULL;
+    }
+    if (bucket == NULL)
+        return 0;
+    if (parent == bucket)
+        parent = NULL;
+
+    now = now_seconds();
+    mutex_lock(bucket->lock);
+    delay = bucket_delay(bucket, now);
+    if (parent != NULL) {
+        mutex_lock(parent->lock);
+        parent_delay = bucket_delay(parent, now);
+        if (parent_delay > delay)
+            delay = parent_delay;
+    }
+    if (take && delay == 0) {
+        bucket->tokens -= 1;
+        if (parent != NULL)
+            parent->tokens -= 1;
+    }
+    if (parent != NULL)
+        mutex_unlock(parent->lock);
+    mutex_unlock(bucket->lock);
+
+    return delay;
+}
+
+
+void token_bucket_init(void)
+{
+    gw_assert(shared_buckets == NULL);
+
+    shared_buckets = dict_create(32, NULL);
+    shared_lock = mutex_create();
+}
+
+
+void token_bucket_shutdown(void)
+{
+    if (shared_buckets == NULL)
+        return;
+
+    if (dict_key_count(shared_buckets) > 0)
+        warning(0, "Shutting down with %ld shared token buckets in use.",
+                dict_key_count(shared_buckets));
+    dict_destroy(shared_buckets);
+    shared_buckets = NULL;
+    mutex_destroy(shared_lock);
+    shared_lock = NULL;
+}
+
+
+TokenBucket *token_bucket_create(double rate, double burst)
+{
+    TokenBucket *bucket;
+
+    gw_assert(rate > 0);
+
+    bucket = gw_malloc(sizeof(*bucket));
+    bucket->lock = mutex_create();
+    bucket->rate = rate;
+    bucket->burst = burst < 1 ? 1 : burst;
+    bucket->tokens = bucket->burst;
+    bucket->last = now_seconds();
+    bucket->name = NULL;
+    bucket->refs = 1;
+
+    return bucket;
+}
+
+
+TokenBucket *token_bucket_create_shared(Octstr *name, double rate, double burst)
+{
+    TokenBucket *bucket;
+
+    gw_assert(shared_buckets != NULL);
+    gw_assert(name != NULL);
+
+    mutex_lock(shared_lock);
+    bucket = dict_get(shared_buckets, name);
+    if (bucket == NULL) {
+        bucket = token_bucket_create(rate, burst);
+        bucket->name = octstr_duplicate(name);
+        dict_put(shared_buckets, name, bucket);
+    } else {
+        if (bucket->rate != rate || bucket->burst != (burst < 1 ? 1 : burst))
+            warning(0, "Token bucket <%s> already exists with rate %.3f and "
+                    "burst %.3f, ignoring rate %.3f and burst %.3f.",
+                    octstr_get_cstr(name), bucket->rate, bucket->burst,
+                    rate, burst);
+        bucket->refs++;
+    }
+    mutex_unlock(shared_lock);
+
+    return bucket;
+}
+
+
+void token_bucket_destroy(TokenBucket *bucket)
+{
+    if (bucket == NULL)
+        return;
+
+    if (bucket->name != NULL) {
+        mutex_lock(shared_lock);
+        if (--bucket->refs > 0) {
+            mutex_unlock(shared_lock);
+            return;
+        }
+        dict_remove(shared_buckets, bucket->name);
+        mutex_unlock(shared_lock);
+        octstr_destroy(bucket->name);
+    }
+    mutex_destroy(bucket->lock);
+    gw_free(bucket);
+}
+
+
+double token_bucket_take(TokenBucket *bucket, TokenBucket *parent)
+{
+    return bucket_take(bucket, parent, 1);
+}
+
+
+double token_bucket_wait(TokenBucket *bucket, TokenBucket *parent)
+{
+    return bucket_take(bucket, parent, 0);
+}
+
+
+static void bucket_return(TokenBucket *bucket)
+{
+    mutex_lock(bucket->lock);
+    bucket->tokens += 1;
+    if (bucket->tokens > bucket->burst)
+        bucket->tokens = bucket->burst;
+    mutex_unlock(bucket->lock);
+}
+
+
+void token_bucket_return(TokenBucket *bucket, TokenBucket *parent)
+{
+    if (bucket != NULL)
+        bucket_return(bucket);
+    if (parent != NULL && parent != bucket)
+        bucket_return(parent);
+}
@@ -0,0 +1,122 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * token_bucket.h - token bucket rate limiter
+ *
+ * A bucket holds up to `burst' tokens and is refilled continuously with
+ * `rate' tokens per second. Sending a message takes one token; when the
+ * bucket is empty, the sender learns how long to wait for the next token
+ * instead of polling.
+ *
+ * Buckets can also be shared by name, e.g. by all connections of one
+ * smsc-id, so that the group as a whole is limited.
+ */
+
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include "gwlib/gwlib.h"
+
+typedef struct TokenBucket TokenBucket;
+
+/*
+ * Initialize and shut down the table of shared buckets. All shared
+ * buckets have to be destroyed before the shutdown.
+ */
+void token_bucket_init(void);
+void token_bucket_shutdown(void);
+
+/*
+ * Create a bucket allowing `rate' tokens per second with bursts of up to
+ * `burst' tokens. A burst smaller than one token is raised to one. The
+ * bucket starts full.
+ */
+TokenBucket *token_bucket_create(double rate, double burst);
+
+/*
+ * Return the bucket shared under `name', creating it with `rate' and
+ * `burst' if it does not exist yet. Each call has to be paired with a
+ * token_bucket_destroy(); the bucket is freed with the last reference.
+ */
+TokenBucket *token_bucket_create_shared(Octstr *name, double rate, double burst);
+
+/*
+ * Destroy a bucket, or drop a reference to a shared one.
+ */
+void token_bucket_destroy(TokenBucket *bucket);
+
+/*
+ * Take one token from `bucket' and, if not NULL, one from `parent'. Either
+ * both tokens are taken or none. Return 0 if the tokens were taken, or
+ * the number of seconds until they will be available. A NULL bucket
+ * never limits.
+ */
+double token_bucket_take(TokenBucket *bucket, TokenBucket *parent);
+
+/*
+ * Like token_bucket_take(), but do not take any tokens.
+ */
+double token_bucket_wait(TokenBucket *bucket, TokenBucket *parent);
+
+/*
+ * Give back the tokens taken by a successful token_bucket_take() that
+ * were not used after all, e.g. because there was nothing left to send.
+ */
+void token_bucket_return(TokenBucket *bucket, TokenBucket *parent);
+
+#endif
@@ -190,6 +190,13 @@ static Cfg *init_wapbox(Cfg *cfg)
         debug("wap", 0, "no syslog parameter");
     }
 
+    /* write log lines from a separate thread */
+    if (cfg_get_integer(&value, grp, octstr_imm("log-async-buffer")) == 0 && value > 0) {
+        int drop = 0;
+        cfg_get_bool(&drop, grp, octstr_imm("log-async-drop"));
+        log_set_async(value, drop);
+    }
+
     /* determine which timezone we use for access logging */
     if ((s = cfg_get(grp, octstr_imm("access-log-time"))) != NULL) {
         lf = (octstr_case_compare(s, octstr_imm("gmt")) == 0) ? 0 : 1;
@@ -93,6 +93,7 @@ void alog_reopen(void)
     gwlist_lock(writers);
     /* wait for writers to complete */
     gwlist_consume(writers);
+    log_flush();
 
     fclose(file);
     file = fopen(filename, "a");
@@ -117,6 +118,7 @@ void alog_close(void)
         gwlist_lock(writers);
         /* wait for writers to complete */
         gwlist_consume(writers);
+        log_flush();
         fclose(file);
         file = NULL;
         gwlist_unlock(writers);
@@ -173,22 +175,12 @@ void alog_use_gmtime(void)
 #define FORMAT_SIZE (10*1024)
 static void format(char *buf, const char *fmt)
 {
-    time_t t;
-    struct tm tm;
     char *p, prefix[1024];
 	
     p = prefix;
 
     if (markers) {
-        time(&t);
-        if (use_localtime)
-            tm = gw_localtime(t);
-        else
-            tm = gw_gmtime(t);
-
-        sprintf(p, "%04d-%02d-%02d %02d:%02d:%02d ",
-                tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
-                tm.tm_hour, tm.tm_min, tm.tm_sec);
+        log_timestamp(p, use_localtime);
     } else {
         *p = '\0';
     }
@@ -218,8 +210,10 @@ void alog(const char *fmt, ...)
     gwlist_add_producer(writers);
     gwlist_unlock(writers);
 
-    vfprintf(file, buf, args);
-    fflush(file);
+    if (log_async_vprintf(file, buf, args) == -1) {
+        vfprintf(file, buf, args);
+        fflush(file);
+    }
 
     gwlist_remove_producer(writers);
 
@@ -197,6 +197,170 @@ alias_t chars_aliases[] = {
     { NULL }
 };
 
+/*
+ * Precomputed conversion tables, filled by charset_init(). For every GSM
+ * character, plain and after an escape, they hold its UTF-8 encoding.
+ * gsm_esc_utf8_len is 0 for escapes that have no meaning of their own.
+ */
+static unsigned char gsm_utf8[128][3];
+static unsigned char gsm_utf8_len[128];
+static unsigned char gsm_esc_utf8[128][3];
+static unsigned char gsm_esc_utf8_len[128];
+
+static int unicode_to_utf8(int c, unsigned char *out)
+{
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = ((c >> 6) | 0xC0) & 0xFF;
+        out[1] = (c & 0x3F) | 0x80;
+        return 2;
+    }
+    /* There are no 4 bytes encoded characters in GSM charset */
+    out[0] = ((c >> 12) | 0xE0) & 0xFF;
+    out[1] = (((c >> 6) & 0x3F) | 0x80) & 0xFF;
+    out[2] = ((c & 0x3F) | 0x80) & 0xFF;
+    return 3;
+}
+
+static void charset_tables_init(void)
+{
+    int c, i;
+
+    for (c = 0; c < 128; c++) {
+        gsm_utf8_len[c] = unicode_to_utf8(gsm_to_unicode[c], gsm_utf8[c]);
+        gsm_esc_utf8_len[c] = 0;
+    }
+    for (i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
+        c = gsm_esctouni[i].gsmesc;
+        gsm_esc_utf8_len[c] = unicode_to_utf8(gsm_esctouni[i].unichar,
+                                              gsm_esc_utf8[c]);
+    }
+}
+
+#if HAVE_ICONV
+
+/* idle conversion descriptors kept per pair of character sets */
+#define ICONV_POOL_SIZE 16
+
+/* pairs of character sets that get their descriptors pooled */
+#define ICONV_MAX_POOLS 32
+
+/* output is collected in chunks of this size before it is appended */
+#define ICONV_CHUNK 1024
+
+/*
+ * Setting up a conversion descriptor costs more than converting a short
+ * message with it, so descriptors are reused: a thread takes one from the
+ * pool of its pair of character sets and puts it back afterwards. Only a
+ * few pairs are in use in practice, so the pools are kept in a small
+ * array that is searched linearly. Pairs beyond ICONV_MAX_POOLS still
+ * convert, they just open and close a descriptor every time.
+ */
+struct iconv_pool {
+    char *from;
+    char *to;
+    iconv_t cd[ICONV_POOL_SIZE];
+    int idle;
+};
+
+static struct iconv_pool *iconv_pools[ICONV_MAX_POOLS];
+static int iconv_pools_num = 0;
+static Mutex *iconv_pools_lock = NULL;
+
+/*
+ * Find the pool of a pair of character sets. Character set names are case
+ * insensitive, so are the lookups. Must be called with iconv_pools_lock
+ * held.
+ */
+static struct iconv_pool *iconv_pool_find(const char *from, const char *to)
+{
+    int i;
+
+    for (i = 0; i < iconv_pools_num; i++) {
+        if (strcasecmp(iconv_pools[i]->from, from) == 0 &&
+            strcasecmp(iconv_pools[i]->to, to) == 0)
+            return iconv_pools[i];
+    }
+    return NULL;
+}
+
+/*
+ * Get a descriptor converting from one character set to another. *pool is
+ * set to the pool it has to be returned to with iconv_put(), or NULL.
+ * A pool is only set up once iconv_open() accepted the pair, so bogus
+ * names can't use up the pool slots.
+ */
+static iconv_t iconv_get(const char *from, const char *to, struct iconv_pool **pool)
+{
+    struct iconv_pool *p;
+    iconv_t cd = (iconv_t) -1;
+
+    mutex_lock(iconv_pools_lock);
+    p = iconv_pool_find(from, to);
+    if (p != NULL && p->idle > 0)
+        cd = p->cd[--p->idle];
+    mutex_unlock(iconv_pools_lock);
+
+    if (cd == (iconv_t) -1) {
+        cd = iconv_open(to, from);
+        if (cd == (iconv_t) -1)
+            p = NULL;
+        else if (p == NULL) {
+            mutex_lock(iconv_pools_lock);
+            /* another thread may have set it up meanwhile */
+            p = iconv_pool_find(from, to);
+            if (p == NULL && iconv_pools_num < ICONV_MAX_POOLS) {
+                p = gw_malloc(sizeof(*p));
+                p->from = gw_strdup(from);
+                p->to = gw_strdup(to);
+                p->idle = 0;
+                iconv_pools[iconv_pools_num++] = p;
+            }
+            mutex_unlock(iconv_pools_lock);
+        }
+    }
+
+    *pool = p;
+    return cd;
+}
+
+static void iconv_put(struct iconv_pool *pool, iconv_t cd)
+{
+    if (pool != NULL) {
+        /* back to the initial shift state for the next user */
+        iconv(cd, NULL, NULL, NULL, NULL);
+
+        mutex_lock(iconv_pools_lock);
+        if (pool->idle < ICONV_POOL_SIZE) {
+            pool->cd[pool->idle++] = cd;
+            cd = (iconv_t) -1;
+        }
+        mutex_unlock(iconv_pools_lock);
+    }
+
+    if (cd != (iconv_t) -1)
+        iconv_close(cd);
+}
+
+static void iconv_pools_destroy(void)
+{
+    struct iconv_pool *pool;
+
+    while (iconv_pools_num > 0) {
+        pool = iconv_pools[--iconv_pools_num];
+        while (pool->idle > 0)
+            iconv_close(pool->cd[--pool->idle]);
+        gw_free(pool->from);
+        gw_free(pool->to);
+        gw_free(pool);
+    }
+}
+
+#endif
+
 void charset_init()
 {
     int i;
@@ -205,11 +369,42 @@ void charset_init()
       xmlAddEncodingAlias(chars_aliases[i].real,chars_aliases[i].alias);
       /*debug("encoding",0,"Add encoding for %s",chars_aliases[i].alias);*/
     }
+
+    charset_tables_init();
+
+#if HAVE_ICONV
+    iconv_pools_lock = mutex_create();
+#endif
 }
 
 void charset_shutdown()
 {
     xmlCleanupEncodingAliases();
+
+#if HAVE_ICONV
+    iconv_pools_destroy();
+    mutex_destroy(iconv_pools_lock);
+    iconv_pools_lock = NULL;
+#endif
+}
+
+/* conversions of up to this many octets use a buffer on the stack */
+#define CONV_STACK_BUFSIZE 1024
+
+/* all octets of the word are ASCII */
+#define ASCII_WORD(w) (((w) & (~0UL / 255 * 0x80)) == 0)
+
+/*
+ * Replace the content of ostr with len octets of buf and release buf
+ * if it was allocated instead of the stack buffer.
+ */
+static void conv_result(Octstr *ostr, unsigned char *buf, long len,
+                        unsigned char *stackbuf)
+{
+    octstr_truncate(ostr, 0);
+    octstr_append_data(ostr, (char *) buf, len);
+    if (buf != stackbuf)
+        gw_free(buf);
 }
 
 /**
@@ -219,63 +414,72 @@ void charset_shutdown()
  */
 void charset_gsm_to_utf8(Octstr *ostr)
 {
+    unsigned char stackbuf[CONV_STACK_BUFSIZE];
+    unsigned char *buf, *out;
+    const unsigned char *in;
     long pos, len;
-    Octstr *newostr;
+    int c;
 
     if (ostr == NULL)
         return;
 
-    newostr = octstr_create("");
     len = octstr_len(ostr);
-    
+    in = (const unsigned char *) octstr_get_cstr(ostr);
+
+    /* no GSM character takes more than twice its octets in UTF-8 */
+    buf = (2 * len <= CONV_STACK_BUFSIZE) ? stackbuf : gw_malloc(2 * len);
+    out = buf;
+
     for (pos = 0; pos < len; pos++) {
-        int c, i;
-        
-        c = octstr_get_char(ostr, pos);
+        c = in[pos];
         if (c > 127) {
             warning(0, "Could not convert GSM (0x%02x) to Unicode.", c);
             continue;
         }
-        
-        if(c == 27 && pos + 1 < len) {
-            c = octstr_get_char(ostr, ++pos);
-            for (i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
-                if (gsm_esctouni[i].gsmesc == c)
-                    break;
-            }   
-            if (gsm_esctouni[i].gsmesc == c) {
+        if (c == 27 && pos + 1 < len) {
+            c = in[pos + 1];
+            if (c < 128 && gsm_esc_utf8_len[c] > 0) {
                 /* found a value for escaped char */
-                c = gsm_esctouni[i].unichar;
-            } else {
-	        /* nothing found, look esc in our table */
-		c = gsm_to_unicode[27];
-                pos--;
-	    }
-        } else if (c < 128) {
-            c = gsm_to_unicode[c];
-        }
-        /* unicode to utf-8 */
-        if(c < 128) {
-            /* 0-127 are ASCII chars that need no conversion */
-            octstr_append_char(newostr, c);
-        } else { 
-            /* test if it can be converterd into a two byte char */
-            if(c < 0x0800) {
-                octstr_append_char(newostr, ((c >> 6) | 0xC0) & 0xFF); /* add 110xxxxx */
-                octstr_append_char(newostr, (c & 0x3F) | 0x80); /* add 10xxxxxx */
-            } else {
-                /* else we encode with 3 bytes. This only happens in case of euro symbol */
-                octstr_append_char(newostr, ((c >> 12) | 0xE0) & 0xFF); /* add 1110xxxx */
-                octstr_append_char(newostr, (((c >> 6) & 0x3F) | 0x80) & 0xFF); /* add 10xxxxxx */
-                octstr_append_char(newostr, ((c  & 0x3F) | 0x80) & 0xFF); /* add 10xxxxxx */
+                memcpy(out, gsm_esc_utf8[c], gsm_esc_utf8_len[c]);
+                out += gsm_esc_utf8_len[c];
+                pos++;
+                continue;
             }
-            /* There are no 4 bytes encoded characters in GSM charset */
+            /* nothing found, look esc in our table */
+            c = 27;
         }
+        /* plain GSM characters take one or two octets */
+        out[0] = gsm_utf8[c][0];
+        if (gsm_utf8_len[c] > 1) {
+            out[1] = gsm_utf8[c][1];
+            out += 2;
+        } else
+            out++;
     }
 
-    octstr_truncate(ostr, 0);
-    octstr_append(ostr, newostr);
-    octstr_destroy(newostr);
+    conv_result(ostr, buf, out - buf, stackbuf);
+}
+
+/*
+ * Map a unicode character beyond Latin-1 to GSM 03.38. Like in the
+ * latin1_to_gsm table an escaped character is returned negative.
+ */
+static int unicode_to_gsm(int c)
+{
+    switch (c) {
+    case 0x394: return 0x10; /* GREEK CAPITAL LETTER DELTA */
+    case 0x3A6: return 0x12; /* GREEK CAPITAL LETTER PHI */
+    case 0x393: return 0x13; /* GREEK CAPITAL LETTER GAMMA */
+    case 0x39B: return 0x14; /* GREEK CAPITAL LETTER LAMBDA */
+    case 0x3A9: return 0x15; /* GREEK CAPITAL LETTER OMEGA */
+    case 0x3A0: return 0x16; /* GREEK CAPITAL LETTER PI */
+    case 0x3A8: return 0x17; /* GREEK CAPITAL LETTER PSI */
+    case 0x3A3: return 0x18; /* GREEK CAPITAL LETTER SIGMA */
+    case 0x398: return 0x19; /* GREEK CAPITAL LETTER THETA */
+    case 0x39E: return 0x1A; /* GREEK CAPITAL LETTER XI */
+    case 0x20AC: return -'e'; /* EURO SIGN */
+    default: return NRP; /* character cannot be represented in GSM 03.38 */
+    }
 }
 
 /**
@@ -287,107 +491,87 @@ void charset_gsm_to_utf8(Octstr *ostr)
  */
 void charset_utf8_to_gsm(Octstr *ostr)
 {
+    unsigned char stackbuf[CONV_STACK_BUFSIZE];
+    unsigned char *buf, *out;
+    const unsigned char *in;
+    unsigned long word;
     long pos, len;
-    int val1, val2;
-    Octstr *newostr;
+    int val1, i;
 
     if (ostr == NULL)
         return;
     
-    newostr = octstr_create("");
     len = octstr_len(ostr);
-    
-    for (pos = 0; pos < len; pos++) {
-        val1 = octstr_get_char(ostr, pos);
-        
-        /* check range */
-        if (val1 < 0 || val1 > 255) {
-            warning(0, "Char (0x%02x) in UTF-8 string not in the range (0, 255). Skipped.", val1);
-            continue;
+    in = (const unsigned char *) octstr_get_cstr(ostr);
+
+    /* every octet gives at most one escaped GSM character */
+    buf = (2 * len <= CONV_STACK_BUFSIZE) ? stackbuf : gw_malloc(2 * len);
+    out = buf;
+
+    pos = 0;
+    while (pos < len) {
+        /* runs of ASCII need no decoding, check them a word at a time */
+        while (pos + (long) sizeof(word) <= len) {
+            memcpy(&word, in + pos, sizeof(word));
+            if (!ASCII_WORD(word))
+                break;
+            for (i = 0; i < (int) sizeof(word); i++) {
+                val1 = latin1_to_gsm[in[pos + i]];
+                if (val1 < 0) {
+                    *out++ = 27;
+                    val1 = -val1;
+                }
+                *out++ = val1;
+            }
+            pos += sizeof(word);
         }
-        
+        if (pos >= len)
+            break;
+
         /* Convert UTF-8 to unicode code */
+        val1 = in[pos];
         
         /* test if two byte utf8 char */
         if ((val1 & 0xE0) == 0xC0) {
             /* test if incomplete utf char */
-            if(pos + 1 < len) {
-                val2 = octstr_get_char(ostr, ++pos);
-                val1 = (((val1 & ~0xC0) << 6) | (val2 & 0x3F));
+            if (pos + 1 < len) {
+                val1 = (((val1 & ~0xC0) << 6) | (in[pos + 1] & 0x3F));
+                pos += 2;
             } else {
                 /* incomplete, ignore it */
                 warning(0, "Incomplete UTF-8 char discovered, skipped. 1");
-                pos += 1;
+                pos += 2;
                 continue;
             }
         } else if ((val1 & 0xF0) == 0xE0) { /* test for three byte utf8 char */
-            if(pos + 2 < len) {
-                val2 = octstr_get_char(ostr, ++pos);
-                val1 = (((val1 & ~0xE0) << 6) | (val2 & 0x3F));
-                val2 = octstr_get_char(ostr, ++pos);
-                val1 = (val1 << 6) | (val2 & 0x3F);
+            if (pos + 2 < len) {
+                val1 = (((val1 & ~0xE0) << 6) | (in[pos + 1] & 0x3F));
+                val1 = (val1 << 6) | (in[pos + 2] & 0x3F);
+                pos += 3;
             } else {
                 /* incomplete, ignore it */
                 warning(0, "Incomplete UTF-8 char discovered, skipped. 2");
-                pos += 2;
+                pos += 3;
                 continue;
             }
-        }
+        } else
+            pos++;
 
         /* test Latin code page 1 char */
-        if(val1 <= 255) {
+        if (val1 <= 255)
             val1 = latin1_to_gsm[val1];
-            /* needs to be escaped ? */
-            if(val1 < 0) {
-                octstr_append_char(newostr, 27);
-                val1 *= -1;
-            }
-        } else {
-            /* Its not a Latin1 char, test for allowed GSM chars */
-            switch(val1) {
-            case 0x394:
-                val1 = 0x10; /* GREEK CAPITAL LETTER DELTA */
-                break;
-            case 0x3A6:
-                val1 = 0x12; /* GREEK CAPITAL LETTER PHI */
-                break;
-            case 0x393:
-                val1 = 0x13; /* GREEK CAPITAL LETTER GAMMA */
-                break;
-            case 0x39B:
-                val1 = 0x14; /* GREEK CAPITAL LETTER LAMBDA */
-                break;
-            case 0x3A9:
-                val1 = 0x15; /* GREEK CAPITAL LETTER OMEGA */
-                break;
-            case 0x3A0:
-                val1 = 0x16; /* GREEK CAPITAL LETTER PI */
-                break;
-            case 0x3A8:
-                val1 = 0x17; /* GREEK CAPITAL LETTER PSI */
-                break;
-            case 0x3A3:
-                val1 = 0x18; /* GREEK CAPITAL LETTER SIGMA */
-                break;
-            case 0x398:
-                val1 = 0x19; /* GREEK CAPITAL LETTER THETA */
-                break;
-            case 0x39E:
-                val1 = 0x1A; /* GREEK CAPITAL LETTER XI */
-                break;
-            case 0x20AC:
-                val1 = 'e'; /* EURO SIGN */
-                octstr_append_char(newostr, 27);
-                break;
-            default: val1 = NRP; /* character cannot be represented in GSM 03.38 */
-            }
+        else
+            val1 = unicode_to_gsm(val1);
+
+        /* needs to be escaped ? */
+        if (val1 < 0) {
+            *out++ = 27;
+            val1 = -val1;
         }
-        octstr_append_char(newostr, val1);
+        *out++ = val1;
     }
 
-    octstr_truncate(ostr, 0);
-    octstr_append(ostr, newostr);
-    octstr_destroy(newostr);
+    conv_result(ostr, buf, out - buf, stackbuf);
 }
 
 
@@ -586,20 +770,38 @@ int charset_from_utf8(Octstr *utf8, Octstr **to, Octstr *charset_to)
     return ret;
 }
 
-int charset_convert(Octstr* string, char* charset_from, char* charset_to)
-{
 #if HAVE_ICONV
-    char *from_buf, *to_buf, *pointer;
-    size_t inbytesleft, outbytesleft, ret;
+
+/*
+ * Move the converted octets collected in chunk to *out, which is created
+ * when needed, and start over with an empty chunk.
+ */
+static void chunk_flush(Octstr **out, char *chunk, char **pointer, size_t *outbytesleft)
+{
+    if (*out == NULL)
+        *out = octstr_create("");
+    octstr_append_data(*out, chunk, *pointer - chunk);
+    *pointer = chunk;
+    *outbytesleft = ICONV_CHUNK;
+}
+
+/*
+ * Convert string with a pooled descriptor. The result is appended to to,
+ * or replaces the content of string if to is NULL. Output is collected
+ * on the stack, so a message that converts to no more than ICONV_CHUNK
+ * octets needs no memory of its own.
+ */
+static int iconv_convert(Octstr *string, Octstr *to, char *charset_from, char *charset_to)
+{
+    char chunk[ICONV_CHUNK];
+    char *from_buf, *pointer;
+    size_t inbytesleft, outbytesleft, ret, nonrev = 0;
+    Octstr *out = to;
+    struct iconv_pool *pool;
     iconv_t cd;
-     
-    if (!charset_from || !charset_to || !string) /* sanity check */
-        return -1;
+    int result = 0;
 
-    if (octstr_len(string) < 1 || strcasecmp(charset_from, charset_to) == 0)
-        return 0; /* we are done, nothing to convert */
-        
-    cd = iconv_open(charset_to, charset_from);
+    cd = iconv_get(charset_from, charset_to, &pool);
     /* Did I succeed in getting a conversion descriptor ? */
     if (cd == (iconv_t)(-1)) {
         /* I guess not */
@@ -607,68 +809,101 @@ int charset_convert(Octstr* string, char* charset_from, char* charset_to)
               charset_from, charset_to);
         return -1; 
     }
-    
+
     from_buf = octstr_get_cstr(string);
     inbytesleft = octstr_len(string);
-    /* allocate max sized buffer, assuming target encoding may be 4 byte unicode */
-    outbytesleft = inbytesleft * 4;
-    pointer = to_buf = gw_malloc(outbytesleft);
+    pointer = chunk;
+    outbytesleft = sizeof(chunk);
 
-    do {
+    while (inbytesleft > 0) {
         ret = iconv(cd, (ICONV_CONST char**) &from_buf, &inbytesleft, &pointer, &outbytesleft);
-        if(ret == -1) {
-            long tmp;
-            /* the conversion failed somewhere */
-            switch(errno) {
-            case E2BIG: /* no space in output buffer */
-                debug("charset", 0, "outbuf to small, realloc.");
-                tmp = pointer - to_buf;
-                to_buf = gw_realloc(to_buf, tmp + inbytesleft * 4);
-                outbytesleft += inbytesleft * 4;
-                pointer = to_buf + tmp;
-                ret = 0;
-                break;
-            case EILSEQ: /* invalid multibyte sequence */
-            case EINVAL: /* incomplete multibyte sequence */
-                warning(0, "Invalid/Incomplete multibyte sequence at position %d, skeep it.",
-                        (int)(from_buf - octstr_get_cstr(string)));
-                /* skeep char and try next */
-                if (outbytesleft == 0) {
-                    /* buffer to small */
-                    tmp = pointer - to_buf;
-                    to_buf = gw_realloc(to_buf, tmp + inbytesleft * 4);
-                    outbytesleft += inbytesleft * 4;
-                    pointer = to_buf + tmp;
-                }
-                pointer[0] = from_buf[0];
-                pointer++;
-                from_buf++;
-                inbytesleft--;
-                outbytesleft--;
-                ret = 0;
-                break;
-            }
+        if (ret != (size_t) -1) {
+            nonrev += ret;
+            continue;
+        }
+        /* the conversion failed somewhere */
+        switch (errno) {
+        case E2BIG: /* no space in output buffer */
+            chunk_flush(&out, chunk, &pointer, &outbytesleft);
+            break;
+        case EILSEQ: /* invalid multibyte sequence */
+        case EINVAL: /* incomplete multibyte sequence */
+            warning(0, "Invalid/Incomplete multibyte sequence at position %d, skeep it.",
+                    (int)(from_buf - octstr_get_cstr(string)));
+            /* skeep char and try next */
+            if (outbytesleft == 0)
+                chunk_flush(&out, chunk, &pointer, &outbytesleft);
+            *pointer++ = *from_buf++;
+            inbytesleft--;
+            outbytesleft--;
+            break;
+        default:
+            error(errno, "Failed to convert string from <%s> to <%s>.", charset_from, charset_to);
+            result = -1;
+            inbytesleft = 0;
         }
-    } while(inbytesleft && ret == 0); /* stop if error occurs and not handled above */
-    
-    iconv_close(cd);
-    
-    if (ret != -1) {
-        /* conversion succeeded */
-        octstr_truncate(string, 0);
-        octstr_append_data(string, to_buf, pointer - to_buf);
-        if (ret)
-            debug("charset", 0, "charset_convert did %ld non-reversible conversions", (long) ret);
-        ret = 0;
-    } else
-        error(errno,"Failed to convert string from <%s> to <%s>.", charset_from, charset_to);
-
-    if (errno == EILSEQ) {
-        debug("charset_convert", 0, "Found an invalid multibyte sequence at position <%d>",
-              (int)(from_buf - octstr_get_cstr(string)));
     }
-    gw_free(to_buf);
-    return ret;
+
+    if (result == 0) {
+        /* write out whatever a stateful encoding still holds back */
+        if (iconv(cd, NULL, NULL, &pointer, &outbytesleft) == (size_t) -1 && errno == E2BIG) {
+            chunk_flush(&out, chunk, &pointer, &outbytesleft);
+            iconv(cd, NULL, NULL, &pointer, &outbytesleft);
+        }
+        if (nonrev)
+            debug("charset", 0, "charset_convert did %ld non-reversible conversions", (long) nonrev);
+    }
+
+    iconv_put(pool, cd);
+
+    if (to == NULL) {
+        /* in place, string is only changed if all went well */
+        if (result == 0) {
+            octstr_truncate(string, 0);
+            if (out != NULL)
+                octstr_append(string, out);
+            octstr_append_data(string, chunk, pointer - chunk);
+        }
+        octstr_destroy(out);
+    } else if (result == 0)
+        octstr_append_data(to, chunk, pointer - chunk);
+
+    return result;
+}
+
+#endif
+
+int charset_convert_to(Octstr *from, Octstr *to, char *charset_from, char *charset_to)
+{
+#if HAVE_ICONV
+    if (!charset_from || !charset_to || !from || !to) /* sanity check */
+        return -1;
+
+    gw_assert(from != to);
+
+    octstr_truncate(to, 0);
+
+    if (octstr_len(from) < 1 || strcasecmp(charset_from, charset_to) == 0) {
+        octstr_append(to, from);
+        return 0; /* we are done, nothing to convert */
+    }
+
+    return iconv_convert(from, to, charset_from, charset_to);
+#endif
+    /* no convertion done due to not having iconv */
+    return -1;
+}
+
+int charset_convert(Octstr* string, char* charset_from, char* charset_to)
+{
+#if HAVE_ICONV
+    if (!charset_from || !charset_to || !string) /* sanity check */
+        return -1;
+
+    if (octstr_len(string) < 1 || strcasecmp(charset_from, charset_to) == 0)
+        return 0; /* we are done, nothing to convert */
+
+    return iconv_convert(string, NULL, charset_from, charset_to);
 #endif
     /* no convertion done due to not having iconv */
     return -1;
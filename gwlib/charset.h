@@ -156,4 +156,13 @@ int charset_from_utf8(Octstr *utf8, Octstr **to, Octstr *charset_to);
  */
 int charset_convert(Octstr* string, char* charset_from, char* charset_to);
 
+/* Same as charset_convert, but leaves from untouched and puts the result
+ * into the octet string to, replacing its content. Conversion descriptors
+ * are reused between calls, and no memory is allocated beyond what to
+ * needs to grow, so a caller converting many messages may keep one to
+ * around. from and to must be different octet strings. Returns 0 on
+ * success and -1 on failure, in which case the content of to is undefined.
+ */
+int charset_convert_to(Octstr *from, Octstr *to, char *charset_from, char *charset_to);
+
 #endif
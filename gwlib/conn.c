@@ -1118,6 +1118,27 @@ Octstr *conn_read_fixed(Connection *conn, long length)
     return result;
 }
 
+int conn_read_fixed_view(Connection *conn, long length, const unsigned char **data)
+{
+    *data = NULL;
+    if (length < 1)
+        return -1;
+
+    lock_in(conn);
+    if (unlocked_inbuf_len(conn) < length) {
+        unlocked_read(conn);
+        if (unlocked_inbuf_len(conn) < length) {
+            unlock_in(conn);
+            return -1;
+        }
+    }
+    *data = (const unsigned char *) octstr_get_cstr(conn->inbuf) + conn->inbufpos;
+    conn->inbufpos += length;
+    unlock_in(conn);
+
+    return 0;
+}
+
 Octstr *conn_read_line(Connection *conn)
 {
     Octstr *result = NULL;
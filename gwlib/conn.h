@@ -266,6 +266,14 @@ Octstr *conn_read_everything(Connection *conn);
  */
 Octstr *conn_read_fixed(Connection *conn, long length);
 
+/* Like conn_read_fixed, but don't copy the data: point *data at exactly
+ * "length" octets inside the input buffer and consume them.  The view
+ * is only valid until the next input operation on the connection, so
+ * this is for connections read by one thread only.  Return 0 on success
+ * and -1 if not enough data is available.
+ */
+int conn_read_fixed_view(Connection *conn, long length, const unsigned char **data);
+
 /* If the input buffer starts with a full line of data (terminated by
  * LF or CR LF), then return that line as an Octstr and remove it
  * from the input buffer.  Otherwise return NULL.
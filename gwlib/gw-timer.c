@@ -60,31 +60,42 @@
  * See gw-timer.h for a description of the interface.
  */
 
+#include <limits.h>
 #include <signal.h>
 
 #include "gwlib/gwlib.h"
 #include "gw-timer.h"
 
 /*
- * Active timers are stored in a TimerHeap.  It is a partially ordered
- * array.  Each element i is the child of element i/2 (rounded down),
- * and a child never elapses before its parent.  The result is that
- * element 0, the top of the heap, is always the first timer to
- * elapse.  The heap is kept in this partial order by all operations on
- * it.  Maintaining a partial order is much cheaper than maintaining
- * a sorted list.
- * The array will be resized as needed.  The size field is the number
- * of elements for which space is reserved, and the len field is the
- * number of elements actually used.  The elements used will always be
- * at tab[0] through tab[len-1].
+ * Active timers are stored in a hierarchical timing wheel.  Each level
+ * of the wheel is an array of WHEEL_SIZE slots, and each slot is a
+ * doubly linked list of timers.  A slot on level 0 holds the timers
+ * that elapse in one particular second, a slot on level 1 covers
+ * WHEEL_SIZE seconds, a slot on level 2 WHEEL_SIZE^2 seconds, and so on.
+ * A timer is put on the lowest level whose span covers the time left
+ * until it elapses, so starting and stopping a timer is O(1) no matter
+ * how many timers are active.
+ *
+ * The timer thread walks level 0 one second at a time.  Whenever it
+ * wraps around, the next slot of level 1 is emptied and its timers are
+ * redistributed ("cascaded") to lower levels, and likewise for the
+ * higher levels.  Each timer is cascaded at most WHEEL_LEVELS - 1 times
+ * during its lifetime.  Timers further in the future than the wheel
+ * spans are parked in the last slot of the top level and cascaded again
+ * until they come into range.
  */
-struct TimerHeap
-{
-    Timer **tab;
-    long len;
-    long size;
-};
-typedef struct TimerHeap TimerHeap;
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN (1L << (WHEEL_BITS * WHEEL_LEVELS))
+
+/*
+ * Elapsed timers are handed to their output lists in batches of at most
+ * this many events, so the timer thread takes each output list's lock
+ * once per batch rather than once per timer.
+ */
+#define ELAPSE_BATCH 64
 
 struct Timerset
 {
@@ -94,29 +105,47 @@ struct Timerset
     volatile sig_atomic_t stopping;
     /*
      * The entire set is locked for any operation on it.  This is
-     * not as expensive as it sounds because usually each set is
-     * used by one caller thread and one (internal) timer thread,
-     * and the timer thread does not wake up very often.
+     * not as expensive as it sounds because all operations on a
+     * timer are O(1) and the timer thread only holds the lock while
+     * moving due timers to their output lists.
      */
     Mutex *mutex;
     /*
-     * Active timers are stored here in a partially ordered structure.
-     * See the definition of TimerHeap, above, for an explanation.
+     * The wheel, see above.  The tick field is the next second the
+     * timer thread will process; every timer that elapses before it
+     * has already been handled.
+     */
+    Timer *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+    long tick;
+    /*
+     * Number of timers in the wheel.
+     */
+    long active;
+    /*
+     * The time the timer thread is going to wake up next.  Starting a
+     * timer that elapses before that wakes the thread up.
+     */
+    long next_wakeup;
+    /*
+     * If set, an elapsing timer puts a copy of its data made by
+     * duplicate() on the output list, and the set owns the data.
+     * See gw_timerset_create_copying.
      */
-    TimerHeap *heap;
+    void *(*duplicate) (void *data);
+    void (*destroy) (void *data);
     /*
-     * The thread that watches the top of the heap, and processes
-     * timers that have elapsed.
+     * The thread that walks the wheel, and processes timers that
+     * have elapsed.
      */
     long thread;
 };
 
 struct Timer
 {
-	/*
-	 * The timer set this timer belongs to.
-	 */
-	Timerset *timerset;
+    /*
+     * The timer set this timer belongs to.
+     */
+    Timerset *timerset;
     /*
      * An event is produced on the output list when the
      * timer elapses.  The timer is not considered to have
@@ -133,13 +162,13 @@ struct Timer
     /*
      * The timer is set to elapse at this time, expressed in
      * Unix time format.  This field is set to -1 if the timer
-     * is not active (i.e. in the timer set's heap).
+     * is not active (i.e. in the timer set's wheel).
      */
     long elapses;
     /*
-     * A duplicate of this event will be put on the output list
-     * when the timer elapses.  It can be NULL if the timer has
-     * not been started yet.
+     * This event will be put on the output list when the timer
+     * elapses (or a copy of it, for a copying timer set).  It can
+     * be NULL if the timer has not been started yet.
      */
     void *data;
     /*
@@ -150,11 +179,13 @@ struct Timer
      */
     void *elapsed_data;
     /*
-     * The index in the timer set's heap.  This field is managed by
-     * the heap operations, and is used to make them faster.
-     * If this timer is not in the heap, this field is -1.
+     * Links of the wheel slot this timer is in.  The slot field
+     * points to the head of the slot, and is NULL if the timer is
+     * not in the wheel.
      */
-    long index;
+    Timer **slot;
+    Timer *prev;
+    Timer *next;
 };
 
 
@@ -162,39 +193,60 @@ struct Timer
  * Internal functions
  */
 static void abort_elapsed(Timer *timer);
-static TimerHeap *heap_create(void);
-static void heap_destroy(TimerHeap *heap);
-static void heap_delete(TimerHeap *heap, long index);
-static int heap_adjust(TimerHeap *heap, long index);
-static void heap_insert(TimerHeap *heap, Timer *timer);
-static void heap_swap(TimerHeap *heap, long index1, long index2);
+static void wheel_insert(Timerset *set, Timer *timer);
+static void wheel_remove(Timer *timer);
+static void wheel_cascade(Timerset *set, int level);
+static long wheel_next_wakeup(Timerset *set);
+static void activate(Timer *timer, long elapses);
+static void deactivate(Timer *timer);
 static void lock(Timerset *set);
 static void unlock(Timerset *set);
 static void watch_timers(void *arg);   /* The timer thread */
-static void elapse_timer(Timer *timer);
+static void elapse_timers(Timerset *set, Timer *due);
 
 
-Timerset *gw_timerset_create(void)
+static Timerset *timerset_create(void *(*duplicate) (void*),
+                                 void (*destroy) (void*))
 {
-	Timerset *set;
+    Timerset *set;
 
-	set = gw_malloc(sizeof(Timerset));
+    set = gw_malloc(sizeof(Timerset));
+    memset(set->wheel, 0, sizeof(set->wheel));
     set->mutex = mutex_create();
-    set->heap = heap_create();
+    set->tick = time(NULL);
+    set->active = 0;
+    set->next_wakeup = LONG_MAX;
+    set->duplicate = duplicate;
+    set->destroy = destroy;
     set->stopping = 0;
     set->thread = gwthread_create(watch_timers, set);
 
     return set;
 }
 
+Timerset *gw_timerset_create(void)
+{
+    return timerset_create(NULL, NULL);
+}
+
+Timerset *gw_timerset_create_copying(void *(*duplicate) (void*),
+                                     void (*destroy) (void*))
+{
+    gw_assert(duplicate != NULL && destroy != NULL);
+
+    return timerset_create(duplicate, destroy);
+}
+
 void gw_timerset_destroy(Timerset *set)
 {
-	if (set == NULL)
-		return;
-       
+    List *timers;
+
+    if (set == NULL)
+        return;
+
     /* Stop all timers. */
-    while (set->heap->len > 0)
-        gw_timer_stop(set->heap->tab[0]);
+    timers = gw_timer_break(set);
+    gwlist_destroy(timers, NULL);
 
     /* Kill timer thread */
     set->stopping = 1;
@@ -202,7 +254,6 @@ void gw_timerset_destroy(Timerset *set)
     gwthread_join(set->thread);
 
     /* Free resources */
-    heap_destroy(set->heap);
     mutex_destroy(set->mutex);
     gw_free(set);
 }
@@ -217,7 +268,8 @@ Timer *gw_timer_create(Timerset *set, List *outputlist, void (*callback) (void*)
     t->elapses = -1;
     t->data = NULL;
     t->elapsed_data = NULL;
-    t->index = -1;
+    t->slot = NULL;
+    t->prev = t->next = NULL;
     t->output = outputlist;
     if (t->output != NULL)
         gwlist_add_producer(outputlist);
@@ -234,6 +286,8 @@ void gw_timer_destroy(Timer *timer)
     gw_timer_stop(timer);
     if (timer->output != NULL)
         gwlist_remove_producer(timer->output);
+    if (timer->timerset->destroy != NULL && timer->data != NULL)
+        timer->timerset->destroy(timer->data);
     gw_free(timer);
 }
 
@@ -245,59 +299,38 @@ void gw_timer_elapsed_destroy(Timer *timer)
     gw_timer_elapsed_stop(timer);
     if (timer->output != NULL)
         gwlist_remove_producer(timer->output);
+    if (timer->timerset->destroy != NULL && timer->data != NULL)
+        timer->timerset->destroy(timer->data);
     gw_free(timer);
 }
 
 void gw_timer_start(Timer *timer, int interval, void *data)
 {
-    int wakeup = 0;
-
     gw_assert(timer != NULL);
 
     if (timer == NULL)
         return;
-        
+
     lock(timer->timerset);
 
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
-    } else {
-        /* Setting a new timer, or resetting an elapsed one.
-         * First deal with a possible elapse event that may
-         * still be on the output list. */
+    /* An active timer is simply moved.  Otherwise first deal with
+     * a possible elapse event that may still be on the output list. */
+    if (timer->slot == NULL)
         abort_elapsed(timer);
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
-    }
+    activate(timer, time(NULL) + interval);
 
     if (data != NULL) {
+        if (timer->timerset->destroy != NULL && timer->data != NULL &&
+            timer->data != data)
+            timer->timerset->destroy(timer->data);
         timer->data = data;
     }
 
     unlock(timer->timerset);
-
-    if (wakeup)
-        gwthread_wakeup(timer->timerset->thread);
 }
 
 void gw_timer_elapsed_start(Timer *timer, int interval, void *data)
 {
-    int wakeup = 0;
-
     gw_assert(timer != NULL);
 
     if (timer == NULL)
@@ -305,40 +338,19 @@ void gw_timer_elapsed_start(Timer *timer, int interval, void *data)
 
     lock(timer->timerset);
 
-    /* Convert to absolute time */
-    interval += time(NULL);
-
-    if (timer->elapses > 0) {
-        /* Resetting an existing timer.  Move it to its new
-         * position in the heap. */
-        if (interval < timer->elapses && timer->index == 0)
-            wakeup = 1;
-        timer->elapses = interval;
-        gw_assert(timer->index >= 0);
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        wakeup |= heap_adjust(timer->timerset->heap, timer->index);
-    } else {
-        /* Setting a new timer, or resetting an elapsed one.
-         * There should be no further elapse event on the
-         * output list here. */
-        /* abort_elapsed(timer); */
-    	timer->elapsed_data = NULL;
-
-        /* Then activate the timer. */
-        timer->elapses = interval;
-        gw_assert(timer->index < 0);
-        heap_insert(timer->timerset->heap, timer);
-        wakeup = timer->index == 0;  /* Do we have a new top? */
-    }
+    /* There should be no further elapse event on the output list
+     * here, so don't search for it. */
+    timer->elapsed_data = NULL;
+    activate(timer, time(NULL) + interval);
 
     if (data != NULL) {
+        if (timer->timerset->destroy != NULL && timer->data != NULL &&
+            timer->data != data)
+            timer->timerset->destroy(timer->data);
         timer->data = data;
     }
 
     unlock(timer->timerset);
-
-    if (wakeup)
-        gwthread_wakeup(timer->timerset->thread);
 }
 
 void gw_timer_stop(Timer *timer)
@@ -346,16 +358,7 @@ void gw_timer_stop(Timer *timer)
     gw_assert(timer != NULL);
     lock(timer->timerset);
 
-    /*
-     * If the timer is active, make it inactive and remove it from
-     * the heap.
-     */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
-
+    deactivate(timer);
     abort_elapsed(timer);
 
     unlock(timer->timerset);
@@ -366,53 +369,38 @@ void gw_timer_elapsed_stop(Timer *timer)
     gw_assert(timer != NULL);
     lock(timer->timerset);
 
-    /*
-     * If the timer is active, make it inactive and remove it from
-     * the heap.
-     */
-    if (timer->elapses > 0) {
-        timer->elapses = -1;
-        gw_assert(timer->timerset->heap->tab[timer->index] == timer);
-        heap_delete(timer->timerset->heap, timer->index);
-    }
-
-    /* abort_elapsed(timer); */
-	timer->elapsed_data = NULL;
+    deactivate(timer);
+    timer->elapsed_data = NULL;
 
     unlock(timer->timerset);
 }
 
 List *gw_timer_break(Timerset *set)
 {
-	List *ret = NULL;
+    List *ret = NULL;
+    Timer *timer;
+    int level, i;
 
     lock(set);
 
-    if (set->heap->len == 0) {
+    if (set->active == 0) {
         unlock(set);
-    	return NULL;
+        return NULL;
     }
 
     ret = gwlist_create();
 
     /* Stop all timers. */
-    while (set->heap->len > 0) {
-    	Timer *timer = set->heap->tab[0];
-
-    	gwlist_append(ret, timer);
-
-        /*
-         * If the timer is active, make it inactive and remove it from
-         * the heap.
-         */
-        if (timer->elapses > 0) {
-            timer->elapses = -1;
-            gw_assert(set->heap->tab[timer->index] == timer);
-            heap_delete(set->heap, timer->index);
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (i = 0; i < WHEEL_SIZE; i++) {
+            while ((timer = set->wheel[level][i]) != NULL) {
+                gwlist_append(ret, timer);
+                deactivate(timer);
+                abort_elapsed(timer);
+            }
         }
-
-        abort_elapsed(timer);
     }
+    gw_assert(set->active == 0);
 
     unlock(set);
 
@@ -446,188 +434,172 @@ static void unlock(Timerset *set)
  */
 static void abort_elapsed(Timer *timer)
 {
+    long count;
+
     if (timer->elapsed_data == NULL)
         return;
 
-    if (timer->output != NULL)
-        gwlist_delete_equal(timer->output, timer->elapsed_data);
+    if (timer->output != NULL) {
+        count = gwlist_delete_equal(timer->output, timer->elapsed_data);
+        if (count > 0 && timer->timerset->destroy != NULL)
+            timer->timerset->destroy(timer->elapsed_data);
+    }
     timer->elapsed_data = NULL;
 }
 
 /*
- * Create a new timer heap.
+ * (Re)schedule the timer to elapse at the given time, waking up the
+ * timer thread if it would otherwise sleep past it.  We have its set
+ * locked.
  */
-static TimerHeap *heap_create(void)
+static void activate(Timer *timer, long elapses)
 {
-    TimerHeap *heap;
+    Timerset *set = timer->timerset;
 
-    heap = gw_malloc(sizeof(*heap));
-    heap->tab = gw_malloc(sizeof(heap->tab[0]));
-    heap->size = 1;
-    heap->len = 0;
+    if (timer->slot != NULL)
+        wheel_remove(timer);
+    timer->elapses = elapses;
+    wheel_insert(set, timer);
 
-    return heap;
+    if (elapses < set->next_wakeup) {
+        set->next_wakeup = elapses;
+        gwthread_wakeup(set->thread);
+    }
 }
 
-static void heap_destroy(TimerHeap *heap)
+static void deactivate(Timer *timer)
 {
-    if (heap == NULL)
-        return;
-
-    gw_free(heap->tab);
-    gw_free(heap);
+    if (timer->slot != NULL)
+        wheel_remove(timer);
+    timer->elapses = -1;
 }
 
 /*
- * Remove a timer from the heap.  Do this by swapping it with the element
- * in the last position, then shortening the heap, then moving the
- * swapped element up or down to maintain the partial ordering.
+ * Put the timer into the slot covering its elapse time, relative to
+ * the set's current tick.  Timers that are already due go to the
+ * current slot of level 0.
  */
-static void heap_delete(TimerHeap *heap, long index)
+static void wheel_insert(Timerset *set, Timer *timer)
 {
-    long last;
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-    gw_assert(heap->tab[index]->index == index);
-
-    last = heap->len - 1;
-    heap_swap(heap, index, last);
-    heap->tab[last]->index = -1;
-    heap->len--;
-    if (index != last)
-        heap_adjust(heap, index);
+    long when, delta;
+    int level;
+    Timer **slot;
+
+    when = timer->elapses;
+    if (when < set->tick)
+        when = set->tick;
+    delta = when - set->tick;
+    if (delta >= WHEEL_SPAN)
+        when = set->tick + WHEEL_SPAN - 1;
+
+    for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+        if (delta < (1L << (WHEEL_BITS * (level + 1))))
+            break;
+    }
+    slot = &set->wheel[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+    timer->slot = slot;
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL)
+        (*slot)->prev = timer;
+    *slot = timer;
+    set->active++;
 }
 
-/*
- * Add a timer to the heap.  Do this by adding it at the end, then
- * moving it up or down as necessary to achieve partial ordering.
- */
-static void heap_insert(TimerHeap *heap, Timer *timer)
+static void wheel_remove(Timer *timer)
 {
-    heap->len++;
-    if (heap->len > heap->size) {
-        heap->tab = gw_realloc(heap->tab,
-                                heap->len * sizeof(heap->tab[0]));
-        heap->size = heap->len;
-    }
-    heap->tab[heap->len - 1] = timer;
-    timer->index = heap->len - 1;
-    heap_adjust(heap, timer->index);
+    gw_assert(timer->slot != NULL);
+
+    if (timer->prev != NULL)
+        timer->prev->next = timer->next;
+    else
+        *timer->slot = timer->next;
+    if (timer->next != NULL)
+        timer->next->prev = timer->prev;
+    timer->slot = NULL;
+    timer->prev = timer->next = NULL;
+    timer->timerset->active--;
 }
 
 /*
- * Swap two elements of the heap, and update their index fields.
- * This is the basic heap operation.
+ * Redistribute the timers of the current slot of this level to the
+ * lower levels.  Called when all levels below have wrapped around.
  */
-static void heap_swap(TimerHeap *heap, long index1, long index2)
+static void wheel_cascade(Timerset *set, int level)
 {
-    Timer *t;
-
-    gw_assert(index1 >= 0);
-    gw_assert(index1 < heap->len);
-    gw_assert(index2 >= 0);
-    gw_assert(index2 < heap->len);
-
-    if (index1 == index2)
-        return;
-
-    t = heap->tab[index1];
-    heap->tab[index1] = heap->tab[index2];
-    heap->tab[index2] = t;
-    heap->tab[index1]->index = index1;
-    heap->tab[index2]->index = index2;
+    Timer *timer, *next;
+    Timer **slot;
+
+    slot = &set->wheel[level][(set->tick >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    timer = *slot;
+    *slot = NULL;
+    for (; timer != NULL; timer = next) {
+        next = timer->next;
+        set->active--;
+        wheel_insert(set, timer);
+    }
 }
 
 /*
- * The current element has broken the partial ordering of the
- * heap (see explanation in the definition of Timerset), and
- * it has to be moved up or down until the ordering is restored.
- * Return 1 if the timer at the heap's top is now earlier than
- * before this operation, otherwise 0.
+ * Return the time when the timer thread needs to look at the wheel
+ * next: the first occupied slot of level 0 before the next cascade,
+ * or the next cascade itself.  We have the set locked.
  */
-static int heap_adjust(TimerHeap *heap, long index)
+static long wheel_next_wakeup(Timerset *set)
 {
-    Timer *t;
-    Timer *parent;
-    long child_index;
-
-    /*
-     * We can assume that the heap was fine before this element's
-     * elapse time was changed.  There are three cases to deal
-     * with:
-     *  - Element's new elapse time is too small; it should be
-     *    moved toward the top.
-     *  - Element's new elapse time is too large; it should be
-     *    moved toward the bottom.
-     *  - Element's new elapse time still fits here, we don't
-     *    have to do anything.
-     */
-
-    gw_assert(index >= 0);
-    gw_assert(index < heap->len);
-
-    /* Move to top? */
-    t = heap->tab[index];
-    parent = heap->tab[index / 2];
-    if (t->elapses < parent->elapses) {
-        /* This will automatically terminate when it reaches
-         * the top, because in that t == parent. */
-        do {
-            heap_swap(heap, index, index / 2);
-            index = index / 2;
-            parent = heap->tab[index / 2];
-        } while (t->elapses < parent->elapses);
-        /* We're done.  Return 1 if we changed the top. */
-        return index == 0;
-    }
+    long t;
 
-    /* Move to bottom? */
-    for (; ; ) {
-        child_index = index * 2;
-        if (child_index >= heap->len)
-            return 0;   /* Already at bottom */
-        if (child_index == heap->len - 1) {
-            /* Only one child */
-            if (heap->tab[child_index]->elapses < t->elapses)
-                heap_swap(heap, index, child_index);
-            break;
-        }
-
-        /* Find out which child elapses first */
-        if (heap->tab[child_index + 1]->elapses <
-            heap->tab[child_index]->elapses) {
-            child_index++;
-        }
+    if (set->active == 0)
+        return LONG_MAX;
 
-        if (heap->tab[child_index]->elapses < t->elapses) {
-            heap_swap(heap, index, child_index);
-            index = child_index;
-        } else {
-            break;
-        }
+    for (t = set->tick; ; t++) {
+        if (set->wheel[0][t & WHEEL_MASK] != NULL)
+            return t;
+        if (((t + 1) & WHEEL_MASK) == 0)
+            return t + 1;
     }
-
-    return 0;
 }
 
 /*
- * This timer has elapsed.  Do the housekeeping.  We have its set locked.
+ * These timers have elapsed.  Do the housekeeping and hand their
+ * events to the output lists, in batches per list.  We have their
+ * set locked.
  */
-static void elapse_timer(Timer *timer)
+static void elapse_timers(Timerset *set, Timer *due)
 {
-    gw_assert(timer != NULL);
-    gw_assert(timer->timerset != NULL);
-    /* This must be true because abort_elapsed is always called
-     * before a timer is activated. */
-    gw_assert(timer->elapsed_data == NULL);
+    void *batch[ELAPSE_BATCH];
+    List *batch_list = NULL;
+    long batch_len = 0;
+    Timer *timer, *next;
+
+    for (timer = due; timer != NULL; timer = next) {
+        next = timer->next;
+        timer->prev = timer->next = NULL;
+        /* This must be true because abort_elapsed is always called
+         * before a timer is activated. */
+        gw_assert(timer->elapsed_data == NULL);
+
+        if (set->duplicate != NULL)
+            timer->elapsed_data = set->duplicate(timer->data);
+        else
+            timer->elapsed_data = timer->data;
+        timer->elapses = -1;
 
-    timer->elapsed_data = timer->data;
-    timer->elapses = -1;
-    if (timer->output != NULL)
-        gwlist_produce(timer->output, timer->elapsed_data);
-    if (timer->callback != NULL)
-        timer->callback(timer->elapsed_data);
+        if (timer->output != NULL) {
+            if (timer->output != batch_list || batch_len == ELAPSE_BATCH) {
+                if (batch_list != NULL)
+                    gwlist_produce_many(batch_list, batch, batch_len);
+                batch_list = timer->output;
+                batch_len = 0;
+            }
+            batch[batch_len++] = timer->elapsed_data;
+        }
+        if (timer->callback != NULL)
+            timer->callback(timer->elapsed_data);
+    }
+    if (batch_list != NULL)
+        gwlist_produce_many(batch_list, batch, batch_len);
 }
 
 /*
@@ -636,8 +608,10 @@ static void elapse_timer(Timer *timer)
 static void watch_timers(void *arg)
 {
     Timerset *set;
-    long top_time;
-    long now;
+    Timer *due, *timer;
+    Timer **slot;
+    long now, wakeup;
+    int level;
 
     set = arg;
 
@@ -646,25 +620,38 @@ static void watch_timers(void *arg)
 
         now = time(NULL);
 
-        while (set->heap->len > 0 && set->heap->tab[0]->elapses <= now) {
-        	Timer *timer = set->heap->tab[0];
-        	heap_delete(set->heap, 0);
-        	elapse_timer(timer);
+        while (set->tick <= now) {
+            /* Cascade the levels that wrap around at this tick. */
+            for (level = 1; level < WHEEL_LEVELS; level++) {
+                if ((set->tick & ((1L << (WHEEL_BITS * level)) - 1)) != 0)
+                    break;
+            }
+            while (--level > 0)
+                wheel_cascade(set, level);
+
+            slot = &set->wheel[0][set->tick & WHEEL_MASK];
+            due = *slot;
+            *slot = NULL;
+            for (timer = due; timer != NULL; timer = timer->next) {
+                timer->slot = NULL;
+                set->active--;
+            }
+            set->tick++;
+            elapse_timers(set, due);
         }
 
-    	/*
-    	 * Now sleep until the next timer elapses.  If there isn't one,
-    	 * then just sleep very long.  We will get woken up if the
-    	 * top of the heap changes before we wake.
-    	 */
-
-    	if (set->heap->len == 0) {
-    		unlock(set);
-    		gwthread_sleep(1000000.0);
-    	} else {
-    		top_time = set->heap->tab[0]->elapses;
-    		unlock(set);
-    		gwthread_sleep(top_time - now);
-    	}
+        /*
+         * Now sleep until the next timer elapses or the wheel needs
+         * to cascade.  If there are no timers, then just sleep very
+         * long.  We will get woken up if a timer is started that
+         * elapses before we wake.
+         */
+        wakeup = set->next_wakeup = wheel_next_wakeup(set);
+        unlock(set);
+
+        if (wakeup == LONG_MAX)
+            gwthread_sleep(1000000.0);
+        else
+            gwthread_sleep(wakeup - now);
     }
 }
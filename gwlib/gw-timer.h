@@ -80,6 +80,9 @@
  * see a timer elapse after being destroyed, or while being extended,
  * because the elapse event will be deleted during such an operation.
  *
+ * Starting and stopping a timer takes constant time regardless of
+ * the number of active timers, and timers have one second resolution.
+ *
  * The timer_* functions have been renamed to gwtimer_* to avoid
  * a name conflict on Solaris systems.
  */
@@ -94,6 +97,17 @@ typedef struct Timerset Timerset;
 
 
 Timerset *gw_timerset_create(void);
+
+/*
+ * Create a timer set whose timers own their event.  When such a timer
+ * elapses, it puts a copy of the event made with 'duplicate' on the
+ * output list instead of the event itself, so the same timer can be
+ * restarted with a NULL event.  Copies taken back from the output list,
+ * events replaced by gw_timer_start and the event of a destroyed timer
+ * are freed with 'destroy'.
+ */
+Timerset *gw_timerset_create_copying(void *(*duplicate) (void*),
+                                     void (*destroy) (void*));
 void gw_timerset_destroy(Timerset *set);
 
 
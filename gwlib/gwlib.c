@@ -97,6 +97,7 @@ void gwlib_shutdown(void)
     charset_shutdown();
     http_shutdown();
     socket_shutdown();
+    log_set_async(0, 0);
     gwthread_shutdown();
     octstr_shutdown();
     gwlib_protected_shutdown();
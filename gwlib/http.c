@@ -752,6 +752,8 @@ static void server_destroy(void *p)
  */
 static Dict *conn_pool;
 static Mutex *conn_pool_lock;
+/* maximum idle connections kept per pool key, -1 for no limit */
+static long conn_pool_max = -1;
 
 
 static void conn_pool_item_destroy(void *item)
@@ -886,6 +888,14 @@ static void conn_pool_put(Connection *conn, Octstr *host, int port, int ssl, Oct
     	list = gwlist_create();
         dict_put(conn_pool, key, list);
     }
+    if (conn_pool_max >= 0 && gwlist_len(list) >= conn_pool_max) {
+        mutex_unlock(conn_pool_lock);
+        debug("gwlib.http", 0, "HTTP: Pool for <%s> full, closing connection (fd=%d).",
+              octstr_get_cstr(key), conn_get_id(conn));
+        octstr_destroy(key);
+        conn_destroy(conn);
+        return;
+    }
     gwlist_append(list, conn);
     /* register connection to get server disconnect */
     conn_register_real(conn, client_fdset, check_pool_conn, key, octstr_destroy_item);
@@ -1742,6 +1752,11 @@ void http_set_client_timeout(long timeout)
     }
 }
 
+void http_set_client_pool_size(long max)
+{
+    conn_pool_max = max;
+}
+
 void http_start_request(HTTPCaller *caller, int method, Octstr *url, List *headers,
     	    	    	Octstr *body, int follow, void *id, Octstr *certkeyfile)
 {
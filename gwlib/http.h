@@ -302,6 +302,13 @@ void http_set_interface(const Octstr *our_host);
  */
 void http_set_client_timeout(long timeout);
 
+/**
+ * Define the maximum number of idle keep-alive connections kept open
+ * per server. Connections returned to a full pool are closed. Set -1
+ * for no limit, which is the default.
+ */
+void http_set_client_pool_size(long max);
+
 /*
  * Functions for doing a GET request. The difference is that _real follows
  * redirections, plain http_get does not. Return value is the status
@@ -414,6 +414,22 @@ void gwlist_produce(List *list, void *item)
 }
 
 
+void gwlist_produce_many(List *list, void **items, long count)
+{
+    long i;
+
+    if (count <= 0)
+        return;
+    lock(list);
+    make_bigger(list, count);
+    for (i = 0; i < count; ++i)
+        list->tab[INDEX(list, list->len + i)] = items[i];
+    list->len += count;
+    pthread_cond_broadcast(&list->nonempty);
+    unlock(list);
+}
+
+
 int gwlist_consumer_count(List *list)
 {
     int ret;
@@ -265,6 +265,13 @@ void gwlist_remove_producer(List *list);
 void gwlist_produce(List *list, void *item);
 
 
+/*
+ * Add `count' items to the end of the list in one go, waking up the
+ * consumers once. Equivalent to calling gwlist_produce for each item.
+ */
+void gwlist_produce_many(List *list, void **items, long count);
+
+
 /*
  * Return the current number of consumers for the list
  */
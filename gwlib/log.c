@@ -67,6 +67,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #ifdef HAVE_EXECINFO_H
 #include <execinfo.h>
@@ -174,6 +175,63 @@ static int sysloglevel;
 static int syslogfacility = LOG_DAEMON;
 static int dosyslog = 0;
 
+/*
+ * Asynchronous logging, see log_set_async().
+ *
+ * Each thread appends its lines to its own ring buffer, indexed by the
+ * thread's slot like thread_to[].  Only that thread moves the head and
+ * only the writer (the writer thread, or log_flush() in any thread,
+ * serialized by writer_lock) moves the tail.  The ring's lock guards
+ * just head, tail and dropped; lines are copied in and written out
+ * without it, so the owner and the writer hold it only briefly.  New
+ * rings are put into rings[] under writer_lock.  A record is a
+ * RingHeader followed by the line, padded to a multiple of the header
+ * size so that a header always fits in front of the end of the buffer.
+ * A header without a file marks the unused rest of the buffer before
+ * the ring wraps.
+ */
+typedef struct {
+    FILE *file;
+    size_t len;
+} RingHeader;
+
+#define RECORD_SIZE(len) \
+    (sizeof(RingHeader) + \
+     ((len) + sizeof(RingHeader) - 1) / sizeof(RingHeader) * sizeof(RingHeader))
+
+typedef struct {
+    unsigned long head;
+    unsigned long tail;
+    unsigned long size;
+    unsigned long dropped;    /* lines dropped, counted by the owner */
+    unsigned long reported;   /* dropped lines already reported */
+    char *buf;
+    Mutex lock;
+} LogRing;
+
+static LogRing *rings[THREADTABLE_SIZE];
+static volatile sig_atomic_t async_enabled = 0;
+static int async_drop = 0;
+static unsigned long async_size = 0;
+static Mutex writer_lock;
+static volatile sig_atomic_t writer_stopping = 0;
+static long writer_thread = -1;
+
+/* How often the writer thread writes the buffered lines out (seconds). */
+#define WRITER_INTERVAL 0.1
+
+/* Longer lines are written directly. */
+#define ASYNC_LINE_SIZE (8 * 1024)
+
+/*
+ * Timestamp prefixes are formatted once per second and thread slot.
+ */
+static struct {
+    time_t t;
+    int local;
+    char str[LOG_TIMESTAMP_SIZE];
+} stamps[THREADTABLE_SIZE];
+
 /*
  * Make sure stderr is included in the list.
  */
@@ -201,19 +259,290 @@ void log_init(void)
     /* default all possible thread to logging index 0, stderr */
     for (i = 0; i < THREADTABLE_SIZE; i++) {
         thread_to[i] = 0;
+        stamps[i].t = -1;
     }
 
+    mutex_init_static(&writer_lock);
+
     add_stderr();
 }
 
 void log_shutdown(void)
 {
+    int i;
+
+    log_set_async(0, 0);
     log_close_all();
+
+    for (i = 0; i < THREADTABLE_SIZE; i++) {
+        if (rings[i] != NULL) {
+            mutex_destroy(&rings[i]->lock);
+            gw_native_free(rings[i]->buf);
+            gw_native_free(rings[i]);
+            rings[i] = NULL;
+        }
+    }
+    mutex_destroy(&writer_lock);
     /* destroy rwlock */
     gw_rwlock_destroy(&rwlock);
 }
 
 
+/*
+ * Write out what has been buffered in the ring.  Returns the number
+ * of lines the owner has dropped since the last call.  We have the
+ * writer_lock.
+ */
+static unsigned long ring_drain(LogRing *ring, FILE **touched, int *num_touched)
+{
+    unsigned long head, tail, dropped;
+    RingHeader *hdr;
+    int i;
+
+    mutex_lock(&ring->lock);
+    head = ring->head;
+    tail = ring->tail;
+    mutex_unlock(&ring->lock);
+
+    while (tail != head) {
+        hdr = (RingHeader *) (ring->buf + (tail & (ring->size - 1)));
+        if (hdr->file == NULL) {
+            tail += hdr->len;
+            continue;
+        }
+        fwrite(hdr + 1, 1, hdr->len, hdr->file);
+        for (i = 0; i < *num_touched && touched[i] != hdr->file; i++)
+            ;
+        if (i == *num_touched && i < MAX_LOGFILES + 1)
+            touched[(*num_touched)++] = hdr->file;
+        tail += RECORD_SIZE(hdr->len);
+    }
+    mutex_lock(&ring->lock);
+    ring->tail = tail;
+    dropped = ring->dropped - ring->reported;
+    ring->reported = ring->dropped;
+    mutex_unlock(&ring->lock);
+
+    return dropped;
+}
+
+
+static unsigned long flush_rings(void)
+{
+    FILE *touched[MAX_LOGFILES + 1];
+    int i, num_touched = 0;
+    unsigned long dropped = 0;
+    LogRing *ring;
+
+    mutex_lock(&writer_lock);
+    for (i = 0; i < THREADTABLE_SIZE; i++) {
+        ring = rings[i];
+        if (ring != NULL)
+            dropped += ring_drain(ring, touched, &num_touched);
+    }
+    for (i = 0; i < num_touched; i++)
+        fflush(touched[i]);
+    mutex_unlock(&writer_lock);
+
+    return dropped;
+}
+
+
+void log_flush(void)
+{
+    flush_rings();
+}
+
+
+static void log_writer(void *arg)
+{
+    unsigned long dropped;
+
+    while (!writer_stopping) {
+        gwthread_sleep(WRITER_INTERVAL);
+        dropped = flush_rings();
+        /* our own lines are written directly, see async_write */
+        if (dropped > 0)
+            warning(0, "Log buffer full, %lu log lines dropped.", dropped);
+    }
+}
+
+
+void log_set_async(long buffer_size, int drop_when_full)
+{
+    unsigned long size;
+
+    if (buffer_size > 0) {
+        if (async_enabled)
+            log_set_async(0, 0);
+        /* rings are a power of two, and at least a few lines long */
+        for (size = 4096; size < (unsigned long) buffer_size; size <<= 1)
+            ;
+        async_size = size;
+        async_drop = drop_when_full;
+        writer_stopping = 0;
+        writer_thread = gwthread_create(log_writer, NULL);
+        if (writer_thread == -1) {
+            error(0, "Cannot start log writer thread, logging synchronously.");
+            return;
+        }
+        async_enabled = 1;
+    } else if (async_enabled) {
+        async_enabled = 0;
+        writer_stopping = 1;
+        gwthread_wakeup(writer_thread);
+        gwthread_join(writer_thread);
+        writer_thread = -1;
+        flush_rings();
+    }
+}
+
+
+/*
+ * Append a line to the calling thread's ring buffer.  Returns 0 if
+ * the line was buffered (or dropped), -1 if it must be written
+ * directly.
+ */
+static int async_write(FILE *file, const char *line, size_t len)
+{
+    long slot;
+    LogRing *ring;
+    unsigned long head, tail, need, to_end, wrap;
+    RingHeader *hdr;
+
+    slot = gwthread_self();
+    if (slot < 0 || slot == writer_thread)
+        return -1;
+    slot %= THREADTABLE_SIZE;
+
+    ring = rings[slot];
+    if (ring == NULL) {
+        ring = gw_native_malloc(sizeof(*ring));
+        ring->head = ring->tail = 0;
+        ring->dropped = ring->reported = 0;
+        ring->size = async_size;
+        ring->buf = gw_native_malloc(ring->size);
+        mutex_init_static(&ring->lock);
+        mutex_lock(&writer_lock);
+        rings[slot] = ring;
+        mutex_unlock(&writer_lock);
+    }
+
+    need = RECORD_SIZE(len);
+    if (need > ring->size / 2)
+        return -1;
+
+    head = ring->head;
+    for (;;) {
+        mutex_lock(&ring->lock);
+        tail = ring->tail;
+        to_end = ring->size - (head & (ring->size - 1));
+        wrap = (to_end < need) ? to_end : 0;
+        if (ring->size - (head - tail) >= need + wrap) {
+            mutex_unlock(&ring->lock);
+            break;
+        }
+        if (!async_enabled) {
+            mutex_unlock(&ring->lock);
+            return -1;
+        }
+        if (async_drop) {
+            ring->dropped++;
+            mutex_unlock(&ring->lock);
+            return 0;
+        }
+        mutex_unlock(&ring->lock);
+        /* make room ourselves rather than wait for the writer */
+        flush_rings();
+    }
+
+    if (wrap) {
+        hdr = (RingHeader *) (ring->buf + (head & (ring->size - 1)));
+        hdr->file = NULL;
+        hdr->len = wrap;
+        head += wrap;
+    }
+    hdr = (RingHeader *) (ring->buf + (head & (ring->size - 1)));
+    hdr->file = file;
+    hdr->len = len;
+    memcpy(hdr + 1, line, len);
+
+    /*
+     * Publish the line, unless logging went synchronous meanwhile: the
+     * last flush of log_set_async() may already have drained the ring.
+     */
+    mutex_lock(&ring->lock);
+    if (!async_enabled) {
+        mutex_unlock(&ring->lock);
+        return -1;
+    }
+    ring->head = head + need;
+    mutex_unlock(&ring->lock);
+
+    /*
+     * No gwthread_wakeup() of the writer here: gwthread logs while it
+     * holds its thread table lock, which gwthread_wakeup() takes too.
+     * A full ring is flushed by its owner, see above.
+     */
+    return 0;
+}
+
+
+int log_async_vprintf(FILE *file, const char *fmt, va_list args)
+{
+    char line[ASYNC_LINE_SIZE];
+    va_list copy;
+    int len;
+
+    if (!async_enabled)
+        return -1;
+
+    va_copy(copy, args);
+    len = vsnprintf(line, sizeof(line), fmt, args);
+    if (len >= 0 && (size_t) len < sizeof(line) &&
+        async_write(file, line, len) == 0) {
+        va_end(copy);
+        return 0;
+    }
+
+    /* too long for the buffer, or not a buffering thread */
+    log_flush();
+    vfprintf(file, fmt, copy);
+    fflush(file);
+    va_end(copy);
+    return 0;
+}
+
+
+void log_timestamp(char *buf, int use_localtime)
+{
+    time_t t;
+    struct tm tm;
+    long slot;
+
+    time(&t);
+    slot = gwthread_self();
+    if (slot >= 0) {
+        slot %= THREADTABLE_SIZE;
+        if (stamps[slot].t == t && stamps[slot].local == use_localtime) {
+            memcpy(buf, stamps[slot].str, LOG_TIMESTAMP_SIZE);
+            return;
+        }
+    }
+
+    tm = use_localtime ? gw_localtime(t) : gw_gmtime(t);
+    sprintf(buf, "%04d-%02d-%02d %02d:%02d:%02d ",
+            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+            tm.tm_hour, tm.tm_min, tm.tm_sec);
+
+    if (slot >= 0) {
+        memcpy(stamps[slot].str, buf, LOG_TIMESTAMP_SIZE);
+        stamps[slot].local = use_localtime;
+        stamps[slot].t = t;
+    }
+}
+
+
 void log_set_output_level(enum output_level level)
 {
     int i;
@@ -267,6 +596,9 @@ void log_reopen(void)
      */
     gw_rwlock_wrlock(&rwlock);
 
+    /* nobody can log now, write out what is buffered for the old files */
+    log_flush();
+
     for (i = 0; i < num_logfiles; ++i) {
         if (logfiles[i].file != stderr) {
             found = 0;
@@ -309,6 +641,8 @@ void log_close_all(void)
      */
     gw_rwlock_wrlock(&rwlock);
 
+    log_flush();
+
     while (num_logfiles > 0) {
         --num_logfiles;
         if (logfiles[num_logfiles].file != stderr && logfiles[num_logfiles].file != NULL) {
@@ -403,24 +737,17 @@ static void format(char *buf, int level, const char *place, int e,
         "LOG: "
     };
     static int tab_size = sizeof(tab) / sizeof(tab[0]);
-    time_t t;
-    struct tm tm;
     char *p, prefix[1024];
     long tid, pid;
     
     p = prefix;
 
     if (with_timestamp_and_pid) {
-        time(&t);
 #if LOG_TIMESTAMP_LOCALTIME
-        tm = gw_localtime(t);
+        log_timestamp(p, 1);
 #else
-        tm = gw_gmtime(t);
+        log_timestamp(p, 0);
 #endif
-        sprintf(p, "%04d-%02d-%02d %02d:%02d:%02d ",
-        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
-        tm.tm_hour, tm.tm_min, tm.tm_sec);
-
         p = strchr(p, '\0');
 
         /* print PID and thread ID */
@@ -457,6 +784,8 @@ static void format(char *buf, int level, const char *place, int e,
 
 static void PRINTFLIKE(2,0) output(FILE *f, char *buf, va_list args) 
 {
+    if (log_async_vprintf(f, buf, args) == 0)
+        return;
     vfprintf(f, buf, args);
     fflush(f);
 }
@@ -593,6 +922,13 @@ void gw_backtrace(void **stack_frames, size_t size, int lock)
 
 void gw_panic(int err, const char *fmt, ...)
 {
+    /*
+     * Write out what is buffered, and the panic and backtrace
+     * directly after it.
+     */
+    async_enabled = 0;
+    log_flush();
+
     /*
      * we don't want PANICs to spread accross smsc logs, so
      * this will be always within the main core log.
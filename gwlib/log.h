@@ -64,6 +64,9 @@
 #ifndef GWLOG_H
 #define GWLOG_H
 
+#include <stdio.h>
+#include <stdarg.h>
+
 /* Symbolic levels for output levels. */
 enum output_level {
 	GW_DEBUG, GW_INFO, GW_WARNING, GW_ERROR, GW_PANIC, GW_BACKTRACE
@@ -170,6 +173,37 @@ void log_reopen(void);
  */
 void log_close_all(void);
 
+/*
+ * Switch to asynchronous logging if `buffer_size' is positive, or back
+ * to synchronous logging if it is 0. In asynchronous mode each thread
+ * formats its log lines (and access log lines) into a ring buffer of its
+ * own, of at least `buffer_size' bytes, and a writer thread writes them
+ * out in batches. If a thread's buffer is full, the line is dropped if
+ * `drop_when_full' is true, otherwise the thread writes out the buffered
+ * lines itself.
+ * Panics flush the buffers and switch back to synchronous logging.
+ */
+void log_set_async(long buffer_size, int drop_when_full);
+
+/*
+ * Write out all lines buffered by asynchronous logging.
+ */
+void log_flush(void);
+
+/*
+ * Queue a formatted log line for `file' if asynchronous logging is on
+ * and return 0. Otherwise do nothing and return -1. For accesslog.c.
+ */
+int log_async_vprintf(FILE *file, const char *fmt, va_list args) PRINTFLIKE(2,0);
+
+/*
+ * Put the current time as "YYYY-MM-DD HH:MM:SS " into `buf', which must
+ * have room for LOG_TIMESTAMP_SIZE bytes. The result is cached per second
+ * and thread.
+ */
+#define LOG_TIMESTAMP_SIZE 24
+void log_timestamp(char *buf, int use_localtime);
+
 /* 
  * Register a thread to a specific logfiles[] index and hence 
  * to a specific exclusive log file.
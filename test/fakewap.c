@@ -102,6 +102,12 @@
  *
  * The test terminates when all packets have been sent.
  *
+ * With -S fakewap first opens the given number of sessions (packets A-C,
+ * each from its own socket) and leaves them connected. The timed test then
+ * runs against a gateway holding that many active sessions and the summary
+ * reports packets/second, so gateway scalability can be measured by
+ * repeating the run with a growing session count.
+ *
  * Tid verification uses following protocol (at WTP level only):
  *
  *    A)   Fakewap -> Gateway
@@ -139,9 +145,10 @@
  * v1.4 - parse WSP message and save only the received payload to the output file
  * v1.5 - support for connectionless get/post
  * v1.6 - robustness fixes for Post (resend group segments if no ack), packet loss simulation
+ * v1.7 - idle session load (-S), packets/second report
  */
 static char usage[] = "\
-fakewap version 1.6\n\
+fakewap version 1.7\n\
 Usage: fakewap [options] url ...\n\
 \n\
 where options are:\n\
@@ -169,6 +176,8 @@ where options are:\n\
 -P in-file	Post data from file\n\
 -w out-file	Write received data to file\n\
 -l loss-precent Simulate packet loss\n\
+-S sessions     open this many idle sessions before the test and keep them\n\
+                connected while it runs (default: 0)\n\
 \n\
 The urls are fetched in random order.\n\
 ";
@@ -251,6 +260,8 @@ struct sockaddr_in src_addr;
 int transaction_mode;
 int packet_loss; /* packet loss rate 0-99 */
 Octstr *useragent;
+int idle_sessions;
+Counter *packets;
 
 /*
  * PDU type, version number and transaction class are supplied by a 
@@ -470,6 +481,7 @@ wap_msg_send( int fd, unsigned char* wtp_hdr, int wtp_hdr_len, unsigned short ti
         error(0, "fakewap: Sending to socket failed");
         return -1;
     }
+    counter_increase(packets);
 
     if (brief) {
         if (wsp_hdr!=NULL) {
@@ -586,6 +598,8 @@ wap_msg_recv( int fd, const unsigned char* hdr, int hdr_len,
 	if (ret == 0) {
             octstr_get_many_chars((char*)msg, datagram, 0, octstr_len(datagram));
 		msg_len = octstr_len(datagram);
+            if (!(udp_flags & MSG_PEEK))
+                counter_increase(packets);
 	}
 	octstr_destroy(datagram);
 	octstr_destroy(dummy);
@@ -868,6 +882,44 @@ send_post_exit:
     return ret;
 }
 
+/*
+**  Open a session from each of the given sockets (Connect, ConnectReply,
+**  Ack) and leave it connected. Returns the number of sessions opened.
+*/
+static int open_idle_sessions(int *fds, int num)
+{
+    unsigned char buf[1024];
+    unsigned char reply_hdr[32];
+    int i, ret, opened = 0;
+
+    WSP_Connect[3] = 2 + octstr_len(useragent); /* set header length */
+    memcpy(buf, WSP_Connect, sizeof(WSP_Connect));
+    memcpy(&buf[sizeof(WSP_Connect)], octstr_get_cstr(useragent), octstr_len(useragent));
+    CONSTRUCT_EXPECTED_REPLY_HDR(reply_hdr, WSP_ConnectReply, 1);
+
+    for (i = 0; i < num; i++) {
+        fds[i] = udp_client_socket();
+        if (fds[i] == -1)
+            panic(0, "fakewap: Couldn't create socket.");
+
+        ret = wap_msg_send(fds[i], WTP_Invoke_Cl2, sizeof(WTP_Invoke_Cl2), 1, 0,
+                           buf, sizeof(WSP_Connect) + octstr_len(useragent), NULL, 0);
+        if (ret == -1)
+            panic(0, "fakewap: Send WSP_Connect failed");
+        ret = wap_msg_recv(fds[i], reply_hdr, sizeof(WSP_ConnectReply),
+                           1, NULL, 0, WAP_MSG_RECEIVE_TIMEOUT, 0);
+        if (ret == -1) {
+            error(0, "fakewap: Idle session %d got no WSP_ConnectReply", i);
+            continue;
+        }
+        if (wap_msg_send(fds[i], WTP_Ack, sizeof(WTP_Ack), 1, 0, NULL, 0, NULL, 0) == -1)
+            panic(0, "fakewap: Send WTP_Ack failed");
+        opened++;
+    }
+    return opened;
+}
+
+
 /*
 **  Function (or thread) sets up a dgram socket.  Then it loops: WTL/WSP
 **  Connect, Get a url and Disconnect until all requests are have been done.
@@ -1198,6 +1250,9 @@ int main(int argc, char **argv)
     int i, opt;
     double delta;
     int proto_version, tcl, tid_new;
+    int *idle_fds = NULL, opened = 0;
+    struct timeval run_start, run_end;
+    double run_secs;
 #ifdef SunOS
     struct sigaction alrm;
 
@@ -1238,6 +1293,7 @@ int main(int argc, char **argv)
     src_addr.sin_port = 0;
     transaction_mode = TXN_MODE_CONNECTION_ORIENTED;
     packet_loss = 0;
+    idle_sessions = 0;
 
     /* create default user agent header prepend with a9, and end with 0 */
     const char firstchar[] = {0xa9, 0}; /* code value for user agent header */
@@ -1246,7 +1302,7 @@ int main(int argc, char **argv)
     octstr_append_data(useragent, octstr_get_cstr(temp), octstr_len(temp) );
     octstr_append_data(useragent, "\0", 1 );
 
-    while ((opt = getopt(argc, argv, "Fhc:g:p:m:i:t:V:t:nsd:A:C:D:I:M:P:w:l:")) != EOF)
+    while ((opt = getopt(argc, argv, "Fhc:g:p:m:i:t:V:t:nsd:A:C:D:I:M:P:w:l:S:")) != EOF)
     {
 	switch (opt) {
 	case 'g':
@@ -1357,6 +1413,10 @@ int main(int argc, char **argv)
             }
 	    break;
 
+	case 'S':
+	    idle_sessions = atoi(optarg);
+	    break;
+
 	case '?':
 	default:
 	    error(0, "fakewap: Unknown option %c", opt);
@@ -1365,8 +1425,6 @@ int main(int argc, char **argv)
 	}
     }
 
-    time(&start_time);
-
     if (optind >= argc)
         panic(0, "%s", usage);
 
@@ -1395,8 +1453,19 @@ int main(int argc, char **argv)
     srand((unsigned int) time(NULL));
 
     mutex = (Mutex*)mutex_create();
+    packets = counter_create();
+
+    if (idle_sessions > 0) {
+        idle_fds = gw_malloc(idle_sessions * sizeof(*idle_fds));
+        info(0, "fakewap: opening %d idle sessions", idle_sessions);
+        opened = open_idle_sessions(idle_fds, idle_sessions);
+        info(0, "fakewap: %d idle sessions connected", opened);
+        counter_set(packets, 0);
+    }
 
     info(0, "fakewap: starting");
+    time(&start_time);
+    gettimeofday(&run_start, NULL);
 
     if (threads < 1) threads = 1;
 
@@ -1410,6 +1479,7 @@ int main(int argc, char **argv)
 
     /* Wait for the other sessions to complete */
     gwthread_join_every(client_session);
+    gettimeofday(&run_end, NULL);
 
     info(0, "fakewap: complete.");
     info(0, "fakewap: %d client threads made total %d transactions.", 
@@ -1420,6 +1490,16 @@ int main(int argc, char **argv)
     info( 0, "fakewap: time of best, worst and average transaction: "
              "%.1f s, %.1f s, %.1f s",
          besttime, worsttime, totaltime / num_sent );
+    run_secs = (run_end.tv_sec - run_start.tv_sec) +
+               (run_end.tv_usec - run_start.tv_usec) / 1e6;
+    info(0, "fakewap: %lu packets, %.1f packets/second with %d idle sessions",
+         counter_value(packets), counter_value(packets) / run_secs, opened);
+
+    for (i = 0; i < idle_sessions; i++)
+        if (idle_fds[i] != -1)
+            close(idle_fds[i]);
+    gw_free(idle_fds);
+    counter_destroy(packets);
 
     octstr_destroy(hostname);
     octstr_destroy(gateway_addr);
@@ -0,0 +1,322 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_charset_convert.c - benchmark charset_convert() and charset_convert_to()
+ *
+ * First checks that random input, including invalid multibyte sequences,
+ * converts the same as with the previous implementation that opened an
+ * iconv descriptor for every call, which is kept below for reference.
+ * Then converts a SMS sized text count times between Latin-1, UTF-8 and
+ * UCS-2 in the given number of threads with the reference, with
+ * charset_convert() and with charset_convert_to() into a reused octet
+ * string, and reports conversions per second.
+ */
+
+#include <errno.h>
+#include <iconv.h>
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+
+static long count = 10000;
+
+/*
+ * The reference implementation, as it was before descriptors were reused.
+ */
+static int old_charset_convert(Octstr* string, char* charset_from, char* charset_to)
+{
+#if HAVE_ICONV
+    char *from_buf, *to_buf, *pointer;
+    size_t inbytesleft, outbytesleft, ret;
+    iconv_t cd;
+     
+    if (!charset_from || !charset_to || !string) /* sanity check */
+        return -1;
+
+    if (octstr_len(string) < 1 || strcasecmp(charset_from, charset_to) == 0)
+        return 0; /* we are done, nothing to convert */
+        
+    cd = iconv_open(charset_to, charset_from);
+    /* Did I succeed in getting a conversion descriptor ? */
+    if (cd == (iconv_t)(-1)) {
+        /* I guess not */
+        error(0,"Failed to convert string from <%s> to <%s> - probably broken type names.", 
+              charset_from, charset_to);
+        return -1; 
+    }
+    
+    from_buf = octstr_get_cstr(string);
+    inbytesleft = octstr_len(string);
+    /* allocate max sized buffer, assuming target encoding may be 4 byte unicode */
+    outbytesleft = inbytesleft * 4;
+    pointer = to_buf = gw_malloc(outbytesleft);
+
+    do {
+        ret = iconv(cd, (ICONV_CONST char**) &from_buf, &inbytesleft, &pointer, &outbytesleft);
+        if(ret == -1) {
+            long tmp;
+            /* the conversion failed somewhere */
+            switch(errno) {
+            case E2BIG: /* no space in output buffer */
+                debug("charset", 0, "outbuf to small, realloc.");
+                tmp = pointer - to_buf;
+                to_buf = gw_realloc(to_buf, tmp + inbytesleft * 4);
+                outbytesleft += inbytesleft * 4;
+                pointer = to_buf + tmp;
+                ret = 0;
+                break;
+            case EILSEQ: /* invalid multibyte sequence */
+            case EINVAL: /* incomplete multibyte sequence */
+                warning(0, "Invalid/Incomplete multibyte sequence at position %d, skeep it.",
+                        (int)(from_buf - octstr_get_cstr(string)));
+                /* skeep char and try next */
+                if (outbytesleft == 0) {
+                    /* buffer to small */
+                    tmp = pointer - to_buf;
+                    to_buf = gw_realloc(to_buf, tmp + inbytesleft * 4);
+                    outbytesleft += inbytesleft * 4;
+                    pointer = to_buf + tmp;
+                }
+                pointer[0] = from_buf[0];
+                pointer++;
+                from_buf++;
+                inbytesleft--;
+                outbytesleft--;
+                ret = 0;
+                break;
+            }
+        }
+    } while(inbytesleft && ret == 0); /* stop if error occurs and not handled above */
+    
+    iconv_close(cd);
+    
+    if (ret != -1) {
+        /* conversion succeeded */
+        octstr_truncate(string, 0);
+        octstr_append_data(string, to_buf, pointer - to_buf);
+        if (ret)
+            debug("charset", 0, "charset_convert did %ld non-reversible conversions", (long) ret);
+        ret = 0;
+    } else
+        error(errno,"Failed to convert string from <%s> to <%s>.", charset_from, charset_to);
+
+    if (errno == EILSEQ) {
+        debug("charset_convert", 0, "Found an invalid multibyte sequence at position <%d>",
+              (int)(from_buf - octstr_get_cstr(string)));
+    }
+    gw_free(to_buf);
+    return ret;
+#endif
+    /* no convertion done due to not having iconv */
+    return -1;
+}
+
+static struct {
+    char *from;
+    char *to;
+} pairs[] = {
+    { "ISO-8859-1", "UTF-8" },
+    { "UTF-8", "UCS-2BE" },
+    { "UTF-8", "ISO-8859-1" },
+    { "UCS-2BE", "UTF-8" },
+    { "WINDOWS-1252", "UTF-8" },
+    { "UTF-8", "ISO-8859-15" },
+};
+
+#define NUM_PAIRS ((int) (sizeof(pairs) / sizeof(pairs[0])))
+
+static Octstr *texts[NUM_PAIRS];
+static int method;
+
+static const char *methods[] = { "iconv_open per call", "charset_convert", "charset_convert_to" };
+
+static void help(void)
+{
+    info(0, "Usage: test_charset_convert [options] [count]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-t threads");
+    info(0, "    number of converting threads (default 1)");
+}
+
+static void check_random(long n)
+{
+    static const char *pieces[] = {
+        "a", " ", "Z", "\xc3\xa9", "\xe2\x82\xac", "\xd0\x96", "\xe4\xb8\xad",
+        "\xc3", "\xe2\x82", "\x80", "\xff", "\x00", "hello world"
+    };
+    Octstr *a, *b, *c;
+    long i, j, len;
+    int k;
+
+    c = octstr_create("");
+    for (i = 0; i < n; i++) {
+        a = octstr_create("");
+        len = gw_rand() % 64;
+        for (j = 0; j < len; j++) {
+            k = gw_rand() % (sizeof(pieces) / sizeof(pieces[0]));
+            octstr_append_data(a, pieces[k], k == 11 ? 1 : strlen(pieces[k]));
+        }
+        k = gw_rand() % NUM_PAIRS;
+        b = octstr_duplicate(a);
+
+        if (old_charset_convert(a, pairs[k].from, pairs[k].to) !=
+            charset_convert_to(b, c, pairs[k].from, pairs[k].to))
+            panic(0, "Conversion from %s to %s returns differently.", pairs[k].from, pairs[k].to);
+        if (charset_convert(b, pairs[k].from, pairs[k].to) != 0 && octstr_len(b) > 0)
+            panic(0, "Conversion from %s to %s failed.", pairs[k].from, pairs[k].to);
+        if (octstr_compare(a, b) != 0 || octstr_compare(a, c) != 0)
+            panic(0, "Conversion from %s to %s differs.", pairs[k].from, pairs[k].to);
+
+        octstr_destroy(a);
+        octstr_destroy(b);
+    }
+    octstr_destroy(c);
+}
+
+static void convert_thread(void *arg)
+{
+    Octstr *os, *out;
+    long i;
+    int k;
+
+    out = octstr_create("");
+    for (i = 0; i < count; i++) {
+        k = i % NUM_PAIRS;
+        switch (method) {
+        case 0:
+            os = octstr_duplicate(texts[k]);
+            old_charset_convert(os, pairs[k].from, pairs[k].to);
+            octstr_destroy(os);
+            break;
+        case 1:
+            os = octstr_duplicate(texts[k]);
+            charset_convert(os, pairs[k].from, pairs[k].to);
+            octstr_destroy(os);
+            break;
+        default:
+            charset_convert_to(texts[k], out, pairs[k].from, pairs[k].to);
+        }
+    }
+    octstr_destroy(out);
+}
+
+int main(int argc, char **argv)
+{
+    struct timeval start, end;
+    long threads = 1, i, *ids;
+    double t;
+    int opt, k;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:t:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case 't':
+                threads = atol(optarg);
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    if (optind < argc)
+        count = atol(argv[optind]);
+
+    /* the conversions complain about broken input a lot */
+    log_set_output_level(GW_ERROR);
+    check_random(count);
+    log_set_output_level(GW_INFO);
+    info(0, "Random input converts the same with both implementations.");
+
+    /* a SMS worth of text in each source character set */
+    for (k = 0; k < NUM_PAIRS; k++) {
+        texts[k] = octstr_create("Gr\xc3\xbc\xc3\x9f\x65 aus K\xc3\xb6ln, 5 \xc2\xa3 f\xc3\xbcr den Kaffee. ");
+        while (octstr_len(texts[k]) < 140)
+            octstr_append(texts[k], octstr_imm("Text message. "));
+        charset_convert(texts[k], "UTF-8", pairs[k].from);
+    }
+
+    ids = gw_malloc(threads * sizeof(*ids));
+    for (method = 0; method < 3; method++) {
+        gettimeofday(&start, NULL);
+        for (i = 0; i < threads; i++)
+            ids[i] = gwthread_create(convert_thread, NULL);
+        for (i = 0; i < threads; i++)
+            gwthread_join(ids[i]);
+        gettimeofday(&end, NULL);
+        t = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+        info(0, "%-20s %ld threads: %10.0f conversions/s", methods[method],
+             threads, t > 0 ? threads * count / t : 0.0);
+    }
+    gw_free(ids);
+
+    for (k = 0; k < NUM_PAIRS; k++)
+        octstr_destroy(texts[k]);
+
+    gwlib_shutdown();
+    return 0;
+}
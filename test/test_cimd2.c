@@ -142,6 +142,19 @@ int max_deliveries = -1;
 int deliveries = 0;
 time_t start_time = 0;
 
+/* Milliseconds to hold back submit responses, to simulate a distant SMSC */
+int latency = 0;
+long submits = 0;
+double first_submit = 0;
+double last_submit = 0;
+
+/* Submit responses waiting for their latency to pass, oldest first */
+struct delayed_response {
+	double due;
+	Octstr *packet;
+};
+List *delayed_responses;
+
 int sockfd = -1;
 
 Octstr *inbuffer;
@@ -193,9 +206,75 @@ static void usage(FILE *out) {
 "      CHK = 3     signal protocol errors (NI)\n"
 "      CHK = 4     signal invalid SMS contents (NI)\n"
 "  --max MAX       With high activity values, stop after MAX deliveries\n"
+"  --latency MS    Answer submits only after MS milliseconds (default %d)\n"
+"                  The rate of received submits is logged every second\n"
 " NI means Not Implemented\n"
 	, progname, username, password, port,
-	activity, spew, logging, checking);
+	activity, spew, logging, checking, latency);
+}
+
+static double now_seconds(void) {
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report_submits(void) {
+	if (submits > 1 && last_submit > first_submit) {
+		info(0, "Received %ld submits in %.2f seconds, %.1f msgs/sec",
+			submits, last_submit - first_submit,
+			(submits - 1) / (last_submit - first_submit));
+	}
+}
+
+/* Count a submit, and log the rate about once a second while
+ * submits arrive. */
+static void count_submit(void) {
+	static double period_start = 0;
+	static long period_submits = 0;
+	double now = now_seconds();
+
+	if (submits++ == 0)
+		first_submit = period_start = now;
+	else
+		period_submits++;
+	last_submit = now;
+
+	if (now - period_start >= 1.0) {
+		info(0, "%ld submits received, %.1f msgs/sec",
+			submits, period_submits / (now - period_start));
+		period_start = now;
+		period_submits = 0;
+	}
+}
+
+static void delay_response(Octstr *packet) {
+	struct delayed_response *delayed;
+
+	delayed = gw_malloc(sizeof(*delayed));
+	delayed->due = now_seconds() + latency / 1000.0;
+	delayed->packet = packet;
+	gwlist_append(delayed_responses, delayed);
+}
+
+/* Move the responses that are due to the output buffer.  Return the
+ * number of microseconds until the next one is due, or -1 if there
+ * is none. */
+static long flush_delayed_responses(Octstr *out) {
+	struct delayed_response *delayed;
+	double now = now_seconds();
+
+	while (gwlist_len(delayed_responses) > 0) {
+		delayed = gwlist_get(delayed_responses, 0);
+		if (delayed->due > now)
+			return (long) ((delayed->due - now) * 1000000) + 1;
+		gwlist_delete(delayed_responses, 0, 1);
+		octstr_append(out, delayed->packet);
+		octstr_destroy(delayed->packet);
+		gw_free(delayed);
+	}
+	return -1;
 }
 
 static void pretty_print(unsigned char *data, size_t length) {
@@ -232,6 +311,7 @@ static void read_data(Octstr *in, int fd) {
 			pretty_print(buf, ret);
 	} else if (ret == 0) {
 		fprintf(stderr, "Client closed socket\n");
+		report_submits();
 		exit(0);
 	} else {
 		if (errno == EINTR || errno == EAGAIN)
@@ -501,6 +581,8 @@ static void handle_submit(Octstr *packet, Octstr *out, int sequence) {
 	while ((tmp = eat_string_parm(packet, 21, 20)))
 		gwlist_append(other_dests, tmp);
 
+	count_submit();
+
 	if (logging == LOG_packets) {
 		int i;
 		printf("RCV: Submit to %s", octstr_get_cstr(dest_addr));
@@ -565,14 +647,17 @@ static void handle_submit(Octstr *packet, Octstr *out, int sequence) {
 	/* TODO: Report many other possible errors here */
 	} else {
 		unsigned char buf[TIMESTAMP_MAXLEN];
+		Octstr *response = latency > 0 ? octstr_create("") : out;
 
 		make_timestamp(buf, time(NULL));
 		if (logging == LOG_packets)
 			printf("SND: Submit OK\n");
-		send_packet(out, 53, sequence,
+		send_packet(response, 53, sequence,
 		            21, octstr_get_cstr(dest_addr),
 			    60, buf,
 			    0);
+		if (response != out)
+			delay_response(response);
 	}
 
 	octstr_destroy(dest_addr);
@@ -937,9 +1022,12 @@ static void main_loop(void) {
 	int n;
 	static int reported_outfull = 0;
 	int interval = -1;
+	long delay;
+	struct timeval tv;
 
 	inbuffer = octstr_create("");
 	outbuffer = octstr_create(intro);
+	delayed_responses = gwlist_create();
 	start_time = time(NULL);
 
 	for (;;) {
@@ -949,6 +1037,7 @@ static void main_loop(void) {
 			warning(0, "outbuffer getting full; waiting...");
 			reported_outfull = 1;
 		}
+		delay = flush_delayed_responses(outbuffer);
 
 		FD_ZERO(&readfds);
 		FD_SET(sockfd, &readfds);
@@ -956,14 +1045,20 @@ static void main_loop(void) {
 		if (octstr_len(outbuffer) > 0) {
 			FD_ZERO(&writefds);
 			FD_SET(sockfd, &writefds);
-			n = select(sockfd+1, &readfds, &writefds, NULL, NULL);
+			if (delay >= 0) {
+				tv.tv_sec = delay / 1000000;
+				tv.tv_usec = delay % 1000000;
+			}
+			n = select(sockfd+1, &readfds, &writefds, NULL,
+			           delay >= 0 ? &tv : NULL);
 		} else {
-			struct timeval tv;
 			struct timeval *tvp;
 
+			if (delay >= 0 && (interval < 0 || delay < interval))
+				interval = delay;
 			if (interval >= 0) {
-				tv.tv_sec = 0;
-				tv.tv_usec = interval;
+				tv.tv_sec = interval / 1000000;
+				tv.tv_usec = interval % 1000000;
 				tvp = &tv;
 			} else {
 				tvp = NULL;
@@ -1010,6 +1105,7 @@ static struct {
 	{ "--logging", &logging, 1 },
 	{ "--checking", &checking, 1 },
 	{ "--max", &max_deliveries, 1 },
+	{ "--latency", &latency, 1 },
 	{ NULL, NULL, 0 },
 };
 
@@ -0,0 +1,303 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * test_dlr_mem.c - check and benchmark the internal DLR storage
+ *
+ * Adds, finds and removes a given number of DLR entries via the
+ * storage handles of gw/dlr_mem.c and panics if an entry goes missing,
+ * comes back wrong or is left behind. Sizes default to 10k and 100k
+ * entries. With -b it then reports the add, find and remove rates per
+ * second, for 10k, 1M and 10M entries by default.
+ */
+
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/dlr_p.h"
+
+#define SMSC_COUNT 16
+
+static void help(void)
+{
+    info(0, "Usage: test_dlr_mem [options] [entries ...]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-s number");
+    info(0, "    number of distinct smsc-ids the entries are spread over (default: %d)",
+         SMSC_COUNT);
+    info(0, "-c filename");
+    info(0, "    read dlr-ttl and dlr-memory-limit settings from given config file");
+    info(0, "-b");
+    info(0, "    benchmark the storage with the given numbers of entries");
+}
+
+static long smsc_count = SMSC_COUNT;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char *what, long count, double t)
+{
+    info(0, "%-8s %10ld entries in %8.3f seconds, %12.0f ops/s.",
+         what, count, t, t > 0 ? count / t : 0.0);
+}
+
+static void run_test(struct dlr_storage *handles, long count)
+{
+    struct dlr_entry *dlr;
+    Octstr **smsc, *ts, *dst;
+    long i;
+
+    smsc = gw_malloc(sizeof(smsc[0]) * smsc_count);
+    for (i = 0; i < smsc_count; i++)
+        smsc[i] = octstr_format("smsc-%ld", i);
+
+    for (i = 0; i < count; i++) {
+        dlr = dlr_entry_create();
+        dlr->smsc = octstr_duplicate(smsc[i % smsc_count]);
+        dlr->timestamp = octstr_format("%08lx", i);
+        dlr->source = octstr_create("12345");
+        dlr->destination = octstr_format("+49170%07ld", i);
+        dlr->service = octstr_create("test");
+        dlr->url = octstr_create("http://localhost/dlr?id=%d");
+        dlr->boxc_id = octstr_create("");
+        dlr->mask = 31;
+        handles->dlr_add(dlr);
+    }
+
+    if (handles->dlr_messages() != count)
+        panic(0, "Storage holds %ld entries, expected %ld.", handles->dlr_messages(), count);
+
+    for (i = 0; i < count; i++) {
+        ts = octstr_format("%08lx", i);
+        dst = octstr_format("+49170%07ld", i);
+        dlr = handles->dlr_get(smsc[i % smsc_count], ts, dst);
+        if (dlr == NULL)
+            panic(0, "Entry %ld not found.", i);
+        if (octstr_compare(dlr->destination, dst) != 0 || dlr->mask != 31)
+            panic(0, "Entry %ld found with destination <%s> and mask %ld.",
+                  i, octstr_get_cstr(dlr->destination), dlr->mask);
+        dlr_entry_destroy(dlr);
+
+        /* the same timestamp under another smsc-id is a different entry */
+        if (smsc_count > 1) {
+            dlr = handles->dlr_get(smsc[(i + 1) % smsc_count], ts, dst);
+            if (dlr != NULL)
+                panic(0, "Entry %ld found under the wrong smsc-id.", i);
+        }
+        octstr_destroy(ts);
+        octstr_destroy(dst);
+    }
+
+    for (i = 0; i < count; i++) {
+        ts = octstr_format("%08lx", i);
+        dst = octstr_format("+49170%07ld", i);
+        handles->dlr_remove(smsc[i % smsc_count], ts, dst);
+        dlr = handles->dlr_get(smsc[i % smsc_count], ts, dst);
+        if (dlr != NULL)
+            panic(0, "Entry %ld still found after remove.", i);
+        octstr_destroy(ts);
+        octstr_destroy(dst);
+    }
+
+    if (handles->dlr_messages() != 0)
+        panic(0, "Storage holds %ld entries after remove, expected 0.", handles->dlr_messages());
+
+    info(0, "%ld entries added, found and removed.", count);
+
+    for (i = 0; i < smsc_count; i++)
+        octstr_destroy(smsc[i]);
+    gw_free(smsc);
+}
+
+static void benchmark(struct dlr_storage *handles, long count)
+{
+    struct dlr_entry *dlr;
+    Octstr **smsc, *ts, *dst;
+    double t;
+    long i, found;
+
+    smsc = gw_malloc(sizeof(smsc[0]) * smsc_count);
+    for (i = 0; i < smsc_count; i++)
+        smsc[i] = octstr_format("smsc-%ld", i);
+
+    info(0, "Running with %ld entries:", count);
+
+    t = now();
+    for (i = 0; i < count; i++) {
+        dlr = dlr_entry_create();
+        dlr->smsc = octstr_duplicate(smsc[i % smsc_count]);
+        dlr->timestamp = octstr_format("%08lx", i);
+        dlr->source = octstr_create("12345");
+        dlr->destination = octstr_format("+49170%07ld", i);
+        dlr->service = octstr_create("bench");
+        dlr->url = octstr_create("http://localhost/dlr?id=%d");
+        dlr->boxc_id = octstr_create("");
+        dlr->mask = 31;
+        handles->dlr_add(dlr);
+    }
+    report("add", count, now() - t);
+
+    if (handles->dlr_messages() != count)
+        panic(0, "Storage holds %ld entries, expected %ld.", handles->dlr_messages(), count);
+
+    found = 0;
+    t = now();
+    for (i = 0; i < count; i++) {
+        ts = octstr_format("%08lx", i);
+        dst = octstr_format("%07ld", i);
+        if ((dlr = handles->dlr_get(smsc[i % smsc_count], ts, dst)) != NULL) {
+            found++;
+            dlr_entry_destroy(dlr);
+        }
+        octstr_destroy(ts);
+        octstr_destroy(dst);
+    }
+    report("find", count, now() - t);
+
+    if (found != count)
+        panic(0, "Found %ld entries, expected %ld.", found, count);
+
+    t = now();
+    for (i = 0; i < count; i++) {
+        ts = octstr_format("%08lx", i);
+        dst = octstr_format("%07ld", i);
+        handles->dlr_remove(smsc[i % smsc_count], ts, dst);
+        octstr_destroy(ts);
+        octstr_destroy(dst);
+    }
+    report("remove", count, now() - t);
+
+    if (handles->dlr_messages() != 0)
+        panic(0, "Storage holds %ld entries after remove, expected 0.", handles->dlr_messages());
+
+    for (i = 0; i < smsc_count; i++)
+        octstr_destroy(smsc[i]);
+    gw_free(smsc);
+}
+
+int main(int argc, char **argv)
+{
+    struct dlr_storage *handles;
+    Cfg *cfg = NULL;
+    int opt, i, bench = 0;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:s:c:b")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case 's':
+                smsc_count = atol(optarg);
+                if (smsc_count < 1)
+                    smsc_count = 1;
+                break;
+
+            case 'c':
+                cfg = cfg_create(octstr_imm(optarg));
+                if (cfg_read(cfg) == -1)
+                    panic(0, "Couldn't read configuration from `%s'.", optarg);
+                break;
+
+            case 'b':
+                bench = 1;
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    handles = dlr_init_mem(cfg);
+
+    if (optind == argc) {
+        run_test(handles, 10000);
+        run_test(handles, 100000);
+    } else {
+        for (i = optind; i < argc; i++)
+            run_test(handles, atol(argv[i]));
+    }
+
+    if (bench && optind == argc) {
+        benchmark(handles, 10000);
+        benchmark(handles, 1000000);
+        benchmark(handles, 10000000);
+    } else if (bench) {
+        for (i = optind; i < argc; i++)
+            benchmark(handles, atol(argv[i]));
+    }
+
+    handles->dlr_shutdown();
+    cfg_destroy(cfg);
+
+    gwlib_shutdown();
+
+    return 0;
+}
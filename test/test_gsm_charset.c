@@ -0,0 +1,479 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_gsm_charset.c - check and benchmark the GSM 03.38 <-> UTF-8 conversions
+ *
+ * Converts a given number of random inputs, including broken UTF-8 and
+ * octets beyond GSM, with charset_gsm_to_utf8() and charset_utf8_to_gsm()
+ * and with the previous octet by octet implementation kept below for
+ * reference, and panics unless both give the same result. ASCII,
+ * Latin-1/escape heavy and Greek texts of SMS size and of 16 kB also
+ * have to convert to GSM and back unchanged. With -b these texts are
+ * then converted count times (count / 10 for 16 kB) with both
+ * implementations and MB/s of input are reported. Count defaults to 10000.
+ */
+
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+
+/* Code used for non-representable characters */
+#define NRP '?'
+
+#include "gwlib/latin1_to_gsm.h"
+
+/*
+ * The reference implementation, as it was before the table driven one.
+ */
+static const struct {
+    int gsmesc;
+    int unichar;
+} gsm_esctouni[] = {
+    { 10, 12 }, /* ASCII page break */
+    { 20, '^' },
+    { 40, '{' },
+    { 41, '}' },
+    { 47, '\\' },
+    { 60, '[' },
+    { 61, '~' },
+    { 62, ']' },
+    { 64, '|' },
+    { 'e', 0x20AC },  /* euro symbol */
+    { -1, -1 }
+};
+
+
+static const int gsm_to_unicode[128] = {
+      '@',  0xA3,   '$',  0xA5,  0xE8,  0xE9,  0xF9,  0xEC,   /* 0 - 7 */
+     0xF2,  0xC7,    10,  0xd8,  0xF8,    13,  0xC5,  0xE5,   /* 8 - 15 */
+    0x394,   '_', 0x3A6, 0x393, 0x39B, 0x3A9, 0x3A0, 0x3A8,   /* 16 - 23 */
+    0x3A3, 0x398, 0x39E,   NRP,  0xC6,  0xE6,  0xDF,  0xC9,   /* 24 - 31 */
+      ' ',   '!',   '"',   '#',  0xA4,   '%',   '&',  '\'',   /* 32 - 39 */
+      '(',   ')',   '*',   '+',   ',',   '-',   '.',   '/',   /* 40 - 47 */
+      '0',   '1',   '2',   '3',   '4',   '5',   '6',   '7',   /* 48 - 55 */
+      '8',   '9',   ':',   ';',   '<',   '=',   '>',   '?',   /* 56 - 63 */
+      0xA1,  'A',   'B',   'C',   'D',   'E',   'F',   'G',   /* 64 - 71 */
+      'H',   'I',   'J',   'K',   'L',   'M',   'N',   'O',   /* 73 - 79 */
+      'P',   'Q',   'R',   'S',   'T',   'U',   'V',   'W',   /* 80 - 87 */
+      'X',   'Y',   'Z',  0xC4,  0xD6,  0xD1,  0xDC,  0xA7,   /* 88 - 95 */
+     0xBF,   'a',   'b',   'c',   'd',   'e',   'f',   'g',   /* 96 - 103 */
+      'h',   'i',   'j',   'k',   'l',   'm',   'n',   'o',   /* 104 - 111 */
+      'p',   'q',   'r',   's',   't',   'u',   'v',   'w',   /* 112 - 119 */
+      'x',   'y',   'z',  0xE4,  0xF6,  0xF1,  0xFC,  0xE0    /* 120 - 127 */
+};
+
+
+static void old_gsm_to_utf8(Octstr *ostr)
+{
+    long pos, len;
+    Octstr *newostr;
+
+    if (ostr == NULL)
+        return;
+
+    newostr = octstr_create("");
+    len = octstr_len(ostr);
+    
+    for (pos = 0; pos < len; pos++) {
+        int c, i;
+        
+        c = octstr_get_char(ostr, pos);
+        if (c > 127) {
+            warning(0, "Could not convert GSM (0x%02x) to Unicode.", c);
+            continue;
+        }
+        
+        if(c == 27 && pos + 1 < len) {
+            c = octstr_get_char(ostr, ++pos);
+            for (i = 0; gsm_esctouni[i].gsmesc >= 0; i++) {
+                if (gsm_esctouni[i].gsmesc == c)
+                    break;
+            }   
+            if (gsm_esctouni[i].gsmesc == c) {
+                /* found a value for escaped char */
+                c = gsm_esctouni[i].unichar;
+            } else {
+	        /* nothing found, look esc in our table */
+		c = gsm_to_unicode[27];
+                pos--;
+	    }
+        } else if (c < 128) {
+            c = gsm_to_unicode[c];
+        }
+        /* unicode to utf-8 */
+        if(c < 128) {
+            /* 0-127 are ASCII chars that need no conversion */
+            octstr_append_char(newostr, c);
+        } else { 
+            /* test if it can be converterd into a two byte char */
+            if(c < 0x0800) {
+                octstr_append_char(newostr, ((c >> 6) | 0xC0) & 0xFF); /* add 110xxxxx */
+                octstr_append_char(newostr, (c & 0x3F) | 0x80); /* add 10xxxxxx */
+            } else {
+                /* else we encode with 3 bytes. This only happens in case of euro symbol */
+                octstr_append_char(newostr, ((c >> 12) | 0xE0) & 0xFF); /* add 1110xxxx */
+                octstr_append_char(newostr, (((c >> 6) & 0x3F) | 0x80) & 0xFF); /* add 10xxxxxx */
+                octstr_append_char(newostr, ((c  & 0x3F) | 0x80) & 0xFF); /* add 10xxxxxx */
+            }
+            /* There are no 4 bytes encoded characters in GSM charset */
+        }
+    }
+
+    octstr_truncate(ostr, 0);
+    octstr_append(ostr, newostr);
+    octstr_destroy(newostr);
+}
+
+static void old_utf8_to_gsm(Octstr *ostr)
+{
+    long pos, len;
+    int val1, val2;
+    Octstr *newostr;
+
+    if (ostr == NULL)
+        return;
+    
+    newostr = octstr_create("");
+    len = octstr_len(ostr);
+    
+    for (pos = 0; pos < len; pos++) {
+        val1 = octstr_get_char(ostr, pos);
+        
+        /* check range */
+        if (val1 < 0 || val1 > 255) {
+            warning(0, "Char (0x%02x) in UTF-8 string not in the range (0, 255). Skipped.", val1);
+            continue;
+        }
+        
+        /* Convert UTF-8 to unicode code */
+        
+        /* test if two byte utf8 char */
+        if ((val1 & 0xE0) == 0xC0) {
+            /* test if incomplete utf char */
+            if(pos + 1 < len) {
+                val2 = octstr_get_char(ostr, ++pos);
+                val1 = (((val1 & ~0xC0) << 6) | (val2 & 0x3F));
+            } else {
+                /* incomplete, ignore it */
+                warning(0, "Incomplete UTF-8 char discovered, skipped. 1");
+                pos += 1;
+                continue;
+            }
+        } else if ((val1 & 0xF0) == 0xE0) { /* test for three byte utf8 char */
+            if(pos + 2 < len) {
+                val2 = octstr_get_char(ostr, ++pos);
+                val1 = (((val1 & ~0xE0) << 6) | (val2 & 0x3F));
+                val2 = octstr_get_char(ostr, ++pos);
+                val1 = (val1 << 6) | (val2 & 0x3F);
+            } else {
+                /* incomplete, ignore it */
+                warning(0, "Incomplete UTF-8 char discovered, skipped. 2");
+                pos += 2;
+                continue;
+            }
+        }
+
+        /* test Latin code page 1 char */
+        if(val1 <= 255) {
+            val1 = latin1_to_gsm[val1];
+            /* needs to be escaped ? */
+            if(val1 < 0) {
+                octstr_append_char(newostr, 27);
+                val1 *= -1;
+            }
+        } else {
+            /* Its not a Latin1 char, test for allowed GSM chars */
+            switch(val1) {
+            case 0x394:
+                val1 = 0x10; /* GREEK CAPITAL LETTER DELTA */
+                break;
+            case 0x3A6:
+                val1 = 0x12; /* GREEK CAPITAL LETTER PHI */
+                break;
+            case 0x393:
+                val1 = 0x13; /* GREEK CAPITAL LETTER GAMMA */
+                break;
+            case 0x39B:
+                val1 = 0x14; /* GREEK CAPITAL LETTER LAMBDA */
+                break;
+            case 0x3A9:
+                val1 = 0x15; /* GREEK CAPITAL LETTER OMEGA */
+                break;
+            case 0x3A0:
+                val1 = 0x16; /* GREEK CAPITAL LETTER PI */
+                break;
+            case 0x3A8:
+                val1 = 0x17; /* GREEK CAPITAL LETTER PSI */
+                break;
+            case 0x3A3:
+                val1 = 0x18; /* GREEK CAPITAL LETTER SIGMA */
+                break;
+            case 0x398:
+                val1 = 0x19; /* GREEK CAPITAL LETTER THETA */
+                break;
+            case 0x39E:
+                val1 = 0x1A; /* GREEK CAPITAL LETTER XI */
+                break;
+            case 0x20AC:
+                val1 = 'e'; /* EURO SIGN */
+                octstr_append_char(newostr, 27);
+                break;
+            default: val1 = NRP; /* character cannot be represented in GSM 03.38 */
+            }
+        }
+        octstr_append_char(newostr, val1);
+    }
+
+    octstr_truncate(ostr, 0);
+    octstr_append(ostr, newostr);
+    octstr_destroy(newostr);
+}
+
+
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void help(void)
+{
+    info(0, "Usage: test_gsm_charset [options] [count]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-b");
+    info(0, "    compare the conversion speed with the old implementation");
+}
+
+static void check_random(long count)
+{
+    static const char *pieces[] = {
+        "a", "Z", " ", "@", "$", "_", "[", "]", "{", "}", "^", "\\", "|", "~",
+        "\x0c", "\r", "\n", "\x1b", "\x7f", "\x80", "\xff", "\xc3", "\xe2\x82",
+        "\xc3\xa9", "\xc2\xa3", "\xce\x94", "\xd0\x96", "\xe2\x82\xac",
+        "\xe4\xb8\xad", "abcdefgh", "\x1b" "e", "\x1b" "(", "\x1b\x1b"
+    };
+    Octstr *a, *b, *c, *d;
+    long i, j, n;
+
+    for (i = 0; i < count; i++) {
+        a = octstr_create("");
+        n = gw_rand() % 64;
+        for (j = 0; j < n; j++)
+            octstr_append_cstr(a, pieces[gw_rand() % (sizeof(pieces) / sizeof(pieces[0]))]);
+        b = octstr_duplicate(a);
+        c = octstr_duplicate(a);
+        d = octstr_duplicate(a);
+
+        old_utf8_to_gsm(a);
+        charset_utf8_to_gsm(b);
+        if (octstr_compare(a, b) != 0)
+            panic(0, "UTF-8 to GSM conversion differs.");
+        old_gsm_to_utf8(c);
+        charset_gsm_to_utf8(d);
+        if (octstr_compare(c, d) != 0)
+            panic(0, "GSM to UTF-8 conversion differs.");
+
+        octstr_destroy(a);
+        octstr_destroy(b);
+        octstr_destroy(c);
+        octstr_destroy(d);
+    }
+}
+
+static void check_text(const char *name, Octstr *utf8)
+{
+    Octstr *a, *b;
+
+    a = octstr_duplicate(utf8);
+    b = octstr_duplicate(utf8);
+    old_utf8_to_gsm(a);
+    charset_utf8_to_gsm(b);
+    if (octstr_compare(a, b) != 0)
+        panic(0, "%s: UTF-8 to GSM conversion differs.", name);
+
+    old_gsm_to_utf8(a);
+    charset_gsm_to_utf8(b);
+    if (octstr_compare(a, b) != 0)
+        panic(0, "%s: GSM to UTF-8 conversion differs.", name);
+    if (octstr_compare(b, utf8) != 0)
+        panic(0, "%s: %ld octets don't convert to GSM and back unchanged.",
+              name, octstr_len(utf8));
+
+    octstr_destroy(a);
+    octstr_destroy(b);
+}
+
+static void benchmark(const char *name, Octstr *utf8, long count)
+{
+    void (*u2g[2])(Octstr *) = { old_utf8_to_gsm, charset_utf8_to_gsm };
+    void (*g2u[2])(Octstr *) = { old_gsm_to_utf8, charset_gsm_to_utf8 };
+    static const char *impl[2] = { "octet", "table" };
+    Octstr *gsm, *os;
+    double t;
+    long i;
+    int k;
+
+    gsm = octstr_duplicate(utf8);
+    charset_utf8_to_gsm(gsm);
+
+    for (k = 0; k < 2; k++) {
+        t = now();
+        for (i = 0; i < count; i++) {
+            os = octstr_duplicate(utf8);
+            u2g[k](os);
+            octstr_destroy(os);
+        }
+        t = now() - t;
+        info(0, "%-8s %6ld octets utf8->gsm %s: %8.1f MB/s", name,
+             octstr_len(utf8), impl[k], t > 0 ? octstr_len(utf8) * count / t / 1e6 : 0.0);
+
+        t = now();
+        for (i = 0; i < count; i++) {
+            os = octstr_duplicate(gsm);
+            g2u[k](os);
+            octstr_destroy(os);
+        }
+        t = now() - t;
+        info(0, "%-8s %6ld octets gsm->utf8 %s: %8.1f MB/s", name,
+             octstr_len(gsm), impl[k], t > 0 ? octstr_len(gsm) * count / t / 1e6 : 0.0);
+    }
+
+    octstr_destroy(gsm);
+}
+
+static Octstr *repeat(const char *text, long len)
+{
+    Octstr *os;
+
+    os = octstr_create("");
+    while (octstr_len(os) < len)
+        octstr_append_cstr(os, text);
+
+    return os;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        const char *text;
+    } texts[] = {
+        { "ascii", "Hello world, this is a plain text message. " },
+        { "latin1", "Gr\xc3\xbc\xc3\x9f\x65 {\xe2\x82\xac} [caf\xc3\xa9] \xc3\xa0 ~5 " },
+        { "greek", "\xce\x94\xce\xa6\xce\x93\xce\x9b\xce\xa9 \xce\xa0\xce\xa8 " },
+    };
+    int opt, i, bench = 0;
+    long count;
+    Octstr *os;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:b")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case 'b':
+                bench = 1;
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    count = (optind < argc) ? atol(argv[optind]) : 10000;
+
+    /* the reference warns about broken input a lot */
+    log_set_output_level(GW_ERROR);
+    check_random(count);
+    log_set_output_level(GW_INFO);
+    info(0, "Random input converts the same with both implementations.");
+
+    for (i = 0; i < 3; i++) {
+        os = repeat(texts[i].text, 160);
+        check_text(texts[i].name, os);
+        octstr_destroy(os);
+        os = repeat(texts[i].text, 16384);
+        check_text(texts[i].name, os);
+        octstr_destroy(os);
+    }
+    info(0, "Texts convert to GSM and back unchanged.");
+
+    if (bench) {
+        for (i = 0; i < 3; i++) {
+            os = repeat(texts[i].text, 160);
+            benchmark(texts[i].name, os, count);
+            octstr_destroy(os);
+            os = repeat(texts[i].text, 16384);
+            benchmark(texts[i].name, os, count / 10);
+            octstr_destroy(os);
+        }
+    }
+
+    gwlib_shutdown();
+    return 0;
+}
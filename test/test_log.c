@@ -0,0 +1,177 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_log.c - benchmark synchronous and asynchronous logging
+ *
+ * Logs count debug lines from each of the given number of threads into
+ * a log file, first synchronously and then through the asynchronous
+ * writer, and reports lines per second. In blocking mode every line
+ * must make it to the file, which is checked by counting them.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+
+static long count = 100000;
+
+static void log_thread(void *arg)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+        debug("test.log", 0, "Line %ld of thread %ld, some payload to log.",
+              i, gwthread_self());
+}
+
+static long count_lines(const char *filename)
+{
+    FILE *f;
+    long lines = 0;
+    int c;
+
+    f = fopen(filename, "r");
+    if (f == NULL)
+        panic(errno, "Cannot open `%s'.", filename);
+    while ((c = getc(f)) != EOF)
+        if (c == '\n')
+            lines++;
+    fclose(f);
+    return lines;
+}
+
+static void help(void)
+{
+    info(0, "Usage: test_log [-t threads] [-b buffer-size] [-d] logfile [count]");
+}
+
+int main(int argc, char **argv)
+{
+    struct timeval start, end;
+    long threads = 4, buffer = 1024 * 1024, i, *ids, lines, total = 0;
+    int opt, mode, drop = 0;
+    char *filename;
+    double t;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "t:b:d")) != EOF) {
+        switch (opt) {
+            case 't':
+                threads = atol(optarg);
+                break;
+
+            case 'b':
+                buffer = atol(optarg);
+                break;
+
+            case 'd':
+                drop = 1;
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    if (optind >= argc) {
+        help();
+        panic(0, "Stopping.");
+    }
+    filename = argv[optind];
+    if (optind + 1 < argc)
+        count = atol(argv[optind + 1]);
+
+    unlink(filename);
+    log_set_output_level(GW_INFO);
+    if (log_open(filename, GW_DEBUG, GW_NON_EXCL) == -1)
+        panic(0, "Stopping.");
+
+    ids = gw_malloc(threads * sizeof(*ids));
+    for (mode = 0; mode < 2; mode++) {
+        if (mode == 1)
+            log_set_async(buffer, drop);
+
+        gettimeofday(&start, NULL);
+        for (i = 0; i < threads; i++)
+            ids[i] = gwthread_create(log_thread, NULL);
+        for (i = 0; i < threads; i++)
+            gwthread_join(ids[i]);
+        log_set_async(0, 0);
+        gettimeofday(&end, NULL);
+
+        t = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+        lines = count_lines(filename) - total;
+        total += lines;
+        info(0, "%-12s %ld threads: %10.0f lines/s, %ld lines written",
+             mode ? "asynchronous" : "synchronous", threads,
+             t > 0 ? threads * count / t : 0.0, lines);
+        if (lines < threads * count && !(mode == 1 && drop))
+            panic(0, "Lines missing from the log file.");
+        total = count_lines(filename);
+    }
+    gw_free(ids);
+    unlink(filename);
+
+    gwlib_shutdown();
+    return 0;
+}
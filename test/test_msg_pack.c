@@ -0,0 +1,280 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * test_msg_pack.c - check and benchmark the Msg wire formats
+ *
+ * Packs typical MT and DLR report messages in both the V1 and the compact
+ * V2 format and panics unless both unpack to the same message and V2 is
+ * the smaller one. Also checks that every message type survives the V2
+ * round trip. With -b it then packs and unpacks both messages a given
+ * number of times in each format and reports nanoseconds per message.
+ * Counts default to 100k and 1M messages.
+ */
+
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+
+static void help(void)
+{
+    info(0, "Usage: test_msg_pack [options] [count ...]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-b");
+    info(0, "    benchmark packing and unpacking count messages");
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char *what, long count, double t)
+{
+    info(0, "%-10s %10ld msgs in %8.3f seconds, %8.0f ns/msg.",
+         what, count, t, count > 0 ? t * 1e9 / count : 0.0);
+}
+
+static Msg *create_msg(int use_report)
+{
+    Msg *msg;
+
+    msg = msg_create(sms);
+    msg->sms.sender = octstr_create("4917012345678");
+    msg->sms.receiver = octstr_create("4917087654321");
+    msg->sms.service = octstr_create("default");
+    msg->sms.smsc_id = octstr_create("smpp-1");
+    msg->sms.boxc_id = octstr_create("smsbox-1");
+    msg->sms.time = time(NULL);
+    msg->sms.coding = 0;
+    msg->sms.dlr_mask = 31;
+    msg->sms.priority = 0;
+    /* the last fields, so that the high bits of the V2 bitmap are used */
+    msg->sms.resend_time = 1610160000;
+    msg->sms.meta_data = octstr_create("?smpp?tag=value&");
+    if (use_report) {
+        msg->sms.sms_type = report_mo;
+        msg->sms.foreign_id = octstr_create("0123456789abcdef");
+        msg->sms.msgdata = octstr_create("id:0123456789 sub:001 dlvrd:001 submit date:1610160000 "
+                                         "done date:1610160001 stat:DELIVRD err:000 text:");
+    } else {
+        msg->sms.sms_type = mt_push;
+        msg->sms.dlr_url = octstr_create("http://localhost:8080/dlr?id=%I&status=%d");
+        msg->sms.msgdata = octstr_create("Hello world, this is a reasonably typical "
+                                         "message text of an MT message.");
+    }
+
+    return msg;
+}
+
+/* compare two messages by their V1 encoding */
+static int msg_equal(Msg *a, Msg *b)
+{
+    Octstr *pa, *pb;
+    int ret;
+
+    pa = msg_pack(a);
+    pb = msg_pack(b);
+    ret = (octstr_compare(pa, pb) == 0);
+    octstr_destroy(pa);
+    octstr_destroy(pb);
+
+    return ret;
+}
+
+/* pack msg in format, check the round trip and return the packed size */
+static long check_format(Msg *msg, int format)
+{
+    Octstr *pack;
+    Msg *copy;
+    long len;
+
+    pack = msg_pack_format(msg, format);
+    copy = msg_unpack(pack);
+    if (copy == NULL || !msg_equal(msg, copy))
+        panic(0, "Format %d does not unpack to the packed message.", format);
+    len = octstr_len(pack);
+    msg_destroy(copy);
+    octstr_destroy(pack);
+
+    return len;
+}
+
+/* make sure every message type survives the V2 round trip */
+static void check_types(void)
+{
+    Msg *msg, *copy;
+    Octstr *pack;
+    int type;
+
+    for (type = 0; type < msg_type_count; type++) {
+        msg = msg_create(type);
+        msg->heartbeat.load = 42;
+        msg->admin.command = cmd_identify;
+        msg->admin.boxc_id = octstr_create("smsbox-1");
+        msg->ack.nack = ack_failed_tmp;
+        msg->ack.time = -123456;
+        msg->wdp_datagram.source_address = octstr_create("127.0.0.1");
+        msg->wdp_datagram.source_port = 9200;
+        msg->wdp_datagram.user_data = octstr_create_from_data("\0\1\2", 3);
+        msg->sms.msgdata = octstr_create("");
+
+        pack = msg_pack_format(msg, MSG_FORMAT_V2);
+        copy = msg_unpack(pack);
+        if (copy == NULL || msg_type(copy) != type || !msg_equal(msg, copy))
+            panic(0, "Message type %d does not survive format 2.", type);
+        msg_destroy(copy);
+        octstr_destroy(pack);
+        msg_destroy(msg);
+    }
+}
+
+static void check_msg(int use_report)
+{
+    Msg *msg;
+    long v1, v2;
+
+    msg = create_msg(use_report);
+    v1 = check_format(msg, MSG_FORMAT_V1);
+    v2 = check_format(msg, MSG_FORMAT_V2);
+    info(0, "%s packs into %ld bytes in format 1, %ld bytes in format 2.",
+         use_report ? "DLR report" : "MT message", v1, v2);
+    if (v2 >= v1)
+        panic(0, "Format 2 is not smaller than format 1.");
+    msg_destroy(msg);
+}
+
+static void benchmark_format(Msg *msg, int format, long count)
+{
+    Octstr *pack;
+    double t;
+    long i;
+
+    t = now();
+    for (i = 0; i < count; i++)
+        octstr_destroy(msg_pack_format(msg, format));
+    report(format == MSG_FORMAT_V2 ? "pack v2" : "pack v1", count, now() - t);
+
+    pack = msg_pack_format(msg, format);
+    t = now();
+    for (i = 0; i < count; i++)
+        msg_destroy(msg_unpack(pack));
+    report(format == MSG_FORMAT_V2 ? "unpack v2" : "unpack v1", count, now() - t);
+    octstr_destroy(pack);
+}
+
+static void benchmark(int use_report, long count)
+{
+    Msg *msg;
+
+    info(0, "Running with %ld %s:", count, use_report ? "DLR reports" : "MT messages");
+
+    msg = create_msg(use_report);
+    benchmark_format(msg, MSG_FORMAT_V1, count);
+    benchmark_format(msg, MSG_FORMAT_V2, count);
+    msg_destroy(msg);
+}
+
+int main(int argc, char **argv)
+{
+    int opt, i, bench = 0;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:b")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case 'b':
+                bench = 1;
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    check_types();
+    check_msg(0);
+    check_msg(1);
+
+    if (bench && optind == argc) {
+        benchmark(0, 100000);
+        benchmark(1, 100000);
+        benchmark(0, 1000000);
+        benchmark(1, 1000000);
+    } else if (bench) {
+        for (i = optind; i < argc; i++) {
+            benchmark(0, atol(argv[i]));
+            benchmark(1, atol(argv[i]));
+        }
+    }
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,281 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * test_smpp_pdu.c - check and benchmark SMPP PDU packing and unpacking
+ *
+ * First checks that PDUs with mandatory fields, built-in and configured
+ * TLVs survive a pack and unpack round trip, including TLVs configured
+ * for one smsc-id only.  Then packs and unpacks count submit_sm PDUs
+ * (default one million) and reports PDUs per second for each.
+ */
+
+#include <sys/time.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/smsc/smpp_pdu.h"
+
+static long count = 1000000;
+
+static char *tlv_config =
+    "group = smpp-tlv\n"
+    "name = my_integer\n"
+    "tag = 0x1401\n"
+    "type = integer\n"
+    "length = 2\n"
+    "\n"
+    "group = smpp-tlv\n"
+    "name = my_string\n"
+    "tag = 0x1402\n"
+    "type = nulterminated\n"
+    "length = 20\n"
+    "\n"
+    "group = smpp-tlv\n"
+    "name = their_octets\n"
+    "tag = 0x1402\n"
+    "type = octetstring\n"
+    "length = 20\n"
+    "smsc-id = theirs\n";
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char *what, long ops, double t)
+{
+    info(0, "%-10s %8ld PDUs: %12.0f PDUs/s", what, ops, t > 0 ? ops / t : 0.0);
+}
+
+static void init_tlvs(void)
+{
+    char name[] = "/tmp/test_smpp_pdu.XXXXXX";
+    Octstr *filename;
+    Cfg *cfg;
+    int fd;
+
+    if ((fd = mkstemp(name)) == -1)
+        panic(errno, "Cannot create temporary config file.");
+    if (write(fd, tlv_config, strlen(tlv_config)) != (ssize_t) strlen(tlv_config))
+        panic(errno, "Cannot write temporary config file.");
+    close(fd);
+
+    filename = octstr_create(name);
+    cfg = cfg_create(filename);
+    if (cfg_read(cfg) == -1 || smpp_pdu_init(cfg) == -1)
+        panic(0, "Cannot configure SMPP TLVs.");
+    cfg_destroy(cfg);
+    octstr_destroy(filename);
+    unlink(name);
+}
+
+static SMPP_PDU *make_submit(long seq)
+{
+    SMPP_PDU *pdu;
+
+    pdu = smpp_pdu_create(submit_sm, seq);
+    pdu->u.submit_sm.source_addr = octstr_create("12345");
+    pdu->u.submit_sm.destination_addr = octstr_create("4912345678901");
+    pdu->u.submit_sm.source_addr_ton = GSM_ADDR_TON_NATIONAL;
+    pdu->u.submit_sm.dest_addr_ton = GSM_ADDR_TON_INTERNATIONAL;
+    pdu->u.submit_sm.dest_addr_npi = GSM_ADDR_NPI_E164;
+    pdu->u.submit_sm.registered_delivery = 1;
+    pdu->u.submit_sm.short_message = octstr_create("Hello world, this is a test message.");
+    pdu->u.submit_sm.user_message_reference = seq & 0xFFFF;
+
+    return pdu;
+}
+
+static void check_octstr(const char *what, Octstr *got, const char *expected)
+{
+    if (got == NULL || octstr_str_compare(got, expected) != 0)
+        panic(0, "%s is `%s', should be `%s'.", what,
+              got ? octstr_get_cstr(got) : "(null)", expected);
+}
+
+static void check_round_trip(void)
+{
+    SMPP_PDU *pdu, *copy;
+    Octstr *os, *os2, *body, *smsc_id;
+
+    pdu = smpp_pdu_create(deliver_sm, 42);
+    pdu->u.deliver_sm.source_addr = octstr_create("4912345678901");
+    pdu->u.deliver_sm.destination_addr = octstr_create("12345");
+    pdu->u.deliver_sm.esm_class = ESM_CLASS_DELIVER_SMSC_DELIVER_ACK;
+    pdu->u.deliver_sm.short_message = octstr_create("id:1 sub:001 dlvrd:001");
+    pdu->u.deliver_sm.receipted_message_id = octstr_create("1");
+    pdu->u.deliver_sm.message_state = 2;
+    dict_put(pdu->u.deliver_sm.tlv, octstr_imm("my_integer"), octstr_create("4711"));
+    dict_put(pdu->u.deliver_sm.tlv, octstr_imm("my_string"), octstr_create("vendor"));
+
+    os = smpp_pdu_pack(NULL, pdu);
+    copy = smpp_pdu_unpack_data(NULL, (unsigned char *) octstr_get_cstr(os) + 4, octstr_len(os) - 4);
+    if (copy == NULL || copy->type != deliver_sm)
+        panic(0, "Unpacking deliver_sm failed.");
+    if (copy->u.deliver_sm.sequence_number != 42 ||
+        copy->u.deliver_sm.esm_class != ESM_CLASS_DELIVER_SMSC_DELIVER_ACK ||
+        copy->u.deliver_sm.message_state != 2)
+        panic(0, "Integer fields of deliver_sm changed.");
+    check_octstr("source_addr", copy->u.deliver_sm.source_addr, "4912345678901");
+    check_octstr("destination_addr", copy->u.deliver_sm.destination_addr, "12345");
+    check_octstr("short_message", copy->u.deliver_sm.short_message, "id:1 sub:001 dlvrd:001");
+    check_octstr("receipted_message_id", copy->u.deliver_sm.receipted_message_id, "1");
+    check_octstr("my_integer", dict_get(copy->u.deliver_sm.tlv, octstr_imm("my_integer")), "4711");
+    check_octstr("my_string", dict_get(copy->u.deliver_sm.tlv, octstr_imm("my_string")), "vendor");
+
+    os2 = smpp_pdu_pack(NULL, copy);
+    if (octstr_compare(os, os2) != 0)
+        panic(0, "Repacking deliver_sm changed it.");
+    smpp_pdu_destroy(copy);
+    octstr_destroy(os2);
+
+    /* the same tag is an octet string for smsc-id `theirs' */
+    smsc_id = octstr_create("theirs");
+    body = octstr_copy(os, 4, octstr_len(os));
+    copy = smpp_pdu_unpack(smsc_id, body);
+    if (copy == NULL)
+        panic(0, "Unpacking deliver_sm for smsc-id `theirs' failed.");
+    if (dict_get(copy->u.deliver_sm.tlv, octstr_imm("my_string")) != NULL)
+        panic(0, "Default TLV used although smsc-id has its own.");
+    os2 = dict_get(copy->u.deliver_sm.tlv, octstr_imm("their_octets"));
+    if (os2 == NULL || octstr_len(os2) != 7 || memcmp(octstr_get_cstr(os2), "vendor", 7) != 0)
+        panic(0, "TLV configured for smsc-id `theirs' not found.");
+    check_octstr("my_integer", dict_get(copy->u.deliver_sm.tlv, octstr_imm("my_integer")), "4711");
+    smpp_pdu_destroy(copy);
+    octstr_destroy(body);
+    octstr_destroy(smsc_id);
+
+    /* truncated PDUs must fail, not read past the end */
+    copy = smpp_pdu_unpack_data(NULL, (unsigned char *) octstr_get_cstr(os) + 4, 20);
+    if (copy != NULL)
+        panic(0, "Truncated deliver_sm unpacked.");
+
+    octstr_destroy(os);
+    smpp_pdu_destroy(pdu);
+}
+
+static void benchmark(long n)
+{
+    SMPP_PDU *pdu;
+    Octstr **packed;
+    double t;
+    long i;
+
+    packed = gw_malloc(n * sizeof(*packed));
+
+    t = now();
+    for (i = 0; i < n; i++) {
+        pdu = make_submit(i + 1);
+        packed[i] = smpp_pdu_pack(NULL, pdu);
+        smpp_pdu_destroy(pdu);
+    }
+    report("pack", n, now() - t);
+
+    /* as read_pdu() in smsc_smpp.c, straight from the received data */
+    t = now();
+    for (i = 0; i < n; i++) {
+        pdu = smpp_pdu_unpack_data(NULL, (unsigned char *) octstr_get_cstr(packed[i]) + 4,
+                                   octstr_len(packed[i]) - 4);
+        if (pdu == NULL || pdu->u.submit_sm.sequence_number != i + 1)
+            panic(0, "Unpacking submit_sm %ld failed.", i + 1);
+        smpp_pdu_destroy(pdu);
+    }
+    report("unpack", n, now() - t);
+
+    for (i = 0; i < n; i++)
+        octstr_destroy(packed[i]);
+    gw_free(packed);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case '?':
+            default:
+                panic(0, "Usage: test_smpp_pdu [-v loglevel] [count]");
+        }
+    }
+
+    if (optind < argc)
+        count = atol(argv[optind]);
+
+    init_tlvs();
+    check_round_trip();
+    info(0, "PDUs survive packing and unpacking.");
+
+    /* don't measure the per TLV debug output */
+    log_set_output_level(GW_INFO);
+    benchmark(count);
+
+    smpp_pdu_shutdown();
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,225 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_sms_split.c - check and benchmark sms_split
+ *
+ * Splits concatenated messages of 1, 10 and 100 parts in GSM 7-bit
+ * (with escaped characters), UCS-2 and 8-bit coding and panics unless
+ * the expected number of correctly numbered parts comes out and the
+ * parts put together give back the original text. With -b it then
+ * splits each message a given number of times and reports microseconds
+ * per split. Count defaults to 1000.
+ */
+
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/msg.h"
+#include "gw/sms.h"
+
+static void help(void)
+{
+    info(0, "Usage: test_sms_split [options] [count]");
+    info(0, "where options are:");
+    info(0, "-v number");
+    info(0, "    set log level for stderr logging");
+    info(0, "-b");
+    info(0, "    benchmark splitting each message count times");
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Create a message filling the given number of concatenated parts.
+ * The 7-bit text mixes plain, escaped (the euro sign) and non-ASCII
+ * characters, the others are just octets.
+ */
+static Msg *create_msg(int coding, long parts)
+{
+    Msg *msg;
+    long i, len;
+
+    msg = msg_create(sms);
+    msg->sms.sender = octstr_create("123");
+    msg->sms.receiver = octstr_create("456");
+    msg->sms.coding = coding;
+    msg->sms.msgdata = octstr_create("");
+
+    if (coding == DC_7BIT) {
+        /*
+         * 153 septets per part, 10 characters are 12 septets. Leave one
+         * septet per part for escapes that don't fit at the end.
+         */
+        for (i = 0; i < parts * 152 / 12; i++)
+            octstr_append_cstr(msg->sms.msgdata, "Hell\xc3\xa9 \xe2\x82\xac{xy");
+    } else {
+        /* 134 octets per part */
+        len = parts * 134;
+        for (i = 0; i < len; i++)
+            octstr_append_char(msg->sms.msgdata, coding == DC_UCS2 ? (i % 2 ? 'a' + i % 26 : 0) : i % 256);
+    }
+
+    return msg;
+}
+
+static void check_split(int coding, long parts)
+{
+    Octstr *text;
+    List *list;
+    Msg *msg, *part;
+    long i;
+
+    msg = create_msg(coding, parts);
+    list = sms_split(msg, NULL, NULL, NULL, NULL, 1, 0, 255, MAX_SMS_OCTETS);
+
+    if (gwlist_len(list) != parts)
+        panic(0, "Coding %d: expected %ld parts, got %ld.", coding, parts, gwlist_len(list));
+
+    text = octstr_create("");
+    for (i = 0; i < gwlist_len(list); i++) {
+        part = gwlist_get(list, i);
+        /* 6 octets of concatenation UDH: length, IEI, IE length, ref, total, number */
+        if (parts > 1 &&
+            (octstr_len(part->sms.udhdata) != 6 ||
+             octstr_get_char(part->sms.udhdata, 4) != parts ||
+             octstr_get_char(part->sms.udhdata, 5) != i + 1))
+            panic(0, "Coding %d: part %ld of %ld has the wrong UDH.", coding, i + 1, parts);
+        if (coding != DC_7BIT && octstr_len(part->sms.msgdata) > 134)
+            panic(0, "Coding %d: part %ld has %ld octets.", coding, i + 1,
+                  octstr_len(part->sms.msgdata));
+        octstr_append(text, part->sms.msgdata);
+    }
+    if (octstr_compare(text, msg->sms.msgdata) != 0)
+        panic(0, "Coding %d: parts don't add up to the original text.", coding);
+
+    octstr_destroy(text);
+    gwlist_destroy(list, msg_destroy_item);
+    msg_destroy(msg);
+}
+
+static void benchmark(int coding, long parts, long count)
+{
+    double t;
+    List *list;
+    Msg *msg;
+    long i;
+
+    msg = create_msg(coding, parts);
+
+    t = now();
+    for (i = 0; i < count; i++) {
+        list = sms_split(msg, NULL, NULL, NULL, NULL, 1, 0, 255, MAX_SMS_OCTETS);
+        gwlist_destroy(list, msg_destroy_item);
+    }
+    t = now() - t;
+
+    info(0, "%-5s %3ld parts (%5ld octets): %6ld splits in %7.3f seconds, %9.1f us/split.",
+         coding == DC_7BIT ? "GSM" : (coding == DC_UCS2 ? "UCS2" : "8BIT"),
+         parts, octstr_len(msg->sms.msgdata), count, t,
+         count > 0 ? t * 1e6 / count : 0.0);
+
+    msg_destroy(msg);
+}
+
+int main(int argc, char **argv)
+{
+    static const int codings[] = { DC_7BIT, DC_UCS2, DC_8BIT };
+    static const long parts[] = { 1, 10, 100 };
+    int opt, i, j, bench = 0;
+    long count;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:b")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case 'b':
+                bench = 1;
+                break;
+
+            case '?':
+            default:
+                error(0, "Invalid option %c", opt);
+                help();
+                panic(0, "Stopping.");
+        }
+    }
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            check_split(codings[i], parts[j]);
+    info(0, "All splits OK.");
+
+    if (bench) {
+        count = (optind < argc) ? atol(argv[optind]) : 1000;
+        for (i = 0; i < 3; i++)
+            for (j = 0; j < 3; j++)
+                benchmark(codings[i], parts[j], count);
+    }
+
+    gwlib_shutdown();
+    return 0;
+}
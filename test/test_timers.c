@@ -0,0 +1,217 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+/*
+ * test_timers.c - check and benchmark gwlib timers
+ *
+ * First checks that started timers elapse on time and stopped or
+ * restarted ones don't.  Then starts, restarts, stops and finally
+ * expires count timers (default one million) all active at the same
+ * time, and reports operations per second for each.
+ */
+
+#include <sys/time.h>
+
+#include "gwlib/gwlib.h"
+#include "gwlib/gw-timer.h"
+
+static long count = 1000000;
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void report(const char *what, long ops, double t)
+{
+    info(0, "%-10s %8ld timers: %12.0f ops/s", what, ops, t > 0 ? ops / t : 0.0);
+}
+
+/*
+ * Start timers elapsing in 0 to 2 seconds, stop every third and push
+ * every fifth far into the future.  The rest must elapse, each exactly
+ * once and not before it is due.
+ */
+static void check_elapse(void)
+{
+    Timerset *set;
+    List *out;
+    Timer *timers[300];
+    long due[300];
+    int seen[300];
+    long i, expected, *item;
+
+    set = gw_timerset_create();
+    out = gwlist_create();
+    gwlist_add_producer(out);
+
+    expected = 0;
+    for (i = 0; i < 300; i++) {
+        timers[i] = gw_timer_create(set, out, NULL);
+        due[i] = time(NULL) + i % 3;
+        gw_timer_start(timers[i], i % 3, (void *) (i + 1));
+        seen[i] = 0;
+    }
+    for (i = 0; i < 300; i++) {
+        if (i % 3 == 0 && i % 5 != 0) {
+            gw_timer_stop(timers[i]);
+        } else if (i % 5 == 0) {
+            gw_timer_start(timers[i], 100000000, NULL);
+        } else
+            expected++;
+    }
+
+    while (expected > 0) {
+        item = gwlist_timed_consume(out, 5);
+        if (item == NULL)
+            panic(0, "%ld timers did not elapse.", expected);
+        i = (long) item - 1;
+        if (seen[i]++ || i % 3 == 0 || i % 5 == 0)
+            panic(0, "Timer %ld elapsed unexpectedly.", i);
+        if (time(NULL) < due[i])
+            panic(0, "Timer %ld elapsed early.", i);
+        expected--;
+    }
+    if (gwlist_timed_consume(out, 2) != NULL)
+        panic(0, "Stopped timer elapsed.");
+
+    for (i = 0; i < 300; i++)
+        gw_timer_destroy(timers[i]);
+    gwlist_remove_producer(out);
+    gwlist_destroy(out, NULL);
+    gw_timerset_destroy(set);
+}
+
+static void benchmark(long n)
+{
+    Timerset *set;
+    List *out;
+    Timer **timers;
+    double t, first;
+    long i;
+
+    set = gw_timerset_create();
+    out = gwlist_create();
+    gwlist_add_producer(out);
+    timers = gw_malloc(n * sizeof(*timers));
+    for (i = 0; i < n; i++)
+        timers[i] = gw_timer_create(set, out, NULL);
+
+    /* WTP style timeouts, between a minute and an hour */
+    t = now();
+    for (i = 0; i < n; i++)
+        gw_timer_start(timers[i], 60 + gw_rand() % 3540, timers[i]);
+    report("start", n, now() - t);
+
+    t = now();
+    for (i = 0; i < n; i++)
+        gw_timer_start(timers[i], 60 + gw_rand() % 3540, NULL);
+    report("restart", n, now() - t);
+
+    t = now();
+    for (i = 0; i < n; i++)
+        gw_timer_stop(timers[i]);
+    report("stop", n, now() - t);
+
+    /* all due in the same second, timed from the first one consumed */
+    for (i = 0; i < n; i++)
+        gw_timer_elapsed_start(timers[i], 2, NULL);
+    gwlist_consume(out);
+    first = now();
+    for (i = 1; i < n; i++)
+        gwlist_consume(out);
+    report("expire", n, now() - first);
+
+    for (i = 0; i < n; i++)
+        gw_timer_elapsed_destroy(timers[i]);
+    gw_free(timers);
+    gwlist_remove_producer(out);
+    gwlist_destroy(out, NULL);
+    gw_timerset_destroy(set);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+
+            case '?':
+            default:
+                panic(0, "Usage: test_timers [-v loglevel] [count]");
+        }
+    }
+
+    if (optind < argc)
+        count = atol(argv[optind]);
+
+    check_elapse();
+    info(0, "Timers elapse as expected.");
+
+    benchmark(count);
+
+    gwlib_shutdown();
+    return 0;
+}
@@ -0,0 +1,212 @@
+/* ==================================================================== 
+ * The Kannel Software License, Version 1.0 
+ * 
+ * Copyright (c) 2001-2013 Kannel Group  
+ * Copyright (c) 1998-2001 WapIT Ltd.   
+ * All rights reserved. 
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions 
+ * are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright 
+ *    notice, this list of conditions and the following disclaimer. 
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright 
+ *    notice, this list of conditions and the following disclaimer in 
+ *    the documentation and/or other materials provided with the 
+ *    distribution. 
+ * 
+ * 3. The end-user documentation included with the redistribution, 
+ *    if any, must include the following acknowledgment: 
+ *       "This product includes software developed by the 
+ *        Kannel Group (http://www.kannel.org/)." 
+ *    Alternately, this acknowledgment may appear in the software itself, 
+ *    if and wherever such third-party acknowledgments normally appear. 
+ * 
+ * 4. The names "Kannel" and "Kannel Group" must not be used to 
+ *    endorse or promote products derived from this software without 
+ *    prior written permission. For written permission, please  
+ *    contact org@kannel.org. 
+ * 
+ * 5. Products derived from this software may not be called "Kannel", 
+ *    nor may "Kannel" appear in their name, without prior written 
+ *    permission of the Kannel Group. 
+ * 
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED 
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES 
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED.  IN NO EVENT SHALL THE KANNEL GROUP OR ITS CONTRIBUTORS 
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY,  
+ * OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT  
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR  
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,  
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE  
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,  
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. 
+ * ==================================================================== 
+ * 
+ * This software consists of voluntary contributions made by many 
+ * individuals on behalf of the Kannel Group.  For more information on  
+ * the Kannel Group, please see <http://www.kannel.org/>. 
+ * 
+ * Portions of this software are based upon software originally written at  
+ * WapIT Ltd., Helsinki, Finland for the Kannel project.  
+ */ 
+
+
+/*
+ * test_token_bucket.c - check the pacing of token buckets
+ *
+ * Runs one sender thread per connection for a few seconds. Each has its
+ * own bucket and all share one bucket, like connections configured with
+ * 'throughput' and 'smsc-id-throughput'. The senders sleep exactly as
+ * long as the buckets tell them. Reports the achieved rates and fails if
+ * any limit is exceeded or the shared limit is not reached, or, with a
+ * burst of 1, if two messages of a sender are closer than 1 / rate.
+ */
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "gwlib/gwlib.h"
+#include "gw/token_bucket.h"
+
+#define MAX_SENDERS 32
+
+static long senders = 4;
+static double seconds = 3;
+static double rate = 100;
+static double shared_rate = 250;
+static double burst = 1;
+
+static TokenBucket *shared;
+
+struct sender {
+    TokenBucket *bucket;
+    long sent;
+    long wakeups;
+    double max_gap;
+    double min_gap;
+};
+
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static void sender_thread(void *arg)
+{
+    struct sender *sender = arg;
+    double start, end, last, now, delay;
+
+    start = last = now_seconds();
+    end = start + seconds;
+    while ((now = now_seconds()) < end) {
+        if ((delay = token_bucket_take(sender->bucket, shared)) > 0) {
+            gwthread_sleep(delay);
+            sender->wakeups++;
+            continue;
+        }
+        if (sender->sent > 0 && now - last > sender->max_gap)
+            sender->max_gap = now - last;
+        if (sender->sent > 0 && (sender->min_gap < 0 || now - last < sender->min_gap))
+            sender->min_gap = now - last;
+        last = now;
+        sender->sent++;
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    struct sender sender[MAX_SENDERS];
+    long i, total, wakeups;
+    double max_gap, expect;
+    int opt;
+
+    gwlib_init();
+
+    while ((opt = getopt(argc, argv, "v:n:t:r:s:b:")) != EOF) {
+        switch (opt) {
+            case 'v':
+                log_set_output_level(atoi(optarg));
+                break;
+            case 'n':
+                senders = atol(optarg);
+                break;
+            case 't':
+                seconds = atof(optarg);
+                break;
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 's':
+                shared_rate = atof(optarg);
+                break;
+            case 'b':
+                burst = atof(optarg);
+                break;
+
+            case '?':
+            default:
+                panic(0, "Usage: test_token_bucket [-v loglevel] [-n senders] "
+                      "[-t seconds] [-r rate] [-s shared-rate] [-b burst]");
+        }
+    }
+    if (senders < 1 || senders > MAX_SENDERS || seconds <= 0 || rate <= 0 ||
+        shared_rate <= 0)
+        panic(0, "Invalid arguments.");
+
+    token_bucket_init();
+    shared = token_bucket_create_shared(octstr_imm("test"), shared_rate, burst);
+
+    for (i = 0; i < senders; i++) {
+        sender[i].bucket = token_bucket_create(rate, burst);
+        sender[i].sent = sender[i].wakeups = 0;
+        sender[i].max_gap = 0;
+        sender[i].min_gap = -1;
+        if (gwthread_create(sender_thread, &sender[i]) == -1)
+            panic(0, "Could not start sender thread.");
+    }
+    gwthread_join_every(sender_thread);
+
+    total = wakeups = 0;
+    max_gap = 0;
+    for (i = 0; i < senders; i++) {
+        info(0, "Sender %ld: %ld messages, %.1f/s, %ld wakeups, gaps %.1f to %.1f ms.",
+             i, sender[i].sent, sender[i].sent / seconds, sender[i].wakeups,
+             sender[i].min_gap * 1000, sender[i].max_gap * 1000);
+        if (sender[i].sent > rate * seconds + burst + 1)
+            panic(0, "Sender %ld exceeded its limit of %.1f/s.", i, rate);
+        /* gettimeofday() has microseconds, allow for rounding */
+        if (burst <= 1 && sender[i].min_gap >= 0 &&
+            sender[i].min_gap < 1 / rate - 2e-6)
+            panic(0, "Sender %ld sent two messages %.3f ms apart.",
+                  i, sender[i].min_gap * 1000);
+        total += sender[i].sent;
+        wakeups += sender[i].wakeups;
+        if (sender[i].max_gap > max_gap)
+            max_gap = sender[i].max_gap;
+        token_bucket_destroy(sender[i].bucket);
+    }
+
+    expect = rate * senders < shared_rate ? rate * senders : shared_rate;
+    info(0, "Total: %ld messages, %.1f/s of %.1f/s allowed, %ld wakeups, "
+         "longest gap %.1f ms.", total, total / seconds, expect, wakeups,
+         max_gap * 1000);
+    if (total > expect * seconds + senders * burst + 1)
+        panic(0, "Senders exceeded the allowed rate.");
+    if (total < expect * seconds * 0.9)
+        panic(0, "Senders did not reach the allowed rate.");
+
+    token_bucket_destroy(shared);
+    token_bucket_shutdown();
+    gwlib_shutdown();
+    return 0;
+}
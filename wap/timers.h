@@ -82,16 +82,17 @@
  *
  * The timer_* functions have been renamed to gwtimer_* to avoid
  * a name conflict on Solaris systems.
+ *
+ * These are thin wrappers around the gwlib timers, see gw-timer.h.
  */
 
 #ifndef TIMERS_H
 #define TIMERS_H
 
 #include "gwlib/gwlib.h"
+#include "gwlib/gw-timer.h"
 #include "wap_events.h"
 
-typedef struct Timer Timer;
-
 /*
  * Start up the timer system.
  * Can be called more than once, in which case multiple shutdowns are
@@ -122,6 +122,14 @@ int wap_addr_tuple_same(WAPAddrTuple *a, WAPAddrTuple *b)
 }
 
 
+Octstr *wap_addr_tuple_key(WAPAddrTuple *tuple)
+{
+    return octstr_format("%lx:%ld %lx:%ld",
+                         (unsigned long) tuple->remote->iaddr, tuple->remote->port,
+                         (unsigned long) tuple->local->iaddr, tuple->local->port);
+}
+
+
 WAPAddrTuple *wap_addr_tuple_duplicate(WAPAddrTuple *tuple) 
 {
     if (tuple == NULL)
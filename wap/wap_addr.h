@@ -83,6 +83,8 @@ WAPAddrTuple *wap_addr_tuple_create(Octstr *rmt_addr, long rmt_port,
 				    Octstr *lcl_addr, long lcl_port);
 void wap_addr_tuple_destroy(WAPAddrTuple *tuple);
 int wap_addr_tuple_same(WAPAddrTuple *a, WAPAddrTuple *b);
+/* Key for indexing tuples in a Dict, equal for tuples that are the same */
+Octstr *wap_addr_tuple_key(WAPAddrTuple *tuple);
 WAPAddrTuple *wap_addr_tuple_duplicate(WAPAddrTuple *tuple);
 void wap_addr_tuple_dump(WAPAddrTuple *tuple);
 
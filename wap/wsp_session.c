@@ -120,15 +120,27 @@ static wap_dispatch_func_t *dispatch_to_ota;
 static int resume_enabled = 1;
 
 static List *queue = NULL;
-static List *session_machines = NULL;
 static Counter *session_id_counter = NULL;
 
+/*
+ * Session machines by session id, and lists of them by address tuple,
+ * newest first. More than one session per address exists only briefly,
+ * while a new session disconnects the old ones.
+ */
+static Dict *session_machines_by_id = NULL;
+static Dict *session_machines_by_tuple = NULL;
+
+#define SESSION_MACHINES_HASH_SIZE 8192
+
 
 static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu);
 static void handle_session_event(WSPMachine *machine, WAPEvent *event, 
 				 WSP_PDU *pdu);
-static WSPMachine *machine_create(void);
+static WSPMachine *machine_create(WAPAddrTuple *tuple);
 static void machine_destroy(void *p);
+static void machine_set_session_id(WSPMachine *sm);
+static WSPMachine *find_session_by_id(long session_id);
+static WSPMachine *find_session_by_tuple(WAPAddrTuple *tuple);
 
 static void handle_method_event(WSPMachine *session, WSPMethodMachine *machine, WAPEvent *event, WSP_PDU *pdu);
 static void cant_handle_event(WSPMachine *sm, WAPEvent *event);
@@ -150,9 +162,6 @@ static Octstr *make_resume_reply_pdu(WSPMachine *m, List *headers);
 static WSP_PDU *make_confirmedpush_pdu(WAPEvent *e);
 static WSP_PDU *make_push_pdu(WAPEvent *e);
 
-static int transaction_belongs_to_session(void *session, void *tuple);
-static int find_by_session_id(void *session, void *idp);
-static int same_client(void *sm1, void *sm2);
 static WSPMethodMachine *find_method_machine(WSPMachine *, long id);
 static WSPPushMachine *find_push_machine(WSPMachine *m, long id);
 
@@ -180,7 +189,6 @@ static void indicate_pushabort(WSPPushMachine *machine, long reason);
 static void confirm_push(WSPPushMachine *machine);
 
 static void main_thread(void *);
-static int id_belongs_to_session (void *, void *);
 static int wsp_encoding_string_to_version(Octstr *enc);
 static Octstr *wsp_encoding_version_to_string(int version);
 
@@ -196,7 +204,8 @@ void wsp_session_init(wap_dispatch_func_t *responder_dispatch,
                       wap_dispatch_func_t *push_ota_dispatch) {
 	queue = gwlist_create();
 	gwlist_add_producer(queue);
-	session_machines = gwlist_create();
+	session_machines_by_id = dict_create(SESSION_MACHINES_HASH_SIZE, NULL);
+	session_machines_by_tuple = dict_create(SESSION_MACHINES_HASH_SIZE, NULL);
 	session_id_counter = counter_create();
 	dispatch_to_wtp_resp = responder_dispatch;
 	dispatch_to_wtp_init = initiator_dispatch;
@@ -209,6 +218,9 @@ void wsp_session_init(wap_dispatch_func_t *responder_dispatch,
 
 
 void wsp_session_shutdown(void) {
+	List *keys, *sessions;
+	Octstr *key;
+
 	gw_assert(run_status == running);
 	run_status = terminating;
 	gwlist_remove_producer(queue);
@@ -216,9 +228,18 @@ void wsp_session_shutdown(void) {
 
 	gwlist_destroy(queue, wap_event_destroy_item);
 
-	debug("wap.wsp", 0, "WSP: %ld session machines left.",
-		gwlist_len(session_machines));
-	gwlist_destroy(session_machines, machine_destroy);
+	debug("wap.wsp", 0, "WSP: %ld addresses with session machines left.",
+		dict_key_count(session_machines_by_tuple));
+	keys = dict_keys(session_machines_by_tuple);
+	while ((key = gwlist_extract_first(keys)) != NULL) {
+		/* the list goes away with the last machine */
+		while ((sessions = dict_get(session_machines_by_tuple, key)) != NULL)
+			machine_destroy(gwlist_get(sessions, 0));
+		octstr_destroy(key);
+	}
+	gwlist_destroy(keys, NULL);
+	dict_destroy(session_machines_by_tuple);
+	dict_destroy(session_machines_by_id);
 
 	counter_destroy(session_id_counter);
         wsp_strings_shutdown();
@@ -350,9 +371,8 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 			/* Create a new session, even if there is already
 			 * a session open for this address.  The new session
 			 * will take care of killing the old ones. */
-			sm = machine_create();
 			gw_assert(tuple != NULL);
-			sm->addr_tuple = wap_addr_tuple_duplicate(tuple);
+			sm = machine_create(tuple);
 			sm->connect_handle = event->u.TR_Invoke_Ind.handle;
 	/* Third test is for class 2 TR-Invoke.ind with Resume PDU */
 	} else if (event->type == TR_Invoke_Ind &&
@@ -361,8 +381,7 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 		/* Pass to session identified by session id, not
 		 * the address tuple. */
 		session_id = pdu->u.Resume.sessionid;
-		sm = gwlist_search(session_machines, &session_id,
-				find_by_session_id);
+		sm = find_session_by_id(session_id);
 		if (sm == NULL) {
 			/* No session; TR-Abort.req(DISCONNECT) */
 			send_abort(WSP_ABORT_DISCONNECT,
@@ -373,8 +392,7 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 	 * TR-Invoke.ind here by ignoring them; this seems to be
 	 * an omission in the spec table. */
 	} else if (event->type == TR_Invoke_Ind) {
-		sm = gwlist_search(session_machines, tuple,
-				 transaction_belongs_to_session);
+		sm = find_session_by_tuple(tuple);
 		if (sm == NULL && (event->u.TR_Invoke_Ind.tcl == 1 ||
 				event->u.TR_Invoke_Ind.tcl == 2)) {
 			send_abort(WSP_ABORT_DISCONNECT,
@@ -384,11 +402,9 @@ static WSPMachine *find_session_machine(WAPEvent *event, WSP_PDU *pdu) {
 	 * do those later, after we've tried to handle them. */
 	} else {
 		if (session_id != -1) {
-			sm = gwlist_search(session_machines, &session_id,
-				find_by_session_id);
+			sm = find_session_by_id(session_id);
 		} else {
-			sm = gwlist_search(session_machines, tuple,
-				transaction_belongs_to_session);
+			sm = find_session_by_tuple(tuple);
 		}
 		/* The table doesn't really say what we should do with
 		 * non-Invoke events for which there is no session.  But
@@ -480,8 +496,10 @@ static void cant_handle_event(WSPMachine *sm, WAPEvent *event) {
 }
 
 
-static WSPMachine *machine_create(void) {
+static WSPMachine *machine_create(WAPAddrTuple *tuple) {
 	WSPMachine *p;
+	List *sessions;
+	Octstr *key;
 	
 	p = gw_malloc(sizeof(WSPMachine));
 	debug("wap.wsp", 0, "WSP: Created WSPMachine %p", (void *) p);
@@ -504,11 +522,18 @@ static WSPMachine *machine_create(void) {
 	p->client_SDU_size = 1400;
 	p->MOR_push = 1;
 	
-	/* Insert new machine at the _front_, because 1) it's more likely
-	 * to get events than old machines are, so this speeds up the linear
-	 * search, and 2) we want the newest machine to get any method
-	 * invokes that come through before the Connect is established. */
-	gwlist_insert(session_machines, 0, p);
+	p->addr_tuple = wap_addr_tuple_duplicate(tuple);
+
+	/* Insert new machine at the _front_, because we want the newest
+	 * machine to get any method invokes that come through before the
+	 * Connect is established. */
+	key = wap_addr_tuple_key(tuple);
+	if ((sessions = dict_get(session_machines_by_tuple, key)) == NULL) {
+		sessions = gwlist_create();
+		dict_put(session_machines_by_tuple, key, sessions);
+	}
+	gwlist_insert(sessions, 0, p);
+	octstr_destroy(key);
 
 	return p;
 }
@@ -534,10 +559,25 @@ static void destroy_pushmachines(List *machines) {
 
 static void machine_destroy(void *pp) {
 	WSPMachine *p;
+	List *sessions;
+	Octstr *key;
 	
 	p = pp;
 	debug("wap.wsp", 0, "Destroying WSPMachine %p", pp);
-	gwlist_delete_equal(session_machines, p);
+
+	key = octstr_format("%ld", p->session_id);
+	if (dict_get(session_machines_by_id, key) == p)
+		dict_remove(session_machines_by_id, key);
+	octstr_destroy(key);
+
+	key = wap_addr_tuple_key(p->addr_tuple);
+	sessions = dict_get(session_machines_by_tuple, key);
+	gwlist_delete_equal(sessions, p);
+	if (gwlist_len(sessions) == 0) {
+		dict_remove(session_machines_by_tuple, key);
+		gwlist_destroy(sessions, NULL);
+	}
+	octstr_destroy(key);
 
 	#define INTEGER(name) p->name = 0;
 	#define OCTSTR(name) octstr_destroy(p->name);
@@ -751,6 +791,16 @@ static unsigned long next_wsp_session_id(void) {
 }
 
 
+static void machine_set_session_id(WSPMachine *sm) {
+	Octstr *key;
+
+	sm->session_id = next_wsp_session_id();
+	key = octstr_format("%ld", sm->session_id);
+	dict_put(session_machines_by_id, key, sm);
+	octstr_destroy(key);
+}
+
+
 static void sanitize_capabilities(List *caps, WSPMachine *m) {
 	long i;
 	Capability *cap;
@@ -1134,22 +1184,27 @@ static WSP_PDU *make_push_pdu(WAPEvent *e)
         return pdu;
 }
 
-static int transaction_belongs_to_session(void *wsp_ptr, void *tuple_ptr) {
-	WSPMachine *wsp;
-	WAPAddrTuple *tuple;
-	
-	wsp = wsp_ptr;
-	tuple = tuple_ptr;
+static WSPMachine *find_session_by_id(long session_id) {
+	WSPMachine *sm;
+	Octstr *key;
 
-	return wap_addr_tuple_same(wsp->addr_tuple, tuple);
+	key = octstr_format("%ld", session_id);
+	sm = dict_get(session_machines_by_id, key);
+	octstr_destroy(key);
+	return sm;
 }
 
 
-static int find_by_session_id(void *wsp_ptr, void *id_ptr) {
-	WSPMachine *wsp = wsp_ptr;
-	long *idp = id_ptr;
-	
-	return wsp->session_id == *idp;
+static WSPMachine *find_session_by_tuple(WAPAddrTuple *tuple) {
+	WSPMachine *sm;
+	List *sessions;
+	Octstr *key;
+
+	key = wap_addr_tuple_key(tuple);
+	sessions = dict_get(session_machines_by_tuple, key);
+	sm = (sessions != NULL) ? gwlist_get(sessions, 0) : NULL;
+	octstr_destroy(key);
+	return sm;
 }
 
 
@@ -1176,25 +1231,24 @@ static WSPPushMachine *find_push_machine(WSPMachine *m, long id)
        return gwlist_search(m->pushmachines, &id, find_by_push_id);
 }
 
-static int same_client(void *a, void *b) {
-	WSPMachine *sm1, *sm2;
-	
-	sm1 = a;
-	sm2 = b;
-	return wap_addr_tuple_same(sm1->addr_tuple, sm2->addr_tuple);
-}
-
-
 static void disconnect_other_sessions(WSPMachine *sm) {
-	List *old_sessions;
+	List *old_sessions, *sessions;
+	Octstr *key;
 	WAPEvent *disconnect;
 	WSPMachine *sm2;
 	long i;
 
-	old_sessions = gwlist_search_all(session_machines, sm, same_client);
-	if (old_sessions == NULL)
+	key = wap_addr_tuple_key(sm->addr_tuple);
+	sessions = dict_get(session_machines_by_tuple, key);
+	octstr_destroy(key);
+	if (sessions == NULL)
 		return;
 
+	/* handling the disconnect may destroy the machine */
+	old_sessions = gwlist_create();
+	for (i = 0; i < gwlist_len(sessions); i++)
+		gwlist_append(old_sessions, gwlist_get(sessions, i));
+
 	for (i = 0; i < gwlist_len(old_sessions); i++) {
 		sm2 = gwlist_get(old_sessions, i);
 		if (sm2 != sm) {
@@ -1433,19 +1487,7 @@ static void abort_pushes(WSPMachine *sm, long reason)
 
 WSPMachine *find_session_machine_by_id (int id) {
 
-	return gwlist_search(session_machines, &id, id_belongs_to_session);
-}
-
-
-static int id_belongs_to_session (void *wsp_ptr, void *pid) {
-	WSPMachine *wsp;
-	int *id;
-
-	wsp = wsp_ptr;
-	id = (int *) pid;
-
-	if (*id == wsp->session_id) return 1;
-	return 0;
+	return find_session_by_id(id);
 }
 
 
@@ -68,14 +68,12 @@
 /*****************************************************************************
  * Internal data structures.
  *
- * List of initiator WTP machines
+ * Initiator WTP machines, by machine id and by address tuple and tid.
  */
-static List *init_machines = NULL;
+static Dict *init_machines = NULL;
+static Dict *init_machines_by_tid = NULL;
 
-/*
- * Counter for initiator WTP machine id numbers, to make sure they are unique.
- */
-static Counter *init_machine_id_counter = NULL;
+#define INIT_MACHINES_HASH_SIZE 1024
 
 /*
  * When we restart an iniator, we must set tidnew flag to avoid excessive tid
@@ -115,10 +113,11 @@ static long init_timer_freq = -1;
 static void main_thread(void *arg);
  
 /*
- * Create and destroy an uniniatilised wtp initiator state machine
+ * Create and destroy an uniniatilised wtp initiator state machine. The
+ * machine id is the handle WSP gave in TR-Invoke.req.
  */
 static WTPInitMachine *init_machine_create(WAPAddrTuple *tuple, unsigned short
-                                           tid, int tidnew);
+                                           tid, int tidnew, long mid);
 static void init_machine_destroy(void *sm);
 static void handle_init_event(WTPInitMachine *machine, WAPEvent *event);
 
@@ -168,8 +167,8 @@ static void stop_initiator_timer(Timer *timer);
 void wtp_initiator_init(wap_dispatch_func_t *datagram_dispatch,
 			wap_dispatch_func_t *session_dispatch, long timer_freq) 
 {
-    init_machines = gwlist_create();
-    init_machine_id_counter = counter_create();
+    init_machines = dict_create(INIT_MACHINES_HASH_SIZE, NULL);
+    init_machines_by_tid = dict_create(INIT_MACHINES_HASH_SIZE, NULL);
      
     queue = gwlist_create();
     gwlist_add_producer(queue);
@@ -187,17 +186,26 @@ void wtp_initiator_init(wap_dispatch_func_t *datagram_dispatch,
 
 void wtp_initiator_shutdown(void) 
 {
+    List *keys;
+    Octstr *key;
+
     gw_assert(initiator_run_status == running);
     initiator_run_status = terminating;
     gwlist_remove_producer(queue);
     gwthread_join_every(main_thread);
 
     debug("wap.wtp", 0, "wtp_initiator_shutdown: %ld init_machines left",
-     	  gwlist_len(init_machines));
-    gwlist_destroy(init_machines, init_machine_destroy);
+     	  dict_key_count(init_machines));
+    keys = dict_keys(init_machines);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        init_machine_destroy(dict_get(init_machines, key));
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+    dict_destroy(init_machines);
+    dict_destroy(init_machines_by_tid);
     gwlist_destroy(queue, wap_event_destroy_item);
 
-    counter_destroy(init_machine_id_counter);
     timers_shutdown();
 }
 
@@ -226,10 +234,20 @@ static void main_thread(void *arg)
     }
 }
 
+static Octstr *init_machine_tid_key(WAPAddrTuple *tuple, long tid)
+{
+    Octstr *key;
+
+    key = wap_addr_tuple_key(tuple);
+    octstr_format_append(key, " %ld", tid);
+    return key;
+}
+
 static WTPInitMachine *init_machine_create(WAPAddrTuple *tuple, unsigned short
-                                           tid, int tidnew)
+                                           tid, int tidnew, long mid)
 {
      WTPInitMachine *init_machine;
+     Octstr *key;
 	
      init_machine = gw_malloc(sizeof(WTPInitMachine)); 
         
@@ -241,12 +259,17 @@ static WTPInitMachine *init_machine_create(WAPAddrTuple *tuple, unsigned short
      #define MACHINE(field) field
      #include "wtp_init_machine.def"
 
-     gwlist_append(init_machines, init_machine);
-
-     init_machine->mid = counter_increase(init_machine_id_counter);
+     init_machine->mid = mid;
      init_machine->addr_tuple = wap_addr_tuple_duplicate(tuple);
      init_machine->tid = tid;
      init_machine->tidnew = tidnew;
+
+     key = octstr_format("%ld", init_machine->mid);
+     dict_put(init_machines, key, init_machine);
+     octstr_destroy(key);
+     key = init_machine_tid_key(tuple, init_machine->tid);
+     dict_put(init_machines_by_tid, key, init_machine);
+     octstr_destroy(key);
 	
      debug("wap.wtp", 0, "WTP: Created WTPInitMachine %p (%ld)", 
 	   (void *) init_machine, init_machine->mid);
@@ -261,12 +284,18 @@ static WTPInitMachine *init_machine_create(WAPAddrTuple *tuple, unsigned short
 static void init_machine_destroy(void *p)
 {
      WTPInitMachine *init_machine;
+     Octstr *key;
 
      init_machine = p;
      debug("wap.wtp", 0, "WTP: Destroying WTPInitMachine %p (%ld)", 
 	    (void *) init_machine, init_machine->mid);
 	
-     gwlist_delete_equal(init_machines, init_machine);
+     key = octstr_format("%ld", init_machine->mid);
+     dict_remove(init_machines, key);
+     octstr_destroy(key);
+     key = init_machine_tid_key(init_machine->addr_tuple, init_machine->tid);
+     dict_remove(init_machines_by_tid, key);
+     octstr_destroy(key);
         
      #define ENUM(name) init_machine->name = INITIATOR_NULL_STATE;
      #define INTEGER(name) init_machine->name = 0; 
@@ -336,35 +365,20 @@ static void handle_init_event(WTPInitMachine *init_machine, WAPEvent *event)
      	  init_machine_destroy(init_machine);      
 }
 
-static int is_wanted_init_machine(void *a, void *b) 
-{
-    struct machine_pattern *pat;
-    WTPInitMachine *m;
-	
-    m = a;
-    pat = b;
-
-    if (m->mid == pat->mid)
-	return 1;
-
-    if (pat->mid != -1)
-	return 0;
-
-    return m->tid == pat->tid && 
-	   wap_addr_tuple_same(m->addr_tuple, pat->tuple);
-}
-
 static WTPInitMachine *init_machine_find(WAPAddrTuple *tuple, long tid, 
                                          long mid) 
 {
-    struct machine_pattern pat;
     WTPInitMachine *m;
+    Octstr *key;
 	
-    pat.tuple = tuple;
-    pat.tid = tid;
-    pat.mid = mid;
-	
-    m = gwlist_search(init_machines, &pat, is_wanted_init_machine);
+    if (mid != -1) {
+        key = octstr_format("%ld", mid);
+        m = dict_get(init_machines, key);
+    } else {
+        key = init_machine_tid_key(tuple, tid);
+        m = dict_get(init_machines_by_tid, key);
+    }
+    octstr_destroy(key);
     return m;
 }
 
@@ -472,8 +486,7 @@ static WTPInitMachine *init_machine_find_or_create(WAPEvent *event)
 	break;
 
 	case TR_Invoke_Req:
-	    machine = init_machine_create(tuple, tid, tidnew);
-            machine->mid = event->u.TR_Invoke_Req.handle;
+	    machine = init_machine_create(tuple, tid, tidnew, mid);
 	break;
 
 	case TR_Abort_Req:
@@ -72,9 +72,14 @@
 /***********************************************************************
  * Internal data structures.
  *
- * List of responder WTP machines.
+ * Responder WTP machines, by machine id and by address tuple and tid.
+ * Every datagram and timer event looks its machine up, so they are
+ * hashed instead of searched.
  */
-static List *resp_machines = NULL;
+static Dict *resp_machines = NULL;
+static Dict *resp_machines_by_tid = NULL;
+
+#define RESP_MACHINES_HASH_SIZE 8192
 
 
 /*
@@ -156,6 +161,7 @@ static char *name_resp_state(int name);
  */
 static WTPRespMachine *resp_machine_find(WAPAddrTuple *tuple, long tid, 
                                          long mid);
+static Octstr *resp_machine_tid_key(WAPAddrTuple *tuple, long tid);
 static void main_thread(void *);
 
 /*
@@ -213,7 +219,8 @@ void wtp_resp_init(wap_dispatch_func_t *datagram_dispatch,
                    wap_dispatch_func_t *push_dispatch, 
                    long timer_freq) 
 {
-    resp_machines = gwlist_create();
+    resp_machines = dict_create(RESP_MACHINES_HASH_SIZE, NULL);
+    resp_machines_by_tid = dict_create(RESP_MACHINES_HASH_SIZE, NULL);
     resp_machine_id_counter = counter_create();
 
     resp_queue = gwlist_create();
@@ -234,14 +241,24 @@ void wtp_resp_init(wap_dispatch_func_t *datagram_dispatch,
 
 void wtp_resp_shutdown(void) 
 {
+    List *keys;
+    Octstr *key;
+
     gw_assert(resp_run_status == running);
     resp_run_status = terminating;
     gwlist_remove_producer(resp_queue);
     gwthread_join_every(main_thread);
 
     debug("wap.wtp", 0, "wtp_resp_shutdown: %ld resp_machines left",
-     	  gwlist_len(resp_machines));
-    gwlist_destroy(resp_machines, resp_machine_destroy);
+     	  dict_key_count(resp_machines));
+    keys = dict_keys(resp_machines);
+    while ((key = gwlist_extract_first(keys)) != NULL) {
+        resp_machine_destroy(dict_get(resp_machines, key));
+        octstr_destroy(key);
+    }
+    gwlist_destroy(keys, NULL);
+    dict_destroy(resp_machines);
+    dict_destroy(resp_machines_by_tid);
     gwlist_destroy(resp_queue, wap_event_destroy_item);
 
     counter_destroy(resp_machine_id_counter);
@@ -552,36 +569,30 @@ static WTPRespMachine *resp_machine_find_or_create(WAPEvent *event)
    return resp_machine;
 }
 
-static int is_wanted_resp_machine(void *a, void *b) 
+static Octstr *resp_machine_tid_key(WAPAddrTuple *tuple, long tid)
 {
-    machine_pattern *pat;
-    WTPRespMachine *m;
-	
-    m = a;
-    pat = b;
-
-    if (m->mid == pat->mid)
-	return 1;
+    Octstr *key;
 
-    if (pat->mid != -1)
-	return 0;
-
-    return m->tid == pat->tid && 
-           wap_addr_tuple_same(m->addr_tuple, pat->tuple);
+    key = wap_addr_tuple_key(tuple);
+    octstr_format_append(key, " %ld", tid);
+    return key;
 }
 
 
 static WTPRespMachine *resp_machine_find(WAPAddrTuple *tuple, long tid, 
                                          long mid) 
 {
-    machine_pattern pat;
     WTPRespMachine *m;
+    Octstr *key;
 	
-    pat.tuple = tuple;
-    pat.tid = tid;
-    pat.mid = mid;
-	
-    m = gwlist_search(resp_machines, &pat, is_wanted_resp_machine);
+    if (mid != -1) {
+        key = octstr_format("%ld", mid);
+        m = dict_get(resp_machines, key);
+    } else {
+        key = resp_machine_tid_key(tuple, tid);
+        m = dict_get(resp_machines_by_tid, key);
+    }
+    octstr_destroy(key);
     return m;
 }
 
@@ -590,6 +601,7 @@ static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid,
                                            long tcl) 
 {
     WTPRespMachine *resp_machine;
+    Octstr *key;
 	
     resp_machine = gw_malloc(sizeof(WTPRespMachine)); 
         
@@ -603,12 +615,17 @@ static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid,
     #define MACHINE(field) field
     #include "wtp_resp_machine.def"
 
-    gwlist_append(resp_machines, resp_machine);
-
     resp_machine->mid = counter_increase(resp_machine_id_counter);
     resp_machine->addr_tuple = wap_addr_tuple_duplicate(tuple);
     resp_machine->tid = tid;
     resp_machine->tcl = tcl;
+
+    key = octstr_format("%ld", resp_machine->mid);
+    dict_put(resp_machines, key, resp_machine);
+    octstr_destroy(key);
+    key = resp_machine_tid_key(tuple, tid);
+    dict_put(resp_machines_by_tid, key, resp_machine);
+    octstr_destroy(key);
 	
     debug("wap.wtp", 0, "WTP: Created WTPRespMachine %p (%ld)", 
 	  (void *) resp_machine, resp_machine->mid);
@@ -624,12 +641,18 @@ static WTPRespMachine *resp_machine_create(WAPAddrTuple *tuple, long tid,
 static void resp_machine_destroy(void * p)
 {
     WTPRespMachine *resp_machine;
+    Octstr *key;
 
     resp_machine = p;
     debug("wap.wtp", 0, "WTP: Destroying WTPRespMachine %p (%ld)", 
 	  (void *) resp_machine, resp_machine->mid);
 	
-    gwlist_delete_equal(resp_machines, resp_machine);
+    key = octstr_format("%ld", resp_machine->mid);
+    dict_remove(resp_machines, key);
+    octstr_destroy(key);
+    key = resp_machine_tid_key(resp_machine->addr_tuple, resp_machine->tid);
+    dict_remove(resp_machines_by_tid, key);
+    octstr_destroy(key);
         
     #define ENUM(name) resp_machine->name = LISTEN;
     #define EVENT(name) wap_event_destroy(resp_machine->name);